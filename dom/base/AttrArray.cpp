@@ -12,6 +12,7 @@
 #include "AttrArray.h"
 
 #include "mozilla/CheckedInt.h"
+#include "mozilla/HashFunctions.h"
 #include "mozilla/MathAlgorithms.h"
 #include "mozilla/MemoryReporting.h"
 
@@ -21,6 +22,10 @@
 #include "nsMappedAttributes.h"
 #include "nsUnicharUtils.h"
 #include "nsContentUtils.h"  // nsAutoScriptBlocker
+#include "nsGkAtoms.h"
+#include "nsIMemoryReporter.h"
+#include "nsTHashtable.h"
+#include "nsThreadUtils.h"
 
 using mozilla::CheckedUint32;
 using mozilla::dom::Document;
@@ -33,6 +38,244 @@ AttrArray::Impl::~Impl() {
   NS_IF_RELEASE(mMappedAttrs);
 }
 
+// Precedes the Impl in the allocation of a shared Impl.
+struct alignas(AttrArray::Impl) AttrArray::SharedImplHeader {
+  static SharedImplHeader* FromImpl(Impl* aImpl) {
+    MOZ_ASSERT(aImpl->mIsShared);
+    return reinterpret_cast<SharedImplHeader*>(aImpl) - 1;
+  }
+
+  Impl* GetImpl() { return reinterpret_cast<Impl*>(this + 1); }
+
+  // The number of AttrArrays using the Impl.
+  uint32_t mRefCnt;
+};
+
+// An entry in the table of shared Impls, keyed by the attributes in them.
+// Doesn't own the Impl, which removes itself from the table when its last
+// AttrArray releases it.
+class AttrArray::SharedImplEntry : public PLDHashEntryHdr {
+ public:
+  typedef const Impl& KeyType;
+  typedef const Impl* KeyTypePointer;
+
+  // Callers fill in mImpl after adding the entry.
+  explicit SharedImplEntry(const Impl* aKey) : mImpl(nullptr) {}
+  SharedImplEntry(SharedImplEntry&& aOther) = default;
+
+  bool KeyEquals(const Impl* aKey) const {
+    if (mImpl->mAttrCount != aKey->mAttrCount ||
+        mImpl->mMappedAttrs != aKey->mMappedAttrs) {
+      return false;
+    }
+    auto otherAttrs = aKey->NonMappedAttrs();
+    uint32_t i = 0;
+    for (const InternalAttr& attr : mImpl->NonMappedAttrs()) {
+      const InternalAttr& other = otherAttrs[i++];
+      if (!attr.mName.Equals(other.mName) ||
+          !attr.mValue.Equals(other.mValue)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static KeyTypePointer KeyToPointer(KeyType aKey) { return &aKey; }
+
+  static PLDHashNumber HashKey(KeyTypePointer aKey) {
+    // Mapped attributes are already unique per set of attributes.
+    PLDHashNumber hash = mozilla::HashGeneric(aKey->mMappedAttrs);
+    for (const InternalAttr& attr : aKey->NonMappedAttrs()) {
+      hash = mozilla::AddToHash(hash, attr.mName.HashValue(),
+                                attr.mValue.HashValue());
+    }
+    return hash;
+  }
+
+  enum { ALLOW_MEMMOVE = true };
+
+  static void RemoveImpl(const Impl* aImpl) {
+    sTable->RemoveEntry(aImpl);
+    if (!sTable->Count()) {
+      delete sTable;
+      sTable = nullptr;
+    }
+  }
+
+  Impl* mImpl;
+
+  // The shared Impls.  Only used on the main thread, which is the only one
+  // parsers create elements on.
+  static nsTHashtable<SharedImplEntry>* sTable;
+};
+
+nsTHashtable<AttrArray::SharedImplEntry>* AttrArray::SharedImplEntry::sTable;
+
+class AttrArray::SharedImplReporter final : public nsIMemoryReporter {
+  MOZ_DEFINE_MALLOC_SIZE_OF(MallocSizeOf)
+
+  ~SharedImplReporter() = default;
+
+ public:
+  NS_DECL_ISUPPORTS
+
+  NS_IMETHOD CollectReports(nsIHandleReportCallback* aHandleReport,
+                            nsISupports* aData, bool aAnonymize) override {
+    int64_t amount = 0;
+    int64_t saved = 0;
+    if (nsTHashtable<SharedImplEntry>* table = SharedImplEntry::sTable) {
+      amount += table->ShallowSizeOfIncludingThis(MallocSizeOf);
+      for (auto iter = table->Iter(); !iter.Done(); iter.Next()) {
+        Impl* impl = iter.Get()->mImpl;
+        SharedImplHeader* header = SharedImplHeader::FromImpl(impl);
+        size_t size = MallocSizeOf(header);
+        for (const InternalAttr& attr : impl->NonMappedAttrs()) {
+          size += attr.mValue.SizeOfExcludingThis(MallocSizeOf);
+        }
+        amount += size;
+        saved += (header->mRefCnt - 1) * size;
+      }
+    }
+
+    MOZ_COLLECT_REPORT(
+        "explicit/dom/shared-attributes", KIND_HEAP, UNITS_BYTES, amount,
+        "Memory used by blocks of attributes shared by elements with the "
+        "same attributes, and by the table used to find them.");
+
+    MOZ_COLLECT_REPORT(
+        "dom-shared-attributes-saved", KIND_OTHER, UNITS_BYTES, saved,
+        "Memory that elements sharing blocks of attributes would use if each "
+        "of them had a copy of its attributes instead.");
+
+    return NS_OK;
+  }
+};
+
+NS_IMPL_ISUPPORTS(AttrArray::SharedImplReporter, nsIMemoryReporter)
+
+// Whether an Impl holds only attributes which can be shared between elements.
+static bool CanShareAttrs(
+    mozilla::Span<const AttrArray::InternalAttr> aAttrs) {
+  for (const AttrArray::InternalAttr& attr : aAttrs) {
+    // Sharers can't each report the NodeInfos of namespaced attributes to the
+    // cycle collector.  Ids are unique, so nothing would share them anyway.
+    if (!attr.mName.IsAtom() || attr.mName.Equals(nsGkAtoms::id)) {
+      return false;
+    }
+    // Other kinds of values are either tied to a particular element, like
+    // the SVG ones, or can be modified through a const value, like
+    // declaration blocks.  Doubles, margins and part mappings aren't
+    // compared by the string they were parsed from, or at all, so they
+    // can't be told apart.
+    switch (attr.mValue.Type()) {
+      case nsAttrValue::eString:
+      case nsAttrValue::eAtom:
+      case nsAttrValue::eInteger:
+      case nsAttrValue::eColor:
+      case nsAttrValue::eEnum:
+      case nsAttrValue::ePercent:
+      case nsAttrValue::eAtomArray:
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+void AttrArray::Share() {
+  MOZ_ASSERT(NS_IsMainThread());
+  if (!mImpl || IsShared() || !mImpl->mAttrCount ||
+      !CanShareAttrs(mImpl->NonMappedAttrs())) {
+    return;
+  }
+
+  nsTHashtable<SharedImplEntry>*& table = SharedImplEntry::sTable;
+  if (!table) {
+    static bool sReporterRegistered = false;
+    if (!sReporterRegistered) {
+      mozilla::RegisterStrongMemoryReporter(new SharedImplReporter());
+      sReporterRegistered = true;
+    }
+    table = new nsTHashtable<SharedImplEntry>();
+  }
+
+  SharedImplEntry* entry = table->PutEntry(mImpl.get(), mozilla::fallible);
+  if (!entry) {
+    return;
+  }
+
+  if (entry->mImpl) {
+    ++SharedImplHeader::FromImpl(entry->mImpl)->mRefCnt;
+    mImpl.reset(entry->mImpl);
+    return;
+  }
+
+  // Nobody has these attributes yet, so move ours into a block with room for
+  // the header.  Like GrowBy, this relies on attributes being movable with
+  // memcpy.
+  uint32_t attrCount = mImpl->mAttrCount;
+  auto* header = static_cast<SharedImplHeader*>(malloc(
+      sizeof(SharedImplHeader) + Impl::AllocationSizeForAttributes(attrCount)));
+  if (!header) {
+    table->RemoveEntry(entry);
+    return;
+  }
+  header->mRefCnt = 1;
+  Impl* impl = header->GetImpl();
+  memcpy(impl, mImpl.get(), Impl::AllocationSizeForAttributes(attrCount));
+  free(mImpl.release());
+  impl->mCapacity = attrCount;
+  impl->mIsShared = true;
+  entry->mImpl = impl;
+  mImpl.reset(impl);
+}
+
+bool AttrArray::DoUnshare() {
+  MOZ_ASSERT(IsShared());
+  SharedImplHeader* header = SharedImplHeader::FromImpl(mImpl.get());
+  uint32_t attrCount = mImpl->mAttrCount;
+  auto* impl = static_cast<Impl*>(
+      malloc(Impl::AllocationSizeForAttributes(attrCount)));
+  if (!impl) {
+    return false;
+  }
+
+  if (header->mRefCnt == 1) {
+    // We're the last user, so just move the attributes out.
+    SharedImplEntry::RemoveImpl(mImpl.get());
+    memcpy(impl, mImpl.release(), Impl::AllocationSizeForAttributes(attrCount));
+    free(header);
+  } else {
+    --header->mRefCnt;
+    Impl* shared = mImpl.release();
+    impl->mAttrCount = attrCount;
+    impl->mMappedAttrs = shared->mMappedAttrs;
+    NS_IF_ADDREF(impl->mMappedAttrs);
+    uint32_t i = 0;
+    for (const InternalAttr& attr : shared->NonMappedAttrs()) {
+      new (&impl->mBuffer[i++]) InternalAttr(attr);
+    }
+  }
+  impl->mCapacity = attrCount;
+  impl->mIsShared = false;
+  mImpl.reset(impl);
+  return true;
+}
+
+void AttrArray::ReleaseShared() {
+  MOZ_ASSERT(NS_IsMainThread());
+  Impl* impl = mImpl.release();
+  SharedImplHeader* header = SharedImplHeader::FromImpl(impl);
+  if (--header->mRefCnt) {
+    return;
+  }
+
+  SharedImplEntry::RemoveImpl(impl);
+  impl->~Impl();
+  free(header);
+}
+
 const nsAttrValue* AttrArray::GetAttr(const nsAtom* aLocalName,
                                       int32_t aNamespaceID) const {
   if (aNamespaceID == kNameSpaceID_None) {
@@ -127,6 +370,9 @@ inline nsresult AttrArray::AddNewAttribute(Name* aName, nsAttrValue& aValue) {
 nsresult AttrArray::SetAndSwapAttr(nsAtom* aLocalName, nsAttrValue& aValue,
                                    bool* aHadValue) {
   *aHadValue = false;
+  if (!Unshare()) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
 
   for (InternalAttr& attr : NonMappedAttrs()) {
     if (attr.mName.Equals(aLocalName)) {
@@ -148,6 +394,9 @@ nsresult AttrArray::SetAndSwapAttr(mozilla::dom::NodeInfo* aName,
   }
 
   *aHadValue = false;
+  if (!Unshare()) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
   for (InternalAttr& attr : NonMappedAttrs()) {
     if (attr.mName.Equals(localName, namespaceID)) {
       attr.mName.SetTo(aName);
@@ -162,6 +411,9 @@ nsresult AttrArray::SetAndSwapAttr(mozilla::dom::NodeInfo* aName,
 
 nsresult AttrArray::RemoveAttrAt(uint32_t aPos, nsAttrValue& aValue) {
   NS_ASSERTION(aPos < AttrCount(), "out-of-bounds");
+  if (!Unshare()) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
 
   uint32_t nonmapped = NonMappedAttrCount();
   if (aPos < nonmapped) {
@@ -331,7 +583,8 @@ nsresult AttrArray::DoUpdateMappedAttrRuleMapper(
 }
 
 void AttrArray::Compact() {
-  if (!mImpl) {
+  // Shared Impls are never bigger than they need to be.
+  if (!mImpl || IsShared()) {
     return;
   }
 
@@ -389,7 +642,7 @@ nsMappedAttributes* AttrArray::GetModifiableMapped(
 nsresult AttrArray::MakeMappedUnique(nsMappedAttributes* aAttributes) {
   NS_ASSERTION(aAttributes, "missing attributes");
 
-  if (!mImpl && !GrowBy(1)) {
+  if (!Unshare() || (!mImpl && !GrowBy(1))) {
     return NS_ERROR_OUT_OF_MEMORY;
   }
 
@@ -441,6 +694,7 @@ nsresult AttrArray::EnsureCapacityToClone(const AttrArray& aOther) {
 
   mImpl->mMappedAttrs = nullptr;
   mImpl->mCapacity = attrCount;
+  mImpl->mIsShared = false;
   mImpl->mAttrCount = 0;
 
   return NS_OK;
@@ -466,7 +720,8 @@ bool AttrArray::GrowBy(uint32_t aGrowSize) {
     } while (capacity.value() < minCapacity.value());
   } else {
     uint32_t shift = mozilla::CeilingLog2(minCapacity.value());
-    if (shift >= 32) {
+    // mCapacity only has 31 bits.
+    if (shift >= 31) {
       return false;
     }
     capacity = 1u << shift;
@@ -486,6 +741,7 @@ bool AttrArray::GrowBy(uint32_t aGrowSize) {
   MOZ_ASSERT(sizeInBytes.value() ==
              Impl::AllocationSizeForAttributes(capacity.value()));
 
+  MOZ_ASSERT(!IsShared(), "Should have unshared before growing");
   const bool needToInitialize = !mImpl;
   Impl* newImpl =
       static_cast<Impl*>(realloc(mImpl.release(), sizeInBytes.value()));
@@ -497,6 +753,7 @@ bool AttrArray::GrowBy(uint32_t aGrowSize) {
   if (needToInitialize) {
     mImpl->mMappedAttrs = nullptr;
     mImpl->mAttrCount = 0;
+    mImpl->mIsShared = false;
   }
 
   mImpl->mCapacity = capacity.value();
@@ -506,7 +763,8 @@ bool AttrArray::GrowBy(uint32_t aGrowSize) {
 size_t AttrArray::SizeOfExcludingThis(
     mozilla::MallocSizeOf aMallocSizeOf) const {
   size_t n = 0;
-  if (mImpl) {
+  // Shared Impls are reported by SharedImplReporter.
+  if (mImpl && !IsShared()) {
     // Don't add the size taken by *mMappedAttrs because it's shared.
 
     n += aMallocSizeOf(mImpl.get());
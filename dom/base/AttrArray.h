@@ -34,7 +34,11 @@ class AttrArray {
 
  public:
   AttrArray() = default;
-  ~AttrArray() = default;
+  ~AttrArray() {
+    if (IsShared()) {
+      ReleaseShared();
+    }
+  }
 
   bool HasAttrs() const { return NonMappedAttrCount() || MappedAttrCount(); }
 
@@ -104,6 +108,13 @@ class AttrArray {
 
   void Compact();
 
+  // Replaces our storage with an immutable block shared with the other
+  // AttrArrays that have the same attributes, if all our attributes are of
+  // kinds that can be shared.  Meant for the attributes of elements created
+  // by parsers, which are often repeated across many elements.  Any change
+  // to the attributes afterwards copies them back into storage of our own.
+  void Share();
+
   size_t SizeOfExcludingThis(mozilla::MallocSizeOf aMallocSizeOf) const;
   bool HasMappedAttrs() const { return MappedAttrCount(); }
   const nsMappedAttributes* GetMapped() const;
@@ -146,6 +157,15 @@ class AttrArray {
 
   bool GrowBy(uint32_t aGrowSize);
 
+  bool IsShared() const { return mImpl && mImpl->mIsShared; }
+
+  // Makes sure mImpl isn't shared before it's modified.  Returns false on OOM.
+  bool Unshare() { return !IsShared() || DoUnshare(); }
+  bool DoUnshare();
+
+  // Drops our reference to a shared mImpl.
+  void ReleaseShared();
+
   // Tries to create an attribute, growing the buffer if needed, with the given
   // name and value.
   //
@@ -192,7 +212,10 @@ class AttrArray {
     ~Impl();
 
     uint32_t mAttrCount;
-    uint32_t mCapacity;  // In number of InternalAttrs
+    uint32_t mCapacity : 31;  // In number of InternalAttrs
+    // Whether this is a block shared by several AttrArrays, see Share().
+    // Shared blocks are immutable, and are preceded by a SharedImplHeader.
+    uint32_t mIsShared : 1;
 
     // Manually refcounted.
     nsMappedAttributes* mMappedAttrs;
@@ -204,6 +227,10 @@ class AttrArray {
 #  pragma warning(pop)
 #endif
 
+  struct SharedImplHeader;
+  class SharedImplEntry;
+  class SharedImplReporter;
+
   mozilla::Span<InternalAttr> NonMappedAttrs() {
     return mImpl ? mImpl->NonMappedAttrs() : mozilla::Span<InternalAttr>();
   }
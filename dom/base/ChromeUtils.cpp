@@ -30,6 +30,7 @@
 #include "mozilla/dom/MediaControlService.h"
 #include "mozilla/dom/Promise.h"
 #include "mozilla/dom/ReportingHeader.h"
+#include "mozilla/dom/TimeoutManager.h"
 #include "mozilla/dom/UnionTypes.h"
 #include "mozilla/dom/WindowBinding.h"  // For IdleRequestCallback/Options
 #include "mozilla/gfx/GPUProcessManager.h"
@@ -1138,6 +1139,28 @@ void ChromeUtils::ResetLastExternalProtocolIframeAllowed(
   PopupBlocker::ResetLastExternalProtocolIframeAllowed();
 }
 
+/* static */
+void ChromeUtils::GetTimeoutDelayStats(GlobalObject& aGlobal,
+                                       TimeoutDelayStatsDictionary& aStats,
+                                       ErrorResult& aRv) {
+  const TimeoutManager::DelayStats& stats = TimeoutManager::GetDelayStats();
+  aStats.mRunCount = stats.mRunCount;
+  aStats.mCallbackCount = stats.mCallbackCount;
+  aStats.mTotalRequested = stats.mTotalRequestedMS;
+  aStats.mTotalDelay = stats.mTotalDelayMS;
+  aStats.mMaxDelay = stats.mMaxDelayMS;
+  if (!aStats.mDelayHistogram.AppendElements(
+          stats.mDelayBuckets, TimeoutManager::DelayStats::kBucketCount,
+          fallible)) {
+    aRv.Throw(NS_ERROR_OUT_OF_MEMORY);
+  }
+}
+
+/* static */
+void ChromeUtils::ResetTimeoutDelayStats(GlobalObject& aGlobal) {
+  TimeoutManager::ResetDelayStats();
+}
+
 /* static */
 void ChromeUtils::RegisterWindowActor(const GlobalObject& aGlobal,
                                       const nsAString& aName,
@@ -185,6 +185,12 @@ class ChromeUtils {
 
   static void ResetLastExternalProtocolIframeAllowed(GlobalObject& aGlobal);
 
+  static void GetTimeoutDelayStats(GlobalObject& aGlobal,
+                                   TimeoutDelayStatsDictionary& aStats,
+                                   ErrorResult& aRv);
+
+  static void ResetTimeoutDelayStats(GlobalObject& aGlobal);
+
   static void RegisterWindowActor(const GlobalObject& aGlobal,
                                   const nsAString& aName,
                                   const WindowActorOptions& aOptions,
@@ -9,6 +9,7 @@
 #include "nsIFrame.h"
 #include "nsContentUtils.h"
 #include "nsLayoutUtils.h"
+#include "nsPresContext.h"
 #include "mozilla/PresShell.h"
 #include "mozilla/ServoBindings.h"
 #include "mozilla/dom/BrowsingContext.h"
@@ -150,11 +151,13 @@ void DOMIntersectionObserver::Unobserve(Element& aTarget) {
   }
 
   mObservationTargets.RemoveElement(&aTarget);
+  mTargetGeometry.Remove(&aTarget);
   aTarget.UnregisterIntersectionObserver(this);
 }
 
 void DOMIntersectionObserver::UnlinkTarget(Element& aTarget) {
   mObservationTargets.RemoveElement(&aTarget);
+  mTargetGeometry.Remove(&aTarget);
   if (mObservationTargets.Length() == 0) {
     Disconnect();
   }
@@ -182,6 +185,7 @@ void DOMIntersectionObserver::Disconnect() {
     target->UnregisterIntersectionObserver(this);
   }
   mObservationTargets.Clear();
+  mTargetGeometry.Clear();
   if (mDocument) {
     mDocument->RemoveIntersectionObserver(this);
   }
@@ -259,8 +263,12 @@ static Document* GetTopLevelDocument(const Document& aDocument) {
 //
 // Both aRootBounds and the return value are relative to
 // nsLayoutUtils::GetContainingBlockForClientRect(aRoot).
+//
+// aCrossesScrollFrame is set to whether there are scroll frames between aTarget
+// and aRoot.
 static Maybe<nsRect> ComputeTheIntersection(nsIFrame* aTarget, nsIFrame* aRoot,
-                                            const nsRect& aRootBounds) {
+                                            const nsRect& aRootBounds,
+                                            bool& aCrossesScrollFrame) {
   nsIFrame* target = aTarget;
   // 1. Let intersectionRect be the result of running the
   // getBoundingClientRect() algorithm on the target.
@@ -285,6 +293,7 @@ static Maybe<nsRect> ComputeTheIntersection(nsIFrame* aTarget, nsIFrame* aRoot,
     // nsHTMLScrollFrame but have a different type, like nsListControlFrame?
     // This looks bogus in that case, but different bug.
     if (containerFrame->IsScrollFrame()) {
+      aCrossesScrollFrame = true;
       nsIScrollableFrame* scrollFrame = do_QueryFrame(containerFrame);
       //
       nsRect subFrameRect = scrollFrame->GetScrollPortRect();
@@ -343,43 +352,66 @@ static Maybe<nsRect> ComputeTheIntersection(nsIFrame* aTarget, nsIFrame* aRoot,
   return Some(rect);
 }
 
-// https://w3c.github.io/IntersectionObserver/#update-intersection-observations-algo
-// (step 2)
-void DOMIntersectionObserver::Update(Document* aDocument,
-                                     DOMHighResTimeStamp time) {
-  // 1 - Let rootBounds be observer's root intersection rectangle.
-  //  ... but since the intersection rectangle depends on the target, we defer
-  //      the inflation until later.
-  nsRect rootRect;
-  nsIFrame* rootFrame = nullptr;
-  Element* root = mRoot;
-  if (mRoot) {
-    if ((rootFrame = mRoot->GetPrimaryFrame())) {
+static const DOMIntersectionObserver::RootGeometry& GetRootGeometry(
+    Element* aObserverRoot, Document* aDocument,
+    DOMIntersectionObserver::RootGeometryCache& aCache) {
+  for (const auto& geometry : aCache) {
+    if (geometry.mObserverRoot == aObserverRoot) {
+      return geometry;
+    }
+  }
+
+  DOMIntersectionObserver::RootGeometry& geometry = *aCache.AppendElement();
+  geometry.mObserverRoot = aObserverRoot;
+  geometry.mRoot = aObserverRoot;
+  if (aObserverRoot) {
+    nsIFrame* rootFrame = aObserverRoot->GetPrimaryFrame();
+    if (rootFrame) {
       nsRect rootRectRelativeToRootFrame;
       if (rootFrame->IsScrollFrame()) {
         // rootRectRelativeToRootFrame should be the content rect of rootFrame,
         // not including the scrollbars.
         nsIScrollableFrame* scrollFrame = do_QueryFrame(rootFrame);
         rootRectRelativeToRootFrame = scrollFrame->GetScrollPortRect();
+        geometry.mScrollPosition = scrollFrame->GetScrollPosition();
       } else {
         // rootRectRelativeToRootFrame should be the border rect of rootFrame.
         rootRectRelativeToRootFrame = rootFrame->GetRectRelativeToSelf();
       }
       nsIFrame* containingBlock =
           nsLayoutUtils::GetContainingBlockForClientRect(rootFrame);
-      rootRect = nsLayoutUtils::TransformFrameRectToAncestor(
+      geometry.mRect = nsLayoutUtils::TransformFrameRectToAncestor(
           rootFrame, rootRectRelativeToRootFrame, containingBlock);
+      geometry.mFrame = rootFrame;
     }
   } else if (Document* topLevelDocument = GetTopLevelDocument(*aDocument)) {
     if (PresShell* presShell = topLevelDocument->GetPresShell()) {
-      rootFrame = presShell->GetRootScrollFrame();
+      nsIFrame* rootFrame = presShell->GetRootScrollFrame();
       if (rootFrame) {
-        root = rootFrame->GetContent()->AsElement();
+        geometry.mRoot = rootFrame->GetContent()->AsElement();
         nsIScrollableFrame* scrollFrame = do_QueryFrame(rootFrame);
-        rootRect = scrollFrame->GetScrollPortRect();
+        geometry.mRect = scrollFrame->GetScrollPortRect();
+        geometry.mScrollPosition = scrollFrame->GetScrollPosition();
+        geometry.mFrame = rootFrame;
       }
     }
   }
+  return geometry;
+}
+
+// https://w3c.github.io/IntersectionObserver/#update-intersection-observations-algo
+// (step 2)
+void DOMIntersectionObserver::Update(Document* aDocument,
+                                     DOMHighResTimeStamp time,
+                                     RootGeometryCache& aRootGeometryCache) {
+  // 1 - Let rootBounds be observer's root intersection rectangle.
+  //  ... but since the intersection rectangle depends on the target, we defer
+  //      the inflation until later.
+  const RootGeometry& rootGeometry =
+      GetRootGeometry(mRoot, aDocument, aRootGeometryCache);
+  const nsRect& rootRect = rootGeometry.mRect;
+  nsIFrame* rootFrame = rootGeometry.mFrame;
+  Element* root = rootGeometry.mRoot;
 
   nsMargin rootMargin;
   NS_FOR_CSS_SIDES(side) {
@@ -414,6 +446,22 @@ void DOMIntersectionObserver::Update(Document* aDocument,
     Maybe<nsRect> intersectionRect;
     nsRect targetRect;
     if (targetFrame && rootFrame) {
+      nsPresContext* presContext = targetFrame->PresContext();
+      TargetGeometry geometry = {targetFrame,
+                                 rootFrame,
+                                 rootBounds,
+                                 rootGeometry.mScrollPosition,
+                                 presContext->GetRestyleGeneration(),
+                                 presContext->FramesConstructedCount(),
+                                 presContext->FramesReflowedCount()};
+      auto lastGeometry = mTargetGeometry.Lookup(target);
+      if (lastGeometry && lastGeometry.Data() == geometry) {
+        // Nothing has been restyled, reflowed or scrolled in a way that could
+        // move the target relative to the root since the last update, so the
+        // threshold the target is at can't have changed either.
+        continue;
+      }
+
       // 2.1. If the intersection root is not the implicit root and target is
       // not a descendant of the intersection root in the containing block
       // chain, skip further processing for target.
@@ -431,8 +479,23 @@ void DOMIntersectionObserver::Update(Document* aDocument,
 
       // 2.4. Let intersectionRect be the result of running the compute the
       // intersection algorithm on target.
-      intersectionRect =
-          ComputeTheIntersection(targetFrame, rootFrame, rootBounds);
+      bool crossesScrollFrame = false;
+      intersectionRect = ComputeTheIntersection(targetFrame, rootFrame,
+                                                rootBounds, crossesScrollFrame);
+
+      // Scroll frames in between and the layout of other documents move the
+      // target too, so only remember the geometry when there are neither.
+      if (!crossesScrollFrame && presContext == rootFrame->PresContext()) {
+        if (lastGeometry) {
+          lastGeometry.Data() = geometry;
+        } else {
+          mTargetGeometry.Put(target, geometry);
+        }
+      } else if (lastGeometry) {
+        lastGeometry.Remove();
+      }
+    } else {
+      mTargetGeometry.Remove(target);
     }
 
     // 2.5. Let targetArea be targetRect’s area.
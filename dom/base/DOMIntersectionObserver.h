@@ -10,8 +10,13 @@
 #include "mozilla/Attributes.h"
 #include "mozilla/dom/IntersectionObserverBinding.h"
 #include "mozilla/ServoStyleConsts.h"
+#include "nsDataHashtable.h"
+#include "nsHashKeys.h"
+#include "nsRect.h"
 #include "nsTArray.h"
 
+class nsIFrame;
+
 namespace mozilla {
 namespace dom {
 
@@ -122,7 +127,24 @@ class DOMIntersectionObserver final : public nsISupports,
 
   bool SetRootMargin(const nsAString& aString);
 
-  void Update(Document* aDocument, DOMHighResTimeStamp time);
+  // The intersection root and its rectangle, before applying the root
+  // margin. These are the same for all the observers with the same root, so
+  // Document::UpdateIntersectionObservations() only computes them once per
+  // update for each root.
+  struct RootGeometry {
+    // The root the observer was created with, null for the implicit root.
+    Element* mObserverRoot = nullptr;
+    Element* mRoot = nullptr;
+    nsIFrame* mFrame = nullptr;
+    nsRect mRect;
+    // Targets move relative to a root which is a scroll frame when it
+    // scrolls, while its rectangle stays the same.
+    nsPoint mScrollPosition;
+  };
+  typedef AutoTArray<RootGeometry, 4> RootGeometryCache;
+
+  void Update(Document* aDocument, DOMHighResTimeStamp time,
+              RootGeometryCache& aRootGeometryCache);
   MOZ_CAN_RUN_SCRIPT void Notify();
 
  protected:
@@ -134,6 +156,30 @@ class DOMIntersectionObserver final : public nsISupports,
                                       const Maybe<nsRect>& aIntersectionRect,
                                       double aIntersectionRatio);
 
+  // What the intersection of a target was last computed from, for targets
+  // with no scroll frames between them and the root, in the same document.
+  // If all of it is the same on the next update, layout has left the target
+  // and the root where they were, and so has the intersection.
+  struct TargetGeometry {
+    nsIFrame* mTargetFrame;
+    nsIFrame* mRootFrame;
+    nsRect mRootBounds;
+    nsPoint mRootScrollPosition;
+    uint64_t mRestyleGeneration;
+    uint64_t mFramesConstructed;
+    uint64_t mFramesReflowed;
+
+    bool operator==(const TargetGeometry& aOther) const {
+      return mTargetFrame == aOther.mTargetFrame &&
+             mRootFrame == aOther.mRootFrame &&
+             mRootBounds.IsEqualEdges(aOther.mRootBounds) &&
+             mRootScrollPosition == aOther.mRootScrollPosition &&
+             mRestyleGeneration == aOther.mRestyleGeneration &&
+             mFramesConstructed == aOther.mFramesConstructed &&
+             mFramesReflowed == aOther.mFramesReflowed;
+    }
+  };
+
   nsCOMPtr<nsPIDOMWindowInner> mOwner;
   RefPtr<Document> mDocument;
   RefPtr<dom::IntersectionCallback> mCallback;
@@ -143,6 +189,8 @@ class DOMIntersectionObserver final : public nsISupports,
 
   // Holds raw pointers which are explicitly cleared by UnlinkTarget().
   nsTArray<Element*> mObservationTargets;
+  // Keyed by the same raw pointers as mObservationTargets.
+  nsDataHashtable<nsPtrHashKey<Element>, TargetGeometry> mTargetGeometry;
 
   nsTArray<RefPtr<DOMIntersectionObserverEntry>> mQueuedEntries;
   bool mConnected;
@@ -23,7 +23,11 @@
 #include "mozilla/NullPrincipal.h"
 #include "NullPrincipalURI.h"
 #include "mozilla/dom/BindingUtils.h"
+#include "mozilla/dom/Event.h"
+#include "mozilla/dom/Promise.h"
 #include "mozilla/dom/ScriptSettings.h"
+#include "nsIDOMEventListener.h"
+#include "nsThreadUtils.h"
 
 using namespace mozilla;
 using namespace mozilla::dom;
@@ -145,14 +149,13 @@ already_AddRefed<Document> DOMParser::ParseFromStream(nsIInputStream* aStream,
                                                       int32_t aContentLength,
                                                       SupportedType aType,
                                                       ErrorResult& aRv) {
-  bool svg = (aType == SupportedType::Image_svg_xml);
-
   // For now, we can only create XML documents.
   // XXXsmaug Should we create an HTMLDocument (in XHTML mode)
   //         for "application/xhtml+xml"?
   if (aType != SupportedType::Text_xml &&
       aType != SupportedType::Application_xml &&
-      aType != SupportedType::Application_xhtml_xml && !svg) {
+      aType != SupportedType::Application_xhtml_xml &&
+      aType != SupportedType::Image_svg_xml) {
     aRv.Throw(NS_ERROR_NOT_IMPLEMENTED);
     return nullptr;
   }
@@ -171,57 +174,19 @@ already_AddRefed<Document> DOMParser::ParseFromStream(nsIInputStream* aStream,
     stream = bufferedStream;
   }
 
-  nsCOMPtr<Document> document =
-      SetUpDocument(svg ? DocumentFlavorSVG : DocumentFlavorLegacyGuess, aRv);
-  if (NS_WARN_IF(aRv.Failed())) {
-    return nullptr;
-  }
-
-  // Create a fake channel
   nsCOMPtr<nsIChannel> parserChannel;
-  NS_NewInputStreamChannel(
-      getter_AddRefs(parserChannel), mDocumentURI,
-      nullptr,  // aStream
-      mPrincipal, nsILoadInfo::SEC_FORCE_INHERIT_PRINCIPAL,
-      nsIContentPolicy::TYPE_OTHER,
-      nsDependentCSubstring(SupportedTypeValues::GetString(aType)));
-  if (NS_WARN_IF(!parserChannel)) {
-    aRv.Throw(NS_ERROR_UNEXPECTED);
-    return nullptr;
-  }
-
-  if (!DOMStringIsNull(aCharset)) {
-    parserChannel->SetContentCharset(NS_ConvertUTF16toUTF8(aCharset));
-  }
-
-  // Tell the document to start loading
   nsCOMPtr<nsIStreamListener> listener;
-
-  // Keep the XULXBL state in sync with the HTML case
-  if (mForceEnableXULXBL) {
-    document->ForceEnableXULXBL();
-  }
-
-  if (mForceEnableDTD) {
-    document->ForceSkipDTDSecurityChecks();
-  }
-
-  // Have to pass false for reset here, else the reset will remove
-  // our event listener.  Should that listener addition move to later
-  // than this call?
-  nsresult rv =
-      document->StartDocumentLoad(kLoadAsData, parserChannel, nullptr, nullptr,
-                                  getter_AddRefs(listener), false);
-
-  if (NS_FAILED(rv) || !listener) {
-    aRv.Throw(NS_ERROR_FAILURE);
+  nsCOMPtr<Document> document =
+      StartDocumentLoad(aType, aCharset, getter_AddRefs(parserChannel),
+                        getter_AddRefs(listener), aRv);
+  if (NS_WARN_IF(aRv.Failed())) {
     return nullptr;
   }
 
   // Now start pumping data to the listener
   nsresult status;
 
-  rv = listener->OnStartRequest(parserChannel);
+  nsresult rv = listener->OnStartRequest(parserChannel);
   if (NS_FAILED(rv)) parserChannel->Cancel(rv);
   parserChannel->GetStatus(&status);
 
@@ -243,6 +208,190 @@ already_AddRefed<Document> DOMParser::ParseFromStream(nsIInputStream* aStream,
   return document.forget();
 }
 
+namespace {
+
+// How much of the input is handed to the parser per task.  XML is parsed as
+// it's handed over, so this bounds how long each task takes.
+const uint32_t kAsyncParseChunkSize = 64 * 1024;
+
+// Resolves the promise of an asynchronous parse with the document once it
+// has been built.
+class AsyncParseEndListener final : public nsIDOMEventListener {
+ public:
+  NS_DECL_ISUPPORTS
+
+  explicit AsyncParseEndListener(Promise* aPromise) : mPromise(aPromise) {}
+
+  NS_IMETHOD HandleEvent(Event* aEvent) override {
+    nsCOMPtr<Document> document = do_QueryInterface(aEvent->GetTarget());
+    MOZ_ASSERT(document);
+    document->RemoveSystemEventListener(NS_LITERAL_STRING("DOMContentLoaded"),
+                                        this, false);
+    if (RefPtr<Promise> promise = mPromise.forget()) {
+      promise->MaybeResolve(document);
+    }
+    return NS_OK;
+  }
+
+  void Fail(Document* aDocument) {
+    aDocument->RemoveSystemEventListener(NS_LITERAL_STRING("DOMContentLoaded"),
+                                         this, false);
+    if (RefPtr<Promise> promise = mPromise.forget()) {
+      promise->MaybeReject(NS_ERROR_FAILURE);
+    }
+  }
+
+ private:
+  ~AsyncParseEndListener() = default;
+
+  RefPtr<Promise> mPromise;
+};
+
+NS_IMPL_ISUPPORTS(AsyncParseEndListener, nsIDOMEventListener)
+
+// Hands the input to the parser one chunk per task, so that the page gets to
+// run in between.
+class AsyncParseRunnable final : public CancelableRunnable {
+ public:
+  AsyncParseRunnable(Document* aDocument, nsIChannel* aChannel,
+                     nsIStreamListener* aListener, nsIInputStream* aStream,
+                     uint32_t aLength, AsyncParseEndListener* aEndListener,
+                     nsISerialEventTarget* aEventTarget)
+      : CancelableRunnable("AsyncParseRunnable"),
+        mDocument(aDocument),
+        mChannel(aChannel),
+        mListener(aListener),
+        mStream(aStream),
+        mEndListener(aEndListener),
+        mEventTarget(aEventTarget),
+        mOffset(0),
+        mLength(aLength) {}
+
+  NS_IMETHOD Run() override {
+    if (!mDocument) {
+      return NS_OK;
+    }
+
+    nsresult status;
+    mChannel->GetStatus(&status);
+    if (NS_SUCCEEDED(status) && mOffset < mLength) {
+      uint32_t count = std::min(mLength - mOffset, kAsyncParseChunkSize);
+      nsresult rv =
+          mListener->OnDataAvailable(mChannel, mStream, mOffset, count);
+      if (NS_FAILED(rv)) {
+        mChannel->Cancel(rv);
+      }
+      mOffset += count;
+      mChannel->GetStatus(&status);
+      if (NS_SUCCEEDED(status) && mOffset < mLength &&
+          NS_SUCCEEDED(mEventTarget->Dispatch(do_AddRef(this)))) {
+        return NS_OK;
+      }
+    }
+
+    nsresult rv = mListener->OnStopRequest(mChannel, status);
+    if (NS_FAILED(rv)) {
+      mEndListener->Fail(mDocument);
+    }
+    // Otherwise the promise is resolved once the document has been built.
+    mDocument = nullptr;
+    return NS_OK;
+  }
+
+  nsresult Cancel() override {
+    if (mDocument) {
+      mChannel->Cancel(NS_BINDING_ABORTED);
+      mListener->OnStopRequest(mChannel, NS_BINDING_ABORTED);
+      mEndListener->Fail(mDocument);
+      mDocument = nullptr;
+    }
+    return NS_OK;
+  }
+
+ private:
+  ~AsyncParseRunnable() = default;
+
+  nsCOMPtr<Document> mDocument;
+  nsCOMPtr<nsIChannel> mChannel;
+  nsCOMPtr<nsIStreamListener> mListener;
+  nsCOMPtr<nsIInputStream> mStream;
+  RefPtr<AsyncParseEndListener> mEndListener;
+  nsCOMPtr<nsISerialEventTarget> mEventTarget;
+  uint32_t mOffset;
+  const uint32_t mLength;
+};
+
+}  // namespace
+
+already_AddRefed<Promise> DOMParser::ParseFromStringAsync(
+    const nsAString& aStr, SupportedType aType, ErrorResult& aRv) {
+  if (NS_WARN_IF(!mOwner)) {
+    aRv.Throw(NS_ERROR_UNEXPECTED);
+    return nullptr;
+  }
+
+  RefPtr<Promise> promise = Promise::Create(mOwner, aRv);
+  if (NS_WARN_IF(aRv.Failed())) {
+    return nullptr;
+  }
+
+  nsAutoCString utf8str;
+  // Convert from UTF16 to UTF8 using fallible allocations
+  if (!AppendUTF16toUTF8(aStr, utf8str, mozilla::fallible)) {
+    aRv.Throw(NS_ERROR_OUT_OF_MEMORY);
+    return nullptr;
+  }
+  uint32_t length = utf8str.Length();
+
+  // The new stream takes over the buffer
+  nsCOMPtr<nsIInputStream> stream;
+  nsresult rv =
+      NS_NewCStringInputStream(getter_AddRefs(stream), std::move(utf8str));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    aRv.Throw(rv);
+    return nullptr;
+  }
+
+  // Unlike ParseFromString, HTML goes through the same data load as XML
+  // here, where it's tokenized off the main thread.
+  nsCOMPtr<nsIChannel> parserChannel;
+  nsCOMPtr<nsIStreamListener> listener;
+  nsCOMPtr<Document> document = StartDocumentLoad(
+      aType, NS_LITERAL_STRING("UTF-8"), getter_AddRefs(parserChannel),
+      getter_AddRefs(listener), aRv);
+  if (NS_WARN_IF(aRv.Failed())) {
+    return nullptr;
+  }
+
+  // The document is only handed out once it has been built, when
+  // DOMContentLoaded is fired at it.
+  RefPtr<AsyncParseEndListener> endListener =
+      new AsyncParseEndListener(promise);
+  rv = document->AddSystemEventListener(NS_LITERAL_STRING("DOMContentLoaded"),
+                                        endListener, false, false);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    aRv.Throw(rv);
+    return nullptr;
+  }
+
+  rv = listener->OnStartRequest(parserChannel);
+  if (NS_FAILED(rv)) {
+    parserChannel->Cancel(rv);
+  }
+
+  nsCOMPtr<nsISerialEventTarget> eventTarget =
+      mOwner->EventTargetFor(TaskCategory::Other);
+  RefPtr<AsyncParseRunnable> runnable =
+      new AsyncParseRunnable(document, parserChannel, listener, stream, length,
+                             endListener, eventTarget);
+  rv = eventTarget->Dispatch(do_AddRef(runnable));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    runnable->Cancel();
+  }
+
+  return promise.forget();
+}
+
 /*static */
 already_AddRefed<DOMParser> DOMParser::Constructor(const GlobalObject& aOwner,
                                                    ErrorResult& rv) {
@@ -320,3 +469,64 @@ already_AddRefed<Document> DOMParser::SetUpDocument(DocumentFlavor aFlavor,
 
   return doc.forget();
 }
+
+already_AddRefed<Document> DOMParser::StartDocumentLoad(
+    SupportedType aType, const nsAString& aCharset, nsIChannel** aChannel,
+    nsIStreamListener** aListener, ErrorResult& aRv) {
+  DocumentFlavor flavor = DocumentFlavorLegacyGuess;
+  if (aType == SupportedType::Text_html) {
+    flavor = DocumentFlavorHTML;
+  } else if (aType == SupportedType::Image_svg_xml) {
+    flavor = DocumentFlavorSVG;
+  }
+
+  nsCOMPtr<Document> document = SetUpDocument(flavor, aRv);
+  if (NS_WARN_IF(aRv.Failed())) {
+    return nullptr;
+  }
+
+  // Create a fake channel
+  nsCOMPtr<nsIChannel> parserChannel;
+  NS_NewInputStreamChannel(
+      getter_AddRefs(parserChannel), mDocumentURI,
+      nullptr,  // aStream
+      mPrincipal, nsILoadInfo::SEC_FORCE_INHERIT_PRINCIPAL,
+      nsIContentPolicy::TYPE_OTHER,
+      nsDependentCSubstring(SupportedTypeValues::GetString(aType)));
+  if (NS_WARN_IF(!parserChannel)) {
+    aRv.Throw(NS_ERROR_UNEXPECTED);
+    return nullptr;
+  }
+
+  if (!DOMStringIsNull(aCharset)) {
+    parserChannel->SetContentCharset(NS_ConvertUTF16toUTF8(aCharset));
+  }
+
+  // Tell the document to start loading
+  nsCOMPtr<nsIStreamListener> listener;
+
+  // Keep the XULXBL state in sync with the HTML case
+  if (mForceEnableXULXBL) {
+    document->ForceEnableXULXBL();
+  }
+
+  if (mForceEnableDTD) {
+    document->ForceSkipDTDSecurityChecks();
+  }
+
+  // Have to pass false for reset here, else the reset will remove
+  // our event listener.  Should that listener addition move to later
+  // than this call?
+  nsresult rv =
+      document->StartDocumentLoad(kLoadAsData, parserChannel, nullptr, nullptr,
+                                  getter_AddRefs(listener), false);
+
+  if (NS_FAILED(rv) || !listener) {
+    aRv.Throw(NS_ERROR_FAILURE);
+    return nullptr;
+  }
+
+  parserChannel.forget(aChannel);
+  listener.forget(aListener);
+  return document.forget();
+}
@@ -15,11 +15,15 @@
 #include "mozilla/dom/DOMParserBinding.h"
 #include "mozilla/dom/TypedArray.h"
 
+class nsIChannel;
 class nsIGlobalObject;
+class nsIStreamListener;
 
 namespace mozilla {
 namespace dom {
 
+class Promise;
+
 class DOMParser final : public nsISupports, public nsWrapperCache {
   typedef mozilla::dom::GlobalObject GlobalObject;
 
@@ -57,6 +61,12 @@ class DOMParser final : public nsISupports, public nsWrapperCache {
                                              SupportedType aType,
                                              ErrorResult& aRv);
 
+  // Parses aStr over several tasks and resolves the returned promise with the
+  // document once it has been built.  HTML is tokenized on the parser thread.
+  already_AddRefed<Promise> ParseFromStringAsync(const nsAString& aStr,
+                                                 SupportedType aType,
+                                                 ErrorResult& aRv);
+
   void ForceEnableXULXBL() {
     mForceEnableXULXBL = true;
     ForceEnableDTD();
@@ -81,6 +91,14 @@ class DOMParser final : public nsISupports, public nsWrapperCache {
   already_AddRefed<Document> SetUpDocument(DocumentFlavor aFlavor,
                                            ErrorResult& aRv);
 
+  // Creates a document of aType and starts loading it as data from a fake
+  // channel.  The data should be pumped to aListener.
+  already_AddRefed<Document> StartDocumentLoad(SupportedType aType,
+                                               const nsAString& aCharset,
+                                               nsIChannel** aChannel,
+                                               nsIStreamListener** aListener,
+                                               ErrorResult& aRv);
+
   nsCOMPtr<nsIGlobalObject> mOwner;
   nsCOMPtr<nsIPrincipal> mPrincipal;
   nsCOMPtr<nsIURI> mDocumentURI;
@@ -62,6 +62,7 @@
 #include "nsCommandParams.h"
 #include "nsUnicharUtils.h"
 #include "nsContentList.h"
+#include "nsContentListIndex.h"
 #include "nsCSSPseudoElements.h"
 #include "nsIObserver.h"
 #include "nsIBaseWindow.h"
@@ -3729,6 +3730,19 @@ void Document::RemoveFromIdTable(Element* aElement, nsAtom* aId) {
   }
 }
 
+nsContentListIndex& Document::EnsureContentListIndex() {
+  if (!mContentListIndex) {
+    mContentListIndex = MakeUnique<nsContentListIndex>(*this);
+  }
+  return *mContentListIndex;
+}
+
+void Document::MaybeDestroyContentListIndex() {
+  if (mContentListIndex && !mContentListIndex->HasLists()) {
+    mContentListIndex = nullptr;
+  }
+}
+
 void Document::SetPrincipals(nsIPrincipal* aNewPrincipal,
                              nsIPrincipal* aNewStoragePrincipal) {
   MOZ_ASSERT(!!aNewPrincipal == !!aNewStoragePrincipal);
@@ -11015,6 +11029,9 @@ void Document::DestroyElementMaps() {
     iter.Get()->ClearAndNotify();
   }
   mIdentifierMap.Clear();
+  // Lists fall back to observing mutations, and the elements to be removed
+  // needn't update the index.
+  mContentListIndex = nullptr;
   mComposedShadowRoots.Clear();
   mResponsiveContent.Clear();
   IncrementExpandoGeneration(*this);
@@ -14679,9 +14696,10 @@ void Document::UpdateIntersectionObservations() {
     DOMIntersectionObserver* observer = iter.Get()->GetKey();
     observers.AppendElement(observer);
   }
+  DOMIntersectionObserver::RootGeometryCache rootGeometryCache;
   for (const auto& observer : observers) {
     if (observer) {
-      observer->Update(this, time);
+      observer->Update(this, time, rootGeometryCache);
     }
   }
 }
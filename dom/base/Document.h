@@ -86,6 +86,7 @@ class imgIRequest;
 class nsCachableElementsByNameNodeList;
 class nsCommandManager;
 class nsContentList;
+class nsContentListIndex;
 class nsDocShell;
 class nsDOMNavigationTiming;
 class nsFrameLoader;
@@ -2170,6 +2171,19 @@ class Document : public nsINode,
   void AddToNameTable(Element* aElement, nsAtom* aName);
   void RemoveFromNameTable(Element* aElement, nsAtom* aName);
 
+  /**
+   * Get the index of elements by local name and class that live content
+   * lists in this document are kept up to date with, if any list uses it.
+   */
+  nsContentListIndex* GetContentListIndex() const {
+    return mContentListIndex.get();
+  }
+  nsContentListIndex& EnsureContentListIndex();
+  /**
+   * Destroys the content list index once no list uses it anymore.
+   */
+  void MaybeDestroyContentListIndex();
+
   /**
    * Returns all elements in the fullscreen stack in the insertion order.
    */
@@ -4405,6 +4419,8 @@ class Document : public nsINode,
   UniquePtr<SelectorCache> mSelectorCache;
   UniquePtr<ServoStyleSet> mStyleSet;
 
+  UniquePtr<nsContentListIndex> mContentListIndex;
+
  protected:
   friend class nsDocumentOnStack;
 
@@ -45,6 +45,7 @@
 #include "nsDOMCSSAttrDeclaration.h"
 #include "nsNameSpaceManager.h"
 #include "nsContentList.h"
+#include "nsContentListIndex.h"
 #include "nsVariant.h"
 #include "nsDOMTokenList.h"
 #include "nsError.h"
@@ -1596,6 +1597,9 @@ nsresult Element::BindToTree(BindContext& aContext, nsINode& aParent) {
     if (HasID()) {
       AddToIdTable(DoGetID());
     }
+    if (nsContentListIndex* index = nsContentListIndex::ForElement(*this)) {
+      index->ElementBound(this);
+    }
     HandleShadowDOMRelatedInsertionSteps(hadParent);
   }
 
@@ -1659,6 +1663,9 @@ void Element::UnbindFromTree(bool aNullParent) {
   if (IsInUncomposedDoc() || detachingFromShadow) {
     RemoveFromIdTable();
   }
+  if (nsContentListIndex* index = nsContentListIndex::ForElement(*this)) {
+    index->ElementUnbound(this);
+  }
 
   if (detachingFromShadow && HasPartAttribute()) {
     if (ShadowRoot* shadow = GetContainingShadow()) {
@@ -2267,12 +2274,23 @@ nsresult Element::SetAttrAndNotify(
       hadDirAuto = HasDirAuto();  // already takes bdi into account
     }
 
+    nsContentListIndex* index = aName == nsGkAtoms::_class
+                                    ? nsContentListIndex::ForElement(*this)
+                                    : nullptr;
+    if (index) {
+      index->ElementClassesWillChange(this);
+    }
+
     // XXXbz Perhaps we should push up the attribute mapping function
     // stuff to Element?
     if (!IsAttributeMapped(aName) ||
         !SetAndSwapMappedAttribute(aName, aParsedValue, &oldValueSet, &rv)) {
       rv = mAttrs.SetAndSwapAttr(aName, aParsedValue, &oldValueSet);
     }
+
+    if (index) {
+      index->ElementClassesChanged(this);
+    }
   } else {
     RefPtr<mozilla::dom::NodeInfo> ni;
     ni = mNodeInfo->NodeInfoManager()->GetNodeInfo(aName, aPrefix, aNamespaceID,
@@ -2602,8 +2620,20 @@ nsresult Element::UnsetAttr(int32_t aNameSpaceID, nsAtom* aName, bool aNotify) {
     hadDirAuto = HasDirAuto();  // already takes bdi into account
   }
 
+  nsContentListIndex* listIndex =
+      aNameSpaceID == kNameSpaceID_None && aName == nsGkAtoms::_class
+          ? nsContentListIndex::ForElement(*this)
+          : nullptr;
+  if (listIndex) {
+    listIndex->ElementClassesWillChange(this);
+  }
+
   nsAttrValue oldValue;
   rv = mAttrs.RemoveAttrAt(index, oldValue);
+
+  if (listIndex) {
+    listIndex->ElementClassesChanged(this);
+  }
   NS_ENSURE_SUCCESS(rv, rv);
 
   PostIdMaybeChange(aNameSpaceID, aName, nullptr);
@@ -707,6 +707,13 @@ class Element : public FragmentOrElement {
    */
   nsresult SetSingleClassFromParser(nsAtom* aSingleClassName);
 
+  /**
+   * Lets the element share the storage of the attributes it was created
+   * with with other elements with the same attributes.  Called by parsers
+   * once they've set them.
+   */
+  void ShareAttrsFromParser() { mAttrs.Share(); }
+
   // aParsedValue receives the old value of the attribute. That's useful if
   // either the input or output value of aParsedValue is StoresOwnData.
   nsresult SetParsedAttr(int32_t aNameSpaceID, nsAtom* aName, nsAtom* aPrefix,
@@ -7,7 +7,9 @@
 #include "StructuredCloneHolder.h"
 
 #include "ImageContainer.h"
+#include "js/ArrayBuffer.h"
 #include "mozilla/AutoRestore.h"
+#include "mozilla/CheckedInt.h"
 #include "mozilla/dom/BindingUtils.h"
 #include "mozilla/dom/BlobBinding.h"
 #include "mozilla/dom/BrowsingContext.h"
@@ -23,6 +25,8 @@
 #include "mozilla/dom/FormData.h"
 #include "mozilla/dom/ImageBitmap.h"
 #include "mozilla/dom/ImageBitmapBinding.h"
+#include "mozilla/dom/ImageData.h"
+#include "mozilla/dom/ImageDataBinding.h"
 #include "mozilla/dom/MessagePort.h"
 #include "mozilla/dom/MessagePortBinding.h"
 #include "mozilla/dom/OffscreenCanvas.h"
@@ -30,11 +34,13 @@
 #include "mozilla/dom/PMessagePort.h"
 #include "mozilla/dom/StructuredCloneTags.h"
 #include "mozilla/dom/ToJSValue.h"
+#include "mozilla/dom/TypedArray.h"
 #include "mozilla/dom/WebIDLSerializable.h"
 #include "mozilla/gfx/2D.h"
 #include "mozilla/ipc/BackgroundChild.h"
 #include "mozilla/ipc/BackgroundUtils.h"
 #include "mozilla/ipc/PBackgroundSharedTypes.h"
+#include "mozilla/Unused.h"
 #include "MultipartBlobImpl.h"
 #include "nsQueryObject.h"
 
@@ -45,6 +51,10 @@ namespace dom {
 
 namespace {
 
+// ImageData pixels below this size are left in the clone buffer, where
+// copying them is cheaper than a separate allocation.
+const uint32_t kMinSharedImageDataLength = 64 * 1024;
+
 JSObject* StructuredCloneCallbacksRead(JSContext* aCx,
                                        JSStructuredCloneReader* aReader,
                                        uint32_t aTag, uint32_t aIndex,
@@ -297,6 +307,7 @@ void StructuredCloneHolder::Read(nsIGlobalObject* aGlobal, JSContext* aCx,
     mWasmModuleArray.Clear();
     mClonedSurfaces.Clear();
     mInputStreamArray.Clear();
+    mImageDataBuffers.Clear();
     Clear();
   }
 }
@@ -860,6 +871,122 @@ bool WriteInputStream(JSStructuredCloneWriter* aWriter,
   return false;
 }
 
+JSObject* ReadSharedImageData(JSContext* aCx,
+                              JSStructuredCloneReader* aReader,
+                              uint32_t aIndex,
+                              StructuredCloneHolder* aHolder) {
+  MOZ_ASSERT(aHolder);
+  MOZ_ASSERT(aHolder->CloneScope() ==
+             StructuredCloneHolder::StructuredCloneScope::SameProcess);
+#ifdef FUZZING
+  if (aIndex >= aHolder->ImageDataBuffers().Length()) {
+    return nullptr;
+  }
+#endif
+  MOZ_ASSERT(aIndex < aHolder->ImageDataBuffers().Length());
+
+  uint32_t width, height;
+  if (!JS_ReadUint32Pair(aReader, &width, &height)) {
+    return nullptr;
+  }
+  CheckedUint32 checkedLength = CheckedUint32(width) * height * 4;
+  if (NS_WARN_IF(!checkedLength.isValid())) {
+    return nullptr;
+  }
+  uint32_t length = checkedLength.value();
+
+  UniquePtr<uint8_t[], JS::FreePolicy>& buffer =
+      aHolder->ImageDataBuffers()[aIndex];
+  if (NS_WARN_IF(!buffer)) {
+    return nullptr;
+  }
+
+  // The pixels can be handed over as they are if nobody else can read them.
+  UniquePtr<uint8_t[], JS::FreePolicy> data;
+  if (aHolder->CanOnlyBeReadOnce()) {
+    data = std::move(buffer);
+  } else {
+    data.reset(js_pod_arena_malloc<uint8_t>(js::ArrayBufferContentsArena,
+                                            length));
+    if (!data) {
+      JS_ReportOutOfMemory(aCx);
+      return nullptr;
+    }
+    memcpy(data.get(), buffer.get(), length);
+  }
+
+  JS::Rooted<JSObject*> arrayBuffer(
+      aCx, JS::NewArrayBufferWithContents(aCx, length, data.get()));
+  if (!arrayBuffer) {
+    return nullptr;
+  }
+  // arrayBuffer owns the data now.
+  mozilla::Unused << data.release();
+
+  JS::Rooted<JSObject*> array(
+      aCx, JS_NewUint8ClampedArrayWithBuffer(aCx, arrayBuffer, 0, length));
+  if (!array) {
+    return nullptr;
+  }
+
+  JS::Rooted<JSObject*> result(aCx);
+  {
+    // RefPtr<ImageData> needs to go out of scope before result is returned,
+    // see ReadBlob.
+    RefPtr<ImageData> imageData = new ImageData(width, height, *array);
+    if (!imageData->WrapObject(aCx, nullptr, &result)) {
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+bool WriteImageData(JSContext* aCx, JSStructuredCloneWriter* aWriter,
+                    JS::Handle<JSObject*> aObj, ImageData* aImageData,
+                    StructuredCloneHolder* aHolder) {
+  MOZ_ASSERT(aWriter);
+  MOZ_ASSERT(aImageData);
+  MOZ_ASSERT(aHolder);
+  MOZ_ASSERT(aHolder->CloneScope() ==
+             StructuredCloneHolder::StructuredCloneScope::SameProcess);
+
+  // Small ImageData, and ImageData whose pixels don't match its size because
+  // their buffer was detached, go in the clone buffer as usual.
+  CheckedUint32 expectedLength =
+      CheckedUint32(aImageData->Width()) * aImageData->Height() * 4;
+  RootedSpiderMonkeyInterface<Uint8ClampedArray> array(aCx);
+  if (!expectedLength.isValid() ||
+      expectedLength.value() < kMinSharedImageDataLength ||
+      !array.Init(aImageData->GetDataObject())) {
+    return StructuredCloneHolder::WriteFullySerializableObjects(aCx, aWriter,
+                                                                aObj);
+  }
+  array.ComputeLengthAndData();
+  if (array.Length() != expectedLength.value()) {
+    return StructuredCloneHolder::WriteFullySerializableObjects(aCx, aWriter,
+                                                                aObj);
+  }
+
+  UniquePtr<uint8_t[], JS::FreePolicy> data(js_pod_arena_malloc<uint8_t>(
+      js::ArrayBufferContentsArena, array.Length()));
+  if (!data) {
+    JS_ReportOutOfMemory(aCx);
+    return false;
+  }
+  memcpy(data.get(), array.Data(), array.Length());
+
+  // We store the position of the pixels in the array as index.
+  if (JS_WriteUint32Pair(aWriter, SCTAG_DOM_SHARED_IMAGEDATA,
+                         aHolder->ImageDataBuffers().Length()) &&
+      JS_WriteUint32Pair(aWriter, aImageData->Width(),
+                         aImageData->Height())) {
+    aHolder->ImageDataBuffers().AppendElement(std::move(data));
+    return true;
+  }
+
+  return false;
+}
+
 }  // anonymous namespace
 
 JSObject* StructuredCloneHolder::CustomReadHandler(
@@ -909,6 +1036,11 @@ JSObject* StructuredCloneHolder::CustomReadHandler(
     return ReadInputStream(aCx, aIndex, this);
   }
 
+  if (aTag == SCTAG_DOM_SHARED_IMAGEDATA &&
+      mStructuredCloneScope == StructuredCloneScope::SameProcess) {
+    return ReadSharedImageData(aCx, aReader, aIndex, this);
+  }
+
   if (aTag == SCTAG_DOM_BROWSING_CONTEXT) {
     return BrowsingContext::ReadStructuredClone(aCx, aReader, this);
   }
@@ -974,6 +1106,14 @@ bool StructuredCloneHolder::CustomWriteHandler(JSContext* aCx,
     }
   }
 
+  // See if this is a large ImageData object.
+  if (mStructuredCloneScope == StructuredCloneScope::SameProcess) {
+    ImageData* imageData = nullptr;
+    if (NS_SUCCEEDED(UNWRAP_OBJECT(ImageData, &obj, imageData))) {
+      return WriteImageData(aCx, aWriter, aObj, imageData, this);
+    }
+  }
+
   // See if this is a StructuredCloneBlob object.
   {
     StructuredCloneBlob* holder = nullptr;
@@ -10,6 +10,7 @@
 #include <utility>
 
 #include "js/StructuredClone.h"
+#include "js/Utility.h"
 #include "jsapi.h"
 #include "mozilla/MemoryReporting.h"
 #include "mozilla/UniquePtr.h"
@@ -177,7 +178,8 @@ class StructuredCloneHolder : public StructuredCloneHolderBase {
   // Call this method to know if this object is keeping some DOM object alive.
   bool HasClonedDOMObjects() const {
     return !mBlobImplArray.IsEmpty() || !mWasmModuleArray.IsEmpty() ||
-           !mClonedSurfaces.IsEmpty() || !mInputStreamArray.IsEmpty();
+           !mClonedSurfaces.IsEmpty() || !mInputStreamArray.IsEmpty() ||
+           !mImageDataBuffers.IsEmpty();
   }
 
   nsTArray<RefPtr<BlobImpl>>& BlobImpls() {
@@ -198,6 +200,16 @@ class StructuredCloneHolder : public StructuredCloneHolderBase {
     return mInputStreamArray;
   }
 
+  nsTArray<UniquePtr<uint8_t[], JS::FreePolicy>>& ImageDataBuffers() {
+    MOZ_ASSERT(mSupportsCloning,
+               "ImageData cannot be taken/set if cloning is not supported.");
+    return mImageDataBuffers;
+  }
+
+  // Holders which support transferring can only be read once, so the objects
+  // they read can take over what was cloned instead of copying it.
+  bool CanOnlyBeReadOnce() const { return mSupportsTransferring; }
+
   StructuredCloneScope CloneScope() const { return mStructuredCloneScope; }
 
   // The global object is set internally just during the Read(). This method
@@ -312,6 +324,11 @@ class StructuredCloneHolder : public StructuredCloneHolderBase {
   // instance, so no race condition will occur.
   nsTArray<RefPtr<gfx::DataSourceSurface>> mClonedSurfaces;
 
+  // This is used for cloning the pixels of large ImageData objects within a
+  // process.  They are copied once when writing, and the ImageData read from
+  // a holder which can only be read once takes them over.
+  nsTArray<UniquePtr<uint8_t[], JS::FreePolicy>> mImageDataBuffers;
+
   // This raw pointer is only set within ::Read() and is unset by the end.
   nsIGlobalObject* MOZ_NON_OWNING_REF mGlobal;
 
@@ -141,6 +141,9 @@ enum StructuredCloneTags {
 
   SCTAG_DOM_CLONED_ERROR_OBJECT,
 
+  // This tag is for ImageData whose pixels are kept out of the clone buffer.
+  SCTAG_DOM_SHARED_IMAGEDATA,
+
   // IMPORTANT: If you plan to add an new IDB tag, it _must_ be add before the
   // "less stable" tags!
 };
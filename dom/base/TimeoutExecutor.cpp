@@ -137,12 +137,15 @@ nsresult TimeoutExecutor::Schedule(const TimeStamp& aDeadline,
   return ScheduleDelayed(aDeadline, now, aMinDelay);
 }
 
-nsresult TimeoutExecutor::MaybeReschedule(const TimeStamp& aDeadline,
-                                          const TimeDuration& aMinDelay) {
+nsresult TimeoutExecutor::MaybeReschedule(
+    const TimeStamp& aDeadline, const TimeDuration& aMinDelay,
+    const TimeDuration& aCoalescingSlack) {
   MOZ_DIAGNOSTIC_ASSERT(!mDeadline.IsNull());
   MOZ_DIAGNOSTIC_ASSERT(mMode == Mode::Immediate || mMode == Mode::Delayed);
 
-  if (aDeadline >= mDeadline) {
+  if (aDeadline + aCoalescingSlack >= mDeadline) {
+    // Either the deadline is later than the one we're scheduled for, or it's
+    // close enough to run in the same wakeup, late by at most the slack.
     return NS_OK;
   }
 
@@ -201,7 +204,8 @@ void TimeoutExecutor::Shutdown() {
 }
 
 nsresult TimeoutExecutor::MaybeSchedule(const TimeStamp& aDeadline,
-                                        const TimeDuration& aMinDelay) {
+                                        const TimeDuration& aMinDelay,
+                                        const TimeDuration& aCoalescingSlack) {
   MOZ_DIAGNOSTIC_ASSERT(!aDeadline.IsNull());
 
   if (mMode == Mode::Shutdown) {
@@ -209,7 +213,7 @@ nsresult TimeoutExecutor::MaybeSchedule(const TimeStamp& aDeadline,
   }
 
   if (mMode == Mode::Immediate || mMode == Mode::Delayed) {
-    return MaybeReschedule(aDeadline, aMinDelay);
+    return MaybeReschedule(aDeadline, aMinDelay, aCoalescingSlack);
   }
 
   return Schedule(aDeadline, aMinDelay);
@@ -64,7 +64,8 @@ class TimeoutExecutor final : public nsIRunnable,
   nsresult Schedule(const TimeStamp& aDeadline, const TimeDuration& aMinDelay);
 
   nsresult MaybeReschedule(const TimeStamp& aDeadline,
-                           const TimeDuration& aMinDelay);
+                           const TimeDuration& aMinDelay,
+                           const TimeDuration& aCoalescingSlack);
 
   MOZ_CAN_RUN_SCRIPT void MaybeExecute();
 
@@ -74,8 +75,12 @@ class TimeoutExecutor final : public nsIRunnable,
 
   void Shutdown();
 
+  // If the executor is already waiting for a later deadline, it keeps waiting
+  // for it rather than waking up earlier for aDeadline as long as that's at
+  // most aCoalescingSlack earlier.
   nsresult MaybeSchedule(const TimeStamp& aDeadline,
-                         const TimeDuration& aMinDelay);
+                         const TimeDuration& aMinDelay,
+                         const TimeDuration& aCoalescingSlack = TimeDuration());
 
   void Cancel();
 
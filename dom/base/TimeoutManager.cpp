@@ -8,6 +8,7 @@
 #include "nsGlobalWindow.h"
 #include "mozilla/Logging.h"
 #include "mozilla/PerformanceCounter.h"
+#include "mozilla/Preferences.h"
 #include "mozilla/StaticPrefs_dom.h"
 #include "mozilla/StaticPrefs_privacy.h"
 #include "mozilla/Telemetry.h"
@@ -260,7 +261,8 @@ nsresult TimeoutManager::MaybeSchedule(const TimeStamp& aWhen,
   // Before we can schedule the executor we need to make sure that we
   // have an updated execution budget.
   UpdateBudget(aNow);
-  return mExecutor->MaybeSchedule(aWhen, MinSchedulingDelay());
+  return mExecutor->MaybeSchedule(aWhen, MinSchedulingDelay(),
+                                  CoalescingSlack());
 }
 
 bool TimeoutManager::IsInvalidFiringId(uint32_t aFiringId) const {
@@ -402,6 +404,10 @@ void TimeoutManager::UpdateBudget(const TimeStamp& aNow,
 #define DOM_MAX_TIMEOUT_VALUE DELAY_INTERVAL_LIMIT
 
 uint32_t TimeoutManager::sNestingLevel = 0;
+TimeoutManager::DelayStats TimeoutManager::sDelayStats;
+
+static bool sCoalescingSlackPrefCached = false;
+static uint32_t sCoalescingSlackMS = 1;
 
 TimeoutManager::TimeoutManager(nsGlobalWindowInner& aWindow,
                                uint32_t aMaxIdleDeferMS)
@@ -424,6 +430,12 @@ TimeoutManager::TimeoutManager(nsGlobalWindowInner& aWindow,
       mThrottleTrackingTimeouts(false),
       mBudgetThrottleTimeouts(false),
       mIsLoading(false) {
+  if (!sCoalescingSlackPrefCached) {
+    sCoalescingSlackPrefCached = true;
+    Preferences::AddUintVarCache(&sCoalescingSlackMS,
+                                 "dom.timeout.coalescing_slack_ms", 1);
+  }
+
   MOZ_LOG(gTimeoutLog, LogLevel::Debug,
           ("TimeoutManager %p created, tracking bucketing %s\n", this,
            StaticPrefs::privacy_trackingprotection_annotate_channels()
@@ -442,6 +454,60 @@ TimeoutManager::~TimeoutManager() {
           ("TimeoutManager %p destroyed\n", this));
 }
 
+/* static */
+TimeDuration TimeoutManager::CoalescingSlack() {
+  return TimeDuration::FromMilliseconds(sCoalescingSlackMS);
+}
+
+/* static */
+void TimeoutManager::ResetDelayStats() { sDelayStats = DelayStats(); }
+
+/* static */
+void TimeoutManager::RecordDelay(Timeout* aTimeout, const TimeStamp& aNow,
+                                 bool aIsFirstInRun) {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  if (aIsFirstInRun) {
+    ++sDelayStats.mRunCount;
+  }
+  ++sDelayStats.mCallbackCount;
+
+  double requestedMS = aTimeout->mInterval.ToMilliseconds();
+  double delayMS = std::max(
+      0.0, (aNow - aTimeout->SubmitTime()).ToMilliseconds() - requestedMS);
+  sDelayStats.mTotalRequestedMS += requestedMS;
+  sDelayStats.mTotalDelayMS += delayMS;
+  sDelayStats.mMaxDelayMS = std::max(sDelayStats.mMaxDelayMS, delayMS);
+
+  uint32_t bucket = 0;
+  for (double limitMS = 1;
+       bucket < DelayStats::kBucketCount - 1 && delayMS >= limitMS;
+       limitMS *= 4) {
+    ++bucket;
+  }
+  ++sDelayStats.mDelayBuckets[bucket];
+}
+
+TimeStamp TimeoutManager::CoalescedDeadline(const Timeout* aTimeout) const {
+  TimeStamp deadline = aTimeout->When();
+  const TimeDuration slack = CoalescingSlack();
+  if (slack.IsZero()) {
+    return deadline;
+  }
+
+  // The list is sorted by deadline, except for timeouts that were inserted
+  // behind ones which are being run, so look at the deadlines of all the
+  // timeouts up to the first that's due too late.
+  const TimeStamp limit = aTimeout->When() + slack;
+  for (const Timeout* timeout = aTimeout->getNext();
+       timeout && timeout->When() <= limit; timeout = timeout->getNext()) {
+    if (timeout->When() > deadline) {
+      deadline = timeout->When();
+    }
+  }
+  return deadline;
+}
+
 uint32_t TimeoutManager::GetTimeoutId(Timeout::Reason aReason) {
   switch (aReason) {
     case Timeout::Reason::eIdleCallbackTimeout:
@@ -687,7 +753,11 @@ void TimeoutManager::RunTimeout(const TimeStamp& aNow,
   for (Timeout* timeout = timeouts.GetFirst(); timeout != nullptr;
        timeout = timeout->getNext()) {
     if (totalTimeLimit.IsZero() || timeout->When() > deadline) {
-      nextDeadline = timeout->When();
+      // Let the timeouts which are due soon after the next one run in the
+      // same wakeup, rather than waking up for each of them.
+      nextDeadline = !aProcessIdle && timeout->When() > deadline
+                         ? CoalescedDeadline(timeout)
+                         : timeout->When();
       break;
     }
 
@@ -765,6 +835,7 @@ void TimeoutManager::RunTimeout(const TimeStamp& aNow,
     // timeout.
     RefPtr<Timeout> next;
 
+    bool isFirstInRun = true;
     for (RefPtr<Timeout> timeout = timeouts.GetFirst(); timeout != nullptr;
          timeout = next) {
       next = timeout->getNext();
@@ -889,6 +960,8 @@ void TimeoutManager::RunTimeout(const TimeStamp& aNow,
         mLastFiringIndex = timeout->mFiringIndex;
 #endif
         // This timeout is good to run.
+        RecordDelay(timeout, now, isFirstInRun);
+        isFirstInRun = false;
         bool timeout_was_cleared = window->RunTimeoutHandler(timeout, scx);
 #if MOZ_GECKO_PROFILER
         if (profiler_can_accept_markers()) {
@@ -103,6 +103,30 @@ class TimeoutManager final {
 
   void SetLoading(bool value);
 
+  // How much later than its deadline a timeout may run so that it can share
+  // a wakeup with other timeouts, from "dom.timeout.coalescing_slack_ms".
+  static TimeDuration CoalescingSlack();
+
+  // Statistics about how late the timeouts of the windows of this process ran
+  // compared to the delay they were set with, for
+  // ChromeUtils.getTimeoutDelayStats().
+  struct DelayStats {
+    static const uint32_t kBucketCount = 6;
+
+    // The number of wakeups which ran timeouts, and of timeouts they ran.
+    uint64_t mRunCount;
+    uint64_t mCallbackCount;
+    double mTotalRequestedMS;
+    double mTotalDelayMS;
+    double mMaxDelayMS;
+    // The number of timeouts which ran less than 1ms late, 1 to 4ms late, 4
+    // to 16ms late, 16 to 64ms late, 64 to 256ms late, and later than that.
+    uint64_t mDelayBuckets[kBucketCount];
+  };
+
+  static const DelayStats& GetDelayStats() { return sDelayStats; }
+  static void ResetDelayStats();
+
  private:
   void MaybeStartThrottleTimeout();
 
@@ -132,6 +156,13 @@ class TimeoutManager final {
 
   void RecordExecution(Timeout* aRunningTimeout, Timeout* aTimeout);
 
+  static void RecordDelay(Timeout* aTimeout, const TimeStamp& aNow,
+                          bool aIsFirstInRun);
+
+  // Returns when to wake up for aTimeout so that the timeouts due at most
+  // CoalescingSlack() after it run in the same wakeup.
+  TimeStamp CoalescedDeadline(const Timeout* aTimeout) const;
+
   void UpdateBudget(const TimeStamp& aNow,
                     const TimeDuration& aDuration = TimeDuration());
 
@@ -226,6 +257,7 @@ class TimeoutManager final {
   bool mIsLoading;
 
   static uint32_t sNestingLevel;
+  static DelayStats sDelayStats;
 };
 
 }  // namespace dom
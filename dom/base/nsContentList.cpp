@@ -11,6 +11,7 @@
  */
 
 #include "nsContentList.h"
+#include "nsContentListIndex.h"
 #include "nsIContent.h"
 #include "mozilla/dom/Document.h"
 #include "mozilla/ContentIterator.h"
@@ -341,6 +342,7 @@ nsContentList::nsContentList(nsINode* aRootNode, int32_t aMatchNameSpaceId,
       mFunc(nullptr),
       mDestroyFunc(nullptr),
       mData(nullptr),
+      mIndexDocument(nullptr),
       mState(LIST_DIRTY),
       mDeep(aDeep),
       mFuncMayDependOnAttr(false),
@@ -380,6 +382,7 @@ nsContentList::nsContentList(nsINode* aRootNode, nsContentListMatchFunc aFunc,
       mFunc(aFunc),
       mDestroyFunc(aDestroyFunc),
       mData(aData),
+      mIndexDocument(nullptr),
       mState(LIST_DIRTY),
       mMatchAll(false),
       mDeep(aDeep),
@@ -402,6 +405,7 @@ nsContentList::nsContentList(nsINode* aRootNode, nsContentListMatchFunc aFunc,
 
 nsContentList::~nsContentList() {
   RemoveFromHashtable();
+  StopUsingIndex();
   if (mIsLiveList && mRootNode) {
     mRootNode->RemoveMutationObserver(this);
   }
@@ -527,6 +531,7 @@ void nsContentList::NodeWillBeDestroyed(const nsINode* aNode) {
   // We shouldn't do anything useful from now on
 
   RemoveFromCaches();
+  StopUsingIndex();
   mRootNode = nullptr;
 
   // We will get no more updates, so we can never know we're up to
@@ -536,6 +541,7 @@ void nsContentList::NodeWillBeDestroyed(const nsINode* aNode) {
 
 void nsContentList::LastRelease() {
   RemoveFromCaches();
+  StopUsingIndex();
   if (mIsLiveList && mRootNode) {
     mRootNode->RemoveMutationObserver(this);
     mRootNode = nullptr;
@@ -557,7 +563,7 @@ void nsContentList::AttributeChanged(Element* aElement, int32_t aNameSpaceID,
   MOZ_ASSERT(aElement, "Must have a content node to work with");
 
   if (!mFunc || !mFuncMayDependOnAttr || mState == LIST_DIRTY ||
-      !MayContainRelevantNodes(aElement->GetParentNode()) ||
+      UsesIndex() || !MayContainRelevantNodes(aElement->GetParentNode()) ||
       !nsContentUtils::IsInSameAnonymousTree(mRootNode, aElement)) {
     // Either we're already dirty or this notification doesn't affect
     // whether we might match aElement.
@@ -591,10 +597,12 @@ void nsContentList::ContentAppended(nsIContent* aFirstNewContent) {
    * Also, if container is anonymous from our point of view, we know that we
    * can't possibly be matching any of the kids.
    *
+   * If we use the index, it dirties us when any of the kids matters.
+   *
    * Optimize out also the common case when just one new node is appended and
    * it doesn't match us.
    */
-  if (mState == LIST_DIRTY ||
+  if (mState == LIST_DIRTY || UsesIndex() ||
       !nsContentUtils::IsInSameAnonymousTree(mRootNode, container) ||
       !MayContainRelevantNodes(container) ||
       (!aFirstNewContent->HasChildren() &&
@@ -683,7 +691,7 @@ void nsContentList::ContentInserted(nsIContent* aChild) {
   // Note that aChild->GetParentNode() can be null here if we are inserting into
   // the document itself; any attempted optimizations to this method should deal
   // with that.
-  if (mState != LIST_DIRTY &&
+  if (mState != LIST_DIRTY && !UsesIndex() &&
       MayContainRelevantNodes(aChild->GetParentNode()) &&
       nsContentUtils::IsInSameAnonymousTree(mRootNode, aChild) &&
       MatchSelf(aChild)) {
@@ -695,7 +703,7 @@ void nsContentList::ContentInserted(nsIContent* aChild) {
 
 void nsContentList::ContentRemoved(nsIContent* aChild,
                                    nsIContent* aPreviousSibling) {
-  if (mState != LIST_DIRTY &&
+  if (mState != LIST_DIRTY && !UsesIndex() &&
       MayContainRelevantNodes(aChild->GetParentNode()) &&
       nsContentUtils::IsInSameAnonymousTree(mRootNode, aChild) &&
       MatchSelf(aChild)) {
@@ -775,6 +783,14 @@ void nsContentList::PopulateSelf(uint32_t aNeededLength,
   if (count >= aNeededLength)  // We're all set
     return;
 
+  if (mState == LIST_DIRTY) {
+    MaybeStartUsingIndex();
+    if (UsesIndex() && PopulateFromIndex()) {
+      ASSERT_IN_SYNC;
+      return;
+    }
+  }
+
   uint32_t elementsToAppend = aNeededLength - count;
 #ifdef DEBUG
   uint32_t invariant = elementsToAppend + mElements.Length();
@@ -817,6 +833,159 @@ void nsContentList::PopulateSelf(uint32_t aNeededLength,
   ASSERT_IN_SYNC;
 }
 
+bool nsContentList::UsesIndex() const {
+  return mIndexDocument && mRootNode &&
+         mRootNode->GetUncomposedDoc() == mIndexDocument &&
+         !mRootNode->IsInNativeAnonymousSubtree();
+}
+
+void nsContentList::MaybeStartUsingIndex() {
+  MOZ_ASSERT(mState == LIST_DIRTY);
+
+  if (mIndexDocument) {
+    if (UsesIndex()) {
+      return;
+    }
+    // Our root was moved to another document.
+    StopUsingIndex();
+  }
+
+  if (!mIsLiveList || !mDeep || !mRootNode ||
+      mRootNode->IsInNativeAnonymousSubtree()) {
+    return;
+  }
+  Document* doc = mRootNode->GetUncomposedDoc();
+  if (!doc) {
+    return;
+  }
+
+  if (mFunc) {
+    const AtomArray* classes = nsContentUtils::GetRequiredClasses(mFunc, mData);
+    if (!classes) {
+      return;
+    }
+    nsContentListIndex& index = doc->EnsureContentListIndex();
+    for (nsAtom* requiredClass : *classes) {
+      if (!mIndexClasses.Contains(requiredClass)) {
+        mIndexClasses.AppendElement(requiredClass);
+        index.AddList(this, nsContentListIndex::KeyType::Class, requiredClass);
+      }
+    }
+  } else {
+    // Qualified names with a prefix match elements with a different local
+    // name.
+    if (mMatchAll || !mXMLMatchAtom ||
+        nsDependentAtomString(mXMLMatchAtom).FindChar(':') != kNotFound) {
+      return;
+    }
+    nsContentListIndex& index = doc->EnsureContentListIndex();
+    index.AddList(this, nsContentListIndex::KeyType::LocalName,
+                  mXMLMatchAtom);
+    if (mHTMLMatchAtom != mXMLMatchAtom) {
+      index.AddList(this, nsContentListIndex::KeyType::LocalName,
+                    mHTMLMatchAtom);
+    }
+  }
+  mIndexDocument = doc;
+}
+
+void nsContentList::StopUsingIndex() {
+  if (!mIndexDocument) {
+    return;
+  }
+
+  if (nsContentListIndex* index = mIndexDocument->GetContentListIndex()) {
+    if (!mIndexClasses.IsEmpty()) {
+      for (nsAtom* indexClass : mIndexClasses) {
+        index->RemoveList(this, nsContentListIndex::KeyType::Class,
+                          indexClass);
+      }
+    } else {
+      index->RemoveList(this, nsContentListIndex::KeyType::LocalName,
+                        mXMLMatchAtom);
+      if (mHTMLMatchAtom != mXMLMatchAtom) {
+        index->RemoveList(this, nsContentListIndex::KeyType::LocalName,
+                          mHTMLMatchAtom);
+      }
+    }
+    mIndexDocument->MaybeDestroyContentListIndex();
+  }
+  mIndexDocument = nullptr;
+  mIndexClasses.Clear();
+}
+
+bool nsContentList::PopulateFromIndex() {
+  MOZ_ASSERT(UsesIndex());
+  MOZ_ASSERT(mState == LIST_DIRTY && mElements.IsEmpty());
+
+  nsContentListIndex* index = mIndexDocument->GetContentListIndex();
+  if (!index) {
+    MOZ_ASSERT_UNREACHABLE("Registered with an index which went away?");
+    return false;
+  }
+
+  AutoTArray<const nsContentListIndex::ElementSet*, 2> candidates;
+  if (!mIndexClasses.IsEmpty()) {
+    // Matching elements have all of the classes, so the fewest elements with
+    // one of them are enough.
+    const nsContentListIndex::ElementSet* fewest = nullptr;
+    for (nsAtom* indexClass : mIndexClasses) {
+      const nsContentListIndex::ElementSet* elements =
+          index->GetElements(nsContentListIndex::KeyType::Class, indexClass);
+      if (!elements || !fewest || elements->Count() < fewest->Count()) {
+        fewest = elements;
+        if (!fewest) {
+          break;
+        }
+      }
+    }
+    candidates.AppendElement(fewest);
+  } else {
+    candidates.AppendElement(index->GetElements(
+        nsContentListIndex::KeyType::LocalName, mXMLMatchAtom));
+    if (mHTMLMatchAtom != mXMLMatchAtom) {
+      candidates.AppendElement(index->GetElements(
+          nsContentListIndex::KeyType::LocalName, mHTMLMatchAtom));
+    }
+  }
+
+  uint32_t candidateCount = 0;
+  for (const nsContentListIndex::ElementSet* elements : candidates) {
+    if (!elements) {
+      MOZ_ASSERT_UNREACHABLE("Registered for keys which aren't indexed?");
+      return false;
+    }
+    candidateCount += elements->Count();
+  }
+
+  // Putting an element in tree order is a lot more expensive than walking
+  // past it, so walk when a sizeable part of the document is a candidate.
+  static const uint32_t kMinElementsPerCandidate = 16;
+  if (candidateCount > index->ElementCount() / kMinElementsPerCandidate) {
+    return false;
+  }
+
+  const bool rootIsDocument = mRootNode == mIndexDocument;
+  AutoTArray<Element*, 32> matches;
+  for (const nsContentListIndex::ElementSet* elements : candidates) {
+    for (auto iter = elements->ConstIter(); !iter.Done(); iter.Next()) {
+      Element* element = iter.Get()->GetKey();
+      if (element != mRootNode && Match(element) &&
+          (rootIsDocument || element->IsInclusiveDescendantOf(mRootNode))) {
+        matches.AppendElement(element);
+      }
+    }
+  }
+  matches.Sort(TreeOrderComparator());
+
+  mElements.SetCapacity(matches.Length());
+  for (Element* element : matches) {
+    mElements.AppendElement(element);
+  }
+  mState = LIST_UP_TO_DATE;
+  return true;
+}
+
 void nsContentList::RemoveFromHashtable() {
   if (mFunc) {
     // This can't be in the table anyway
@@ -14,6 +14,7 @@
 #define nsContentList_h___
 
 #include "mozilla/Attributes.h"
+#include "mozilla/AtomArray.h"
 #include "nsContentListDeclarations.h"
 #include "nsISupports.h"
 #include "nsTArray.h"
@@ -32,6 +33,7 @@
 
 namespace mozilla {
 namespace dom {
+class Document;
 class Element;
 }  // namespace dom
 }  // namespace mozilla
@@ -353,6 +355,16 @@ class nsContentList : public nsBaseContentList,
     Reset();
   }
 
+  /**
+   * Called by the nsContentListIndex we are registered with when it goes
+   * away.
+   */
+  void IndexDestroyed() {
+    mIndexDocument = nullptr;
+    mIndexClasses.Clear();
+    SetDirty();
+  }
+
   virtual void LastRelease() override;
 
  protected:
@@ -415,6 +427,26 @@ class nsContentList : public nsBaseContentList,
    */
   virtual void RemoveFromCaches() override { RemoveFromHashtable(); }
 
+  /**
+   * Whether we are kept up to date by the nsContentListIndex of our root's
+   * document, rather than by our mutation observer notifications.  That is
+   * the case for live, deep lists that match elements by local name or
+   * class, while their root is in the document.
+   */
+  bool UsesIndex() const;
+  /**
+   * Registers with the nsContentListIndex of our root's document if it can
+   * keep us up to date.  Must only be called while we are dirty.
+   */
+  void MaybeStartUsingIndex();
+  void StopUsingIndex();
+  /**
+   * Fills in the list from the elements in the index with our keys.
+   * Returns false if there are enough of them that walking our subtree is
+   * likely to be faster.
+   */
+  bool PopulateFromIndex();
+
   nsINode* mRootNode;  // Weak ref
   int32_t mMatchNameSpaceId;
   RefPtr<nsAtom> mHTMLMatchAtom;
@@ -433,6 +465,17 @@ class nsContentList : public nsBaseContentList,
    * Closure data to pass to mFunc when we call it
    */
   void* mData;
+  /**
+   * The document whose nsContentListIndex we are registered with, if any.
+   */
+  mozilla::dom::Document* mIndexDocument;  // Weak ref
+  /**
+   * The classes we are registered with the index for, if we match by class.
+   * We are registered for all of them, since a change to any of them can
+   * change whether an element matches.  Otherwise we are registered for our
+   * match atoms.
+   */
+  mozilla::AtomArray mIndexClasses;
   /**
    * The current state of the list (possible values are:
    * LIST_UP_TO_DATE, LIST_LAZY, LIST_DIRTY
@@ -0,0 +1,217 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * nsContentListIndex is a per-document index of elements by local name and
+ * class, used to keep live content lists up to date without walking the
+ * document.
+ */
+
+#include "nsContentListIndex.h"
+
+#include "mozilla/dom/Document.h"
+#include "mozilla/dom/Element.h"
+#include "nsAttrValue.h"
+#include "nsContentList.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+template <typename Func>
+static void ForEachClass(const Element& aElement, Func aFunc) {
+  const nsAttrValue* classes = aElement.GetClasses();
+  if (!classes) {
+    return;
+  }
+  for (uint32_t i = 0, count = classes->GetAtomCount(); i < count; ++i) {
+    aFunc(classes->AtomAt(i));
+  }
+}
+
+void nsContentListIndex::Entry::DirtyLists() const {
+  for (nsContentList* list : mLists) {
+    list->SetDirty();
+  }
+}
+
+nsContentListIndex::nsContentListIndex(Document& aDocument)
+    : mDocument(aDocument), mElementCount(0) {}
+
+nsContentListIndex::~nsContentListIndex() {
+  for (EntryTable* table : {&mLocalNames, &mClasses}) {
+    for (auto iter = table->Iter(); !iter.Done(); iter.Next()) {
+      for (nsContentList* list : iter.Data()->mLists) {
+        list->IndexDestroyed();
+      }
+    }
+  }
+}
+
+/* static */
+bool nsContentListIndex::IsIndexed(const Element& aElement) {
+  return aElement.IsInUncomposedDoc() &&
+         !aElement.IsInNativeAnonymousSubtree();
+}
+
+/* static */
+nsContentListIndex* nsContentListIndex::ForElement(const Element& aElement) {
+  nsContentListIndex* index = aElement.OwnerDoc()->GetContentListIndex();
+  return index && IsIndexed(aElement) ? index : nullptr;
+}
+
+void nsContentListIndex::AddList(nsContentList* aList, KeyType aType,
+                                 nsAtom* aKey) {
+  EntryTable& table = Table(aType);
+  if (Entry* entry = table.Get(aKey)) {
+    MOZ_ASSERT(!entry->mLists.Contains(aList));
+    entry->mLists.AppendElement(aList);
+    return;
+  }
+
+  auto* entry = new Entry();
+  entry->mLists.AppendElement(aList);
+  table.Put(aKey, entry);
+  mKeyFilter.add(aKey);
+
+  // Find the elements which already have the key, counting all elements on
+  // the way since it's cheap to do so here.
+  uint32_t elementCount = 0;
+  for (nsIContent* cur = mDocument.GetFirstChild(); cur;
+       cur = cur->GetNextNode()) {
+    // Skip elements which are in the middle of being bound, they'll get
+    // here through ElementBound.
+    if (!cur->IsElement() || !IsIndexed(*cur->AsElement())) {
+      continue;
+    }
+    ++elementCount;
+    Element* element = cur->AsElement();
+    if (aType == KeyType::LocalName) {
+      if (element->NodeInfo()->NameAtom() == aKey) {
+        entry->mElements.PutEntry(element);
+      }
+    } else {
+      const nsAttrValue* classes = element->GetClasses();
+      if (classes && classes->Contains(aKey, eCaseMatters)) {
+        entry->mElements.PutEntry(element);
+      }
+    }
+  }
+  mElementCount = elementCount;
+}
+
+void nsContentListIndex::RemoveList(nsContentList* aList, KeyType aType,
+                                    nsAtom* aKey) {
+  EntryTable& table = Table(aType);
+  Entry* entry = table.Get(aKey);
+  MOZ_ASSERT(entry && entry->mLists.Contains(aList), "Not registered?");
+  if (!entry) {
+    return;
+  }
+
+  entry->mLists.RemoveElement(aList);
+  if (entry->mLists.IsEmpty()) {
+    table.Remove(aKey);
+    mKeyFilter.remove(aKey);
+  }
+}
+
+const nsContentListIndex::ElementSet* nsContentListIndex::GetElements(
+    KeyType aType, nsAtom* aKey) const {
+  const EntryTable& table =
+      aType == KeyType::LocalName ? mLocalNames : mClasses;
+  Entry* entry = table.Get(aKey);
+  return entry ? &entry->mElements : nullptr;
+}
+
+void nsContentListIndex::ElementBound(Element* aElement) {
+  MOZ_ASSERT(IsIndexed(*aElement));
+  ++mElementCount;
+
+  if (Entry* entry =
+          GetEntry(mLocalNames, aElement->NodeInfo()->NameAtom())) {
+    entry->mElements.PutEntry(aElement);
+    entry->DirtyLists();
+  }
+
+  if (mClasses.Count()) {
+    ForEachClass(*aElement, [&](nsAtom* aClass) {
+      if (Entry* entry = GetEntry(mClasses, aClass)) {
+        entry->mElements.PutEntry(aElement);
+        entry->DirtyLists();
+      }
+    });
+  }
+}
+
+void nsContentListIndex::ElementUnbound(Element* aElement) {
+  MOZ_ASSERT(IsIndexed(*aElement));
+  if (mElementCount) {
+    --mElementCount;
+  }
+
+  if (Entry* entry =
+          GetEntry(mLocalNames, aElement->NodeInfo()->NameAtom())) {
+    if (entry->mElements.GetEntry(aElement)) {
+      entry->mElements.RemoveEntry(aElement);
+      entry->DirtyLists();
+    }
+  }
+
+  if (mClasses.Count()) {
+    ForEachClass(*aElement, [&](nsAtom* aClass) {
+      Entry* entry = GetEntry(mClasses, aClass);
+      if (entry && entry->mElements.GetEntry(aElement)) {
+        entry->mElements.RemoveEntry(aElement);
+        entry->DirtyLists();
+      }
+    });
+  }
+}
+
+void nsContentListIndex::ElementClassesWillChange(Element* aElement) {
+  MOZ_ASSERT(IsIndexed(*aElement));
+  MOZ_ASSERT(mChangingClassEntries.IsEmpty(), "Unpaired call?");
+
+  if (!mClasses.Count()) {
+    return;
+  }
+
+  // Take the element out of the entries for its current classes, but only
+  // dirty the lists of those it isn't put back into once we know the new
+  // classes.
+  ForEachClass(*aElement, [&](nsAtom* aClass) {
+    Entry* entry = GetEntry(mClasses, aClass);
+    if (entry && entry->mElements.GetEntry(aElement)) {
+      entry->mElements.RemoveEntry(aElement);
+      mChangingClassEntries.AppendElement(entry);
+    }
+  });
+}
+
+void nsContentListIndex::ElementClassesChanged(Element* aElement) {
+  MOZ_ASSERT(IsIndexed(*aElement));
+
+  if (!mClasses.Count()) {
+    MOZ_ASSERT(mChangingClassEntries.IsEmpty());
+    return;
+  }
+
+  ForEachClass(*aElement, [&](nsAtom* aClass) {
+    Entry* entry = GetEntry(mClasses, aClass);
+    if (!entry || entry->mElements.GetEntry(aElement)) {
+      return;
+    }
+    entry->mElements.PutEntry(aElement);
+    if (!mChangingClassEntries.RemoveElement(entry)) {
+      entry->DirtyLists();
+    }
+  });
+
+  for (Entry* entry : mChangingClassEntries) {
+    entry->DirtyLists();
+  }
+  mChangingClassEntries.Clear();
+}
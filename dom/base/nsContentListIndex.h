@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * nsContentListIndex is a per-document index of elements by local name and
+ * class, used to keep live content lists up to date without walking the
+ * document.
+ */
+
+#ifndef nsContentListIndex_h___
+#define nsContentListIndex_h___
+
+#include "mozilla/Attributes.h"
+#include "mozilla/BloomFilter.h"
+#include "nsClassHashtable.h"
+#include "nsHashKeys.h"
+#include "nsTArray.h"
+#include "nsTHashtable.h"
+
+class nsAtom;
+class nsContentList;
+
+namespace mozilla {
+namespace dom {
+class Document;
+class Element;
+}  // namespace dom
+}  // namespace mozilla
+
+/**
+ * Maps the local names and classes that the live content lists of a document
+ * match on to the elements of the document that have them.
+ *
+ * Only the keys some list registered for are indexed, and a counting Bloom
+ * filter of them lets elements whose name and classes no list cares about
+ * be inserted, removed, or have their classes changed without touching the
+ * index.  Lists registered for a key are dirtied when an element gains or
+ * loses that key, so they don't need to look at any other mutation, and can
+ * be rebuilt from the elements with their key rather than from a walk of
+ * their subtree.
+ *
+ * Only elements which are reachable from the document through child lists
+ * are indexed, that is, not elements in shadow trees or native anonymous
+ * content.  Elements keep the index up to date as they are bound to and
+ * unbound from the document, and when their classes change.
+ */
+class nsContentListIndex final {
+ public:
+  typedef nsTHashtable<nsPtrHashKey<mozilla::dom::Element>> ElementSet;
+
+  enum class KeyType : uint8_t { LocalName, Class };
+
+  explicit nsContentListIndex(mozilla::dom::Document& aDocument);
+  ~nsContentListIndex();
+
+  /**
+   * Whether aElement is indexed if its owner document has an index.
+   */
+  static bool IsIndexed(const mozilla::dom::Element& aElement);
+
+  /**
+   * Returns the index aElement needs to keep up to date, if any.
+   */
+  static nsContentListIndex* ForElement(const mozilla::dom::Element& aElement);
+
+  /**
+   * Registers aList to be dirtied when an element gains or loses the given
+   * key.  The first list registered for a key causes a walk of the document
+   * to find the elements which have it.
+   */
+  void AddList(nsContentList* aList, KeyType aType, nsAtom* aKey);
+  void RemoveList(nsContentList* aList, KeyType aType, nsAtom* aKey);
+  bool HasLists() const {
+    return mLocalNames.Count() != 0 || mClasses.Count() != 0;
+  }
+
+  /**
+   * Returns the elements in the document with a key that a list registered
+   * for, in no particular order.
+   */
+  const ElementSet* GetElements(KeyType aType, nsAtom* aKey) const;
+
+  /**
+   * The number of indexed elements in the document.
+   */
+  uint32_t ElementCount() const { return mElementCount; }
+
+  void ElementBound(mozilla::dom::Element* aElement);
+  void ElementUnbound(mozilla::dom::Element* aElement);
+  /**
+   * Must be called in pairs around a change to the classes of an indexed
+   * element, with nothing else touching the index in between.
+   */
+  void ElementClassesWillChange(mozilla::dom::Element* aElement);
+  void ElementClassesChanged(mozilla::dom::Element* aElement);
+
+ private:
+  struct Entry {
+    ElementSet mElements;
+    nsTArray<nsContentList*> mLists;
+
+    void DirtyLists() const;
+  };
+
+  typedef nsClassHashtable<nsRefPtrHashKey<nsAtom>, Entry> EntryTable;
+
+  EntryTable& Table(KeyType aType) {
+    return aType == KeyType::LocalName ? mLocalNames : mClasses;
+  }
+
+  Entry* GetEntry(EntryTable& aTable, nsAtom* aKey) const {
+    return mKeyFilter.mightContain(aKey) ? aTable.Get(aKey) : nullptr;
+  }
+
+  mozilla::dom::Document& mDocument;
+  EntryTable mLocalNames;
+  EntryTable mClasses;
+  // Holds the keys of both tables.
+  mozilla::BloomFilter<12, nsAtom> mKeyFilter;
+  // The class entries that the element whose classes are changing was in
+  // before the change.
+  AutoTArray<Entry*, 4> mChangingClassEntries;
+  uint32_t mElementCount;
+};
+
+#endif  // nsContentListIndex_h___
@@ -6123,6 +6123,19 @@ bool nsContentUtils::MatchClassNames(Element* aElement, int32_t aNamespaceID,
   return true;
 }
 
+// static
+const AtomArray* nsContentUtils::GetRequiredClasses(
+    nsContentListMatchFunc aFunc, void* aData) {
+  if (aFunc != MatchClassNames) {
+    return nullptr;
+  }
+  ClassMatchingInfo* info = static_cast<ClassMatchingInfo*>(aData);
+  if (info->mClasses.IsEmpty() || info->mCaseTreatment != eCaseMatters) {
+    return nullptr;
+  }
+  return &info->mClasses;
+}
+
 // static
 void nsContentUtils::DestroyClassNameArray(void* aData) {
   ClassMatchingInfo* info = static_cast<ClassMatchingInfo*>(aData);
@@ -8501,11 +8514,19 @@ class StringBuilder {
 
 static void AppendEncodedCharacters(const nsTextFragment* aText,
                                     StringBuilder& aBuilder) {
+  // Most text has nothing to encode, and finding that out is quicker than
+  // counting.
+  int32_t firstToEncode = aText->FindCharInSet(u"<>&\u00A0");
+  if (firstToEncode == kNotFound) {
+    aBuilder.Append(aText);
+    return;
+  }
+
   uint32_t extraSpaceNeeded = 0;
   uint32_t len = aText->GetLength();
   if (aText->Is2b()) {
     const char16_t* data = aText->Get2b();
-    for (uint32_t i = 0; i < len; ++i) {
+    for (uint32_t i = firstToEncode; i < len; ++i) {
       const char16_t c = data[i];
       switch (c) {
         case '<':
@@ -8526,7 +8547,7 @@ static void AppendEncodedCharacters(const nsTextFragment* aText,
     }
   } else {
     const char* data = aText->Get1b();
-    for (uint32_t i = 0; i < len; ++i) {
+    for (uint32_t i = firstToEncode; i < len; ++i) {
       const unsigned char c = data[i];
       switch (c) {
         case '<':
@@ -21,6 +21,7 @@
 #include "js/Value.h"
 #include "js/RootingAPI.h"
 #include "mozilla/dom/FromParser.h"
+#include "mozilla/AtomArray.h"
 #include "mozilla/BasicEvents.h"
 #include "mozilla/CallState.h"
 #include "mozilla/CORSMode.h"
@@ -2304,6 +2305,14 @@ class nsContentUtils {
         AllocClassMatchingInfo, aClasses);
   }
 
+  /**
+   * If aFunc and aData are those of a getElementsByClassName list, returns
+   * the classes that the elements it matches must all have, compared
+   * case-sensitively.  Returns null otherwise.
+   */
+  static const mozilla::AtomArray* GetRequiredClasses(
+      nsContentListMatchFunc aFunc, void* aData);
+
   /**
    * Returns a presshell for this document, if there is one. This will be
    * aDoc's direct presshell if there is one, otherwise we'll look at all
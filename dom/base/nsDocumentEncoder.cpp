@@ -43,7 +43,10 @@
 #include "mozilla/dom/Text.h"
 #include "nsLayoutUtils.h"
 #include "mozilla/Maybe.h"
+#include "mozilla/Monitor.h"
 #include "mozilla/ScopeExit.h"
+#include "mozilla/Unused.h"
+#include "nsThreadUtils.h"
 
 using namespace mozilla;
 using namespace mozilla::dom;
@@ -55,9 +58,15 @@ class TextStreamer {
   /**
    * @param aStream Will be kept alive by the TextStreamer.
    * @param aUnicodeEncoder Needs to be non-nullptr.
+   * @param aEncodingTarget If non-null, the text is encoded and written to
+   *        aStream on it instead of on the calling thread, in which case
+   *        aStream has to be usable from there.
    */
   TextStreamer(nsIOutputStream& aStream, UniquePtr<Encoder> aUnicodeEncoder,
-               bool aIsPlainText, nsAString& aOutputBuffer);
+               bool aIsPlainText, nsAString& aOutputBuffer,
+               nsISerialEventTarget* aEncodingTarget = nullptr);
+
+  ~TextStreamer();
 
   /**
    * String will be truncated if it is written to stream.
@@ -65,54 +74,129 @@ class TextStreamer {
   nsresult FlushIfStringLongEnough();
 
   /**
-   * String will be truncated.
+   * String will be truncated.  Waits until everything has been written when
+   * writing on an encoding target.
    */
   nsresult ForceFlush();
 
  private:
   const static uint32_t kMaxLengthBeforeFlush = 1024;
 
+  // Bigger chunks for the encoding target, so that dispatching them doesn't
+  // cost more than encoding them.
+  const static uint32_t kMaxLengthBeforeDispatch = 64 * 1024;
+
+  // How much text may wait for the encoding target before flushing blocks,
+  // so that serializing a big document doesn't buffer most of it.
+  const static uint32_t kMaxPendingLength = 1024 * 1024;
+
   const static uint32_t kEncoderBufferSizeInBytes = 4096;
 
-  nsresult EncodeAndWrite();
+  /**
+   * Encodes text and writes it to the stream, either directly or through the
+   * encoding target.
+   */
+  class Writer final {
+   public:
+    NS_INLINE_DECL_THREADSAFE_REFCOUNTING(TextStreamer::Writer)
+
+    Writer(nsIOutputStream& aStream, UniquePtr<Encoder> aUnicodeEncoder,
+           bool aIsPlainText);
+
+    nsresult EncodeAndWrite(const nsAString& aText);
+
+    /**
+     * Encodes and writes a copy of aText on aTarget, after waiting for
+     * pending text if there is too much of it.  Returns the first error
+     * writing on aTarget ran into.
+     */
+    nsresult Dispatch(nsISerialEventTarget& aTarget, const nsAString& aText);
+
+    /**
+     * Waits until all the text dispatched so far has been written.
+     */
+    nsresult WaitForPendingText();
+
+   private:
+    ~Writer() = default;
+
+    // Kept alive by the TextStreamer, which waits for pending text before
+    // going away.
+    nsIOutputStream* const mStream;
+    const UniquePtr<Encoder> mUnicodeEncoder;
+    const bool mIsPlainText;
+
+    Monitor mMonitor;
+    // The number of characters dispatched but not written yet.
+    uint32_t mPendingLength;
+    nsresult mStatus;
+  };
 
   nsresult EncodeAndWriteAndTruncate();
 
   const nsCOMPtr<nsIOutputStream> mStream;
-  const UniquePtr<Encoder> mUnicodeEncoder;
-  const bool mIsPlainText;
+  const RefPtr<Writer> mWriter;
+  const nsCOMPtr<nsISerialEventTarget> mEncodingTarget;
   nsAString& mOutputBuffer;
 };
 
 TextStreamer::TextStreamer(nsIOutputStream& aStream,
                            UniquePtr<Encoder> aUnicodeEncoder,
-                           bool aIsPlainText, nsAString& aOutputBuffer)
+                           bool aIsPlainText, nsAString& aOutputBuffer,
+                           nsISerialEventTarget* aEncodingTarget)
     : mStream{&aStream},
-      mUnicodeEncoder(std::move(aUnicodeEncoder)),
-      mIsPlainText(aIsPlainText),
-      mOutputBuffer(aOutputBuffer) {
-  MOZ_ASSERT(mUnicodeEncoder);
+      mWriter(new Writer(aStream, std::move(aUnicodeEncoder), aIsPlainText)),
+      mEncodingTarget(aEncodingTarget),
+      mOutputBuffer(aOutputBuffer) {}
+
+TextStreamer::~TextStreamer() {
+  if (mEncodingTarget) {
+    Unused << mWriter->WaitForPendingText();
+  }
 }
 
 nsresult TextStreamer::FlushIfStringLongEnough() {
   nsresult rv = NS_OK;
 
-  if (mOutputBuffer.Length() > kMaxLengthBeforeFlush) {
+  uint32_t maxLength =
+      mEncodingTarget ? kMaxLengthBeforeDispatch : kMaxLengthBeforeFlush;
+  if (mOutputBuffer.Length() > maxLength) {
     rv = EncodeAndWriteAndTruncate();
   }
 
   return rv;
 }
 
-nsresult TextStreamer::ForceFlush() { return EncodeAndWriteAndTruncate(); }
+nsresult TextStreamer::ForceFlush() {
+  nsresult rv = EncodeAndWriteAndTruncate();
+  if (mEncodingTarget) {
+    nsresult waitRv = mWriter->WaitForPendingText();
+    if (NS_SUCCEEDED(rv)) {
+      rv = waitRv;
+    }
+  }
+  return rv;
+}
+
+TextStreamer::Writer::Writer(nsIOutputStream& aStream,
+                             UniquePtr<Encoder> aUnicodeEncoder,
+                             bool aIsPlainText)
+    : mStream(&aStream),
+      mUnicodeEncoder(std::move(aUnicodeEncoder)),
+      mIsPlainText(aIsPlainText),
+      mMonitor("TextStreamer::Writer::mMonitor"),
+      mPendingLength(0),
+      mStatus(NS_OK) {
+  MOZ_ASSERT(mUnicodeEncoder);
+}
 
-nsresult TextStreamer::EncodeAndWrite() {
-  if (mOutputBuffer.IsEmpty()) {
+nsresult TextStreamer::Writer::EncodeAndWrite(const nsAString& aText) {
+  if (aText.IsEmpty()) {
     return NS_OK;
   }
 
   uint8_t buffer[kEncoderBufferSizeInBytes];
-  auto src = MakeSpan(mOutputBuffer);
+  auto src = MakeSpan(aText);
   auto bufferSpan = MakeSpan(buffer);
   // Reserve space for terminator
   auto dst = bufferSpan.To(bufferSpan.Length() - 1);
@@ -152,8 +236,68 @@ nsresult TextStreamer::EncodeAndWrite() {
   }
 }
 
+nsresult TextStreamer::Writer::Dispatch(nsISerialEventTarget& aTarget,
+                                        const nsAString& aText) {
+  uint32_t length = aText.Length();
+  if (!length) {
+    return NS_OK;
+  }
+
+  {
+    MonitorAutoLock lock(mMonitor);
+    while (NS_SUCCEEDED(mStatus) && mPendingLength > kMaxPendingLength) {
+      lock.Wait();
+    }
+    if (NS_FAILED(mStatus)) {
+      return mStatus;
+    }
+    mPendingLength += length;
+  }
+
+  RefPtr<Writer> self = this;
+  nsString text(aText);
+  nsresult rv = aTarget.Dispatch(
+      NS_NewRunnableFunction(
+          "TextStreamer::Writer::Dispatch",
+          [self, text, length]() {
+            MonitorAutoLock lock(self->mMonitor);
+            if (NS_SUCCEEDED(self->mStatus)) {
+              nsresult rv;
+              {
+                MonitorAutoUnlock unlock(self->mMonitor);
+                rv = self->EncodeAndWrite(text);
+              }
+              if (NS_FAILED(rv)) {
+                self->mStatus = rv;
+              }
+            }
+            self->mPendingLength -= length;
+            lock.Notify();
+          }),
+      NS_DISPATCH_NORMAL);
+  if (NS_FAILED(rv)) {
+    MonitorAutoLock lock(mMonitor);
+    mPendingLength -= length;
+    return rv;
+  }
+  return NS_OK;
+}
+
+nsresult TextStreamer::Writer::WaitForPendingText() {
+  MonitorAutoLock lock(mMonitor);
+  while (mPendingLength) {
+    lock.Wait();
+  }
+  return mStatus;
+}
+
 nsresult TextStreamer::EncodeAndWriteAndTruncate() {
-  const nsresult rv = EncodeAndWrite();
+  nsresult rv;
+  if (mEncodingTarget) {
+    rv = mWriter->Dispatch(*mEncodingTarget, mOutputBuffer);
+  } else {
+    rv = mWriter->EncodeAndWrite(mOutputBuffer);
+  }
   mOutputBuffer.Truncate();
   return rv;
 }
@@ -213,6 +357,15 @@ class nsDocumentEncoder : public nsIDocumentEncoder {
 
   void Initialize(bool aClearCachedSerializer = true);
 
+  /**
+   * Serializes the scope into aOutput, which is also the buffer of
+   * mTextStreamer if there is one.
+   *
+   * @param aMaxLength As described at
+   * `nsIDocumentEncodder.encodeToStringWithMaxLength`.
+   */
+  nsresult Serialize(uint32_t aMaxLength, nsAString& aOutput);
+
   /**
    * @param aMaxLength As described at
    * `nsIDocumentEncodder.encodeToStringWithMaxLength`.
@@ -236,7 +389,8 @@ class nsDocumentEncoder : public nsIDocumentEncoder {
                                       uint32_t aMaxLength = 0);
   nsresult SerializeNodeEnd(nsINode& aOriginalNode,
                             nsINode* aFixupNode = nullptr);
-  // This serializes the content of aNode.
+  // This serializes the content of aNode.  Unlike the recursive version it
+  // doesn't support fixup, skipping invisible content or a maximum length.
   nsresult SerializeToStringIterative(nsINode* aNode);
   nsresult SerializeRangeToString(nsRange* aRange);
   nsresult SerializeRangeNodes(nsRange* aRange, nsINode* aNode, int32_t aDepth);
@@ -482,8 +636,7 @@ nsresult nsDocumentEncoder::SerializeNode() {
   nsresult rv = NS_OK;
   nsINode* node = mEncodingScope.mNode;
   const bool nodeIsContainer = mEncodingScope.mNodeIsContainer;
-  if (!mNodeFixup && !(mFlags & SkipInvisibleContent) && !mTextStreamer &&
-      nodeIsContainer) {
+  if (!mNodeFixup && !(mFlags & SkipInvisibleContent) && nodeIsContainer) {
     rv = SerializeToStringIterative(node);
   } else {
     rv = SerializeToStringRecursive(node, nodeIsContainer);
@@ -500,6 +653,11 @@ nsresult nsDocumentEncoder::SerializeWholeDocument(uint32_t aMaxLength) {
   nsresult rv = mSerializer->AppendDocumentStart(mDocument);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Large documents can be too deep to recurse through.
+  if (!mNodeFixup && !(mFlags & SkipInvisibleContent) && !aMaxLength) {
+    return SerializeToStringIterative(mDocument);
+  }
+
   rv = SerializeToStringRecursive(mDocument, false, aMaxLength);
   return rv;
 }
@@ -792,6 +950,10 @@ nsresult nsDocumentEncoder::SerializeToStringIterative(nsINode* aNode) {
     while (!node && current && current != aNode) {
       rv = SerializeNodeEnd(*current);
       NS_ENSURE_SUCCESS(rv, rv);
+      if (mTextStreamer) {
+        rv = mTextStreamer->FlushIfStringLongEnough();
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
       // Check if we have siblings.
       node = current->GetNextSibling();
       if (!node) {
@@ -1108,27 +1270,7 @@ nsDocumentEncoder::EncodeToStringWithMaxLength(uint32_t aMaxLength,
   // output owns the buffer now!
   mCachedBuffer = nullptr;
 
-  if (!mSerializer) {
-    nsAutoCString progId(NS_CONTENTSERIALIZER_CONTRACTID_PREFIX);
-    AppendUTF16toUTF8(mMimeType, progId);
-
-    mSerializer = do_CreateInstance(progId.get());
-    NS_ENSURE_TRUE(mSerializer, NS_ERROR_NOT_IMPLEMENTED);
-  }
-
-  nsresult rv = NS_OK;
-
-  bool rewriteEncodingDeclaration =
-      !mEncodingScope.IsLimited() &&
-      !(mFlags & OutputDontRewriteEncodingDeclaration);
-  mSerializer->Init(mFlags, mWrapColumn, mEncoding, mIsCopying,
-                    rewriteEncodingDeclaration, &mNeedsPreformatScanning,
-                    output);
-
-  rv = SerializeDependingOnScope(aMaxLength);
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  rv = mSerializer->FlushAndFinish();
+  nsresult rv = Serialize(aMaxLength, output);
 
   mCachedBuffer = nsStringBuffer::FromString(output);
   // We have to be careful how we set aOutputString, because we don't
@@ -1155,33 +1297,66 @@ nsDocumentEncoder::EncodeToStringWithMaxLength(uint32_t aMaxLength,
   return rv;
 }
 
+nsresult nsDocumentEncoder::Serialize(uint32_t aMaxLength,
+                                      nsAString& aOutput) {
+  if (!mSerializer) {
+    nsAutoCString progId(NS_CONTENTSERIALIZER_CONTRACTID_PREFIX);
+    AppendUTF16toUTF8(mMimeType, progId);
+
+    mSerializer = do_CreateInstance(progId.get());
+    NS_ENSURE_TRUE(mSerializer, NS_ERROR_NOT_IMPLEMENTED);
+  }
+
+  bool rewriteEncodingDeclaration =
+      !mEncodingScope.IsLimited() &&
+      !(mFlags & OutputDontRewriteEncodingDeclaration);
+  mSerializer->Init(mFlags, mWrapColumn, mEncoding, mIsCopying,
+                    rewriteEncodingDeclaration, &mNeedsPreformatScanning,
+                    aOutput);
+
+  nsresult rv = SerializeDependingOnScope(aMaxLength);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return mSerializer->FlushAndFinish();
+}
+
 NS_IMETHODIMP
 nsDocumentEncoder::EncodeToStream(nsIOutputStream* aStream) {
   MOZ_ASSERT(mRangeContexts.IsEmpty(), "Re-entrant call to nsDocumentEncoder.");
   auto rangeContextGuard = MakeScopeExit([&] { mRangeContexts.Clear(); });
   NS_ENSURE_ARG_POINTER(aStream);
 
-  nsresult rv = NS_OK;
-
   if (!mDocument) return NS_ERROR_NOT_INITIALIZED;
 
   if (!mEncoding) {
     return NS_ERROR_UCONV_NOCONV;
   }
 
+  AutoReleaseDocumentIfNeeded autoReleaseDocument(this);
+
+  nsCOMPtr<nsISerialEventTarget> encodingTarget;
+  if (mFlags & OutputEncodeOffMainThread) {
+    nsresult rv = NS_CreateBackgroundTaskQueue("nsDocumentEncoder",
+                                               getter_AddRefs(encodingTarget));
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  // The serializer writes into buf, which the streamer empties into the
+  // stream whenever it gets long enough, so that the whole output never
+  // needs to be in memory at once.
   nsAutoString buf;
   const bool isPlainText = mMimeType.LowerCaseEqualsLiteral(kTextMime);
-  mTextStreamer.emplace(*aStream, mEncoding->NewEncoder(), isPlainText, buf);
+  mTextStreamer.emplace(*aStream, mEncoding->NewEncoder(), isPlainText, buf,
+                        encodingTarget);
+  auto textStreamerGuard = MakeScopeExit([&] { mTextStreamer.reset(); });
 
-  rv = EncodeToString(buf);
+  nsresult rv = Serialize(0, buf);
 
   // Force a flush of the last chunk of data.
-  rv = mTextStreamer->ForceFlush();
+  nsresult flushRv = mTextStreamer->ForceFlush();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  mTextStreamer.reset();
-
-  return rv;
+  return flushRv;
 }
 
 NS_IMETHODIMP
@@ -1232,6 +1407,7 @@ class nsHTMLCopyEncoder : public nsDocumentEncoder {
                                        nsAString& aInfoString,
                                        nsAString& aEncodedString) override;
   NS_IMETHOD EncodeToString(nsAString& aOutputString) override;
+  NS_IMETHOD EncodeToStream(nsIOutputStream* aStream) override;
 
  protected:
   enum Endpoint { kStart, kEnd };
@@ -1384,6 +1560,14 @@ nsHTMLCopyEncoder::EncodeToString(nsAString& aOutputString) {
   return nsDocumentEncoder::EncodeToString(aOutputString);
 }
 
+NS_IMETHODIMP
+nsHTMLCopyEncoder::EncodeToStream(nsIOutputStream* aStream) {
+  if (mIsTextWidget) {
+    mMimeType.AssignLiteral("text/plain");
+  }
+  return nsDocumentEncoder::EncodeToStream(aStream);
+}
+
 NS_IMETHODIMP
 nsHTMLCopyEncoder::EncodeToStringWithContext(nsAString& aContextString,
                                              nsAString& aInfoString,
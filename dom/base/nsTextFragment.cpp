@@ -16,6 +16,7 @@
 #include "nsMemory.h"
 #include "nsBidiUtils.h"
 #include "nsUnicharUtils.h"
+#include "mozilla/ArrayUtils.h"
 #include "mozilla/CheckedInt.h"
 #include "mozilla/MemoryReporting.h"
 #include "mozilla/SSE.h"
@@ -163,6 +164,11 @@ static inline int32_t FirstNon8BitUnvectorized(const char16_t* str,
 namespace mozilla {
 namespace SSE2 {
 int32_t FirstNon8Bit(const char16_t* str, const char16_t* end);
+int32_t FindFirstInSet(const char* str, const char* end, const char* aSet,
+                       uint32_t aSetLength, bool aInSet);
+int32_t FindFirstInSet(const char16_t* str, const char16_t* end,
+                       const char16_t* aSet, uint32_t aSetLength,
+                       bool aInSet);
 }  // namespace SSE2
 }  // namespace mozilla
 #endif
@@ -196,6 +202,24 @@ static inline int32_t FirstNon8Bit(const char16_t* str, const char16_t* end) {
   return FirstNon8BitUnvectorized(str, end);
 }
 
+/*
+ * This function returns the index of the first character in str which is one
+ * of the aSetLength characters at aSet if aInSet is true, or which isn't if
+ * aInSet is false, or -1 if there is no such character.
+ */
+template <typename CharT>
+static inline int32_t FindFirstInSet(const CharT* str, const CharT* end,
+                                     const CharT* aSet, uint32_t aSetLength,
+                                     bool aInSet) {
+#ifdef MOZILLA_MAY_SUPPORT_SSE2
+  if (aSetLength <= kMaxVectorizedSetLength && mozilla::supports_sse2()) {
+    return mozilla::SSE2::FindFirstInSet(str, end, aSet, aSetLength, aInSet);
+  }
+#endif
+
+  return FindFirstInSetUnvectorized(str, end, aSet, aSetLength, aInSet);
+}
+
 bool nsTextFragment::SetTo(const char16_t* aBuffer, int32_t aLength,
                            bool aUpdateBidi, bool aForce2b) {
   if (aForce2b && mState.mIs2b && !m2b->IsReadonly()) {
@@ -504,6 +528,50 @@ void nsTextFragment::UpdateBidiFlag(const char16_t* aBuffer, uint32_t aLength) {
   }
 }
 
+int32_t nsTextFragment::FindFirstInSet(const char16_t* aSet,
+                                       uint32_t aSetLength, uint32_t aOffset,
+                                       bool aInSet) const {
+  if (aOffset >= mState.mLength) {
+    return kNotFound;
+  }
+
+  int32_t index;
+  if (mState.mIs2b) {
+    const char16_t* text = Get2b();
+    index = ::FindFirstInSet(text + aOffset, text + mState.mLength, aSet,
+                             aSetLength, aInSet);
+  } else {
+    // Characters which don't fit in a byte can't be in 1-byte text, so leave
+    // them out of the set.
+    AutoTArray<char, kMaxVectorizedSetLength> set;
+    for (uint32_t i = 0; i < aSetLength; ++i) {
+      if (aSet[i] < 256) {
+        set.AppendElement(static_cast<char>(aSet[i]));
+      }
+    }
+    index = ::FindFirstInSet(m1b + aOffset, m1b + mState.mLength,
+                             set.Elements(), set.Length(), aInSet);
+  }
+
+  return index < 0 ? kNotFound : index + aOffset;
+}
+
+int32_t nsTextFragment::FindChar(char16_t aChar, uint32_t aOffset) const {
+  return FindFirstInSet(&aChar, 1, aOffset, true);
+}
+
+int32_t nsTextFragment::FindCharInSet(const char16_t* aSet,
+                                      uint32_t aOffset) const {
+  return FindFirstInSet(aSet, NS_strlen(aSet), aOffset, true);
+}
+
+bool nsTextFragment::IsOnlyWhitespace() const {
+  // Keep in sync with dom::IsSpaceCharacter.
+  static const char16_t kWhitespace[] = u" \t\n\r\f";
+  return FindFirstInSet(kWhitespace, ArrayLength(kWhitespace) - 1, 0,
+                        false) == kNotFound;
+}
+
 bool nsTextFragment::TextEquals(const nsTextFragment& aOther) const {
   if (!Is2b()) {
     // We're 1-byte.
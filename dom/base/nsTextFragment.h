@@ -294,9 +294,31 @@ class nsTextFragment final {
    */
   MOZ_MUST_USE bool TextEquals(const nsTextFragment& aOther) const;
 
+  /**
+   * Return the index of the first occurrence of aChar at or after aOffset,
+   * or kNotFound if there is none.
+   */
+  int32_t FindChar(char16_t aChar, uint32_t aOffset = 0) const;
+
+  /**
+   * Return the index of the first occurrence at or after aOffset of any of
+   * the characters in the null-terminated aSet, or kNotFound if there is
+   * none.
+   */
+  int32_t FindCharInSet(const char16_t* aSet, uint32_t aOffset = 0) const;
+
+  /**
+   * Return true if the fragment only contains ASCII whitespace (see
+   * dom::IsSpaceCharacter), including when it's empty.
+   */
+  bool IsOnlyWhitespace() const;
+
  private:
   void ReleaseText();
 
+  int32_t FindFirstInSet(const char16_t* aSet, uint32_t aSetLength,
+                         uint32_t aOffset, bool aInSet) const;
+
   /**
    * Scan the contents of the fragment and turn on mState.mIsBidi if it
    * includes any Bidi characters.
@@ -33,4 +33,37 @@ struct Non8BitParameters<8> {
   static inline uint32_t numUnicharsPerWord() { return 4; }
 };
 
+// The largest character sets which FindFirstInSet has vectorized versions
+// for; larger sets are searched for one character at a time.
+static const uint32_t kMaxVectorizedSetLength = 8;
+
+template <typename CharT>
+static inline bool IsInSet(CharT aChar, const CharT* aSet,
+                           uint32_t aSetLength) {
+  for (uint32_t i = 0; i < aSetLength; ++i) {
+    if (aChar == aSet[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Returns the index of the first character in [str, end) which is one of the
+ * aSetLength characters at aSet if aInSet is true, or which isn't if aInSet is
+ * false. Returns -1 if there is no such character.
+ */
+template <typename CharT>
+static inline int32_t FindFirstInSetUnvectorized(const CharT* str,
+                                                 const CharT* end,
+                                                 const CharT* aSet,
+                                                 uint32_t aSetLength,
+                                                 bool aInSet) {
+  const int32_t len = end - str;
+  for (int32_t i = 0; i < len; i++) {
+    if (IsInSet(str[i], aSet, aSetLength) == aInSet) return i;
+  }
+  return -1;
+}
+
 #endif
@@ -11,6 +11,8 @@
 #include "nscore.h"
 #include "nsAlgorithm.h"
 #include "nsTextFragmentImpl.h"
+#include "mozilla/Assertions.h"
+#include "mozilla/MathAlgorithms.h"
 #include <algorithm>
 
 namespace mozilla::SSE2 {
@@ -63,4 +65,77 @@ int32_t FirstNon8Bit(const char16_t* str, const char16_t* end) {
   return -1;
 }
 
+template <typename CharT>
+struct CharVectorOps;
+
+template <>
+struct CharVectorOps<char> {
+  static inline __m128i splat(char c) { return _mm_set1_epi8(c); }
+  static inline __m128i equal(__m128i a, __m128i b) {
+    return _mm_cmpeq_epi8(a, b);
+  }
+};
+
+template <>
+struct CharVectorOps<char16_t> {
+  static inline __m128i splat(char16_t c) {
+    return _mm_set1_epi16(static_cast<int16_t>(c));
+  }
+  static inline __m128i equal(__m128i a, __m128i b) {
+    return _mm_cmpeq_epi16(a, b);
+  }
+};
+
+template <typename CharT>
+static inline int32_t FindFirstInSetImpl(const CharT* str, const CharT* end,
+                                         const CharT* aSet,
+                                         uint32_t aSetLength, bool aInSet) {
+  typedef CharVectorOps<CharT> ops;
+  const uint32_t numCharsPerVector = sizeof(__m128i) / sizeof(CharT);
+  const int32_t len = end - str;
+  int32_t i = 0;
+
+  MOZ_ASSERT(aSetLength <= kMaxVectorizedSetLength);
+  __m128i setVects[kMaxVectorizedSetLength];
+  for (uint32_t j = 0; j < aSetLength; j++) {
+    setVects[j] = ops::splat(aSet[j]);
+  }
+  // Flips the bits of the characters in the set when we look for one which
+  // isn't.
+  const int flipMask = aInSet ? 0 : 0xffff;
+
+  // Check one XMM register (16 bytes) at a time. Unaligned loads are about
+  // as fast as aligned ones on the CPUs we care about, so we don't bother
+  // aligning first.
+  const int32_t vectWalkEnd = (len / numCharsPerVector) * numCharsPerVector;
+  for (; i < vectWalkEnd; i += numCharsPerVector) {
+    const __m128i vect =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+    __m128i matches = _mm_setzero_si128();
+    for (uint32_t j = 0; j < aSetLength; j++) {
+      matches = _mm_or_si128(matches, ops::equal(vect, setVects[j]));
+    }
+    const int bits = _mm_movemask_epi8(matches) ^ flipMask;
+    if (bits) {
+      return i + CountTrailingZeroes32(bits) / sizeof(CharT);
+    }
+  }
+
+  // Take care of the remainder one character at a time.
+  int32_t remainder =
+      FindFirstInSetUnvectorized(str + i, end, aSet, aSetLength, aInSet);
+  return remainder < 0 ? -1 : i + remainder;
+}
+
+int32_t FindFirstInSet(const char* str, const char* end, const char* aSet,
+                       uint32_t aSetLength, bool aInSet) {
+  return FindFirstInSetImpl(str, end, aSet, aSetLength, aInSet);
+}
+
+int32_t FindFirstInSet(const char16_t* str, const char16_t* end,
+                       const char16_t* aSet, uint32_t aSetLength,
+                       bool aInSet) {
+  return FindFirstInSetImpl(str, end, aSet, aSetLength, aInSet);
+}
+
 }  // namespace mozilla::SSE2
@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include "mozilla/ErrorResult.h"
+#include "mozilla/Preferences.h"
+#include "mozilla/dom/DOMParser.h"
+#include "mozilla/dom/Document.h"
+#include "mozilla/dom/Element.h"
+#include "nsAttrValue.h"
+#include "nsGkAtoms.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+namespace {
+
+static already_AddRefed<Document> ParseXML(const char* aSource) {
+  IgnoredErrorResult error;
+  RefPtr<DOMParser> parser = DOMParser::CreateWithoutGlobal(error);
+  if (NS_WARN_IF(error.Failed())) {
+    return nullptr;
+  }
+  return parser->ParseFromString(NS_ConvertASCIItoUTF16(aSource),
+                                 SupportedType::Application_xml, error);
+}
+
+static bool SharesAttrs(Element* aA, Element* aB,
+                        nsAtom* aName = nsGkAtoms::_class) {
+  return aA->GetParsedAttr(aName) == aB->GetParsedAttr(aName);
+}
+
+}  // namespace
+
+TEST(AttrArray, ParsedAttributesAreShared)
+{
+  RefPtr<Document> doc = ParseXML(
+      "<table>"
+      "<row class='item odd' role='row' aria-selected='false'/>"
+      "<row class='item odd' role='row' aria-selected='false'/>"
+      "<row class='item odd' role='row' aria-selected='false'/>"
+      "<row class='item odd' role='row' aria-selected='true'/>"
+      "<row class='item odd' role='row' aria-selected='false' id='last'/>"
+      "</table>");
+  ASSERT_TRUE(doc);
+  Element* root = doc->GetRootElement();
+  ASSERT_TRUE(root);
+  RefPtr<Element> first = root->GetFirstElementChild();
+  RefPtr<Element> second = first->GetNextElementSibling();
+  RefPtr<Element> third = second->GetNextElementSibling();
+  RefPtr<Element> selected = third->GetNextElementSibling();
+  RefPtr<Element> last = selected->GetNextElementSibling();
+
+  EXPECT_TRUE(SharesAttrs(first, second));
+  EXPECT_TRUE(SharesAttrs(first, third));
+  // Different values, and attributes which aren't shared.
+  EXPECT_FALSE(SharesAttrs(first, selected));
+  EXPECT_FALSE(SharesAttrs(first, last));
+
+  // Changing the attributes of an element gives it its own copy of them,
+  // and leaves the others alone.
+  second->SetAttr(kNameSpaceID_None, nsGkAtoms::aria_selected,
+                  NS_LITERAL_STRING("true"), true);
+  EXPECT_FALSE(SharesAttrs(first, second));
+  EXPECT_TRUE(SharesAttrs(first, third));
+  EXPECT_TRUE(second->AttrValueIs(kNameSpaceID_None, nsGkAtoms::aria_selected,
+                                  NS_LITERAL_STRING("true"), eCaseMatters));
+  EXPECT_TRUE(first->AttrValueIs(kNameSpaceID_None, nsGkAtoms::aria_selected,
+                                 NS_LITERAL_STRING("false"), eCaseMatters));
+  EXPECT_EQ(second->GetAttrCount(), 3u);
+
+  third->UnsetAttr(kNameSpaceID_None, nsGkAtoms::role, true);
+  EXPECT_FALSE(SharesAttrs(first, third));
+  EXPECT_FALSE(third->HasAttr(kNameSpaceID_None, nsGkAtoms::role));
+  EXPECT_TRUE(first->HasAttr(kNameSpaceID_None, nsGkAtoms::role));
+  EXPECT_EQ(third->GetAttrCount(), 2u);
+
+  // The last element using a block of attributes takes it over.
+  EXPECT_EQ(first->GetAttrCount(), 3u);
+  first->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                 NS_LITERAL_STRING("item even"), true);
+  EXPECT_TRUE(first->AttrValueIs(kNameSpaceID_None, nsGkAtoms::_class,
+                                 NS_LITERAL_STRING("item even"),
+                                 eCaseMatters));
+  EXPECT_EQ(first->GetAttrCount(), 3u);
+}
+
+TEST(AttrArray, ValuesWhichParseAlikeAreNotShared)
+{
+  // Doubles which are equal but were written differently.
+  RefPtr<Document> doc = ParseXML(
+      "<html xmlns='http://www.w3.org/1999/xhtml'>"
+      "<progress value='1'/>"
+      "<progress value='1.0'/>"
+      "</html>");
+  ASSERT_TRUE(doc);
+  Element* root = doc->GetRootElement();
+  ASSERT_TRUE(root);
+  RefPtr<Element> first = root->GetFirstElementChild();
+  RefPtr<Element> second = first->GetNextElementSibling();
+  ASSERT_TRUE(second);
+  ASSERT_TRUE(second->IsHTMLElement(nsGkAtoms::progress));
+  EXPECT_FALSE(SharesAttrs(first, second, nsGkAtoms::value));
+  nsAutoString value;
+  second->GetAttr(kNameSpaceID_None, nsGkAtoms::value, value);
+  EXPECT_TRUE(value.EqualsLiteral("1.0"));
+
+  // Part mappings, which can't be compared at all.
+  Preferences::SetBool("layout.css.shadow-parts.enabled", true);
+  doc = ParseXML(
+      "<html xmlns='http://www.w3.org/1999/xhtml'>"
+      "<div exportparts='a:b, c'/>"
+      "<div exportparts='a:b, c'/>"
+      "</html>");
+  Preferences::ClearUser("layout.css.shadow-parts.enabled");
+  ASSERT_TRUE(doc);
+  root = doc->GetRootElement();
+  ASSERT_TRUE(root);
+  first = root->GetFirstElementChild();
+  second = first->GetNextElementSibling();
+  ASSERT_TRUE(second);
+  EXPECT_FALSE(SharesAttrs(first, second, nsGkAtoms::exportparts));
+  EXPECT_TRUE(second->AttrValueIs(kNameSpaceID_None, nsGkAtoms::exportparts,
+                                  NS_LITERAL_STRING("a:b, c"), eCaseMatters));
+}
@@ -0,0 +1,270 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/ErrorResult.h"
+#include "mozilla/NullPrincipal.h"
+#include "mozilla/dom/Document.h"
+#include "mozilla/dom/Element.h"
+#include "nsAttrValue.h"
+#include "nsContentList.h"
+#include "nsGkAtoms.h"
+#include "nsIHTMLCollection.h"
+#include "nsNetUtil.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+namespace {
+
+static already_AddRefed<Document> CreateDocument() {
+  nsCOMPtr<nsIURI> uri;
+  NS_NewURI(getter_AddRefs(uri), "about:blank");
+  nsCOMPtr<nsIPrincipal> principal =
+      NullPrincipal::CreateWithoutOriginAttributes();
+  nsCOMPtr<Document> document;
+  nsresult rv = NS_NewDOMDocument(getter_AddRefs(document),
+                                  EmptyString(),  // aNamespaceURI
+                                  EmptyString(),  // aQualifiedName
+                                  nullptr,        // aDoctype
+                                  uri, uri, principal,
+                                  false,    // aLoadedAsData
+                                  nullptr,  // aEventObject
+                                  DocumentFlavorHTML);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return nullptr;
+  }
+  return document.forget();
+}
+
+static already_AddRefed<Element> AppendElement(nsINode* aParent, nsAtom* aTag,
+                                               const char* aClass) {
+  RefPtr<Element> element = aParent->OwnerDoc()->CreateHTMLElement(aTag);
+  if (aClass) {
+    element->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                     NS_ConvertASCIItoUTF16(aClass), false);
+  }
+  IgnoredErrorResult error;
+  aParent->AppendChild(*element, error);
+  return element.forget();
+}
+
+// Appends aSectionCount divs to the body of aDocument with aItemCount
+// children each.  Every child has the "item" class, every 50th is a p and
+// the others are spans, and every 100th is also "selected".
+static void CreateSections(Document* aDocument, uint32_t aSectionCount,
+                           uint32_t aItemCount) {
+  RefPtr<Element> html = AppendElement(aDocument, nsGkAtoms::html, nullptr);
+  RefPtr<Element> body = AppendElement(html, nsGkAtoms::body, nullptr);
+  uint32_t item = 0;
+  for (uint32_t i = 0; i < aSectionCount; ++i) {
+    RefPtr<Element> section = AppendElement(body, nsGkAtoms::div, "section");
+    for (uint32_t j = 0; j < aItemCount; ++j, ++item) {
+      RefPtr<Element> child = AppendElement(
+          section, item % 50 ? nsGkAtoms::span : nsGkAtoms::p,
+          item % 100 ? "item" : "item selected");
+    }
+  }
+}
+
+static bool HasClass(Element* aElement, nsAtom* aClass) {
+  const nsAttrValue* classes = aElement->GetClasses();
+  return classes && classes->Contains(aClass, eCaseMatters);
+}
+
+// Checks that aList has the elements below aRoot which aMatch returns true
+// for, in tree order.
+template <typename Func>
+static void ExpectListContents(nsIHTMLCollection* aList, nsINode* aRoot,
+                               Func aMatch) {
+  uint32_t length = aList->Length();
+  uint32_t index = 0;
+  for (nsINode* cur = aRoot->GetFirstChild(); cur;
+       cur = cur->GetNextNode(aRoot)) {
+    if (cur->IsElement() && aMatch(cur->AsElement())) {
+      ASSERT_LT(index, length);
+      EXPECT_EQ(aList->Item(index), cur->AsElement());
+      ++index;
+    }
+  }
+  EXPECT_EQ(index, length);
+}
+
+}  // namespace
+
+TEST(ContentList, LiveListsFollowMutations)
+{
+  RefPtr<Document> doc = CreateDocument();
+  ASSERT_TRUE(doc);
+  CreateSections(doc, 10, 100);
+
+  RefPtr<Element> body = doc->GetBody();
+  RefPtr<Element> section = body->GetFirstElementChild();
+  RefPtr<Element> otherSection = section->GetNextElementSibling();
+
+  RefPtr<nsIHTMLCollection> selected =
+      doc->GetElementsByClassName(NS_LITERAL_STRING("selected"));
+  RefPtr<nsIHTMLCollection> items =
+      doc->GetElementsByClassName(NS_LITERAL_STRING("item"));
+  RefPtr<nsIHTMLCollection> selectedItems =
+      doc->GetElementsByClassName(NS_LITERAL_STRING("selected item"));
+  RefPtr<nsIHTMLCollection> paragraphs =
+      doc->GetElementsByTagName(NS_LITERAL_STRING("P"));
+  RefPtr<nsIHTMLCollection> selectedInSection =
+      otherSection->GetElementsByClassName(NS_LITERAL_STRING("selected"));
+
+  RefPtr<nsAtom> itemClass = NS_Atomize("item");
+  auto isSelected = [](Element* aElement) {
+    return HasClass(aElement, nsGkAtoms::selected);
+  };
+  auto isItem = [&](Element* aElement) {
+    return HasClass(aElement, itemClass);
+  };
+  auto isSelectedItem = [&](Element* aElement) {
+    return isSelected(aElement) && isItem(aElement);
+  };
+  auto isParagraph = [](Element* aElement) {
+    return aElement->IsHTMLElement(nsGkAtoms::p);
+  };
+  auto checkAll = [&]() {
+    ExpectListContents(selected, doc, isSelected);
+    ExpectListContents(items, doc, isItem);
+    ExpectListContents(selectedItems, doc, isSelectedItem);
+    ExpectListContents(paragraphs, doc, isParagraph);
+    ExpectListContents(selectedInSection, otherSection, isSelected);
+  };
+  checkAll();
+  EXPECT_EQ(selected->Length(), 10u);
+  EXPECT_EQ(paragraphs->Length(), 20u);
+
+  // Insertions and removals of unrelated and matching elements.
+  RefPtr<Element> unrelated = AppendElement(section, nsGkAtoms::span, "other");
+  checkAll();
+  RefPtr<Element> inserted =
+      AppendElement(otherSection, nsGkAtoms::p, "item selected");
+  checkAll();
+  IgnoredErrorResult error;
+  section->InsertBefore(*inserted, section->GetFirstChild(), error);
+  ASSERT_FALSE(error.Failed());
+  checkAll();
+
+  // Class changes, including ones which keep or drop some of the classes.
+  RefPtr<Element> item = otherSection->GetLastElementChild();
+  item->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                NS_LITERAL_STRING("selected item"), true);
+  checkAll();
+  item->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                NS_LITERAL_STRING("item other"), true);
+  checkAll();
+  inserted->UnsetAttr(kNameSpaceID_None, nsGkAtoms::_class, true);
+  checkAll();
+  unrelated->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                     NS_LITERAL_STRING("selected selected"), true);
+  checkAll();
+
+  // Changes which keep the first class of "selected item" and toggle the
+  // second one.
+  RefPtr<Element> toggled = AppendElement(section, nsGkAtoms::span, "selected");
+  checkAll();
+  toggled->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                   NS_LITERAL_STRING("selected item"), true);
+  checkAll();
+  toggled->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                   NS_LITERAL_STRING("selected other"), true);
+  checkAll();
+  toggled->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                   NS_LITERAL_STRING("item selected"), true);
+  checkAll();
+  toggled->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                   NS_LITERAL_STRING("item"), true);
+  checkAll();
+
+  // Removing a subtree, and mutating it while it's out of the document.
+  body->RemoveChild(*otherSection, error);
+  ASSERT_FALSE(error.Failed());
+  checkAll();
+  RefPtr<Element> outside =
+      AppendElement(otherSection, nsGkAtoms::p, "selected");
+  otherSection->GetFirstElementChild()->SetAttr(
+      kNameSpaceID_None, nsGkAtoms::_class, NS_LITERAL_STRING("selected"),
+      true);
+  checkAll();
+  body->AppendChild(*otherSection, error);
+  ASSERT_FALSE(error.Failed());
+  checkAll();
+
+  // Lists which come and go while others use the same keys.
+  RefPtr<nsIHTMLCollection> moreSelected =
+      body->GetElementsByClassName(NS_LITERAL_STRING("selected"));
+  ExpectListContents(moreSelected, body, isSelected);
+  moreSelected = nullptr;
+  RefPtr<Element> last = AppendElement(body, nsGkAtoms::p, "selected");
+  checkAll();
+}
+
+TEST(ContentList, QuirksModeClassLists)
+{
+  RefPtr<Document> doc = CreateDocument();
+  ASSERT_TRUE(doc);
+  doc->SetCompatibilityMode(eCompatibility_NavQuirks);
+  CreateSections(doc, 2, 100);
+
+  // Class names match case-insensitively in quirks mode.
+  RefPtr<nsIHTMLCollection> selected =
+      doc->GetElementsByClassName(NS_LITERAL_STRING("SELECTED"));
+  EXPECT_EQ(selected->Length(), 2u);
+  RefPtr<Element> element =
+      AppendElement(doc->GetBody(), nsGkAtoms::div, "Selected");
+  EXPECT_EQ(selected->Length(), 3u);
+  EXPECT_EQ(selected->Item(2), element);
+}
+
+// Mutations of a document with about 100k elements while a page holds live
+// collections of its elements.  Most mutations don't affect most of the
+// collections.
+MOZ_GTEST_BENCH(ContentList, MutateLargeDocument, [] {
+  const uint32_t kSectionCount = 1000;
+  const uint32_t kItemCount = 100;
+  const uint32_t kMutationCount = 10000;
+
+  RefPtr<Document> doc = CreateDocument();
+  ASSERT_TRUE(doc);
+  CreateSections(doc, kSectionCount, kItemCount);
+  RefPtr<Element> body = doc->GetBody();
+
+  RefPtr<nsIHTMLCollection> lists[] = {
+      doc->GetElementsByClassName(NS_LITERAL_STRING("selected")),
+      doc->GetElementsByClassName(NS_LITERAL_STRING("item")),
+      doc->GetElementsByTagName(NS_LITERAL_STRING("p")),
+      doc->GetElementsByTagName(NS_LITERAL_STRING("span")),
+  };
+
+  IgnoredErrorResult error;
+  RefPtr<Element> section = body->GetFirstElementChild();
+  for (uint32_t i = 0; i < kMutationCount; ++i) {
+    // Add and remove a node which no list matches, change a class no list
+    // matches, and every so often select another item.
+    RefPtr<Element> child = AppendElement(section, nsGkAtoms::div, nullptr);
+    section->RemoveChild(*child, error);
+    Element* item = section->GetLastElementChild();
+    item->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                  NS_LITERAL_STRING("item hover"), true);
+    if (i % 10 == 0) {
+      item->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                    NS_LITERAL_STRING("item selected"), true);
+    }
+    section = section->GetNextElementSibling();
+    if (!section) {
+      section = body->GetFirstElementChild();
+    }
+
+    for (const RefPtr<nsIHTMLCollection>& list : lists) {
+      ASSERT_NE(list->Length(), 0u);
+    }
+  }
+});
@@ -0,0 +1,215 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/ErrorResult.h"
+#include "mozilla/NullPrincipal.h"
+#include "mozilla/dom/Document.h"
+#include "mozilla/dom/Element.h"
+#include "nsGkAtoms.h"
+#include "nsIDocumentEncoder.h"
+#include "nsIOutputStream.h"
+#include "nsNetUtil.h"
+#include "nsTextNode.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+namespace {
+
+class StringOutputStream final : public nsIOutputStream {
+ public:
+  NS_DECL_THREADSAFE_ISUPPORTS
+  NS_DECL_NSIOUTPUTSTREAM
+
+  explicit StringOutputStream(nsresult aWriteResult = NS_OK)
+      : mWriteCount(0), mLargestWrite(0), mWriteResult(aWriteResult) {}
+
+  nsCString mData;
+  // How the data arrived, to tell streaming from writing it all at once.
+  uint32_t mWriteCount;
+  uint32_t mLargestWrite;
+
+ private:
+  ~StringOutputStream() = default;
+
+  const nsresult mWriteResult;
+};
+
+NS_IMPL_ISUPPORTS(StringOutputStream, nsIOutputStream)
+
+NS_IMETHODIMP
+StringOutputStream::Close() { return NS_OK; }
+
+NS_IMETHODIMP
+StringOutputStream::Flush() { return NS_OK; }
+
+NS_IMETHODIMP
+StringOutputStream::Write(const char* aBuf, uint32_t aCount,
+                          uint32_t* aResult) {
+  if (NS_FAILED(mWriteResult)) {
+    return mWriteResult;
+  }
+  mData.Append(aBuf, aCount);
+  ++mWriteCount;
+  mLargestWrite = std::max(mLargestWrite, aCount);
+  *aResult = aCount;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+StringOutputStream::WriteFrom(nsIInputStream* aFromStream, uint32_t aCount,
+                              uint32_t* aResult) {
+  return NS_ERROR_NOT_IMPLEMENTED;
+}
+
+NS_IMETHODIMP
+StringOutputStream::WriteSegments(nsReadSegmentFun aReader, void* aClosure,
+                                  uint32_t aCount, uint32_t* aResult) {
+  return NS_ERROR_NOT_IMPLEMENTED;
+}
+
+NS_IMETHODIMP
+StringOutputStream::IsNonBlocking(bool* aNonBlocking) {
+  *aNonBlocking = false;
+  return NS_OK;
+}
+
+// Creates a document with aRowCount divs of text in its body, like a long
+// report.
+static already_AddRefed<Document> CreateReport(uint32_t aRowCount) {
+  nsCOMPtr<nsIURI> uri;
+  NS_NewURI(getter_AddRefs(uri), "about:blank");
+  nsCOMPtr<nsIPrincipal> principal =
+      NullPrincipal::CreateWithoutOriginAttributes();
+  nsCOMPtr<Document> document;
+  nsresult rv = NS_NewDOMDocument(getter_AddRefs(document),
+                                  EmptyString(),  // aNamespaceURI
+                                  EmptyString(),  // aQualifiedName
+                                  nullptr,        // aDoctype
+                                  uri, uri, principal,
+                                  false,    // aLoadedAsData
+                                  nullptr,  // aEventObject
+                                  DocumentFlavorHTML);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return nullptr;
+  }
+
+  IgnoredErrorResult error;
+  RefPtr<Element> html = document->CreateHTMLElement(nsGkAtoms::html);
+  document->AppendChild(*html, error);
+  RefPtr<Element> body = document->CreateHTMLElement(nsGkAtoms::body);
+  html->AppendChild(*body, error);
+  for (uint32_t i = 0; i < aRowCount; ++i) {
+    RefPtr<Element> row = document->CreateHTMLElement(nsGkAtoms::div);
+    row->SetAttr(kNameSpaceID_None, nsGkAtoms::_class,
+                 NS_LITERAL_STRING("row"), false);
+    nsAutoString text;
+    text.AppendLiteral("Row ");
+    text.AppendInt(i);
+    text.AppendLiteral(u" \u00e9t\u00e9 & <done>");
+    RefPtr<nsTextNode> textNode = document->CreateTextNode(text);
+    row->AppendChild(*textNode, error);
+    body->AppendChild(*row, error);
+  }
+  if (NS_WARN_IF(error.Failed())) {
+    return nullptr;
+  }
+  return document.forget();
+}
+
+static already_AddRefed<nsIDocumentEncoder> CreateEncoder(Document* aDocument,
+                                                          uint32_t aFlags) {
+  nsCOMPtr<nsIDocumentEncoder> encoder =
+      do_createDocumentEncoder("application/xhtml+xml");
+  if (!encoder ||
+      NS_FAILED(encoder->NativeInit(
+          aDocument, NS_LITERAL_STRING("application/xhtml+xml"),
+          nsIDocumentEncoder::OutputRaw | aFlags)) ||
+      NS_FAILED(encoder->SetCharset(NS_LITERAL_CSTRING("UTF-8")))) {
+    return nullptr;
+  }
+  return encoder.forget();
+}
+
+static void EncodeToStream(Document* aDocument, uint32_t aFlags,
+                           StringOutputStream* aStream) {
+  nsCOMPtr<nsIDocumentEncoder> encoder = CreateEncoder(aDocument, aFlags);
+  ASSERT_TRUE(encoder);
+  ASSERT_EQ(encoder->EncodeToStream(aStream), NS_OK);
+}
+
+}  // namespace
+
+TEST(DocumentEncoder, StreamMatchesString)
+{
+  RefPtr<Document> doc = CreateReport(5000);
+  ASSERT_TRUE(doc);
+
+  nsCOMPtr<nsIDocumentEncoder> encoder = CreateEncoder(doc, 0);
+  ASSERT_TRUE(encoder);
+  nsAutoString expected;
+  ASSERT_EQ(encoder->EncodeToString(expected), NS_OK);
+  ASSERT_NE(expected.Find(NS_LITERAL_STRING("Row 4999 ")), kNotFound);
+
+  for (uint32_t flags : {0u, nsIDocumentEncoder::OutputEncodeOffMainThread}) {
+    RefPtr<StringOutputStream> stream = new StringOutputStream();
+    EncodeToStream(doc, flags, stream);
+    EXPECT_TRUE(NS_ConvertUTF8toUTF16(stream->mData).Equals(expected));
+  }
+}
+
+TEST(DocumentEncoder, StreamIsWrittenInChunks)
+{
+  // About 10MB of output, which must not be built up and written at once.
+  RefPtr<Document> doc = CreateReport(250000);
+  ASSERT_TRUE(doc);
+
+  for (uint32_t flags : {0u, nsIDocumentEncoder::OutputEncodeOffMainThread}) {
+    RefPtr<StringOutputStream> stream = new StringOutputStream();
+    EncodeToStream(doc, flags, stream);
+    uint32_t length = stream->mData.Length();
+    EXPECT_GT(length, 10000000u);
+    EXPECT_GT(stream->mWriteCount, 10u);
+    EXPECT_LT(stream->mLargestWrite, length / 10);
+  }
+}
+
+TEST(DocumentEncoder, StreamErrors)
+{
+  RefPtr<Document> doc = CreateReport(5000);
+  ASSERT_TRUE(doc);
+
+  for (uint32_t flags : {0u, nsIDocumentEncoder::OutputEncodeOffMainThread}) {
+    nsCOMPtr<nsIDocumentEncoder> encoder = CreateEncoder(doc, flags);
+    ASSERT_TRUE(encoder);
+    RefPtr<StringOutputStream> stream =
+        new StringOutputStream(NS_BASE_STREAM_CLOSED);
+    EXPECT_EQ(encoder->EncodeToStream(stream), NS_BASE_STREAM_CLOSED);
+  }
+}
+
+// Exports a report of about 10MB, on the main thread or writing it from a
+// background thread.
+MOZ_GTEST_BENCH(DocumentEncoder, EncodeLargeDocumentToStream, [] {
+  RefPtr<Document> doc = CreateReport(250000);
+  ASSERT_TRUE(doc);
+  RefPtr<StringOutputStream> stream = new StringOutputStream();
+  EncodeToStream(doc, 0, stream);
+  EXPECT_GT(stream->mData.Length(), 10000000u);
+});
+
+MOZ_GTEST_BENCH(DocumentEncoder, EncodeLargeDocumentToStreamOffMainThread, [] {
+  RefPtr<Document> doc = CreateReport(250000);
+  ASSERT_TRUE(doc);
+  RefPtr<StringOutputStream> stream = new StringOutputStream();
+  EncodeToStream(doc, nsIDocumentEncoder::OutputEncodeOffMainThread, stream);
+  EXPECT_GT(stream->mData.Length(), 10000000u);
+});
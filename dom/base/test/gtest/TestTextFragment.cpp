@@ -0,0 +1,175 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/ErrorResult.h"
+#include "mozilla/NullPrincipal.h"
+#include "mozilla/dom/Document.h"
+#include "mozilla/dom/Element.h"
+#include "nsContentUtils.h"
+#include "nsGkAtoms.h"
+#include "nsNetUtil.h"
+#include "nsTextFragment.h"
+#include "nsTextNode.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+namespace {
+
+static void SetFragment(nsTextFragment& aFragment, const nsAString& aText,
+                        bool aForce2b) {
+  ASSERT_TRUE(aFragment.SetTo(aText.BeginReading(), aText.Length(), false,
+                              aForce2b));
+  ASSERT_EQ(aFragment.Is2b(), aForce2b);
+}
+
+static already_AddRefed<Document> CreateDocument() {
+  nsCOMPtr<nsIURI> uri;
+  NS_NewURI(getter_AddRefs(uri), "about:blank");
+  nsCOMPtr<nsIPrincipal> principal =
+      NullPrincipal::CreateWithoutOriginAttributes();
+  nsCOMPtr<Document> document;
+  nsresult rv = NS_NewDOMDocument(getter_AddRefs(document),
+                                  EmptyString(),  // aNamespaceURI
+                                  EmptyString(),  // aQualifiedName
+                                  nullptr,        // aDoctype
+                                  uri, uri, principal,
+                                  false,    // aLoadedAsData
+                                  nullptr,  // aEventObject
+                                  DocumentFlavorHTML);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return nullptr;
+  }
+  return document.forget();
+}
+
+}  // namespace
+
+TEST(TextFragment, FindChar)
+{
+  // Cover the vectorized loops and the remainders for both storage widths,
+  // with the character in every position.
+  for (bool force2b : {false, true}) {
+    for (uint32_t length = 1; length < 70; ++length) {
+      for (uint32_t pos = 0; pos < length; ++pos) {
+        nsAutoString text;
+        for (uint32_t i = 0; i < length; ++i) {
+          text.Append(i == pos ? char16_t('&') : char16_t('a' + i % 26));
+        }
+        nsTextFragment fragment;
+        SetFragment(fragment, text, force2b);
+        EXPECT_EQ(fragment.FindChar('&'), int32_t(pos));
+        EXPECT_EQ(fragment.FindChar('&', pos), int32_t(pos));
+        EXPECT_EQ(fragment.FindChar('&', pos + 1), kNotFound);
+        EXPECT_EQ(fragment.FindChar('<'), kNotFound);
+        EXPECT_EQ(fragment.FindCharInSet(u"<>&"), int32_t(pos));
+        EXPECT_EQ(fragment.FindCharInSet(u"<>"), kNotFound);
+      }
+    }
+  }
+
+  nsTextFragment fragment;
+  SetFragment(fragment, NS_LITERAL_STRING(u"café & crème"), false);
+  EXPECT_EQ(fragment.FindChar(0xe8), 9);
+  EXPECT_EQ(fragment.FindCharInSet(u" é"), 3);
+  // Characters which don't fit in a byte are never in 1-byte text, even if
+  // their low byte is.
+  EXPECT_EQ(fragment.FindChar(0x1e9), kNotFound);
+  EXPECT_EQ(fragment.FindChar('c', 100), kNotFound);
+
+  SetFragment(fragment, NS_LITERAL_STRING(u"… café ā"), true);
+  EXPECT_EQ(fragment.FindChar(0x101), 7);
+  EXPECT_EQ(fragment.FindChar(0xe9), 5);
+  EXPECT_EQ(fragment.FindChar(0x1e9), kNotFound);
+}
+
+TEST(TextFragment, IsOnlyWhitespace)
+{
+  nsTextFragment fragment;
+  EXPECT_TRUE(fragment.IsOnlyWhitespace());
+
+  for (bool force2b : {false, true}) {
+    for (uint32_t length = 1; length < 70; ++length) {
+      nsAutoString text;
+      for (uint32_t i = 0; i < length; ++i) {
+        text.Append(u" \t\n\r\f"[i % 5]);
+      }
+      SetFragment(fragment, text, force2b);
+      EXPECT_TRUE(fragment.IsOnlyWhitespace());
+
+      for (char16_t other : {u'x', u'\v', char16_t(0xa0)}) {
+        nsAutoString withOther(text);
+        withOther.SetCharAt(other, length - 1);
+        SetFragment(fragment, withOther, force2b);
+        EXPECT_FALSE(fragment.IsOnlyWhitespace());
+      }
+    }
+  }
+}
+
+// Builds a document with about 10 million characters of text in paragraphs,
+// with a mix of 1-byte and 2-byte text and whitespace between the paragraphs,
+// and then looks at the text the way layout and serialization do.
+MOZ_GTEST_BENCH(TextFragment, TextHeavyDocument, [] {
+  const uint32_t kParagraphCount = 10000;
+  const uint32_t kSentenceCount = 10;
+
+  RefPtr<Document> doc = CreateDocument();
+  ASSERT_TRUE(doc);
+  IgnoredErrorResult error;
+  RefPtr<Element> html = doc->CreateHTMLElement(nsGkAtoms::html);
+  doc->AppendChild(*html, error);
+  RefPtr<Element> body = doc->CreateHTMLElement(nsGkAtoms::body);
+  html->AppendChild(*body, error);
+
+  for (uint32_t i = 0; i < kParagraphCount; ++i) {
+    RefPtr<nsTextNode> space =
+        doc->CreateTextNode(NS_LITERAL_STRING("\n    \n    "));
+    body->AppendChild(*space, error);
+    RefPtr<Element> p = doc->CreateHTMLElement(nsGkAtoms::p);
+    RefPtr<nsTextNode> text = doc->CreateTextNode(EmptyString());
+    // Text gets appended in chunks, as when it arrives from the network.
+    for (uint32_t j = 0; j < kSentenceCount; ++j) {
+      text->AppendData(
+          i % 10 ? NS_LITERAL_STRING(
+                       "The quick brown fox jumps over the lazy dog, again "
+                       "and again, until it gets tired of jumping. ")
+                 : NS_LITERAL_STRING(
+                       u"Le renard brun rapide saute par-dessus le chien "
+                       u"paresseux — encore et encore. "),
+          error);
+    }
+    p->AppendChild(*text, error);
+    body->AppendChild(*p, error);
+  }
+  ASSERT_FALSE(error.Failed());
+
+  uint32_t whitespaceCount = 0;
+  uint32_t periodCount = 0;
+  for (nsIContent* cur = body->GetFirstChild(); cur;
+       cur = cur->GetNextNode(body)) {
+    if (!cur->IsText()) {
+      continue;
+    }
+    if (cur->ThreadSafeTextIsOnlyWhitespace()) {
+      ++whitespaceCount;
+    }
+    const nsTextFragment* fragment = cur->GetText();
+    for (int32_t offset = fragment->FindChar('.'); offset != kNotFound;
+         offset = fragment->FindChar('.', offset + 1)) {
+      ++periodCount;
+    }
+  }
+  EXPECT_EQ(whitespaceCount, kParagraphCount);
+  EXPECT_EQ(periodCount, kParagraphCount * kSentenceCount);
+
+  nsAutoString markup;
+  ASSERT_TRUE(nsContentUtils::SerializeNodeToMarkup(body, true, markup));
+  EXPECT_GT(markup.Length(), 2000000u);
+});
@@ -59,6 +59,7 @@
 #include "mozilla/MouseEvents.h"
 #include "mozilla/Telemetry.h"
 #include "mozilla/TextEvents.h"
+#include "mozilla/ThreadLocal.h"
 #include "mozilla/TouchEvents.h"
 #include "mozilla/Unused.h"
 
@@ -91,8 +92,6 @@ class ELMCreationDetector {
            mInitialCount != EventListenerManager::sMainThreadCreatedCount;
   }
 
-  bool IsMainThread() { return !mNonMainThread; }
-
  private:
   bool mNonMainThread;
   uint32_t mInitialCount;
@@ -344,7 +343,10 @@ class EventTargetChainItem {
       }
       mManager = mTarget->GetExistingListenerManager();
     }
-    if (mManager) {
+    // Skip the manager if it knows it has no listeners for this type of
+    // event. This is checked again for every phase, since listeners may be
+    // added while the event is being dispatched.
+    if (mManager && mManager->MayHaveListenersFor(aVisitor.mEvent)) {
       NS_ASSERTION(aVisitor.mEvent->mCurrentTarget == nullptr,
                    "CurrentTarget should be null!");
 
@@ -645,14 +647,88 @@ void EventTargetChainItem::HandleEventTargetChain(
   }
 }
 
-static nsTArray<EventTargetChainItem>* sCachedMainThreadChain = nullptr;
+// Keeps the storage of event target chains around, so that dispatching an
+// event doesn't normally allocate. There is one pool per thread with a JS
+// context, holding a few chains since listeners may dispatch events too.
+class EventTargetChainPool final {
+ public:
+  EventTargetChainPool() { mChains.SetCapacity(kMaxPooledChains); }
+
+  void Take(nsTArray<EventTargetChainItem>& aChain) {
+    if (mChains.IsEmpty()) {
+      aChain.SetCapacity(kInitialChainCapacity);
+      return;
+    }
+    aChain.SwapElements(mChains.LastElement());
+    mChains.RemoveLastElement();
+  }
+
+  void Return(nsTArray<EventTargetChainItem>& aChain) {
+    // Don't hold on to the storage of unusually long chains.
+    if (aChain.Capacity() > kMaxChainCapacity) {
+      return;
+    }
+    // Releasing the items may end up dispatching events, and returning their
+    // chains, so check whether there is room only afterwards.
+    aChain.ClearAndRetainStorage();
+    if (mChains.Length() < kMaxPooledChains) {
+      mChains.AppendElement()->SwapElements(aChain);
+    }
+  }
+
+ private:
+  static const uint32_t kMaxPooledChains = 4;
+  static const uint32_t kInitialChainCapacity = 128;
+  static const uint32_t kMaxChainCapacity = 512;
+
+  nsTArray<nsTArray<EventTargetChainItem>> mChains;
+};
+
+static MOZ_THREAD_LOCAL(EventTargetChainPool*) sChainPool;
+
+// Gives aChain storage from the current thread's pool for the duration of a
+// dispatch, and puts it back, emptied, afterwards.
+class MOZ_RAII AutoReuseChainStorage final {
+ public:
+  explicit AutoReuseChainStorage(nsTArray<EventTargetChainItem>& aChain)
+      : mChain(aChain),
+        mPool(sChainPool.initialized() ? sChainPool.get() : nullptr) {
+    if (mPool) {
+      mPool->Take(mChain);
+    }
+  }
+
+  ~AutoReuseChainStorage() {
+    if (mPool) {
+      mPool->Return(mChain);
+    }
+  }
+
+ private:
+  nsTArray<EventTargetChainItem>& mChain;
+  EventTargetChainPool* mPool;
+};
+
+/* static */
+void EventDispatcher::InitThread() {
+  if (!sChainPool.init()) {
+    MOZ_CRASH();
+  }
+  MOZ_ASSERT(!sChainPool.get());
+  sChainPool.set(new EventTargetChainPool());
+}
 
 /* static */
-void EventDispatcher::Shutdown() {
-  delete sCachedMainThreadChain;
-  sCachedMainThreadChain = nullptr;
+void EventDispatcher::ShutdownThread() {
+  if (sChainPool.initialized()) {
+    delete sChainPool.get();
+    sChainPool.set(nullptr);
+  }
 }
 
+/* static */
+void EventDispatcher::Shutdown() { ShutdownThread(); }
+
 EventTargetChainItem* EventTargetChainItemForChromeTarget(
     nsTArray<EventTargetChainItem>& aChain, nsINode* aNode,
     EventTargetChainItem* aChild = nullptr) {
@@ -847,13 +923,7 @@ nsresult EventDispatcher::Dispatch(nsISupports* aTarget,
 
   ELMCreationDetector cd;
   nsTArray<EventTargetChainItem> chain;
-  if (cd.IsMainThread()) {
-    if (!sCachedMainThreadChain) {
-      sCachedMainThreadChain = new nsTArray<EventTargetChainItem>();
-    }
-    chain.SwapElements(*sCachedMainThreadChain);
-    chain.SetCapacity(128);
-  }
+  AutoReuseChainStorage reuseChainStorage(chain);
 
   // Create the event target chain item for the event target.
   EventTargetChainItem* targetEtci = EventTargetChainItem::Create(
@@ -1116,11 +1186,6 @@ nsresult EventDispatcher::Dispatch(nsISupports* aTarget,
     *aEventStatus = preVisitor.mEventStatus;
   }
 
-  if (cd.IsMainThread() && chain.Capacity() == 128 && sCachedMainThreadChain) {
-    chain.ClearAndRetainStorage();
-    chain.SwapElements(*sCachedMainThreadChain);
-  }
-
   return rv;
 }
 
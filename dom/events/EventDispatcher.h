@@ -379,6 +379,13 @@ class EventDispatcher {
   static void GetComposedPathFor(WidgetEvent* aEvent,
                                  nsTArray<RefPtr<dom::EventTarget>>& aPath);
 
+  /**
+   * Called on each thread which gets a JS context, when it is created and
+   * destroyed, to set up and free the storage reused for event target chains.
+   */
+  static void InitThread();
+  static void ShutdownThread();
+
   /**
    * Called at shutting down.
    */
@@ -110,7 +110,8 @@ EventListenerManagerBase::EventListenerManagerBase()
       mClearingListeners(false),
       mIsMainThreadELM(NS_IsMainThread()),
       mHasNonPrivilegedClickListeners(false),
-      mUnknownNonPrivilegedClickListeners(false) {
+      mUnknownNonPrivilegedClickListeners(false),
+      mListenerTypeIndexStale(false) {
   static_assert(sizeof(EventListenerManagerBase) == sizeof(uint32_t),
                 "Keep the size of EventListenerManagerBase size compact!");
 }
@@ -144,6 +145,7 @@ void EventListenerManager::RemoveAllListenersSilently() {
   }
   mClearingListeners = true;
   mListeners.Clear();
+  mListenerTypeIndex = nullptr;
   mClearingListeners = false;
 }
 
@@ -253,6 +255,10 @@ void EventListenerManager::AddEventListenerInternal(
   }
   listener->mListener = std::move(aListenerHolder);
 
+  if (mListenerTypeIndex && !mListenerTypeIndexStale) {
+    mListenerTypeIndex->Add(*listener);
+  }
+
   if (aFlags.mInSystemGroup) {
     mMayHaveSystemGroupListeners = true;
   }
@@ -564,6 +570,7 @@ void EventListenerManager::NotifyEventListenerRemoved(nsAtom* aUserType) {
   // and NotifyAboutMainThreadListenerChange should be changed too.
   mNoListenerForEvent = eVoidEvent;
   mNoListenerForEventAtom = nullptr;
+  mListenerTypeIndexStale = true;
   if (mTarget) {
     mTarget->EventListenerRemoved(aUserType);
   }
@@ -623,6 +630,54 @@ bool EventListenerManager::HasNonPrivilegedClickListeners() {
   return mHasNonPrivilegedClickListeners;
 }
 
+void EventListenerManager::ListenerTypeIndex::Add(const Listener& aListener) {
+  if (aListener.mListenerType == Listener::eNoListener) {
+    return;
+  }
+  if (aListener.mAllEvents) {
+    mHasAllEventsListener = true;
+    return;
+  }
+  mMessages[aListener.mEventMessage / 32] |=
+      1u << (aListener.mEventMessage % 32);
+  if (aListener.mTypeAtom) {
+    mTypeAtoms.PutEntry(aListener.mTypeAtom);
+  }
+}
+
+void EventListenerManager::RebuildListenerTypeIndex() {
+  mListenerTypeIndex = MakeUnique<ListenerTypeIndex>();
+  mListenerTypeIndexStale = false;
+
+  nsAutoTObserverArray<Listener, 2>::ForwardIterator iter(mListeners);
+  while (iter.HasMore()) {
+    mListenerTypeIndex->Add(iter.GetNext());
+  }
+}
+
+bool EventListenerManager::MayHaveListenersForInternal(
+    const WidgetEvent* aEvent) {
+  if (!mListenerTypeIndex || mListenerTypeIndexStale) {
+    RebuildListenerTypeIndex();
+  }
+
+  // This must agree with ListenerCanHandle() and the legacy event fallback in
+  // HandleEventInternal().
+  if (mListenerTypeIndex->mHasAllEventsListener) {
+    return true;
+  }
+  if (aEvent->mMessage == eUnidentifiedEvent) {
+    return mListenerTypeIndex->mTypeAtoms.Contains(
+        aEvent->mSpecifiedEventType);
+  }
+  if (mListenerTypeIndex->HasMessage(aEvent->mMessage)) {
+    return true;
+  }
+  EventMessage legacyEventMessage = GetLegacyEventMessage(aEvent->mMessage);
+  return legacyEventMessage != aEvent->mMessage && aEvent->IsTrusted() &&
+         mListenerTypeIndex->HasMessage(legacyEventMessage);
+}
+
 bool EventListenerManager::ListenerCanHandle(const Listener* aListener,
                                              const WidgetEvent* aEvent,
                                              EventMessage aEventMessage) const
@@ -1633,6 +1688,11 @@ size_t EventListenerManager::SizeOfIncludingThis(
       n += jsEventHandler->SizeOfIncludingThis(aMallocSizeOf);
     }
   }
+  if (mListenerTypeIndex) {
+    n += aMallocSizeOf(mListenerTypeIndex.get());
+    n += mListenerTypeIndex->mTypeAtoms.ShallowSizeOfExcludingThis(
+        aMallocSizeOf);
+  }
   return n;
 }
 
@@ -11,10 +11,13 @@
 #include "mozilla/dom/EventListenerBinding.h"
 #include "mozilla/JSEventHandler.h"
 #include "mozilla/MemoryReporting.h"
+#include "mozilla/UniquePtr.h"
 #include "nsCOMPtr.h"
 #include "nsCycleCollectionParticipant.h"
 #include "nsGkAtoms.h"
+#include "nsHashKeys.h"
 #include "nsIDOMEventListener.h"
+#include "nsTHashtable.h"
 #include "nsTObserverArray.h"
 #include "nsTArray.h"
 
@@ -158,7 +161,8 @@ class EventListenerManagerBase {
   uint16_t mIsMainThreadELM : 1;
   uint16_t mHasNonPrivilegedClickListeners : 1;
   uint16_t mUnknownNonPrivilegedClickListeners : 1;
-  // uint16_t mUnused : 2;
+  uint16_t mListenerTypeIndexStale : 1;
+  // uint16_t mUnused : 1;
 };
 
 /*
@@ -351,6 +355,9 @@ class EventListenerManager final : public EventListenerManagerBase {
          mNoListenerForEventAtom == aEvent->mSpecifiedEventType)) {
       return;
     }
+    if (!MayHaveListenersFor(aEvent)) {
+      return;
+    }
     HandleEventInternal(aPresContext, aEvent, aDOMEvent, aCurrentTarget,
                         aEventStatus, aItemInShadowTree);
   }
@@ -397,6 +404,16 @@ class EventListenerManager final : public EventListenerManagerBase {
    */
   bool HasListeners() const;
 
+  /**
+   * Returns false if there definitely isn't a listener for aEvent's type,
+   * without looking at each listener. Managers with few listeners don't keep
+   * track of their types, and always return true.
+   */
+  bool MayHaveListenersFor(const WidgetEvent* aEvent) {
+    return mListeners.Length() <= kListenerTypeIndexThreshold ||
+           MayHaveListenersForInternal(aEvent);
+  }
+
   /**
    * Sets aList to the list of nsIEventListenerInfo objects representing the
    * listeners managed by this listener manager.
@@ -606,6 +623,32 @@ class EventListenerManager final : public EventListenerManagerBase {
   bool ListenerCanHandle(const Listener* aListener, const WidgetEvent* aEvent,
                          EventMessage aEventMessage) const;
 
+  /**
+   * The types a manager with many listeners has listeners for, so that events
+   * of other types, which are most of the events dispatched to windows and
+   * documents, can be skipped without scanning mListeners. Adding a listener
+   * adds its type. Removing one marks the index stale, and it's rebuilt the
+   * next time it's used, so it may list types that no longer have listeners
+   * but never misses one.
+   */
+  struct ListenerTypeIndex {
+    void Add(const Listener& aListener);
+    bool HasMessage(EventMessage aMessage) const {
+      return mMessages[aMessage / 32] & (1u << (aMessage % 32));
+    }
+
+    // A bit for each EventMessage that has listeners.
+    uint32_t mMessages[(eEventMessage_MaxValue + 31) / 32] = {};
+    // The type atoms of all listeners, for eUnidentifiedEvent events.
+    nsTHashtable<nsRefPtrHashKey<nsAtom>> mTypeAtoms;
+    bool mHasAllEventsListener = false;
+  };
+
+  static const uint32_t kListenerTypeIndexThreshold = 8;
+
+  bool MayHaveListenersForInternal(const WidgetEvent* aEvent);
+  void RebuildListenerTypeIndex();
+
   // BE AWARE, a lot of instances of EventListenerManager will be created.
   // Therefor, we need to keep this class compact.  When you add integer
   // members, please add them to EventListemerManagerBase and check the size
@@ -619,6 +662,7 @@ class EventListenerManager final : public EventListenerManagerBase {
   nsAutoTObserverArray<Listener, 2> mListeners;
   dom::EventTarget* MOZ_NON_OWNING_REF mTarget;
   RefPtr<nsAtom> mNoListenerForEventAtom;
+  UniquePtr<ListenerTypeIndex> mListenerTypeIndex;
 
   friend class ELMCreationDetector;
   static uint32_t sMainThreadCreatedCount;
@@ -0,0 +1,140 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/ErrorResult.h"
+#include "mozilla/EventDispatcher.h"
+#include "mozilla/EventListenerManager.h"
+#include "mozilla/MouseEvents.h"
+#include "mozilla/NullPrincipal.h"
+#include "mozilla/dom/Document.h"
+#include "mozilla/dom/Element.h"
+#include "mozilla/dom/Event.h"
+#include "nsGkAtoms.h"
+#include "nsIDOMEventListener.h"
+#include "nsNetUtil.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+namespace {
+
+class PointerListener final : public nsIDOMEventListener {
+ public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIDOMEVENTLISTENER
+
+  // If set, each pointermove dispatches a pointerdown to this element while
+  // the pointermove is still being dispatched.
+  RefPtr<Element> mNestedTarget;
+  uint32_t mMoves = 0;
+  uint32_t mDowns = 0;
+
+ private:
+  ~PointerListener() = default;
+};
+
+NS_IMPL_ISUPPORTS(PointerListener, nsIDOMEventListener)
+
+MOZ_CAN_RUN_SCRIPT_BOUNDARY
+static void DispatchPointerEvent(Element* aTarget, EventMessage aMessage) {
+  RefPtr<Element> target = aTarget;
+  WidgetPointerEvent event(true, aMessage, nullptr);
+  EventDispatcher::Dispatch(ToSupports(target), nullptr, &event);
+}
+
+NS_IMETHODIMP
+PointerListener::HandleEvent(Event* aEvent) {
+  if (aEvent->WidgetEventPtr()->mMessage == ePointerDown) {
+    ++mDowns;
+    return NS_OK;
+  }
+  ++mMoves;
+  if (mNestedTarget) {
+    DispatchPointerEvent(mNestedTarget, ePointerDown);
+  }
+  return NS_OK;
+}
+
+static void AddListener(Element* aElement, nsIDOMEventListener* aListener,
+                        const char* aType) {
+  aElement->GetOrCreateListenerManager()->AddEventListenerByType(
+      aListener, NS_ConvertASCIItoUTF16(aType), TrustedEventsAtBubble());
+}
+
+// Creates a document with aDepth nested divs, and returns the innermost one.
+static already_AddRefed<Element> CreateDeepTree(uint32_t aDepth) {
+  nsCOMPtr<nsIURI> uri;
+  NS_NewURI(getter_AddRefs(uri), "about:blank");
+  nsCOMPtr<nsIPrincipal> principal =
+      NullPrincipal::CreateWithoutOriginAttributes();
+  nsCOMPtr<Document> document;
+  nsresult rv = NS_NewDOMDocument(getter_AddRefs(document),
+                                  EmptyString(),  // aNamespaceURI
+                                  EmptyString(),  // aQualifiedName
+                                  nullptr,        // aDoctype
+                                  uri, uri, principal,
+                                  false,    // aLoadedAsData
+                                  nullptr,  // aEventObject
+                                  DocumentFlavorHTML);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return nullptr;
+  }
+
+  IgnoredErrorResult error;
+  nsCOMPtr<nsINode> parent = document;
+  RefPtr<Element> element;
+  for (uint32_t i = 0; i < aDepth; ++i) {
+    element = document->CreateHTMLElement(nsGkAtoms::div);
+    parent->AppendChild(*element, error);
+    if (NS_WARN_IF(error.Failed())) {
+      return nullptr;
+    }
+    parent = element;
+  }
+  return element.forget();
+}
+
+}  // namespace
+
+TEST(EventDispatcher, NestedDispatch)
+{
+  RefPtr<Element> leaf = CreateDeepTree(50);
+  ASSERT_TRUE(leaf);
+  RefPtr<Element> root = leaf->OwnerDoc()->GetRootElement();
+
+  RefPtr<PointerListener> rootListener = new PointerListener();
+  AddListener(root, rootListener, "pointermove");
+  AddListener(root, rootListener, "pointerdown");
+  RefPtr<PointerListener> leafListener = new PointerListener();
+  leafListener->mNestedTarget = leaf;
+  AddListener(leaf, leafListener, "pointermove");
+
+  // Each pointermove reaches the root after a pointerdown has been
+  // dispatched through the same elements from the leaf's listener.
+  for (uint32_t i = 0; i < 3; ++i) {
+    DispatchPointerEvent(leaf, ePointerMove);
+  }
+  EXPECT_EQ(leafListener->mMoves, 3u);
+  EXPECT_EQ(rootListener->mMoves, 3u);
+  EXPECT_EQ(rootListener->mDowns, 3u);
+}
+
+// Pointer moves over the innermost element of a deep tree, with a listener
+// at the root, like a page tracking the pointer.
+MOZ_GTEST_BENCH(EventDispatcher, DispatchToDeepTree, [] {
+  const uint32_t kEventCount = 1000000;
+  RefPtr<Element> leaf = CreateDeepTree(32);
+  ASSERT_TRUE(leaf);
+  RefPtr<PointerListener> listener = new PointerListener();
+  AddListener(leaf->OwnerDoc()->GetRootElement(), listener, "pointermove");
+  for (uint32_t i = 0; i < kEventCount; ++i) {
+    DispatchPointerEvent(leaf, ePointerMove);
+  }
+  ASSERT_EQ(listener->mMoves, kEventCount);
+});
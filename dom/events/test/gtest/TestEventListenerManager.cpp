@@ -0,0 +1,175 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/BasicEvents.h"
+#include "mozilla/DOMEventTargetHelper.h"
+#include "mozilla/EventDispatcher.h"
+#include "mozilla/EventListenerManager.h"
+#include "nsAtom.h"
+#include "nsIDOMEventListener.h"
+#include "nsPrintfCString.h"
+#include "nsString.h"
+
+using namespace mozilla;
+using namespace mozilla::dom;
+
+namespace {
+
+class CountingListener final : public nsIDOMEventListener {
+ public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIDOMEVENTLISTENER
+
+  uint32_t mCount = 0;
+
+ private:
+  ~CountingListener() = default;
+};
+
+NS_IMPL_ISUPPORTS(CountingListener, nsIDOMEventListener)
+
+NS_IMETHODIMP
+CountingListener::HandleEvent(Event* aEvent) {
+  ++mCount;
+  return NS_OK;
+}
+
+static void AddListener(DOMEventTargetHelper* aTarget,
+                        nsIDOMEventListener* aListener, const char* aType) {
+  aTarget->GetOrCreateListenerManager()->AddEventListenerByType(
+      aListener, NS_ConvertASCIItoUTF16(aType), TrustedEventsAtBubble());
+}
+
+static void RemoveListener(DOMEventTargetHelper* aTarget,
+                           nsIDOMEventListener* aListener, const char* aType) {
+  aTarget->GetOrCreateListenerManager()->RemoveEventListenerByType(
+      aListener, NS_ConvertASCIItoUTF16(aType), TrustedEventsAtBubble());
+}
+
+// Dispatches an event with aMessage, or, if aType is given, an event of that
+// type that Gecko doesn't know about.
+MOZ_CAN_RUN_SCRIPT_BOUNDARY
+static void DispatchTo(DOMEventTargetHelper* aTarget, EventMessage aMessage,
+                       const char* aType = nullptr, bool aTrusted = true) {
+  RefPtr<DOMEventTargetHelper> target = aTarget;
+  WidgetEvent event(aTrusted, aMessage);
+  if (aType) {
+    event.mSpecifiedEventType = NS_Atomize(nsPrintfCString("on%s", aType));
+  }
+  EventDispatcher::Dispatch(ToSupports(target), nullptr, &event);
+}
+
+static bool MayHaveListenersFor(DOMEventTargetHelper* aTarget,
+                                EventMessage aMessage,
+                                const char* aType = nullptr,
+                                bool aTrusted = true) {
+  WidgetEvent event(aTrusted, aMessage);
+  if (aType) {
+    event.mSpecifiedEventType = NS_Atomize(nsPrintfCString("on%s", aType));
+  }
+  return aTarget->GetOrCreateListenerManager()->MayHaveListenersFor(&event);
+}
+
+}  // namespace
+
+TEST(EventListenerManager, ListenerTypeIndex)
+{
+  RefPtr<DOMEventTargetHelper> target = new DOMEventTargetHelper();
+  RefPtr<CountingListener> others = new CountingListener();
+  RefPtr<CountingListener> moves = new CountingListener();
+  RefPtr<CountingListener> animations = new CountingListener();
+
+  // Enough listeners for the manager to index their types.
+  for (uint32_t i = 0; i < 20; ++i) {
+    AddListener(target, others, nsPrintfCString("custom%u", i).get());
+  }
+  AddListener(target, moves, "mousemove");
+
+  EXPECT_TRUE(MayHaveListenersFor(target, eMouseMove));
+  EXPECT_FALSE(MayHaveListenersFor(target, eMouseDown));
+  EXPECT_TRUE(MayHaveListenersFor(target, eUnidentifiedEvent, "custom3"));
+  EXPECT_FALSE(MayHaveListenersFor(target, eUnidentifiedEvent, "unknown"));
+
+  DispatchTo(target, eMouseMove);
+  DispatchTo(target, eMouseDown);
+  DispatchTo(target, eUnidentifiedEvent, "custom3");
+  DispatchTo(target, eUnidentifiedEvent, "unknown");
+  EXPECT_EQ(moves->mCount, 1u);
+  EXPECT_EQ(others->mCount, 1u);
+
+  // Removed listeners drop out of the index.
+  RemoveListener(target, moves, "mousemove");
+  EXPECT_FALSE(MayHaveListenersFor(target, eMouseMove));
+  DispatchTo(target, eMouseMove);
+  EXPECT_EQ(moves->mCount, 1u);
+
+  // And added ones get in, also once the index has been built.
+  AddListener(target, moves, "mousemove");
+  EXPECT_TRUE(MayHaveListenersFor(target, eMouseMove));
+  DispatchTo(target, eMouseMove);
+  EXPECT_EQ(moves->mCount, 2u);
+
+  // Trusted events also go to listeners for their legacy type.
+  AddListener(target, animations, "webkitAnimationEnd");
+  EXPECT_TRUE(MayHaveListenersFor(target, eAnimationEnd));
+  EXPECT_FALSE(MayHaveListenersFor(target, eAnimationEnd, nullptr, false));
+  DispatchTo(target, eAnimationEnd);
+  DispatchTo(target, eAnimationEnd, nullptr, false);
+  EXPECT_EQ(animations->mCount, 1u);
+
+  target->GetOrCreateListenerManager()->RemoveAllListeners();
+  EXPECT_FALSE(MayHaveListenersFor(target, eMouseMove));
+}
+
+// A target like a window in a large app: hundreds of listeners for dozens of
+// types, receiving mostly events it has no listeners for.
+class EventListenerManagerBench : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kTypeCount = 60;
+  static constexpr uint32_t kListenersPerType = 5;
+  static constexpr uint32_t kEventCount = 100000;
+
+  void SetUp() override {
+    mTarget = new DOMEventTargetHelper();
+    mListener = new CountingListener();
+    for (uint32_t i = 0; i < kTypeCount; ++i) {
+      for (uint32_t j = 0; j < kListenersPerType; ++j) {
+        // Distinct listener objects, so that they aren't deduplicated.
+        RefPtr<CountingListener> listener = new CountingListener();
+        AddListener(mTarget, listener, nsPrintfCString("custom%u", i).get());
+        mListeners.AppendElement(listener);
+      }
+    }
+    AddListener(mTarget, mListener, "scroll");
+  }
+
+  void TearDown() override {
+    mTarget->GetOrCreateListenerManager()->RemoveAllListeners();
+  }
+
+  RefPtr<DOMEventTargetHelper> mTarget;
+  RefPtr<CountingListener> mListener;
+  nsTArray<RefPtr<CountingListener>> mListeners;
+};
+
+// Alternating between types defeats the manager's one-entry cache of the
+// last type it had no listeners for.
+MOZ_GTEST_BENCH_F(EventListenerManagerBench, DispatchUnlistenedTypes, [this] {
+  for (uint32_t i = 0; i < kEventCount; ++i) {
+    DispatchTo(mTarget, i % 2 ? eMouseMove : ePointerMove);
+  }
+  ASSERT_EQ(mListener->mCount, 0u);
+});
+
+MOZ_GTEST_BENCH_F(EventListenerManagerBench, DispatchListenedType, [this] {
+  for (uint32_t i = 0; i < kEventCount; ++i) {
+    DispatchTo(mTarget, eScroll);
+  }
+  ASSERT_EQ(mListener->mCount, kEventCount);
+});
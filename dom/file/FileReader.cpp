@@ -21,6 +21,7 @@
 #include "mozilla/dom/WorkerRef.h"
 #include "mozilla/dom/WorkerScope.h"
 #include "mozilla/Encoding.h"
+#include "mozilla/Unused.h"
 #include "nsAlgorithm.h"
 #include "nsCycleCollectionParticipant.h"
 #include "nsDOMJSUtils.h"
@@ -251,6 +252,59 @@ nsresult ReadFuncBinaryString(nsIInputStream* aInputStream, void* aClosure,
   return NS_OK;
 }
 
+// Decodes aSource and appends the text to aDest. Bytes of a character split
+// between calls are kept by the decoder until the next one.
+nsresult DecodeAndAppendText(Decoder& aDecoder, Span<const uint8_t> aSource,
+                             nsAString& aDest, bool aLast) {
+  CheckedInt<size_t> needed = aDecoder.MaxUTF16BufferLength(aSource.Length());
+  uint32_t oldLength = aDest.Length();
+  needed += oldLength;
+  if (!needed.isValid() || needed.value() > UINT32_MAX) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  nsresult rv;
+  BulkWriteHandle<char16_t> handle =
+      aDest.BulkWrite(needed.value(), oldLength, false, rv);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+
+  uint32_t result;
+  size_t read;
+  size_t written;
+  bool hadErrors;
+  Tie(result, read, written, hadErrors) =
+      aDecoder.DecodeToUTF16(aSource, handle.AsSpan().From(oldLength), aLast);
+  MOZ_ASSERT(result == kInputEmpty);
+  MOZ_ASSERT(read == aSource.Length());
+  Unused << hadErrors;
+  handle.Finish(oldLength + written, false);
+  return NS_OK;
+}
+
+struct MOZ_STACK_CLASS TextReadClosure {
+  Decoder& mDecoder;
+  nsAString& mDest;
+  nsresult mRv;
+};
+
+nsresult ReadFuncText(nsIInputStream* aInputStream, void* aClosure,
+                      const char* aFromRawSegment, uint32_t aToOffset,
+                      uint32_t aCount, uint32_t* aWriteCount) {
+  TextReadClosure* closure = static_cast<TextReadClosure*>(aClosure);
+  closure->mRv = DecodeAndAppendText(
+      closure->mDecoder,
+      MakeSpan(reinterpret_cast<const uint8_t*>(aFromRawSegment), aCount),
+      closure->mDest, false);
+  if (NS_FAILED(closure->mRv)) {
+    *aWriteCount = 0;
+    return closure->mRv;
+  }
+  *aWriteCount = aCount;
+  return NS_OK;
+}
+
 }  // namespace
 
 nsresult FileReader::DoReadData(uint64_t aCount) {
@@ -309,6 +363,51 @@ nsresult FileReader::DoReadData(uint64_t aCount) {
 
     MOZ_ASSERT(size.value() == oldLen + bytesRead);
     mResult.Truncate(size.value());
+  } else if (mDataFormat == FILE_AS_TEXT) {
+    CheckedInt<uint64_t> size = mDataLen;
+    size += aCount;
+
+    if (!size.isValid() || size.value() > UINT32_MAX || size.value() > mTotal) {
+      return NS_ERROR_OUT_OF_MEMORY;
+    }
+
+    MOZ_ASSERT(mDecoder);
+
+    if (NS_InputStreamIsBuffered(mAsyncStream)) {
+      TextReadClosure closure = {*mDecoder, mDecodedText, NS_OK};
+      nsresult rv = mAsyncStream->ReadSegments(ReadFuncText, &closure, aCount,
+                                               &bytesRead);
+      NS_ENSURE_SUCCESS(rv, rv);
+      NS_ENSURE_SUCCESS(closure.mRv, closure.mRv);
+    } else {
+      while (aCount > 0) {
+        char tmpBuffer[4096];
+        uint32_t minCount =
+            XPCOM_MIN(aCount, static_cast<uint64_t>(sizeof(tmpBuffer)));
+        uint32_t read;
+
+        nsresult rv = mAsyncStream->Read(tmpBuffer, minCount, &read);
+        if (rv == NS_BASE_STREAM_CLOSED) {
+          rv = NS_OK;
+        }
+
+        NS_ENSURE_SUCCESS(rv, rv);
+
+        if (read == 0) {
+          // The stream finished too early.
+          return NS_ERROR_OUT_OF_MEMORY;
+        }
+
+        rv = DecodeAndAppendText(
+            *mDecoder,
+            MakeSpan(reinterpret_cast<const uint8_t*>(tmpBuffer), read),
+            mDecodedText, false);
+        NS_ENSURE_SUCCESS(rv, rv);
+
+        aCount -= read;
+        bytesRead += read;
+      }
+    }
   } else {
     CheckedInt<uint64_t> size = mDataLen;
     size += aCount;
@@ -387,8 +486,11 @@ void FileReader::ReadFileContent(Blob& aBlob, const nsAString& aCharset,
   }
 
   // Binary Format doesn't need a post-processing of the data. Everything is
-  // written directly into mResult.
-  if (mDataFormat != FILE_AS_BINARY) {
+  // written directly into mResult. Text is decoded into mDecodedText as it
+  // arrives, so a large file is never held both encoded and decoded.
+  if (mDataFormat == FILE_AS_TEXT) {
+    mDecoder = GetTextEncoding(mBlob, mCharset)->NewDecoder();
+  } else if (mDataFormat != FILE_AS_BINARY) {
     if (mDataFormat == FILE_AS_ARRAYBUFFER) {
       mFileData = js_pod_malloc<char>(mTotal);
     } else {
@@ -413,9 +515,9 @@ void FileReader::ReadFileContent(Blob& aBlob, const nsAString& aCharset,
   DispatchProgressEvent(NS_LITERAL_STRING(LOADSTART_STR));
 }
 
-nsresult FileReader::GetAsText(Blob* aBlob, const nsACString& aCharset,
-                               const char* aFileData, uint32_t aDataLen,
-                               nsAString& aResult) {
+/* static */
+const Encoding* FileReader::GetTextEncoding(Blob* aBlob,
+                                            const nsACString& aCharset) {
   // Try the API argument.
   const Encoding* encoding = Encoding::ForLabel(aCharset);
   if (!encoding) {
@@ -434,11 +536,7 @@ nsresult FileReader::GetAsText(Blob* aBlob, const nsACString& aCharset,
       encoding = UTF_8_ENCODING;
     }
   }
-
-  auto data = MakeSpan(reinterpret_cast<const uint8_t*>(aFileData), aDataLen);
-  nsresult rv;
-  Tie(rv, encoding) = encoding->Decode(data, aResult);
-  return NS_FAILED(rv) ? rv : NS_OK;
+  return encoding;
 }
 
 nsresult FileReader::GetAsDataURL(Blob* aBlob, const char* aFileData,
@@ -503,6 +601,8 @@ void FileReader::FreeFileData() {
     mFileData = nullptr;
   }
 
+  mDecoder = nullptr;
+  mDecodedText.Truncate();
   mDataLen = 0;
 }
 
@@ -670,12 +770,11 @@ void FileReader::OnLoadEnd(nsresult aStatus) {
   if (mDataFormat == FILE_AS_DATAURL) {
     rv = GetAsDataURL(mBlob, mFileData, mDataLen, mResult);
   } else if (mDataFormat == FILE_AS_TEXT) {
-    if (!mFileData && mDataLen) {
-      rv = NS_ERROR_OUT_OF_MEMORY;
-    } else if (!mFileData) {
-      rv = GetAsText(mBlob, mCharset, "", mDataLen, mResult);
-    } else {
-      rv = GetAsText(mBlob, mCharset, mFileData, mDataLen, mResult);
+    // Flush anything the decoder is holding back, then hand the buffer over.
+    rv = DecodeAndAppendText(*mDecoder, Span<const uint8_t>(), mDecodedText,
+                             true);
+    if (NS_SUCCEEDED(rv)) {
+      mResult = mDecodedText;
     }
   }
 
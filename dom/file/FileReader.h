@@ -9,6 +9,7 @@
 
 #include "mozilla/Attributes.h"
 #include "mozilla/DOMEventTargetHelper.h"
+#include "mozilla/UniquePtr.h"
 
 #include "nsIAsyncInputStream.h"
 #include "nsIInterfaceRequestor.h"
@@ -23,6 +24,10 @@ class nsITimer;
 class nsIEventTarget;
 
 namespace mozilla {
+
+class Decoder;
+class Encoding;
+
 namespace dom {
 
 class Blob;
@@ -127,9 +132,8 @@ class FileReader final : public DOMEventTargetHelper,
 
   void ReadFileContent(Blob& aBlob, const nsAString& aCharset,
                        eDataFormat aDataFormat, ErrorResult& aRv);
-  nsresult GetAsText(Blob* aBlob, const nsACString& aCharset,
-                     const char* aFileData, uint32_t aDataLen,
-                     nsAString& aResult);
+  static const Encoding* GetTextEncoding(Blob* aBlob,
+                                         const nsACString& aCharset);
   nsresult GetAsDataURL(Blob* aBlob, const char* aFileData, uint32_t aDataLen,
                         nsAString& aResult);
 
@@ -160,6 +164,10 @@ class FileReader final : public DOMEventTargetHelper,
   nsCString mCharset;
   uint32_t mDataLen;
 
+  // Text is decoded as it is read rather than buffered in mFileData.
+  UniquePtr<Decoder> mDecoder;
+  nsString mDecodedText;
+
   eDataFormat mDataFormat;
 
   nsString mResult;
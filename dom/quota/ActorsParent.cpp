@@ -28,6 +28,7 @@
 #include "mozilla/AutoRestore.h"
 #include "mozilla/BasePrincipal.h"
 #include "mozilla/CondVar.h"
+#include "mozilla/DirectoryReader.h"
 #include "mozilla/Telemetry.h"
 #include "mozilla/dom/PContent.h"
 #include "mozilla/dom/cache/QuotaClient.h"
@@ -5007,8 +5008,10 @@ nsresult QuotaManager::InitializeRepository(PersistenceType aPersistenceType) {
     return rv;
   }
 
-  nsCOMPtr<nsIDirectoryEnumerator> entries;
-  rv = directory->GetDirectoryEntries(getter_AddRefs(entries));
+  // Origin directories are told apart from other files by their type alone,
+  // which the reader usually gets without stat'ing each entry.
+  DirectoryReader entries;
+  rv = entries.Open(directory);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Rep_GetDirEntries);
     return rv;
@@ -5020,25 +5023,22 @@ nsresult QuotaManager::InitializeRepository(PersistenceType aPersistenceType) {
   nsresult statusKeeper = NS_OK;
 #endif
 
-  nsCOMPtr<nsIFile> childDirectory;
-  while (NS_SUCCEEDED(
-             (rv = entries->GetNextFile(getter_AddRefs(childDirectory)))) &&
-         childDirectory) {
+  DirectoryEntry entry;
+  bool hasEntry;
+  while (NS_SUCCEEDED((rv = entries.Next(entry, &hasEntry))) && hasEntry) {
     if (NS_WARN_IF(IsShuttingDown())) {
       RETURN_STATUS_OR_RESULT(statusKeeper, NS_ERROR_ABORT);
     }
 
-    bool isDirectory;
-    rv = childDirectory->IsDirectory(&isDirectory);
-    if (NS_WARN_IF(NS_FAILED(rv))) {
+    if (NS_WARN_IF(NS_FAILED(entry.mStatResult))) {
       REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Rep_IsDirectory);
-      RECORD_IN_NIGHTLY(statusKeeper, rv);
-      CONTINUE_IN_NIGHTLY_RETURN_IN_OTHERS(rv);
+      RECORD_IN_NIGHTLY(statusKeeper, entry.mStatResult);
+      CONTINUE_IN_NIGHTLY_RETURN_IN_OTHERS(entry.mStatResult);
     }
 
-    if (!isDirectory) {
+    if (!entry.IsDirectory()) {
       nsString leafName;
-      rv = childDirectory->GetLeafName(leafName);
+      rv = entry.GetLeafName(leafName);
       if (NS_WARN_IF(NS_FAILED(rv))) {
         REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Rep_GetLeafName);
         RECORD_IN_NIGHTLY(statusKeeper, rv);
@@ -5055,6 +5055,14 @@ nsresult QuotaManager::InitializeRepository(PersistenceType aPersistenceType) {
       continue;
     }
 
+    nsCOMPtr<nsIFile> childDirectory;
+    rv = entries.GetFile(entry, getter_AddRefs(childDirectory));
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      REPORT_TELEMETRY_INIT_ERR(kQuotaInternalError, Rep_GetNextFile);
+      RECORD_IN_NIGHTLY(statusKeeper, rv);
+      CONTINUE_IN_NIGHTLY_RETURN_IN_OTHERS(rv);
+    }
+
     int64_t timestamp;
     bool persisted;
     nsCString suffix;
@@ -5119,30 +5127,30 @@ nsresult QuotaManager::InitializeOrigin(PersistenceType aPersistenceType,
   nsresult statusKeeper = NS_OK;
 #endif
 
-  nsCOMPtr<nsIDirectoryEnumerator> entries;
-  rv = aDirectory->GetDirectoryEntries(getter_AddRefs(entries));
+  DirectoryReader entries;
+  rv = entries.Open(aDirectory);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Ori_GetDirEntries);
     return rv;
   }
 
-  nsCOMPtr<nsIFile> file;
-  while (NS_SUCCEEDED((rv = entries->GetNextFile(getter_AddRefs(file)))) &&
-         file) {
+  DirectoryEntry entry;
+  bool hasEntry;
+  while (NS_SUCCEEDED((rv = entries.Next(entry, &hasEntry))) && hasEntry) {
     if (NS_WARN_IF(IsShuttingDown())) {
       RETURN_STATUS_OR_RESULT(statusKeeper, NS_ERROR_ABORT);
     }
 
-    bool isDirectory;
-    rv = file->IsDirectory(&isDirectory);
-    if (NS_WARN_IF(NS_FAILED(rv))) {
+    if (NS_WARN_IF(NS_FAILED(entry.mStatResult))) {
       REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Ori_IsDirectory);
-      RECORD_IN_NIGHTLY(statusKeeper, rv);
-      CONTINUE_IN_NIGHTLY_RETURN_IN_OTHERS(rv);
+      RECORD_IN_NIGHTLY(statusKeeper, entry.mStatResult);
+      CONTINUE_IN_NIGHTLY_RETURN_IN_OTHERS(entry.mStatResult);
     }
 
+    bool isDirectory = entry.IsDirectory();
+
     nsString leafName;
-    rv = file->GetLeafName(leafName);
+    rv = entry.GetLeafName(leafName);
     if (NS_WARN_IF(NS_FAILED(rv))) {
       REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Ori_GetLeafName);
       RECORD_IN_NIGHTLY(statusKeeper, rv);
@@ -5155,7 +5163,11 @@ nsresult QuotaManager::InitializeOrigin(PersistenceType aPersistenceType,
       }
 
       if (IsTempMetadata(leafName)) {
-        rv = file->Remove(/* recursive */ false);
+        nsCOMPtr<nsIFile> file;
+        rv = entries.GetFile(entry, getter_AddRefs(file));
+        if (NS_SUCCEEDED(rv)) {
+          rv = file->Remove(/* recursive */ false);
+        }
         if (NS_WARN_IF(NS_FAILED(rv))) {
           REPORT_TELEMETRY_INIT_ERR(kQuotaExternalError, Ori_Remove);
           RECORD_IN_NIGHTLY(statusKeeper, rv);
@@ -92,6 +92,7 @@ void SVGAnimatedClass::SetAnimValue(const nsAString& aValue,
   if (mAnimVal && mAnimVal->Equals(aValue)) {
     return;
   }
+  aSVGElement->WillAnimateClass();
   if (!mAnimVal) {
     mAnimVal = new nsString();
   }
@@ -129,6 +130,7 @@ SMILValue SVGAnimatedClass::SMILString::GetBaseValue() const {
 
 void SVGAnimatedClass::SMILString::ClearAnimValue() {
   if (mVal->mAnimVal) {
+    mSVGElement->WillAnimateClass();
     mVal->mAnimVal = nullptr;
     mSVGElement->DidAnimateClass();
   }
@@ -31,6 +31,7 @@
 #include "mozAutoDocUpdate.h"
 #include "nsAttrValueOrString.h"
 #include "nsCSSProps.h"
+#include "nsContentListIndex.h"
 #include "nsContentUtils.h"
 #include "nsDOMCSSAttrDeclaration.h"
 #include "nsICSSDeclaration.h"
@@ -107,6 +108,12 @@ JSObject* SVGElement::WrapNode(JSContext* aCx,
 //----------------------------------------------------------------------
 // SVGElement methods
 
+void SVGElement::WillAnimateClass() {
+  if (nsContentListIndex* index = nsContentListIndex::ForElement(*this)) {
+    index->ElementClassesWillChange(this);
+  }
+}
+
 void SVGElement::DidAnimateClass() {
   // For Servo, snapshot the element before we change it.
   PresShell* presShell = OwnerDoc()->GetPresShell();
@@ -123,6 +130,10 @@ void SVGElement::DidAnimateClass() {
   }
   mClassAnimAttr->ParseAtomArray(src);
 
+  if (nsContentListIndex* index = nsContentListIndex::ForElement(*this)) {
+    index->ElementClassesChanged(this);
+  }
+
   // FIXME(emilio): This re-selector-matches, but we do the snapshot stuff right
   // above... Is this needed anymore?
   if (presShell) {
@@ -83,6 +83,8 @@ class SVGElement : public SVGElementBase  // nsIContent
 
   NS_DECL_ADDSIZEOFEXCLUDINGTHIS
 
+  // Must be called in pairs around changes to the animated class.
+  void WillAnimateClass();
   void DidAnimateClass();
 
   // nsIContent interface methods
@@ -934,6 +934,8 @@ nsresult nsXMLContentSink::HandleStartElement(
   result = AddAttributes(aAtts, content->AsElement());
 
   if (NS_OK == result) {
+    content->AsElement()->ShareAttrsFromParser();
+
     // Store the element
     if (!SetDocElement(nameSpaceID, localName, content) && appendContent) {
       NS_ENSURE_TRUE(parent, NS_ERROR_UNEXPECTED);
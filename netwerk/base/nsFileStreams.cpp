@@ -25,6 +25,8 @@
 #include "nsLiteralString.h"
 #include "nsSocketTransport2.h"  // for ErrorAccordingToNSPR()
 #include "mozilla/ipc/InputStreamUtils.h"
+#include "mozilla/AsyncFileIO.h"
+#include "mozilla/Monitor.h"
 #include "mozilla/Unused.h"
 #include "mozilla/FileUtils.h"
 #include "nsNetCID.h"
@@ -35,8 +37,11 @@ typedef mozilla::ipc::FileDescriptor::PlatformHandleType FileHandleType;
 using namespace mozilla::ipc;
 using namespace mozilla::net;
 
+using mozilla::AsyncFileIO;
 using mozilla::DebugOnly;
 using mozilla::Maybe;
+using mozilla::Monitor;
+using mozilla::MonitorAutoLock;
 using mozilla::Nothing;
 using mozilla::Some;
 
@@ -397,6 +402,111 @@ NS_IMPL_RELEASE_INHERITED(nsFileInputStream, nsFileStreamBase)
 NS_IMPL_CLASSINFO(nsFileInputStream, nullptr, nsIClassInfo::THREADSAFE,
                   NS_LOCALFILEINPUTSTREAM_CID)
 
+////////////////////////////////////////////////////////////////////////////////
+// nsFileInputStream::ReadAhead
+
+class nsFileInputStream::ReadAhead final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(ReadAhead)
+
+  ReadAhead()
+      : mMonitor("nsFileInputStream::ReadAhead::mMonitor"),
+        mBuffer(mozilla::MakeUnique<char[]>(kChunkSize)),
+        mOffset(0),
+        mLength(0),
+        mPending(false),
+        mStarted(false) {}
+
+  /**
+   * Starts reading the chunk of aFD at aOffset, replacing the current one.
+   */
+  void Start(PRFileDesc* aFD, int64_t aOffset) {
+    RefPtr<AsyncFileIO> io = AsyncFileIO::Get();
+    if (!io) {
+      return;
+    }
+
+    {
+      MonitorAutoLock lock(mMonitor);
+      MOZ_ASSERT(!mPending);
+      mPending = true;
+      mOffset = aOffset;
+      mLength = 0;
+    }
+    mStarted = true;
+
+    // The callback is called on an I/O thread, and errors are left for the
+    // next synchronous read to find.
+    RefPtr<ReadAhead> self = this;
+    io->Read(aFD, aOffset, mBuffer.get(), kChunkSize, nullptr,
+             [self](nsresult aStatus, uint32_t aBytes) {
+               MonitorAutoLock lock(self->mMonitor);
+               self->mLength = NS_SUCCEEDED(aStatus) ? aBytes : 0;
+               self->mPending = false;
+               lock.Notify();
+             });
+  }
+
+  /**
+   * Waits for the read started last to complete. Returns whether a read was
+   * started since the previous call, and the offset it read at in aOffset.
+   */
+  bool Wait(int64_t* aOffset) {
+    if (!mStarted) {
+      return false;
+    }
+    mStarted = false;
+
+    MonitorAutoLock lock(mMonitor);
+    while (mPending) {
+      lock.Wait();
+    }
+    *aOffset = mOffset;
+    return true;
+  }
+
+  /**
+   * Copies what the chunk holds of the file at aOffset into aBuf, and
+   * returns the number of bytes copied. Wait() must have been called.
+   */
+  uint32_t Take(int64_t aOffset, char* aBuf, uint32_t aCount) {
+    MOZ_ASSERT(!mPending);
+    if (aOffset < mOffset || aOffset >= mOffset + mLength) {
+      return 0;
+    }
+    uint32_t start = uint32_t(aOffset - mOffset);
+    uint32_t count = std::min(aCount, mLength - start);
+    memcpy(aBuf, mBuffer.get() + start, count);
+    return count;
+  }
+
+  /**
+   * Whether the chunk holds the file at aOffset.
+   */
+  bool Contains(int64_t aOffset) const {
+    MOZ_ASSERT(!mPending);
+    return aOffset >= mOffset && aOffset < mOffset + mLength;
+  }
+
+  static const uint32_t kChunkSize = 64 * 1024;
+
+ private:
+  ~ReadAhead() { MOZ_ASSERT(!mPending); }
+
+  Monitor mMonitor;
+  mozilla::UniquePtr<char[]> mBuffer;
+  // Written under mMonitor, and only read without it while no read is in
+  // flight.
+  int64_t mOffset;
+  uint32_t mLength;
+  bool mPending;
+  // Only used on the stream's thread.
+  bool mStarted;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// nsFileInputStream
+
 NS_INTERFACE_MAP_BEGIN(nsFileInputStream)
   NS_INTERFACE_MAP_ENTRY(nsIInputStream)
   NS_INTERFACE_MAP_ENTRY(nsIFileInputStream)
@@ -410,6 +520,11 @@ NS_IMPL_CI_INTERFACE_GETTER(nsFileInputStream, nsIInputStream,
                             nsIFileInputStream, nsISeekableStream,
                             nsITellableStream, nsILineInputStream)
 
+nsFileInputStream::~nsFileInputStream() {
+  // The base class closes the file, which mustn't happen under a read.
+  WaitForReadAhead();
+}
+
 nsresult nsFileInputStream::Create(nsISupports* aOuter, REFNSIID aIID,
                                    void** aResult) {
   NS_ENSURE_NO_AGGREGATION(aOuter);
@@ -455,6 +570,9 @@ nsFileInputStream::Init(nsIFile* aFile, int32_t aIOFlags, int32_t aPerm,
 
 NS_IMETHODIMP
 nsFileInputStream::Close() {
+  WaitForReadAhead();
+  mReadAhead = nullptr;
+
   // Get the cache position at the time the file was close. This allows
   // NS_SEEK_CUR on a closed file that has been opened with
   // REOPEN_ON_REWIND.
@@ -470,7 +588,9 @@ nsFileInputStream::Close() {
 
 NS_IMETHODIMP
 nsFileInputStream::Read(char* aBuf, uint32_t aCount, uint32_t* _retval) {
-  nsresult rv = nsFileStreamBase::Read(aBuf, aCount, _retval);
+  nsresult rv = mBehaviorFlags & READ_AHEAD
+                    ? ReadWithReadAhead(aBuf, aCount, _retval)
+                    : nsFileStreamBase::Read(aBuf, aCount, _retval);
   if (rv == NS_ERROR_FILE_NOT_FOUND) {
     // Don't warn if this is a deffered file not found.
     return rv;
@@ -486,6 +606,68 @@ nsFileInputStream::Read(char* aBuf, uint32_t aCount, uint32_t* _retval) {
   return NS_OK;
 }
 
+nsresult nsFileInputStream::ReadWithReadAhead(char* aBuf, uint32_t aCount,
+                                              uint32_t* aResult) {
+  nsresult rv = DoPendingOpen();
+  if (rv == NS_BASE_STREAM_CLOSED) {
+    *aResult = 0;
+    return NS_OK;
+  }
+
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+
+  WaitForReadAhead();
+
+  int64_t position = PR_Seek64(mFD, 0, PR_SEEK_CUR);
+  if (position == -1) {
+    return NS_ErrorAccordingToNSPR();
+  }
+
+  if (!mReadAhead) {
+    mReadAhead = new ReadAhead();
+  }
+
+  uint32_t bytesRead = mReadAhead->Take(position, aBuf, aCount);
+  if (bytesRead) {
+    if (PR_Seek64(mFD, position + bytesRead, PR_SEEK_SET) == -1) {
+      return NS_ErrorAccordingToNSPR();
+    }
+  } else {
+    int32_t result = PR_Read(mFD, aBuf, aCount);
+    if (result == -1) {
+      return NS_ErrorAccordingToNSPR();
+    }
+    bytesRead = uint32_t(result);
+  }
+
+  // Once the chunk is used up, read the next one while the caller deals
+  // with this one.
+  position += bytesRead;
+  if (bytesRead && !mReadAhead->Contains(position)) {
+    mReadAhead->Start(mFD, position);
+  }
+
+  *aResult = bytesRead;
+  return NS_OK;
+}
+
+void nsFileInputStream::WaitForReadAhead() {
+  if (!mReadAhead) {
+    return;
+  }
+
+  int64_t offset;
+  if (mReadAhead->Wait(&offset)) {
+#ifdef XP_WIN
+    // Positional reads move the file pointer on Windows. Reads are only ever
+    // started at the current position, so put it back there.
+    PR_Seek64(mFD, offset, PR_SEEK_SET);
+#endif
+  }
+}
+
 NS_IMETHODIMP
 nsFileInputStream::ReadLine(nsACString& aLine, bool* aResult) {
   if (!mLineBuffer) {
@@ -506,6 +688,8 @@ nsresult nsFileInputStream::SeekInternal(int32_t aWhence, int64_t aOffset,
     return rv;
   }
 
+  WaitForReadAhead();
+
   if (aClearBuf) {
     mLineBuffer = nullptr;
   }
@@ -532,11 +716,13 @@ nsresult nsFileInputStream::SeekInternal(int32_t aWhence, int64_t aOffset,
 
 NS_IMETHODIMP
 nsFileInputStream::Tell(int64_t* aResult) {
+  WaitForReadAhead();
   return nsFileStreamBase::Tell(aResult);
 }
 
 NS_IMETHODIMP
 nsFileInputStream::Available(uint64_t* aResult) {
+  WaitForReadAhead();
   return nsFileStreamBase::Available(aResult);
 }
 
@@ -151,7 +151,10 @@ class nsFileInputStream : public nsFileStreamBase,
   static nsresult Create(nsISupports* aOuter, REFNSIID aIID, void** aResult);
 
  protected:
-  virtual ~nsFileInputStream() = default;
+  // The chunk of the file read in the background for READ_AHEAD.
+  class ReadAhead;
+
+  virtual ~nsFileInputStream();
 
   void SerializeInternal(mozilla::ipc::InputStreamParams& aParams,
                          FileDescriptorArray& aFileDescriptors);
@@ -159,8 +162,16 @@ class nsFileInputStream : public nsFileStreamBase,
   nsresult SeekInternal(int32_t aWhence, int64_t aOffset,
                         bool aClearBuf = true);
 
+  nsresult ReadWithReadAhead(char* aBuf, uint32_t aCount, uint32_t* aResult);
+
+  // Waits for a read started for READ_AHEAD to complete. Must be called
+  // before anything that uses or moves the file position.
+  void WaitForReadAhead();
+
   nsAutoPtr<nsLineBuffer<char> > mLineBuffer;
 
+  RefPtr<ReadAhead> mReadAhead;
+
   /**
    * The file being opened.
    */
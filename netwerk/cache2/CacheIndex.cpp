@@ -2595,9 +2595,9 @@ nsresult CacheIndex::ScheduleUpdateTimer(uint32_t aDelay) {
       ioTarget);
 }
 
-nsresult CacheIndex::SetupDirectoryEnumerator() {
+nsresult CacheIndex::SetupDirectoryReader() {
   MOZ_ASSERT(!NS_IsMainThread());
-  MOZ_ASSERT(!mDirEnumerator);
+  MOZ_ASSERT(!mDirReader);
 
   nsresult rv;
   nsCOMPtr<nsIFile> file;
@@ -2614,17 +2614,21 @@ nsresult CacheIndex::SetupDirectoryEnumerator() {
 
   if (!exists) {
     NS_WARNING(
-        "CacheIndex::SetupDirectoryEnumerator() - Entries directory "
+        "CacheIndex::SetupDirectoryReader() - Entries directory "
         "doesn't exist!");
     LOG(
-        ("CacheIndex::SetupDirectoryEnumerator() - Entries directory doesn't "
+        ("CacheIndex::SetupDirectoryReader() - Entries directory doesn't "
          "exist!"));
     return NS_ERROR_UNEXPECTED;
   }
 
-  rv = file->GetDirectoryEntries(getter_AddRefs(mDirEnumerator));
+  // Read the size and modification time of each entry along with its name,
+  // rather than stat'ing the files one by one later.
+  auto reader = MakeUnique<DirectoryReader>(DirectoryReader::eStat);
+  rv = reader->Open(file);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  mDirReader = std::move(reader);
   return NS_OK;
 }
 
@@ -2701,11 +2705,11 @@ void CacheIndex::BuildIndex() {
 
   nsresult rv;
 
-  if (!mDirEnumerator) {
+  if (!mDirReader) {
     {
       // Do not do IO under the lock.
       StaticMutexAutoUnlock unlock(sLock);
-      rv = SetupDirectoryEnumerator();
+      rv = SetupDirectoryReader();
     }
     if (mState == SHUTDOWN) {
       // The index was shut down while we released the lock. FinishUpdate() was
@@ -2727,42 +2731,24 @@ void CacheIndex::BuildIndex() {
       return;
     }
 
-    bool fileExists = false;
-    nsCOMPtr<nsIFile> file;
+    // Files removed since the directory was read are skipped by the reader.
+    // Files it couldn't stat are returned with mStatResult set.
+    DirectoryEntry dirEntry;
+    bool hasEntry = false;
     {
       // Do not do IO under the lock.
       StaticMutexAutoUnlock unlock(sLock);
-      rv = mDirEnumerator->GetNextFile(getter_AddRefs(file));
-
-      if (file) {
-        file->Exists(&fileExists);
-      }
+      rv = mDirReader->Next(dirEntry, &hasEntry);
     }
     if (mState == SHUTDOWN) {
       return;
     }
-    if (!file) {
+    if (!hasEntry) {
       FinishUpdate(NS_SUCCEEDED(rv));
       return;
     }
 
-    nsAutoCString leaf;
-    rv = file->GetNativeLeafName(leaf);
-    if (NS_FAILED(rv)) {
-      LOG(
-          ("CacheIndex::BuildIndex() - GetNativeLeafName() failed! Skipping "
-           "file."));
-      mDontMarkIndexClean = true;
-      continue;
-    }
-
-    if (!fileExists) {
-      LOG(
-          ("CacheIndex::BuildIndex() - File returned by the iterator was "
-           "removed in the meantime [name=%s]",
-           leaf.get()));
-      continue;
-    }
+    const nsCString& leaf = dirEntry.mNativeLeafName;
 
     SHA1Sum::Hash hash;
     rv = CacheFileIOManager::StrToHash(leaf, &hash);
@@ -2771,7 +2757,10 @@ void CacheIndex::BuildIndex() {
           ("CacheIndex::BuildIndex() - Filename is not a hash, removing file. "
            "[name=%s]",
            leaf.get()));
-      file->Remove(false);
+      nsCOMPtr<nsIFile> file;
+      if (NS_SUCCEEDED(mDirReader->GetFile(dirEntry, getter_AddRefs(file)))) {
+        file->Remove(false);
+      }
       continue;
     }
 
@@ -2807,20 +2796,32 @@ void CacheIndex::BuildIndex() {
 
     MOZ_ASSERT(!handle);
 
+    nsCOMPtr<nsIFile> file;
+    rv = mDirReader->GetFile(dirEntry, getter_AddRefs(file));
+    if (NS_FAILED(rv)) {
+      LOG(
+          ("CacheIndex::BuildIndex() - GetFile() failed! Skipping file. "
+           "[name=%s]",
+           leaf.get()));
+      mDontMarkIndexClean = true;
+      continue;
+    }
+
     RefPtr<CacheFileMetadata> meta = new CacheFileMetadata();
-    int64_t size = 0;
+    int64_t size = dirEntry.mFileSize;
 
     {
       // Do not do IO under the lock.
       StaticMutexAutoUnlock unlock(sLock);
       rv = meta->SyncReadMetadata(file);
 
-      if (NS_SUCCEEDED(rv)) {
+      if (NS_SUCCEEDED(rv) && NS_FAILED(dirEntry.mStatResult)) {
+        // The reader couldn't stat the file, try again through the nsIFile.
         rv = file->GetFileSize(&size);
         if (NS_FAILED(rv)) {
           LOG(
-              ("CacheIndex::BuildIndex() - Cannot get filesize of file that was"
-               " successfully parsed. [name=%s]",
+              ("CacheIndex::BuildIndex() - Cannot get filesize of file "
+               "that was successfully parsed. [name=%s]",
                leaf.get()));
         }
       }
@@ -2943,11 +2944,11 @@ void CacheIndex::UpdateIndex() {
 
   nsresult rv;
 
-  if (!mDirEnumerator) {
+  if (!mDirReader) {
     {
       // Do not do IO under the lock.
       StaticMutexAutoUnlock unlock(sLock);
-      rv = SetupDirectoryEnumerator();
+      rv = SetupDirectoryReader();
     }
     if (mState == SHUTDOWN) {
       // The index was shut down while we released the lock. FinishUpdate() was
@@ -2970,42 +2971,24 @@ void CacheIndex::UpdateIndex() {
       return;
     }
 
-    bool fileExists = false;
-    nsCOMPtr<nsIFile> file;
+    // Files removed since the directory was read are skipped by the reader.
+    // Files it couldn't stat are returned with mStatResult set.
+    DirectoryEntry dirEntry;
+    bool hasEntry = false;
     {
       // Do not do IO under the lock.
       StaticMutexAutoUnlock unlock(sLock);
-      rv = mDirEnumerator->GetNextFile(getter_AddRefs(file));
-
-      if (file) {
-        file->Exists(&fileExists);
-      }
+      rv = mDirReader->Next(dirEntry, &hasEntry);
     }
     if (mState == SHUTDOWN) {
       return;
     }
-    if (!file) {
+    if (!hasEntry) {
       FinishUpdate(NS_SUCCEEDED(rv));
       return;
     }
 
-    nsAutoCString leaf;
-    rv = file->GetNativeLeafName(leaf);
-    if (NS_FAILED(rv)) {
-      LOG(
-          ("CacheIndex::UpdateIndex() - GetNativeLeafName() failed! Skipping "
-           "file."));
-      mDontMarkIndexClean = true;
-      continue;
-    }
-
-    if (!fileExists) {
-      LOG(
-          ("CacheIndex::UpdateIndex() - File returned by the iterator was "
-           "removed in the meantime [name=%s]",
-           leaf.get()));
-      continue;
-    }
+    const nsCString& leaf = dirEntry.mNativeLeafName;
 
     SHA1Sum::Hash hash;
     rv = CacheFileIOManager::StrToHash(leaf, &hash);
@@ -3014,7 +2997,10 @@ void CacheIndex::UpdateIndex() {
           ("CacheIndex::UpdateIndex() - Filename is not a hash, removing file. "
            "[name=%s]",
            leaf.get()));
-      file->Remove(false);
+      nsCOMPtr<nsIFile> file;
+      if (NS_SUCCEEDED(mDirReader->GetFile(dirEntry, getter_AddRefs(file)))) {
+        file->Remove(false);
+      }
       continue;
     }
 
@@ -3050,52 +3036,53 @@ void CacheIndex::UpdateIndex() {
 
     MOZ_ASSERT(!handle);
 
-    if (entry) {
-      PRTime lastModifiedTime;
-      {
-        // Do not do IO under the lock.
-        StaticMutexAutoUnlock unlock(sLock);
-        rv = file->GetLastModifiedTime(&lastModifiedTime);
-      }
-      if (mState == SHUTDOWN) {
-        return;
-      }
-      if (NS_FAILED(rv)) {
+    if (entry && NS_FAILED(dirEntry.mStatResult)) {
+      LOG(
+          ("CacheIndex::UpdateIndex() - Cannot get lastModifiedTime. "
+           "[name=%s]",
+           leaf.get()));
+      // Assume the file is newer than index
+    } else if (entry) {
+      PRTime lastModifiedTime = dirEntry.mLastModifiedTime;
+      if (mIndexTimeStamp > (lastModifiedTime / PR_MSEC_PER_SEC)) {
         LOG(
-            ("CacheIndex::UpdateIndex() - Cannot get lastModifiedTime. "
-             "[name=%s]",
-             leaf.get()));
-        // Assume the file is newer than index
-      } else {
-        if (mIndexTimeStamp > (lastModifiedTime / PR_MSEC_PER_SEC)) {
-          LOG(
-              ("CacheIndex::UpdateIndex() - Skipping file because of last "
-               "modified time. [name=%s, indexTimeStamp=%" PRIu32 ", "
-               "lastModifiedTime=%" PRId64 "]",
-               leaf.get(), mIndexTimeStamp,
-               lastModifiedTime / PR_MSEC_PER_SEC));
-
-          CacheIndexEntryAutoManage entryMng(&hash, this);
-          entry->MarkFresh();
-          continue;
-        }
+            ("CacheIndex::UpdateIndex() - Skipping file because of last "
+             "modified time. [name=%s, indexTimeStamp=%" PRIu32 ", "
+             "lastModifiedTime=%" PRId64 "]",
+             leaf.get(), mIndexTimeStamp, lastModifiedTime / PR_MSEC_PER_SEC));
+
+        CacheIndexEntryAutoManage entryMng(&hash, this);
+        entry->MarkFresh();
+        continue;
       }
     }
 
+    nsCOMPtr<nsIFile> file;
+    rv = mDirReader->GetFile(dirEntry, getter_AddRefs(file));
+    if (NS_FAILED(rv)) {
+      LOG(
+          ("CacheIndex::UpdateIndex() - GetFile() failed! Skipping file. "
+           "[name=%s]",
+           leaf.get()));
+      mDontMarkIndexClean = true;
+      continue;
+    }
+
     RefPtr<CacheFileMetadata> meta = new CacheFileMetadata();
-    int64_t size = 0;
+    int64_t size = dirEntry.mFileSize;
 
     {
       // Do not do IO under the lock.
       StaticMutexAutoUnlock unlock(sLock);
       rv = meta->SyncReadMetadata(file);
 
-      if (NS_SUCCEEDED(rv)) {
+      if (NS_SUCCEEDED(rv) && NS_FAILED(dirEntry.mStatResult)) {
+        // The reader couldn't stat the file, try again through the nsIFile.
         rv = file->GetFileSize(&size);
         if (NS_FAILED(rv)) {
           LOG(
-              ("CacheIndex::UpdateIndex() - Cannot get filesize of file that "
-               "was successfully parsed. [name=%s]",
+              ("CacheIndex::UpdateIndex() - Cannot get filesize of file "
+               "that was successfully parsed. [name=%s]",
                leaf.get()));
         }
       }
@@ -3154,19 +3141,19 @@ void CacheIndex::FinishUpdate(bool aSucceeded) {
 
   sLock.AssertCurrentThreadOwns();
 
-  if (mDirEnumerator) {
+  if (mDirReader) {
     if (NS_IsMainThread()) {
       LOG(
           ("CacheIndex::FinishUpdate() - posting of PreShutdownInternal failed?"
-           " Cannot safely release mDirEnumerator, leaking it!"));
-      NS_WARNING(("CacheIndex::FinishUpdate() - Leaking mDirEnumerator!"));
+           " Cannot safely release mDirReader, leaking it!"));
+      NS_WARNING(("CacheIndex::FinishUpdate() - Leaking mDirReader!"));
       // This can happen only in case dispatching event to IO thread failed in
       // CacheIndex::PreShutdown().
-      Unused << mDirEnumerator.forget();  // Leak it since dir enumerator is not
-                                          // threadsafe
+      Unused << mDirReader.release();  // Leak it since the directory reader is
+                                       // not threadsafe
     } else {
-      mDirEnumerator->Close();
-      mDirEnumerator = nullptr;
+      mDirReader->Close();
+      mDirReader = nullptr;
     }
   }
 
@@ -16,6 +16,7 @@
 #include "nsTHashtable.h"
 #include "nsThreadUtils.h"
 #include "mozilla/IntegerPrintfMacros.h"
+#include "mozilla/DirectoryReader.h"
 #include "mozilla/SHA1.h"
 #include "mozilla/StaticMutex.h"
 #include "mozilla/StaticPtr.h"
@@ -23,7 +24,6 @@
 #include "mozilla/TimeStamp.h"
 
 class nsIFile;
-class nsIDirectoryEnumerator;
 class nsITimer;
 
 #ifdef DEBUG
@@ -898,7 +898,7 @@ class CacheIndex final : public CacheFileIOListener, public nsIRunnable {
   void DelayedUpdateLocked();
   // Posts timer event that start update or build process.
   nsresult ScheduleUpdateTimer(uint32_t aDelay);
-  nsresult SetupDirectoryEnumerator();
+  nsresult SetupDirectoryReader();
   nsresult InitEntryFromDiskData(CacheIndexEntry* aEntry,
                                  CacheFileMetadata* aMetaData,
                                  int64_t aFileSize);
@@ -1070,8 +1070,8 @@ class CacheIndex final : public CacheFileIOListener, public nsIRunnable {
   RefPtr<FileOpenHelper> mJournalFileOpener;
   RefPtr<FileOpenHelper> mTmpFileOpener;
 
-  // Directory enumerator used when building and updating index.
-  nsCOMPtr<nsIDirectoryEnumerator> mDirEnumerator;
+  // Directory reader used when building and updating index.
+  UniquePtr<DirectoryReader> mDirReader;
 
   // Main index hashtable.
   nsTHashtable<CacheIndexEntry> mIndex;
@@ -18,6 +18,7 @@
 #include "mozilla/AutoRestore.h"
 #include "mozilla/CycleCollectedJSRuntime.h"
 #include "mozilla/DebuggerOnGCRunnable.h"
+#include "mozilla/EventDispatcher.h"
 #include "mozilla/MemoryReporting.h"
 #include "mozilla/Sprintf.h"
 #include "mozilla/SystemGroup.h"
@@ -112,6 +113,7 @@ CycleCollectedJSContext::~CycleCollectedJSContext() {
   nsCycleCollector_forgetJSContext();
 
   mozilla::dom::DestroyScriptSettings();
+  EventDispatcher::ShutdownThread();
 
   mOwningThread->SetScriptObserver(nullptr);
   NS_RELEASE(mOwningThread);
@@ -125,6 +127,7 @@ nsresult CycleCollectedJSContext::Initialize(JSRuntime* aParentRuntime,
   MOZ_ASSERT(!mJSContext);
 
   mozilla::dom::InitScriptSettings();
+  EventDispatcher::InitThread();
   mJSContext = JS_NewContext(aMaxBytes, aParentRuntime);
   if (!mJSContext) {
     return NS_ERROR_OUT_OF_MEMORY;
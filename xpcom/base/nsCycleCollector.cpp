@@ -1558,7 +1558,10 @@ class nsCycleCollectorLogger final : public nsICycleCollectorListener {
         mWantAllTraces(false),
         mDisableLog(false),
         mWantAfterProcessing(false),
-        mCCLog(nullptr) {}
+        mCCLog(nullptr),
+        mMaxSliceDuration(0.0) {
+    ClearSliceHistogram();
+  }
 
   NS_DECL_ISUPPORTS
 
@@ -1610,11 +1613,50 @@ class nsCycleCollectorLogger final : public nsICycleCollectorListener {
     return NS_OK;
   }
 
+  // Upper bounds, in milliseconds, of all but the last bucket of the slice
+  // histogram.
+  static constexpr uint32_t kSliceHistogramBounds[] = {1,  2,  5,  10,
+                                                       20, 50, 100};
+  static const size_t kSliceHistogramBuckets =
+      ArrayLength(kSliceHistogramBounds) + 1;
+
+  NS_IMETHOD GetSliceHistogramBounds(nsTArray<uint32_t>& aBounds) override {
+    aBounds.Clear();
+    aBounds.AppendElements(kSliceHistogramBounds,
+                           ArrayLength(kSliceHistogramBounds));
+    return NS_OK;
+  }
+
+  NS_IMETHOD GetSliceHistogram(nsTArray<uint32_t>& aHistogram) override {
+    aHistogram.Clear();
+    aHistogram.AppendElements(mSliceHistogram, kSliceHistogramBuckets);
+    return NS_OK;
+  }
+
+  NS_IMETHOD GetMaxSliceDuration(double* aDuration) override {
+    *aDuration = mMaxSliceDuration;
+    return NS_OK;
+  }
+
+  void NoteSlice(TimeDuration aDuration) {
+    double ms = aDuration.ToMilliseconds();
+    size_t bucket = 0;
+    while (bucket < ArrayLength(kSliceHistogramBounds) &&
+           ms >= kSliceHistogramBounds[bucket]) {
+      ++bucket;
+    }
+    ++mSliceHistogram[bucket];
+    if (ms > mMaxSliceDuration) {
+      mMaxSliceDuration = ms;
+    }
+  }
+
   nsresult Begin() {
     nsresult rv;
 
     mCurrentAddress.AssignLiteral("0x");
     ClearDescribers();
+    ClearSliceHistogram();
     if (mDisableLog) {
       return NS_OK;
     }
@@ -1787,6 +1829,13 @@ class nsCycleCollectorLogger final : public nsICycleCollectorListener {
     }
   }
 
+  void ClearSliceHistogram() {
+    for (auto& count : mSliceHistogram) {
+      count = 0;
+    }
+    mMaxSliceDuration = 0.0;
+  }
+
   nsCOMPtr<nsICycleCollectorLogSink> mLogSink;
   bool mWantAllTraces;
   bool mDisableLog;
@@ -1794,8 +1843,12 @@ class nsCycleCollectorLogger final : public nsICycleCollectorListener {
   nsCString mCurrentAddress;
   mozilla::LinkedList<CCGraphDescriber> mDescribers;
   FILE* mCCLog;
+  uint32_t mSliceHistogram[kSliceHistogramBuckets];
+  double mMaxSliceDuration;
 };
 
+constexpr uint32_t nsCycleCollectorLogger::kSliceHistogramBounds[];
+
 NS_IMPL_ISUPPORTS(nsCycleCollectorLogger, nsICycleCollectorListener)
 
 already_AddRefed<nsICycleCollectorListener> nsCycleCollector_createLogger() {
@@ -1816,6 +1869,111 @@ static bool ValueIsGrayCCThing(const JS::Value& value) {
 // Bacon & Rajan's |MarkRoots| routine.
 ////////////////////////////////////////////////////////////////////////
 
+// Children noted by a participant's Traverse method are buffered here and
+// only added to the graph once Traverse has returned. This lets graph building
+// yield partway through the children of a single participant, such as the
+// root of a big DOM subtree or a huge JS array, instead of having to finish
+// all of its edges in one slice.
+class CCPendingChildren {
+ public:
+  struct Child {
+    void* mPointer;
+    nsCycleCollectionParticipant* mParticipant;
+  };
+
+  CCPendingChildren()
+      : mNext(0), mDeferred(false), mDeferredSetComplete(true) {}
+
+  // aEdgeName is only recorded if it is non-null, which must be the same for
+  // every child.
+  bool Append(void* aPtr, nsCycleCollectionParticipant* aParticipant,
+              const nsCString* aEdgeName) {
+    MOZ_ASSERT(!mDeferred, "Noting children while others are deferred");
+    if (!mChildren.AppendElement(Child{aPtr, aParticipant}, fallible)) {
+      return false;
+    }
+    if (aEdgeName && !mEdgeNames.AppendElement(*aEdgeName, fallible)) {
+      mChildren.RemoveLastElement();
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t Length() const { return mChildren.Length(); }
+
+  bool IsDone() const { return mNext == mChildren.Length(); }
+
+  // Returns the next child to add to the graph. Its mPointer is null if the
+  // object died while graph building was suspended.
+  const Child& GetNext(const nsCString** aEdgeName) {
+    MOZ_ASSERT(!IsDone());
+    *aEdgeName = mEdgeNames.IsEmpty() ? nullptr : &mEdgeNames[mNext];
+    return mChildren[mNext++];
+  }
+
+  // Called when graph building yields with children left to add. Objects may
+  // be freed before the next slice, so remember which ones we still point to.
+  void Defer() {
+    MOZ_ASSERT(!IsDone());
+    if (mDeferred) {
+      return;
+    }
+    mDeferred = true;
+    for (uint32_t i = mNext; i < mChildren.Length(); ++i) {
+      if (!mDeferredSet.put(mChildren[i].mPointer)) {
+        // Fall back to scanning the remaining children on every removal.
+        mDeferredSet.clear();
+        mDeferredSetComplete = false;
+        return;
+      }
+    }
+  }
+
+  void Remove(void* aPtr) {
+    if (!mDeferred || IsDone()) {
+      return;
+    }
+    if (mDeferredSetComplete && !mDeferredSet.has(aPtr)) {
+      return;
+    }
+    for (uint32_t i = mNext; i < mChildren.Length(); ++i) {
+      if (mChildren[i].mPointer == aPtr) {
+        mChildren[i].mPointer = nullptr;
+      }
+    }
+  }
+
+  void Clear() {
+    // Don't hang on to the memory used by one unusually large participant.
+    if (mChildren.Capacity() > kMaxRetainedChildren) {
+      mChildren.Clear();
+      mChildren.Compact();
+      mEdgeNames.Clear();
+      mEdgeNames.Compact();
+    } else {
+      mChildren.ClearAndRetainStorage();
+      mEdgeNames.Clear();
+    }
+    mNext = 0;
+    if (mDeferred) {
+      mDeferredSet.clearAndCompact();
+      mDeferred = false;
+      mDeferredSetComplete = true;
+    }
+  }
+
+ private:
+  static const uint32_t kMaxRetainedChildren = 16 * 1024;
+
+  nsTArray<Child> mChildren;
+  // Only used when the graph is being logged.
+  nsTArray<nsCString> mEdgeNames;
+  uint32_t mNext;
+  bool mDeferred;
+  bool mDeferredSetComplete;
+  mozilla::HashSet<void*, mozilla::DefaultHasher<void*>> mDeferredSet;
+};
+
 class CCGraphBuilder final : public nsCycleCollectionTraversalCallback,
                              public nsCycleCollectionNoteRootCallback {
  private:
@@ -1829,8 +1987,10 @@ class CCGraphBuilder final : public nsCycleCollectionTraversalCallback,
   nsCString mNextEdgeName;
   RefPtr<nsCycleCollectorLogger> mLogger;
   bool mMergeZones;
-  UniquePtr<NodePool::Enumerator> mCurrNode;
   uint32_t mNoteChildCount;
+  UniquePtr<NodePool::Enumerator> mCurrNode;
+  // Allocated separately to keep CCGraphBuilder within its size limit.
+  UniquePtr<CCPendingChildren> mPendingChildren;
 
   struct PtrInfoCache : public MruCache<void*, PtrInfo*, PtrInfoCache, 491> {
     static HashNumber Hash(const void* aKey) { return HashGeneric(aKey); }
@@ -1861,9 +2021,17 @@ class CCGraphBuilder final : public nsCycleCollectionTraversalCallback,
   // building is finished.
   bool BuildGraph(SliceBudget& aBudget);
 
-  void RemoveCachedEntry(void* aPtr) { mGraphCache.Remove(aPtr); }
+  void RemoveCachedEntry(void* aPtr) {
+    mGraphCache.Remove(aPtr);
+    mPendingChildren->Remove(aPtr);
+  }
 
  private:
+  // Adds the children buffered by the last Traverse call to the graph. Returns
+  // false if the budget ran out first.
+  bool AddPendingChildren(SliceBudget& aBudget);
+  void FinishCurrentNode();
+
   PtrInfo* AddNode(void* aPtr, nsCycleCollectionParticipant* aParticipant);
   PtrInfo* AddWeakMapNode(JS::GCCellPtr aThing);
   PtrInfo* AddWeakMapNode(JSObject* aObject);
@@ -1915,13 +2083,22 @@ class CCGraphBuilder final : public nsCycleCollectionTraversalCallback,
   NS_IMETHOD_(void)
   NoteChild(void* aChild, nsCycleCollectionParticipant* aCp,
             nsCString& aEdgeName) {
+    const nsCString* edgeName = mLogger ? &aEdgeName : nullptr;
+    if (!mPendingChildren->Append(aChild, aCp, edgeName)) {
+      mGraph.mOutOfMemory = true;
+      MOZ_ASSERT(false, "OOM while building cycle collector graph");
+    }
+  }
+
+  void AddChildEdge(void* aChild, nsCycleCollectionParticipant* aCp,
+                    const nsCString* aEdgeName) {
     PtrInfo* childPi = AddNode(aChild, aCp);
     if (!childPi) {
       return;
     }
     mEdgeBuilder.Add(childPi);
     if (mLogger) {
-      mLogger->NoteEdge((uint64_t)aChild, aEdgeName.get());
+      mLogger->NoteEdge((uint64_t)aChild, aEdgeName->get());
     }
     ++childPi->mInternalRefs;
   }
@@ -1950,7 +2127,8 @@ CCGraphBuilder::CCGraphBuilder(CCGraph& aGraph, CycleCollectorResults& aResults,
       mJSZoneParticipant(nullptr),
       mLogger(aLogger),
       mMergeZones(aMergeZones),
-      mNoteChildCount(0) {
+      mNoteChildCount(0),
+      mPendingChildren(MakeUnique<CCPendingChildren>()) {
   // 4096 is an allocation bucket size.
   static_assert(sizeof(CCGraphBuilder) <= 4096,
                 "Don't create too large CCGraphBuilder objects");
@@ -2038,12 +2216,24 @@ void CCGraphBuilder::DoneAddingRoots() {
   mCurrNode = MakeUnique<NodePool::Enumerator>(mGraph.mNodes);
 }
 
-MOZ_NEVER_INLINE bool CCGraphBuilder::BuildGraph(SliceBudget& aBudget) {
-  const intptr_t kNumNodesBetweenTimeChecks = 1000;
-  const intptr_t kStep = SliceBudget::CounterReset / kNumNodesBetweenTimeChecks;
+// The budget is charged this much for each node traversed and each child
+// noted, so the time is checked about every thousand of them.
+static const intptr_t kNumNodesBetweenTimeChecks = 1000;
+static const intptr_t kGraphBuildingStep =
+    SliceBudget::CounterReset / kNumNodesBetweenTimeChecks;
 
+MOZ_NEVER_INLINE bool CCGraphBuilder::BuildGraph(SliceBudget& aBudget) {
   MOZ_ASSERT(mCurrNode);
 
+  // Finish off the participant that the previous slice yielded in the middle
+  // of.
+  if (!mPendingChildren->IsDone()) {
+    if (!AddPendingChildren(aBudget)) {
+      return false;
+    }
+    FinishCurrentNode();
+  }
+
   while (!aBudget.isOverBudget() && !mCurrNode->IsDone()) {
     mNoteChildCount = 0;
 
@@ -2064,11 +2254,15 @@ MOZ_NEVER_INLINE bool CCGraphBuilder::BuildGraph(SliceBudget& aBudget) {
                          "Cycle collector Traverse method failed");
     }
 
-    if (mCurrNode->AtBlockEnd()) {
-      SetLastChild();
-    }
+    // Buffered children are charged as they are added.
+    MOZ_ASSERT(mNoteChildCount >= mPendingChildren->Length());
+    aBudget.step(kGraphBuildingStep *
+                 (mNoteChildCount - mPendingChildren->Length() + 1));
 
-    aBudget.step(kStep * (mNoteChildCount + 1));
+    if (!AddPendingChildren(aBudget)) {
+      return false;
+    }
+    FinishCurrentNode();
   }
 
   if (!mCurrNode->IsDone()) {
@@ -2084,6 +2278,33 @@ MOZ_NEVER_INLINE bool CCGraphBuilder::BuildGraph(SliceBudget& aBudget) {
   return true;
 }
 
+bool CCGraphBuilder::AddPendingChildren(SliceBudget& aBudget) {
+  while (!mPendingChildren->IsDone()) {
+    if (aBudget.isOverBudget()) {
+      mPendingChildren->Defer();
+      return false;
+    }
+
+    const nsCString* edgeName;
+    const CCPendingChildren::Child& child =
+        mPendingChildren->GetNext(&edgeName);
+    if (child.mPointer) {
+      AddChildEdge(child.mPointer, child.mParticipant, edgeName);
+    }
+    aBudget.step(kGraphBuildingStep);
+  }
+  return true;
+}
+
+void CCGraphBuilder::FinishCurrentNode() {
+  MOZ_ASSERT(mPendingChildren->IsDone());
+  mPendingChildren->Clear();
+
+  if (mCurrNode->AtBlockEnd()) {
+    SetLastChild();
+  }
+}
+
 NS_IMETHODIMP_(void)
 CCGraphBuilder::NoteXPCOMRoot(nsISupports* aRoot,
                               nsCycleCollectionParticipant* aParticipant) {
@@ -3381,6 +3602,7 @@ bool nsCycleCollector::Collect(ccType aCCType, SliceBudget& aBudget,
     return false;
   }
   mActivelyCollecting = true;
+  TimeStamp sliceStart = TimeStamp::Now();
 
   MOZ_ASSERT(!IsIncrementalGCInProgress());
 
@@ -3406,12 +3628,17 @@ bool nsCycleCollector::Collect(ccType aCCType, SliceBudget& aBudget,
 
   ++mResults.mNumSlices;
 
+  // ScanRoots drops mLogger before the collection is over, so hold on to it
+  // for recording how long this slice took.
+  RefPtr<nsCycleCollectorLogger> sliceLogger = mLogger;
+
   bool continueSlice = aBudget.isUnlimited() || !aPreferShorterSlices;
   do {
     switch (mIncrementalPhase) {
       case IdlePhase:
         PrintPhase("BeginCollection");
         BeginCollection(aCCType, aManualListener);
+        sliceLogger = mLogger;
         break;
       case GraphBuildingPhase:
         PrintPhase("MarkRoots");
@@ -3449,6 +3676,10 @@ bool nsCycleCollector::Collect(ccType aCCType, SliceBudget& aBudget,
     }
   } while (continueSlice);
 
+  if (sliceLogger) {
+    sliceLogger->NoteSlice(TimeStamp::Now() - sliceStart);
+  }
+
   // Clear mActivelyCollecting here to ensure that a recursive call to
   // Collect() does something.
   mActivelyCollecting = false;
@@ -4,8 +4,9 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
+
 // Moz headers (alphabetical)
-#include "nsCRTGlue.h"
 #include "nsError.h"
 #include "nsIFile.h"
 #include "nsINIParser.h"
@@ -14,87 +15,203 @@
 
 using namespace mozilla;
 
-nsresult nsINIParser::Init(nsIFile* aFile) {
-  nsCString result;
-  MOZ_TRY_VAR(result, URLPreloader::ReadFile(aFile));
+nsINIParser::nsINIParser() : mIndexed(false) {}
 
-  return InitFromString(result);
-}
+nsINIParser::~nsINIParser() {}
 
-static const char kNL[] = "\r\n";
-static const char kEquals[] = "=";
-static const char kWhitespace[] = " \t";
-static const char kRBracket[] = "]";
+nsresult nsINIParser::Init(nsIFile* aFile) {
+  MOZ_TRY_VAR(mBuffer, URLPreloader::ReadFile(aFile));
 
-nsresult nsINIParser::InitFromString(const nsCString& aStr) {
-  nsCString fileContents;
-  char* buffer;
+  return InitFromString(mBuffer);
+}
 
+nsresult nsINIParser::InitFromString(const nsACString& aStr) {
   if (StringHead(aStr, 3) == "\xEF\xBB\xBF") {
     // Someone set us up the Utf-8 BOM
     // This case is easy, since we assume that BOM-less
     // files are Utf-8 anyway.  Just skip the BOM and process as usual.
-    fileContents.Append(aStr);
-    buffer = fileContents.BeginWriting() + 3;
+    mData.Rebind(aStr, 3);
+  } else if (StringHead(aStr, 2) == "\xFF\xFE") {
+    // Someone set us up the Utf-16LE BOM
+    nsDependentSubstring str(
+        reinterpret_cast<const char16_t*>(aStr.BeginReading()),
+        aStr.Length() / 2);
+
+    nsCString utf8;
+    AppendUTF16toUTF8(Substring(str, 1), utf8);
+    mBuffer = std::move(utf8);
+    mData.Rebind(mBuffer, 0);
   } else {
-    if (StringHead(aStr, 2) == "\xFF\xFE") {
-      // Someone set us up the Utf-16LE BOM
-      nsDependentSubstring str(reinterpret_cast<const char16_t*>(aStr.get()),
-                               aStr.Length() / 2);
-
-      AppendUTF16toUTF8(Substring(str, 1), fileContents);
-    } else {
-      fileContents.Append(aStr);
-    }
+    mData.Rebind(aStr, 0);
+  }
 
-    buffer = fileContents.BeginWriting();
+  // Nothing after a null character is parsed.
+  int32_t nul = mData.FindChar('\0');
+  if (nul != kNotFound) {
+    mData.Rebind(mData.BeginReading(), nul);
   }
 
-  char* currSection = nullptr;
+  return NS_OK;
+}
 
-  // outer loop tokenizes into lines
-  while (char* token = NS_strtok(kNL, &buffer)) {
-    if (token[0] == '#' || token[0] == ';') {  // it's a comment
-      continue;
+// Returns the line starting at aCur, and moves aCur past it and its line
+// break.
+static nsDependentCSubstring NextLine(const char*& aCur, const char* aEnd) {
+  const char* start = aCur;
+  while (aCur < aEnd && *aCur != '\r' && *aCur != '\n') {
+    ++aCur;
+  }
+  nsDependentCSubstring line(start, aCur);
+  if (aCur < aEnd) {
+    ++aCur;
+  }
+  return line;
+}
+
+// Returns aLine without its leading whitespace, or an empty string if aLine
+// is a comment.
+static nsDependentCSubstring TrimLine(const nsACString& aLine) {
+  const char* cur = aLine.BeginReading();
+  const char* end = aLine.EndReading();
+  if (cur < end && (*cur == '#' || *cur == ';')) {
+    return nsDependentCSubstring(end, end);
+  }
+  while (cur < end && (*cur == ' ' || *cur == '\t')) {
+    ++cur;
+  }
+  return nsDependentCSubstring(cur, end);
+}
+
+// Checks that aLine, which starts with a '[', is a well-formed section
+// header, and sets aName to the section's name if so. A header missing its
+// ']' runs to the end of the line.
+static bool ParseSectionHeader(const nsACString& aLine,
+                               nsDependentCSubstring& aName) {
+  int32_t rb = aLine.FindChar(']');
+  if (rb == kNotFound) {
+    rb = aLine.Length();
+  }
+  if (rb <= 1) {
+    return false;
+  }
+
+  // Nothing but whitespace may follow the ']'.
+  for (uint32_t i = rb + 1; i < aLine.Length(); ++i) {
+    if (aLine[i] != ' ' && aLine[i] != '\t') {
+      return false;
     }
+  }
+
+  aName.Rebind(aLine.BeginReading() + 1, rb - 1);
+  return aName.FindChar('[') == kNotFound;
+}
 
-    token = (char*)NS_strspnp(kWhitespace, token);
-    if (!*token) {  // empty line
+void nsINIParser::EnsureSectionIndex() {
+  if (mIndexed) {
+    return;
+  }
+  mIndexed = true;
+
+  INISection* section = nullptr;
+  const char* body = nullptr;
+  const char* cur = mData.BeginReading();
+  const char* end = mData.EndReading();
+
+  while (cur < end) {
+    const char* lineStart = cur;
+    nsDependentCSubstring line = TrimLine(NextLine(cur, end));
+    if (line.IsEmpty() || line.First() != '[') {
       continue;
     }
 
-    if (token[0] == '[') {  // section header!
-      ++token;
-      currSection = token;
-
-      char* rb = NS_strtok(kRBracket, &token);
-      if (!rb || NS_strtok(kWhitespace, &token)) {
-        // there's either an unclosed [Section or a [Section]Moretext!
-        // we could frankly decide that this INI file is malformed right
-        // here and stop, but we won't... keep going, looking for
-        // a well-formed [section] to continue working with
-        currSection = nullptr;
-      }
+    if (section) {
+      section->bodies.AppendElement(Substring(body, lineStart));
+    }
 
+    // If the header is malformed, ignore the lines up to the next
+    // well-formed one.
+    nsDependentCSubstring name;
+    if (!ParseSectionHeader(line, name)) {
+      section = nullptr;
       continue;
     }
 
-    if (!currSection) {
-      // If we haven't found a section header (or we found a malformed
-      // section header), don't bother parsing this line.
-      continue;
+    section = LookupSection(name);
+    if (!section) {
+      section = mSections.AppendElement();
+      section->name.Rebind(name.BeginReading(), name.Length());
     }
+    body = cur;
+  }
 
-    char* key = token;
-    char* e = NS_strtok(kEquals, &token);
-    if (!e || !token) {
-      continue;
+  if (section) {
+    section->bodies.AppendElement(Substring(body, end));
+  }
+}
+
+void nsINIParser::ParseSection(INISection& aSection) {
+  for (const nsDependentCSubstring& body : aSection.bodies) {
+    const char* cur = body.BeginReading();
+    const char* end = body.EndReading();
+    while (cur < end) {
+      nsDependentCSubstring line = TrimLine(NextLine(cur, end));
+      if (!line.IsEmpty()) {
+        ParseValue(aSection, line);
+      }
     }
+  }
+  aSection.bodies.Clear();
+}
 
-    SetString(currSection, key, token);
+void nsINIParser::ParseValue(INISection& aSection, const nsACString& aLine) {
+  // The key is everything up to the first '=', and may not be empty.
+  int32_t equals = aLine.FindChar('=');
+  if (equals <= 0) {
+    return;
   }
 
-  return NS_OK;
+  nsDependentCSubstring key(aLine.BeginReading(), equals);
+  INIValue* val = FindValue(aSection, key);
+  if (!val) {
+    val = aSection.values.AppendElement();
+    val->key.Rebind(key.BeginReading(), key.Length());
+  }
+  val->value.Rebind(aLine.BeginReading() + equals + 1,
+                    aLine.EndReading());
+}
+
+nsINIParser::INISection* nsINIParser::LookupSection(
+    const nsACString& aSection) {
+  for (INISection& section : mSections) {
+    if (section.name.Equals(aSection)) {
+      return &section;
+    }
+  }
+  return nullptr;
+}
+
+nsINIParser::INISection* nsINIParser::FindSection(const char* aSection) {
+  EnsureSectionIndex();
+
+  INISection* section = LookupSection(nsDependentCString(aSection));
+  if (section) {
+    ParseSection(*section);
+  }
+  return section;
+}
+
+nsINIParser::INIValue* nsINIParser::FindValue(INISection& aSection,
+                                              const nsACString& aKey) {
+  for (INIValue& val : aSection.values) {
+    if (val.key.Equals(aKey)) {
+      return &val;
+    }
+  }
+  return nullptr;
+}
+
+void nsINIParser::RemoveSection(INISection* aSection) {
+  mSections.RemoveElementAt(aSection - mSections.Elements());
 }
 
 bool nsINIParser::IsValidSection(const char* aSection) {
@@ -126,19 +243,15 @@ nsresult nsINIParser::GetString(const char* aSection, const char* aKey,
     return NS_ERROR_INVALID_ARG;
   }
 
-  INIValue* val;
-  mSections.Get(aSection, &val);
-
-  while (val) {
-    if (strcmp(val->key, aKey) == 0) {
-      aResult.Assign(val->value);
-      return NS_OK;
-    }
-
-    val = val->next.get();
+  INISection* section = FindSection(aSection);
+  INIValue* val =
+      section ? FindValue(*section, nsDependentCString(aKey)) : nullptr;
+  if (!val) {
+    return NS_ERROR_FAILURE;
   }
 
-  return NS_ERROR_FAILURE;
+  aResult.Assign(val->value);
+  return NS_OK;
 }
 
 nsresult nsINIParser::GetString(const char* aSection, const char* aKey,
@@ -147,29 +260,34 @@ nsresult nsINIParser::GetString(const char* aSection, const char* aKey,
     return NS_ERROR_INVALID_ARG;
   }
 
-  INIValue* val;
-  mSections.Get(aSection, &val);
-
-  while (val) {
-    if (strcmp(val->key, aKey) == 0) {
-      strncpy(aResult, val->value, aResultLen);
-      aResult[aResultLen - 1] = '\0';
-      if (strlen(val->value) >= aResultLen) {
-        return NS_ERROR_LOSS_OF_SIGNIFICANT_DATA;
-      }
-
-      return NS_OK;
-    }
+  INISection* section = FindSection(aSection);
+  INIValue* val =
+      section ? FindValue(*section, nsDependentCString(aKey)) : nullptr;
+  if (!val) {
+    return NS_ERROR_FAILURE;
+  }
 
-    val = val->next.get();
+  uint32_t length = std::min(val->value.Length(), aResultLen - 1);
+  memcpy(aResult, val->value.BeginReading(), length);
+  aResult[length] = '\0';
+  if (val->value.Length() >= aResultLen) {
+    return NS_ERROR_LOSS_OF_SIGNIFICANT_DATA;
   }
 
-  return NS_ERROR_FAILURE;
+  return NS_OK;
 }
 
 nsresult nsINIParser::GetSections(INISectionCallback aCB, void* aClosure) {
-  for (auto iter = mSections.Iter(); !iter.Done(); iter.Next()) {
-    if (!aCB(iter.Key(), aClosure)) {
+  EnsureSectionIndex();
+
+  for (INISection& section : mSections) {
+    ParseSection(section);
+    if (section.values.IsEmpty()) {
+      continue;
+    }
+
+    nsAutoCString name(section.name);
+    if (!aCB(name.get(), aClosure)) {
       break;
     }
   }
@@ -182,10 +300,15 @@ nsresult nsINIParser::GetStrings(const char* aSection, INIStringCallback aCB,
     return NS_ERROR_INVALID_ARG;
   }
 
-  INIValue* val;
+  INISection* section = FindSection(aSection);
+  if (!section) {
+    return NS_OK;
+  }
 
-  for (mSections.Get(aSection, &val); val; val = val->next.get()) {
-    if (!aCB(val->key, val->value, aClosure)) {
+  for (const INIValue& val : section->values) {
+    nsAutoCString key(val.key);
+    nsAutoCString value(val.value);
+    if (!aCB(key.get(), value.get(), aClosure)) {
       return NS_OK;
     }
   }
@@ -199,28 +322,22 @@ nsresult nsINIParser::SetString(const char* aSection, const char* aKey,
     return NS_ERROR_INVALID_ARG;
   }
 
-  INIValue* v;
-  if (!mSections.Get(aSection, &v)) {
-    v = new INIValue(aKey, aValue);
-
-    mSections.Put(aSection, v);
-    return NS_OK;
+  INISection* section = FindSection(aSection);
+  if (!section) {
+    section = mSections.AppendElement();
+    section->ownedName.Assign(aSection);
+    section->name.Rebind(section->ownedName, 0);
   }
 
-  // Check whether this key has already been specified; overwrite
-  // if so, or append if not.
-  while (v) {
-    if (!strcmp(aKey, v->key)) {
-      v->SetValue(aValue);
-      break;
-    }
-    if (!v->next) {
-      v->next = MakeUnique<INIValue>(aKey, aValue);
-      break;
-    }
-    v = v->next.get();
+  // Overwrite the key if it has already been specified, or append it if not.
+  INIValue* val = FindValue(*section, nsDependentCString(aKey));
+  if (!val) {
+    val = section->values.AppendElement();
+    val->ownedKey.Assign(aKey);
+    val->key.Rebind(val->ownedKey, 0);
   }
-  NS_ASSERTION(v, "v should never be null coming out of this loop");
+  val->ownedValue.Assign(aValue);
+  val->value.Rebind(val->ownedValue, 0);
 
   return NS_OK;
 }
@@ -230,30 +347,19 @@ nsresult nsINIParser::DeleteString(const char* aSection, const char* aKey) {
     return NS_ERROR_INVALID_ARG;
   }
 
-  INIValue* val;
-  if (!mSections.Get(aSection, &val)) {
+  INISection* section = FindSection(aSection);
+  if (!section) {
     return NS_ERROR_FAILURE;
   }
 
-  // Special case the first result
-  if (strcmp(val->key, aKey) == 0) {
-    if (!val->next) {
-      mSections.Remove(aSection);
-    } else {
-      mSections.Put(aSection, val->next.release());
-      delete val;
-    }
-    return NS_OK;
-  }
-
-  while (val->next) {
-    if (strcmp(val->next->key, aKey) == 0) {
-      val->next = std::move(val->next->next);
-
+  for (uint32_t i = 0; i < section->values.Length(); ++i) {
+    if (section->values[i].key.Equals(aKey)) {
+      section->values.RemoveElementAt(i);
+      if (section->values.IsEmpty()) {
+        RemoveSection(section);
+      }
       return NS_OK;
     }
-
-    val = val->next.get();
   }
 
   return NS_ERROR_FAILURE;
@@ -264,10 +370,14 @@ nsresult nsINIParser::DeleteSection(const char* aSection) {
     return NS_ERROR_INVALID_ARG;
   }
 
-  if (!mSections.Remove(aSection)) {
+  INISection* section = FindSection(aSection);
+  if (!section) {
     return NS_ERROR_FAILURE;
   }
-  return NS_OK;
+
+  bool existed = !section->values.IsEmpty();
+  RemoveSection(section);
+  return existed ? NS_OK : NS_ERROR_FAILURE;
 }
 
 nsresult nsINIParser::RenameSection(const char* aSection,
@@ -276,29 +386,47 @@ nsresult nsINIParser::RenameSection(const char* aSection,
     return NS_ERROR_INVALID_ARG;
   }
 
-  if (mSections.Get(aNewName, nullptr)) {
+  INISection* existing = FindSection(aNewName);
+  if (existing && !existing->values.IsEmpty()) {
     return NS_ERROR_ILLEGAL_VALUE;
   }
 
-  mozilla::UniquePtr<INIValue> val;
-  if (mSections.Remove(aSection, &val)) {
-    mSections.Put(aNewName, val.release());
-  } else {
+  INISection* section = FindSection(aSection);
+  if (!section || section->values.IsEmpty()) {
     return NS_ERROR_FAILURE;
   }
 
+  // Drop the empty section with the new name, if the file had one.
+  if (existing) {
+    RemoveSection(existing);
+    section = FindSection(aSection);
+  }
+
+  section->ownedName.Assign(aNewName);
+  section->name.Rebind(section->ownedName, 0);
+
   return NS_OK;
 }
 
 nsresult nsINIParser::WriteToFile(nsIFile* aFile) {
   nsCString buffer;
 
-  for (auto iter = mSections.Iter(); !iter.Done(); iter.Next()) {
-    buffer.AppendPrintf("[%s]\n", iter.Key());
-    INIValue* val = iter.UserData();
-    while (val) {
-      buffer.AppendPrintf("%s=%s\n", val->key, val->value);
-      val = val->next.get();
+  EnsureSectionIndex();
+
+  for (INISection& section : mSections) {
+    ParseSection(section);
+    if (section.values.IsEmpty()) {
+      continue;
+    }
+
+    buffer.Append('[');
+    buffer.Append(section.name);
+    buffer.AppendLiteral("]\n");
+    for (const INIValue& val : section.values) {
+      buffer.Append(val.key);
+      buffer.Append('=');
+      buffer.Append(val.value);
+      buffer.Append('\n');
     }
     buffer.AppendLiteral("\n");
   }
@@ -14,7 +14,8 @@
 #endif
 
 #include "nscore.h"
-#include "nsClassHashtable.h"
+#include "nsString.h"
+#include "nsTArray.h"
 #include "mozilla/UniquePtr.h"
 
 #include <stdio.h>
@@ -23,14 +24,18 @@ class nsIFile;
 
 class nsINIParser {
  public:
-  nsINIParser() {}
-  ~nsINIParser() {}
+  nsINIParser();
+  ~nsINIParser();
 
   /**
    * Initialize the INIParser with a nsIFile. If this method fails, no
-   * other methods should be called. This method reads and parses the file,
-   * the class does not hold a file handle open. An instance must only be
-   * initialized once.
+   * other methods should be called. An instance must only be initialized
+   * once.
+   *
+   * This method reads the file, the class does not hold a file handle open.
+   * The file is only parsed as far as needed: the first lookup finds the
+   * section headers, and the keys of a section are found the first time the
+   * section is used.
    */
   nsresult Init(nsIFile* aFile);
 
@@ -128,35 +133,52 @@ class nsINIParser {
   nsresult RenameSection(const char* aSection, const char* aNewName);
 
   /**
-   * Writes the ini data to disk.
+   * Writes the ini data to disk. The file may be the one the parser was
+   * initialized with.
    * @param aFile         the file to write to
    * @throws NS_ERROR_FAILURE on failure.
    */
   nsresult WriteToFile(nsIFile* aFile);
 
  private:
+  // The key and value point into the file's data, or, once set by
+  // SetString(), into ownedKey and ownedValue.
   struct INIValue {
-    INIValue(const char* aKey, const char* aValue)
-        : key(strdup(aKey)), value(strdup(aValue)) {}
-
-    ~INIValue() {
-      delete key;
-      delete value;
-    }
-
-    void SetValue(const char* aValue) {
-      delete value;
-      value = strdup(aValue);
-    }
-
-    const char* key;
-    const char* value;
-    mozilla::UniquePtr<INIValue> next;
+    nsDependentCSubstring key;
+    nsDependentCSubstring value;
+    nsCString ownedKey;
+    nsCString ownedValue;
   };
 
-  nsClassHashtable<nsCharPtrHashKey, INIValue> mSections;
+  struct INISection {
+    nsDependentCSubstring name;
+    nsCString ownedName;
+    // The lines following each of the section's headers, up to the next
+    // header. They are split into values, and cleared, the first time the
+    // section is used.
+    nsTArray<nsDependentCSubstring> bodies;
+    nsTArray<INIValue> values;
+  };
 
-  nsresult InitFromString(const nsCString& aStr);
+  // Sections in the order they appear in the file, followed by the ones added
+  // by SetString(). Sections that are in the file but have no valid keys are
+  // kept, but treated as if they did not exist.
+  nsTArray<INISection> mSections;
+  bool mIndexed;
+
+  // The file's contents, after its BOM. This is in mBuffer.
+  nsDependentCSubstring mData;
+  nsCString mBuffer;
+
+  nsresult InitFromString(const nsACString& aStr);
+
+  void EnsureSectionIndex();
+  void ParseSection(INISection& aSection);
+  void ParseValue(INISection& aSection, const nsACString& aLine);
+  INISection* LookupSection(const nsACString& aSection);
+  INISection* FindSection(const char* aSection);
+  INIValue* FindValue(INISection& aSection, const nsACString& aKey);
+  void RemoveSection(INISection* aSection);
 
   bool IsValidSection(const char* aSection);
   bool IsValidKey(const char* aKey);
@@ -35,6 +35,7 @@
 #include "mozilla/ResultExtensions.h"
 #include "mozilla/Services.h"
 #include "mozilla/Telemetry.h"
+#include "mozilla/ThreadCachingAllocator.h"
 #include "mozilla/UniquePtrExtensions.h"
 #include "mozilla/dom/MemoryReportTypes.h"
 #include "mozilla/dom/ContentParent.h"
@@ -1326,6 +1327,39 @@ class AtomTablesReporter final : public nsIMemoryReporter {
 };
 NS_IMPL_ISUPPORTS(AtomTablesReporter, nsIMemoryReporter)
 
+class ThreadCachingAllocatorReporter final : public nsIMemoryReporter {
+  MOZ_DEFINE_MALLOC_SIZE_OF(MallocSizeOf)
+
+  ~ThreadCachingAllocatorReporter() = default;
+
+ public:
+  NS_DECL_ISUPPORTS
+
+  NS_IMETHOD CollectReports(nsIHandleReportCallback* aHandleReport,
+                            nsISupports* aData, bool aAnonymize) override {
+    ThreadCachingAllocatorSizes sizes;
+    ThreadCachingAllocator::AddSizeOf(MallocSizeOf, sizes);
+
+    MOZ_COLLECT_REPORT("explicit/xpcom/thread-caching-allocator/used",
+                       KIND_HEAP, UNITS_BYTES, sizes.mUsed,
+                       "Memory in live ThreadCachingAllocator blocks.");
+
+    MOZ_COLLECT_REPORT(
+        "explicit/xpcom/thread-caching-allocator/unused", KIND_HEAP,
+        UNITS_BYTES, sizes.mUnused,
+        "Memory held by ThreadCachingAllocator's per-thread caches that is "
+        "free for reuse.");
+
+    MOZ_COLLECT_REPORT("explicit/xpcom/thread-caching-allocator/overhead",
+                       KIND_HEAP, UNITS_BYTES, sizes.mOverhead,
+                       "Memory used by ThreadCachingAllocator's per-thread "
+                       "cache structures.");
+
+    return NS_OK;
+  }
+};
+NS_IMPL_ISUPPORTS(ThreadCachingAllocatorReporter, nsIMemoryReporter)
+
 class ThreadsReporter final : public nsIMemoryReporter {
   MOZ_DEFINE_MALLOC_SIZE_OF(MallocSizeOf)
   ~ThreadsReporter() = default;
@@ -1636,6 +1670,8 @@ nsMemoryReporterManager::Init() {
 
   RegisterStrongReporter(new AtomTablesReporter());
 
+  RegisterStrongReporter(new ThreadCachingAllocatorReporter());
+
   RegisterStrongReporter(new ThreadsReporter());
 
 #ifdef DEBUG
@@ -18,6 +18,11 @@
 #include "mozilla/MemoryReporting.h"
 #include "mozilla/Maybe.h"
 #include "mozilla/ChaosMode.h"
+#include "mozilla/SSE.h"
+
+#ifdef MOZILLA_PRESUME_SSE2
+#  include <emmintrin.h>
+#endif
 
 using namespace mozilla;
 
@@ -112,8 +117,11 @@ static const PLDHashTableOps gStubOps = {
 }
 
 static bool SizeOfEntryStore(uint32_t aCapacity, uint32_t aEntrySize,
-                             uint32_t* aNbytes) {
+                             PLDHashTableLayout aLayout, uint32_t* aNbytes) {
   uint32_t slotSize = aEntrySize + sizeof(PLDHashNumber);
+  if (aLayout == PLDHashTableLayout::Grouped) {
+    slotSize += 1;  // The control byte.
+  }
   uint64_t nbytes64 = uint64_t(aCapacity) * uint64_t(slotSize);
   *aNbytes = aCapacity * slotSize;
   return uint64_t(*aNbytes) == nbytes64;  // returns false on overflow
@@ -138,8 +146,9 @@ static inline uint32_t MinLoad(uint32_t aCapacity) {
 // containing |aLength| elements while respecting the following contraints:
 // - table must be at most 75% full;
 // - capacity must be a power of two;
-// - capacity cannot be too small.
-static inline void BestCapacity(uint32_t aLength, uint32_t* aCapacityOut,
+// - capacity cannot be too small (|aMinCapacity| is a power of two).
+static inline void BestCapacity(uint32_t aLength, uint32_t aMinCapacity,
+                                uint32_t* aCapacityOut,
                                 uint32_t* aLog2CapacityOut) {
   // Callers should ensure this is true.
   MOZ_ASSERT(aLength <= PLDHashTable::kMaxInitialLength);
@@ -147,8 +156,8 @@ static inline void BestCapacity(uint32_t aLength, uint32_t* aCapacityOut,
   // Compute the smallest capacity allowing |aLength| elements to be inserted
   // without rehashing.
   uint32_t capacity = (aLength * 4 + (3 - 1)) / 3;  // == ceil(aLength * 4 / 3)
-  if (capacity < PLDHashTable::kMinCapacity) {
-    capacity = PLDHashTable::kMinCapacity;
+  if (capacity < aMinCapacity) {
+    capacity = aMinCapacity;
   }
 
   // Round up capacity to next power-of-two.
@@ -160,17 +169,20 @@ static inline void BestCapacity(uint32_t aLength, uint32_t* aCapacityOut,
   *aLog2CapacityOut = log2;
 }
 
-/* static */ MOZ_ALWAYS_INLINE uint32_t
-PLDHashTable::HashShift(uint32_t aEntrySize, uint32_t aLength) {
+/* static */ MOZ_ALWAYS_INLINE uint32_t PLDHashTable::HashShift(
+    uint32_t aEntrySize, uint32_t aLength, PLDHashTableLayout aLayout) {
   if (aLength > kMaxInitialLength) {
     MOZ_CRASH("Initial length is too large");
   }
 
   uint32_t capacity, log2;
-  BestCapacity(aLength, &capacity, &log2);
+  BestCapacity(aLength,
+               aLayout == PLDHashTableLayout::Grouped ? kGroupWidth
+                                                      : kMinCapacity,
+               &capacity, &log2);
 
   uint32_t nbytes;
-  if (!SizeOfEntryStore(capacity, aEntrySize, &nbytes)) {
+  if (!SizeOfEntryStore(capacity, aEntrySize, aLayout, &nbytes)) {
     MOZ_CRASH("Initial entry store size is too large");
   }
 
@@ -179,14 +191,15 @@ PLDHashTable::HashShift(uint32_t aEntrySize, uint32_t aLength) {
 }
 
 PLDHashTable::PLDHashTable(const PLDHashTableOps* aOps, uint32_t aEntrySize,
-                           uint32_t aLength)
+                           uint32_t aLength, PLDHashTableLayout aLayout)
     : mOps(recordreplay::GeneratePLDHashTableCallbacks(aOps)),
       mEntryStore(),
       mGeneration(0),
-      mHashShift(HashShift(aEntrySize, aLength)),
+      mHashShift(HashShift(aEntrySize, aLength, aLayout)),
       mEntrySize(aEntrySize),
       mEntryCount(0),
-      mRemovedCount(0) {
+      mRemovedCount(0),
+      mLayout(aLayout) {
   // An entry size greater than 0xff is unlikely, but let's check anyway. If
   // you hit this, your hashtable would waste lots of space for unused entries
   // and you should change your hash table's entries to pointers.
@@ -213,8 +226,9 @@ PLDHashTable& PLDHashTable::operator=(PLDHashTable&& aOther) {
   // Reconstruct |this|.
   const PLDHashTableOps* ops =
       recordreplay::UnwrapPLDHashTableCallbacks(aOther.mOps);
+  PLDHashTableLayout layout = aOther.mLayout;
   this->~PLDHashTable();
-  new (KnownNotNull, this) PLDHashTable(ops, aOther.mEntrySize, 0);
+  new (KnownNotNull, this) PLDHashTable(ops, aOther.mEntrySize, 0, layout);
 
   // Move non-const pieces over.
   mHashShift = std::move(aOther.mHashShift);
@@ -283,6 +297,91 @@ auto PLDHashTable::SlotForIndex(uint32_t aIndex) const -> Slot {
   return mEntryStore.SlotForIndex(aIndex, mEntrySize, CapacityFromHashShift());
 }
 
+uint32_t PLDHashTable::IndexForSlot(const Slot& aSlot) const {
+  return aSlot.HashPtr() - reinterpret_cast<PLDHashNumber*>(mEntryStore.Get());
+}
+
+// Grouped tables keep a control byte per slot, which is either one of the
+// markers below or, for live entries, the 7 hash bits from ControlHash(). Both
+// markers have the high bit set, and no control hash does.
+static const uint8_t kControlFree = 0x80;
+static const uint8_t kControlRemoved = 0xfe;
+
+// A group of kGroupWidth control bytes, and the ways of matching them. Each
+// Match*() method returns a bitmask with bit i set if control byte i matches.
+class ControlGroup {
+ public:
+  explicit ControlGroup(const uint8_t* aControls)
+#ifdef MOZILLA_PRESUME_SSE2
+      : mControls(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(aControls))) {
+  }
+#else
+      : mControls(aControls) {
+  }
+#endif
+
+  uint32_t Match(uint8_t aControl) const {
+#ifdef MOZILLA_PRESUME_SSE2
+    return uint32_t(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(mControls, _mm_set1_epi8(char(aControl)))));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < PLDHashTable::kGroupWidth; i++) {
+      mask |= uint32_t(mControls[i] == aControl) << i;
+    }
+    return mask;
+#endif
+  }
+
+  uint32_t MatchFree() const { return Match(kControlFree); }
+
+  uint32_t MatchFreeOrRemoved() const {
+#ifdef MOZILLA_PRESUME_SSE2
+    return uint32_t(_mm_movemask_epi8(mControls));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < PLDHashTable::kGroupWidth; i++) {
+      mask |= uint32_t(mControls[i] >> 7) << i;
+    }
+    return mask;
+#endif
+  }
+
+ private:
+#ifdef MOZILLA_PRESUME_SSE2
+  __m128i mControls;
+#else
+  const uint8_t* mControls;
+#endif
+};
+
+uint8_t* PLDHashTable::Controls() const {
+  MOZ_ASSERT(IsGrouped());
+  return mEntryStore.Controls(CapacityFromHashShift(), mEntrySize);
+}
+
+// The group index comes from the top bits of the key hash (see Hash1()), so
+// use the seven bits right below those for the control byte.
+uint8_t PLDHashTable::ControlHash(PLDHashNumber aKeyHash) const {
+  MOZ_ASSERT(mHashShift + 4 >= 7);
+  return uint8_t((aKeyHash >> (mHashShift + 4 - 7)) & 0x7f);
+}
+
+void PLDHashTable::SetControl(const Slot& aSlot, uint8_t aControl) {
+  Controls()[IndexForSlot(aSlot)] = aControl;
+}
+
+char* PLDHashTable::AllocateEntryStore(uint32_t aCapacity,
+                                       uint32_t aNbytes) const {
+  char* store = (char*)calloc(1, aNbytes);
+  if (store && IsGrouped()) {
+    char* controls = store + aCapacity * (sizeof(PLDHashNumber) + mEntrySize);
+    memset(controls, kControlFree, aCapacity);
+  }
+  return store;
+}
+
 PLDHashTable::~PLDHashTable() {
 #ifdef MOZ_HASH_TABLE_CHECKS_ENABLED
   AutoDestructorOp op(mChecker);
@@ -309,9 +408,10 @@ void PLDHashTable::ClearAndPrepareForLength(uint32_t aLength) {
   // Get these values before the destructor clobbers them.
   const PLDHashTableOps* ops = recordreplay::UnwrapPLDHashTableCallbacks(mOps);
   uint32_t entrySize = mEntrySize;
+  PLDHashTableLayout layout = mLayout;
 
   this->~PLDHashTable();
-  new (KnownNotNull, this) PLDHashTable(ops, entrySize, aLength);
+  new (KnownNotNull, this) PLDHashTable(ops, entrySize, aLength, layout);
 }
 
 void PLDHashTable::Clear() { ClearAndPrepareForLength(kDefaultInitialLength); }
@@ -330,6 +430,11 @@ MOZ_ALWAYS_INLINE auto PLDHashTable::SearchTable(const void* aKey,
   MOZ_ASSERT(mEntryStore.Get());
   NS_ASSERTION(!(aKeyHash & kCollisionFlag), "!(aKeyHash & kCollisionFlag)");
 
+  if (IsGrouped()) {
+    return SearchGroups<Reason>(aKey, aKeyHash, std::forward<Success>(aSuccess),
+                                std::forward<Failure>(aFailure));
+  }
+
   // Compute the primary hash address.
   PLDHashNumber hash1 = Hash1(aKeyHash);
   Slot slot = SlotForIndex(hash1);
@@ -389,6 +494,62 @@ MOZ_ALWAYS_INLINE auto PLDHashTable::SearchTable(const void* aKey,
   return aFailure();
 }
 
+// The SearchTable() equivalent for grouped tables. Groups are probed in
+// triangular order (group, group + 1, group + 3, group + 6, ...), which visits
+// every group of a power-of-two sized table. A probe sequence ends at the first
+// group containing a free slot: RawRemove() only frees a slot if its group
+// already has a free slot, i.e. if no insertion ever probed past that group.
+template <PLDHashTable::SearchReason Reason, typename Success, typename Failure>
+MOZ_ALWAYS_INLINE auto PLDHashTable::SearchGroups(const void* aKey,
+                                                  PLDHashNumber aKeyHash,
+                                                  Success&& aSuccess,
+                                                  Failure&& aFailure) const {
+  const uint8_t* controls = Controls();
+  const uint8_t controlHash = ControlHash(aKeyHash);
+  const uint32_t groupMask = (CapacityFromHashShift() / kGroupWidth) - 1;
+  uint32_t group = Hash1(aKeyHash) / kGroupWidth;
+
+  PLDHashMatchEntry matchEntry = mOps->matchEntry;
+
+  // The first free or removed slot seen, for Add() to use. (Only used if
+  // Reason==ForAdd.)
+  Maybe<Slot> firstAvailable;
+
+  for (uint32_t stride = 1;; stride++) {
+    const uint32_t base = group * kGroupWidth;
+    ControlGroup controlGroup(controls + base);
+
+    for (uint32_t matches = controlGroup.Match(controlHash); matches;
+         matches &= matches - 1) {
+      Slot slot = SlotForIndex(base + CountTrailingZeroes32(matches));
+      if (matchEntry(slot.ToEntry(), aKey)) {
+        return aSuccess(slot);
+      }
+    }
+
+    if (Reason == ForAdd && !firstAvailable) {
+      uint32_t available = controlGroup.MatchFreeOrRemoved();
+      if (available) {
+        firstAvailable.emplace(
+            SlotForIndex(base + CountTrailingZeroes32(available)));
+      }
+    }
+
+    if (MOZ_LIKELY(controlGroup.MatchFree())) {
+      if (Reason != ForAdd) {
+        return aFailure();
+      }
+      return aSuccess(*firstAvailable);
+    }
+
+    MOZ_ASSERT(stride <= groupMask, "should have found a free slot");
+    group = (group + stride) & groupMask;
+  }
+
+  // NOTREACHED
+  return aFailure();
+}
+
 // This is a copy of SearchTable(), used by ChangeTable(), hardcoded to
 //   1. assume |Reason| is |ForAdd|,
 //   2. assume that |aKey| will never match an existing entry, and
@@ -401,6 +562,10 @@ MOZ_ALWAYS_INLINE auto PLDHashTable::FindFreeSlot(PLDHashNumber aKeyHash) const
   MOZ_ASSERT(mEntryStore.Get());
   NS_ASSERTION(!(aKeyHash & kCollisionFlag), "!(aKeyHash & kCollisionFlag)");
 
+  if (IsGrouped()) {
+    return FindFreeSlotInGroups(aKeyHash);
+  }
+
   // Compute the primary hash address.
   PLDHashNumber hash1 = Hash1(aKeyHash);
   Slot slot = SlotForIndex(hash1);
@@ -431,6 +596,29 @@ MOZ_ALWAYS_INLINE auto PLDHashTable::FindFreeSlot(PLDHashNumber aKeyHash) const
   // NOTREACHED
 }
 
+// The FindFreeSlot() equivalent for grouped tables. The new slot's control
+// byte is set here, since ChangeTable() only deals with hashes.
+auto PLDHashTable::FindFreeSlotInGroups(PLDHashNumber aKeyHash) const -> Slot {
+  uint8_t* controls = Controls();
+  const uint32_t groupMask = (CapacityFromHashShift() / kGroupWidth) - 1;
+  uint32_t group = Hash1(aKeyHash) / kGroupWidth;
+
+  for (uint32_t stride = 1;; stride++) {
+    const uint32_t base = group * kGroupWidth;
+    uint32_t free = ControlGroup(controls + base).MatchFree();
+    if (free) {
+      uint32_t index = base + CountTrailingZeroes32(free);
+      controls[index] = ControlHash(aKeyHash);
+      return SlotForIndex(index);
+    }
+
+    MOZ_ASSERT(stride <= groupMask, "should have found a free slot");
+    group = (group + stride) & groupMask;
+  }
+
+  // NOTREACHED
+}
+
 bool PLDHashTable::ChangeTable(int32_t aDeltaLog2) {
   MOZ_ASSERT(mEntryStore.Get());
 
@@ -443,11 +631,11 @@ bool PLDHashTable::ChangeTable(int32_t aDeltaLog2) {
   }
 
   uint32_t nbytes;
-  if (!SizeOfEntryStore(newCapacity, mEntrySize, &nbytes)) {
+  if (!SizeOfEntryStore(newCapacity, mEntrySize, mLayout, &nbytes)) {
     return false;  // overflowed
   }
 
-  char* newEntryStore = (char*)calloc(1, nbytes);
+  char* newEntryStore = AllocateEntryStore(newCapacity, nbytes);
   if (!newEntryStore) {
     return false;
   }
@@ -518,9 +706,10 @@ PLDHashEntryHdr* PLDHashTable::Add(const void* aKey,
   if (!mEntryStore.Get()) {
     uint32_t nbytes;
     // We already checked this in the constructor, so it must still be true.
-    MOZ_RELEASE_ASSERT(
-        SizeOfEntryStore(CapacityFromHashShift(), mEntrySize, &nbytes));
-    mEntryStore.Set((char*)calloc(1, nbytes), &mGeneration);
+    MOZ_RELEASE_ASSERT(SizeOfEntryStore(CapacityFromHashShift(), mEntrySize,
+                                        mLayout, &nbytes));
+    mEntryStore.Set(AllocateEntryStore(CapacityFromHashShift(), nbytes),
+                    &mGeneration);
     if (!mEntryStore.Get()) {
       return nullptr;
     }
@@ -566,6 +755,9 @@ PLDHashEntryHdr* PLDHashTable::Add(const void* aKey,
       mOps->initEntry(slot.ToEntry(), aKey);
     }
     slot.SetKeyHash(keyHash);
+    if (IsGrouped()) {
+      SetControl(slot, ControlHash(keyHash));
+    }
     mEntryCount++;
   }
 
@@ -578,7 +770,8 @@ PLDHashEntryHdr* PLDHashTable::Add(const void* aKey) {
     if (!mEntryStore.Get()) {
       // We OOM'd while allocating the initial entry storage.
       uint32_t nbytes;
-      (void)SizeOfEntryStore(CapacityFromHashShift(), mEntrySize, &nbytes);
+      (void)SizeOfEntryStore(CapacityFromHashShift(), mEntrySize, mLayout,
+                             &nbytes);
       NS_ABORT_OOM(nbytes);
     } else {
       // We failed to resize the existing entry storage, either due to OOM or
@@ -640,7 +833,20 @@ void PLDHashTable::RawRemove(Slot& aSlot) {
   PLDHashEntryHdr* entry = aSlot.ToEntry();
   PLDHashNumber keyHash = aSlot.KeyHash();
   mOps->clearEntry(this, entry);
-  if (keyHash & kCollisionFlag) {
+  if (IsGrouped()) {
+    // See SearchGroups() for why a group with a free slot can't be in the
+    // middle of any probe sequence.
+    uint32_t index = IndexForSlot(aSlot);
+    uint8_t* controls = Controls();
+    if (ControlGroup(controls + (index & ~(kGroupWidth - 1))).MatchFree()) {
+      controls[index] = kControlFree;
+      aSlot.MarkFree();
+    } else {
+      controls[index] = kControlRemoved;
+      aSlot.MarkRemoved();
+      mRemovedCount++;
+    }
+  } else if (keyHash & kCollisionFlag) {
     aSlot.MarkRemoved();
     mRemovedCount++;
   } else {
@@ -655,9 +861,9 @@ void PLDHashTable::RawRemove(Slot& aSlot) {
 void PLDHashTable::ShrinkIfAppropriate() {
   uint32_t capacity = Capacity();
   if (mRemovedCount >= capacity >> 2 ||
-      (capacity > kMinCapacity && mEntryCount <= MinLoad(capacity))) {
+      (capacity > MinCapacity() && mEntryCount <= MinLoad(capacity))) {
     uint32_t log2;
-    BestCapacity(mEntryCount, &capacity, &log2);
+    BestCapacity(mEntryCount, MinCapacity(), &capacity, &log2);
 
     int32_t deltaLog2 = log2 - (kPLDHashNumberBits - mHashShift);
     MOZ_ASSERT(deltaLog2 <= 0);
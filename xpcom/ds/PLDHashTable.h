@@ -31,6 +31,21 @@ static const uint32_t kPLDHashNumberBits = mozilla::kHashNumberBits;
 class PLDHashTable;
 struct PLDHashTableOps;
 
+// How a PLDHashTable lays out and probes its entry storage. This is fixed for
+// the lifetime of a table; see the comment above PLDHashTable::EntryStore.
+enum class PLDHashTableLayout : uint8_t {
+  // Probe the array of cached key hashes using double hashing. This is the
+  // default, and the most compact layout.
+  DoubleHashing,
+
+  // Additionally keep one control byte per slot, holding 7 bits of the key
+  // hash or a free/removed marker, and probe groups of 16 control bytes at a
+  // time (using SIMD where available). Lookups touch far less memory per probe
+  // and tolerate long collision chains better, at the cost of one extra byte
+  // per slot and a minimum capacity of 16. Good for large, hot tables.
+  Grouped,
+};
+
 // Table entry header structure.
 //
 // In order to allow in-line allocation of key and value, we do not declare
@@ -306,6 +321,18 @@ class PLDHashTable {
   // Entries may have problems if they contain over-aligned members such as
   // SIMD vector types, but this has not been a problem in practice.
   //
+  // Tables using PLDHashTableLayout::Grouped additionally store one control
+  // byte per slot after the entries:
+  //
+  // +-------+-----+-------+--------+-----+--------+-------+-----+-------+
+  // | hash0 | ... | hashN | entry0 | ... | entryN | ctrl0 | ... | ctrlN |
+  // +-------+-----+-------+--------+-----+--------+-------+-----+-------+
+  //
+  // Putting them last keeps the offsets of the hashes and entries identical
+  // for both layouts, so everything that only walks the hashes (iteration,
+  // resizing, destruction) is shared. Probing only reads the control bytes,
+  // sixteen at a time, and goes to the entries for candidate matches.
+  //
   // Note: It would be natural to store the generation within this class, but
   // we can't do that without bloating sizeof(PLDHashTable) on 64-bit machines.
   // So instead we store it outside this class, and Set() takes a pointer to it
@@ -332,6 +359,11 @@ class PLDHashTable {
 
     char* Get() const { return mEntryStore; }
 
+    uint8_t* Controls(uint32_t aCapacity, uint32_t aEntrySize) const {
+      return reinterpret_cast<uint8_t*>(Entries(aCapacity) +
+                                        aCapacity * aEntrySize);
+    }
+
     Slot SlotForIndex(uint32_t aIndex, uint32_t aEntrySize,
                       uint32_t aCapacity) const {
       char* entries = Entries(aCapacity);
@@ -374,8 +406,9 @@ class PLDHashTable {
   };
 
   // These fields are packed carefully. On 32-bit platforms,
-  // sizeof(PLDHashTable) is 20. On 64-bit platforms, sizeof(PLDHashTable) is
-  // 32; 28 bytes of data followed by 4 bytes of padding for alignment.
+  // sizeof(PLDHashTable) is 24; 21 bytes of data followed by 3 bytes of
+  // padding. On 64-bit platforms, sizeof(PLDHashTable) is 32; 29 bytes of data
+  // followed by 3 bytes of padding for alignment.
   const PLDHashTableOps* const mOps;  // Virtual operations; see below.
   EntryStore mEntryStore;             // (Lazy) entry storage and generation.
   uint16_t mGeneration;               // The storage generation.
@@ -383,6 +416,7 @@ class PLDHashTable {
   const uint8_t mEntrySize;           // Number of bytes in an entry.
   uint32_t mEntryCount;               // Number of entries in table.
   uint32_t mRemovedCount;             // Removed entry sentinels in table.
+  const PLDHashTableLayout mLayout;   // Entry storage layout.
 
 #ifdef MOZ_HASH_TABLE_CHECKS_ENABLED
   mutable Checker mChecker;
@@ -399,6 +433,10 @@ class PLDHashTable {
 
   static const uint32_t kMinCapacity = 8;
 
+  // The number of control bytes probed at once by PLDHashTableLayout::Grouped
+  // tables, which is also their minimum capacity.
+  static const uint32_t kGroupWidth = 16;
+
   // Making this half of kMaxCapacity ensures it'll fit. Nobody should need an
   // initial length anywhere nearly this large, anyway.
   static const uint32_t kMaxInitialLength = kMaxCapacity / 2;
@@ -415,12 +453,17 @@ class PLDHashTable {
   //
   // This will crash if |aEntrySize| and/or |aLength| are too large.
   PLDHashTable(const PLDHashTableOps* aOps, uint32_t aEntrySize,
-               uint32_t aLength = kDefaultInitialLength);
+               uint32_t aLength = kDefaultInitialLength,
+               PLDHashTableLayout aLayout = PLDHashTableLayout::DoubleHashing);
 
   PLDHashTable(PLDHashTable&& aOther)
       // Initialize fields which are checked by the move assignment operator
       // and the destructor (which the move assignment operator calls).
-      : mOps(nullptr), mEntryStore(), mGeneration(0), mEntrySize(0) {
+      : mOps(nullptr),
+        mEntryStore(),
+        mGeneration(0),
+        mEntrySize(0),
+        mLayout(PLDHashTableLayout::DoubleHashing) {
     *this = std::move(aOther);
   }
 
@@ -444,6 +487,7 @@ class PLDHashTable {
   }
 
   uint32_t EntrySize() const { return mEntrySize; }
+  PLDHashTableLayout Layout() const { return mLayout; }
   uint32_t EntryCount() const { return mEntryCount; }
   uint32_t Generation() const { return mGeneration; }
 
@@ -630,7 +674,13 @@ class PLDHashTable {
   }
 
  private:
-  static uint32_t HashShift(uint32_t aEntrySize, uint32_t aLength);
+  static uint32_t HashShift(uint32_t aEntrySize, uint32_t aLength,
+                            PLDHashTableLayout aLayout);
+
+  bool IsGrouped() const { return mLayout == PLDHashTableLayout::Grouped; }
+  uint32_t MinCapacity() const {
+    return IsGrouped() ? kGroupWidth : kMinCapacity;
+  }
 
   static const PLDHashNumber kCollisionFlag = 1;
 
@@ -640,6 +690,14 @@ class PLDHashTable {
 
   static bool MatchSlotKeyhash(Slot& aSlot, const PLDHashNumber aHash);
   Slot SlotForIndex(uint32_t aIndex) const;
+  uint32_t IndexForSlot(const Slot& aSlot) const;
+
+  char* AllocateEntryStore(uint32_t aCapacity, uint32_t aNbytes) const;
+
+  // Grouped layout helpers.
+  uint8_t* Controls() const;
+  uint8_t ControlHash(PLDHashNumber aKeyHash) const;
+  void SetControl(const Slot& aSlot, uint8_t aControl);
 
   // We store mHashShift rather than sizeLog2 to optimize the collision-free
   // case in SearchTable.
@@ -657,7 +715,12 @@ class PLDHashTable {
   auto SearchTable(const void* aKey, PLDHashNumber aKeyHash,
                    PLDSuccess&& aSucess, PLDFailure&& aFailure) const;
 
+  template <SearchReason Reason, typename PLDSuccess, typename PLDFailure>
+  auto SearchGroups(const void* aKey, PLDHashNumber aKeyHash,
+                    PLDSuccess&& aSucess, PLDFailure&& aFailure) const;
+
   Slot FindFreeSlot(PLDHashNumber aKeyHash) const;
+  Slot FindFreeSlotInGroups(PLDHashNumber aKeyHash) const;
 
   bool ChangeTable(int aDeltaLog2);
 
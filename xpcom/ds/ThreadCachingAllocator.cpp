@@ -0,0 +1,327 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "mozilla/ThreadCachingAllocator.h"
+
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+
+#include "mozilla/ArenaAllocator.h"
+#include "mozilla/Assertions.h"
+#include "mozilla/Atomics.h"
+#include "mozilla/Likely.h"
+#include "mozilla/MemoryChecking.h"
+#include "mozilla/Mutex.h"
+#include "mozilla/StaticMutex.h"
+#include "mozilla/ThreadLocal.h"
+#include "mozilla/mozalloc.h"
+#include "nsDebug.h"
+#include "prthread.h"
+
+namespace mozilla {
+
+namespace {
+
+// Every block starts with a header word holding its owning cache and its size
+// class. Caches are 16-byte aligned, which leaves the low four bits for the
+// class.
+typedef uintptr_t BlockHeader;
+
+const size_t kHeaderSize = sizeof(BlockHeader);
+const uintptr_t kSizeClassMask = 0xf;
+const uintptr_t kLargeSizeClass = kSizeClassMask;
+
+static_assert(kHeaderSize <= ThreadCachingAllocator::kAlignment &&
+                  ThreadCachingAllocator::kAlignment % kHeaderSize == 0,
+              "Header must preserve block alignment");
+
+// Usable sizes of the small size classes. Spacing is 8 bytes up to 32 and
+// then roughly 25% so internal fragmentation stays bounded.
+constexpr size_t kSizeClasses[] = {8,  16,  24,  32,  48,  64,  80,
+                                   96, 128, 160, 192, 224, 256};
+constexpr size_t kNumSizeClasses =
+    sizeof(kSizeClasses) / sizeof(kSizeClasses[0]);
+
+static_assert(kNumSizeClasses <= kLargeSizeClass,
+              "Size class must fit in the header");
+static_assert(kSizeClasses[kNumSizeClasses - 1] ==
+                  ThreadCachingAllocator::kMaxSmallSize,
+              "The last size class must be kMaxSmallSize");
+
+// Maps (aSize + 7) / 8 to a size class.
+const uint8_t kSizeToClass[ThreadCachingAllocator::kMaxSmallSize / 8 + 1] = {
+    0,  0,  1,  2,  3,  4,  4,  5,  5,  6,  6,  7,  7,  8,  8,  8,  8,
+    9,  9,  9,  9,  10, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 12};
+
+inline size_t SizeClassFor(size_t aSize) {
+  MOZ_ASSERT(aSize <= ThreadCachingAllocator::kMaxSmallSize);
+  size_t sizeClass = kSizeToClass[(aSize + 7) / 8];
+  MOZ_ASSERT(kSizeClasses[sizeClass] >= aSize);
+  MOZ_ASSERT_IF(sizeClass > 0, kSizeClasses[sizeClass - 1] < aSize);
+  return sizeClass;
+}
+
+inline size_t BlockSize(size_t aSizeClass) {
+  return kHeaderSize + kSizeClasses[aSizeClass];
+}
+
+// Free blocks are linked through their payload.
+struct FreeBlock {
+  FreeBlock* mNext;
+};
+
+inline BlockHeader* HeaderOf(void* aPtr) {
+  return reinterpret_cast<BlockHeader*>(aPtr) - 1;
+}
+
+inline void* PayloadOf(BlockHeader* aHeader) { return aHeader + 1; }
+
+class alignas(16) ThreadCache {
+ public:
+  // Protected by sThreadCachesLock.
+  ThreadCache* mNextCache;
+  ThreadCache* mNextOrphan;
+
+  ThreadCache()
+      : mNextCache(nullptr),
+        mNextOrphan(nullptr),
+        mArenaLock("ThreadCache::mArenaLock"),
+        mUsedBytes(0),
+        mRemoteFrees(nullptr) {
+    for (auto& list : mFreeLists) {
+      list = nullptr;
+    }
+  }
+
+  void* Allocate(size_t aSizeClass) {
+    FreeBlock* block = mFreeLists[aSizeClass];
+    if (MOZ_UNLIKELY(!block)) {
+      DrainRemoteFrees();
+      block = mFreeLists[aSizeClass];
+    }
+
+    BlockHeader* header;
+    if (block) {
+      mFreeLists[aSizeClass] = block->mNext;
+      header = HeaderOf(block);
+      MOZ_MAKE_MEM_UNDEFINED(block, kSizeClasses[aSizeClass]);
+    } else {
+      MutexAutoLock lock(mArenaLock);
+      header = static_cast<BlockHeader*>(
+          mArena.Allocate(BlockSize(aSizeClass), fallible));
+      if (!header) {
+        return nullptr;
+      }
+      *header = reinterpret_cast<uintptr_t>(this) | aSizeClass;
+    }
+
+    // Only this thread writes mUsedBytes, so there's no need for an atomic
+    // read-modify-write; the atomic is only there for the memory reporter.
+    mUsedBytes = mUsedBytes + BlockSize(aSizeClass);
+    return PayloadOf(header);
+  }
+
+  // Frees a block owned by this cache on the owning thread.
+  void FreeLocal(void* aPtr, size_t aSizeClass) {
+    MOZ_MAKE_MEM_UNDEFINED(aPtr, kSizeClasses[aSizeClass]);
+    PushFreeBlock(static_cast<FreeBlock*>(aPtr), aSizeClass);
+    mUsedBytes = mUsedBytes - BlockSize(aSizeClass);
+  }
+
+  // Frees a block owned by this cache on some other thread.
+  void FreeRemote(void* aPtr) {
+    FreeBlock* block = static_cast<FreeBlock*>(aPtr);
+    while (true) {
+      FreeBlock* head = mRemoteFrees;
+      block->mNext = head;
+      if (mRemoteFrees.compareExchange(head, block)) {
+        return;
+      }
+    }
+  }
+
+  void AddSizeOf(MallocSizeOf aMallocSizeOf,
+                 ThreadCachingAllocatorSizes& aSizes) {
+    size_t arenaSize;
+    {
+      MutexAutoLock lock(mArenaLock);
+      arenaSize = mArena.SizeOfExcludingThis(aMallocSizeOf);
+    }
+    size_t used = std::min(size_t(mUsedBytes), arenaSize);
+    aSizes.mUsed += used;
+    aSizes.mUnused += arenaSize - used;
+    aSizes.mOverhead += aMallocSizeOf(this);
+  }
+
+  static const size_t kArenaSize = 16 * 1024;
+
+ private:
+  void PushFreeBlock(FreeBlock* aBlock, size_t aSizeClass) {
+    aBlock->mNext = mFreeLists[aSizeClass];
+    mFreeLists[aSizeClass] = aBlock;
+  }
+
+  // Moves blocks freed by other threads to the local free lists. The list is
+  // taken in one exchange, so there is no ABA problem with concurrent pushes.
+  void DrainRemoteFrees() {
+    FreeBlock* block = mRemoteFrees.exchange(nullptr);
+    size_t freedBytes = 0;
+    while (block) {
+      FreeBlock* next = block->mNext;
+      size_t sizeClass = *HeaderOf(block) & kSizeClassMask;
+      PushFreeBlock(block, sizeClass);
+      freedBytes += BlockSize(sizeClass);
+      block = next;
+    }
+    mUsedBytes = mUsedBytes - freedBytes;
+  }
+
+  // Only touched by the owning thread.
+  FreeBlock* mFreeLists[kNumSizeClasses];
+
+  // The arena is only allocated from by the owning thread, but the memory
+  // reporter walks its chunks from the main thread. The lock is only taken
+  // when carving new blocks, which stops once the free lists warm up.
+  Mutex mArenaLock;
+  ArenaAllocator<kArenaSize, ThreadCachingAllocator::kAlignment> mArena;
+
+  // Bytes in blocks handed out by this cache and not yet returned to it.
+  // Written only by the owning thread.
+  Atomic<size_t, Relaxed> mUsedBytes;
+
+  // Blocks owned by this cache that were freed by other threads.
+  Atomic<FreeBlock*, ReleaseAcquire> mRemoteFrees;
+};
+
+static_assert(alignof(ThreadCache) > kSizeClassMask,
+              "Cache addresses must leave room for the size class");
+
+// All caches ever created, and those whose thread has exited. Caches are never
+// destroyed, since blocks they own may be freed at any time, so there's no
+// need for a matching destructor call and free() for the aligned allocation.
+StaticMutex sThreadCachesLock;
+ThreadCache* sAllThreadCaches;
+ThreadCache* sOrphanedCaches;
+
+// The NSPR thread-private index is used for its destructor, which orphans the
+// cache when the thread exits; lookups use the faster MOZ_THREAD_LOCAL.
+Atomic<bool> sThreadCachesInitialized;
+PRUintn sThreadPrivateIndex;
+MOZ_THREAD_LOCAL(ThreadCache*) sThreadCache;
+
+void OrphanThreadCache(void* aCache) {
+  ThreadCache* cache = static_cast<ThreadCache*>(aCache);
+  sThreadCache.set(nullptr);
+  StaticMutexAutoLock lock(sThreadCachesLock);
+  cache->mNextOrphan = sOrphanedCaches;
+  sOrphanedCaches = cache;
+}
+
+MOZ_NEVER_INLINE ThreadCache* CreateThreadCache() {
+  ThreadCache* cache;
+  {
+    StaticMutexAutoLock lock(sThreadCachesLock);
+    if (!sThreadCachesInitialized) {
+      if (!sThreadCache.init() ||
+          PR_NewThreadPrivateIndex(&sThreadPrivateIndex, OrphanThreadCache) !=
+              PR_SUCCESS) {
+        MOZ_CRASH("Couldn't set up ThreadCachingAllocator thread locals");
+      }
+      sThreadCachesInitialized = true;
+    }
+
+    if (sOrphanedCaches) {
+      cache = sOrphanedCaches;
+      sOrphanedCaches = cache->mNextOrphan;
+      cache->mNextOrphan = nullptr;
+    } else {
+      // Plain operator new needn't honour alignas() beyond the platform's
+      // max_align_t, so ask for the alignment the headers rely on.
+      void* mem = moz_xmemalign(alignof(ThreadCache), sizeof(ThreadCache));
+      MOZ_RELEASE_ASSERT(
+          (reinterpret_cast<uintptr_t>(mem) & kSizeClassMask) == 0,
+          "ThreadCache must be aligned for the block headers");
+      cache = new (mem) ThreadCache();
+      cache->mNextCache = sAllThreadCaches;
+      sAllThreadCaches = cache;
+    }
+  }
+
+  sThreadCache.set(cache);
+  PR_SetThreadPrivate(sThreadPrivateIndex, cache);
+  return cache;
+}
+
+MOZ_ALWAYS_INLINE ThreadCache* CurrentThreadCache() {
+  if (MOZ_LIKELY(sThreadCachesInitialized)) {
+    if (ThreadCache* cache = sThreadCache.get()) {
+      return cache;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+void* ThreadCachingAllocator::Allocate(size_t aSize, const fallible_t&) {
+  if (aSize > kMaxSmallSize) {
+    BlockHeader* header =
+        static_cast<BlockHeader*>(malloc(kHeaderSize + aSize));
+    if (!header) {
+      return nullptr;
+    }
+    *header = kLargeSizeClass;
+    return PayloadOf(header);
+  }
+
+  ThreadCache* cache = CurrentThreadCache();
+  if (MOZ_UNLIKELY(!cache)) {
+    cache = CreateThreadCache();
+  }
+  return cache->Allocate(SizeClassFor(aSize));
+}
+
+void* ThreadCachingAllocator::Allocate(size_t aSize) {
+  void* p = Allocate(aSize, fallible);
+  if (MOZ_UNLIKELY(!p)) {
+    NS_ABORT_OOM(aSize);
+  }
+  return p;
+}
+
+void ThreadCachingAllocator::Free(void* aPtr) {
+  if (!aPtr) {
+    return;
+  }
+
+  BlockHeader* header = HeaderOf(aPtr);
+  size_t sizeClass = *header & kSizeClassMask;
+  if (sizeClass == kLargeSizeClass) {
+    free(header);
+    return;
+  }
+
+  MOZ_ASSERT(sizeClass < kNumSizeClasses);
+  ThreadCache* owner =
+      reinterpret_cast<ThreadCache*>(*header & ~kSizeClassMask);
+  if (owner == CurrentThreadCache()) {
+    owner->FreeLocal(aPtr, sizeClass);
+  } else {
+    owner->FreeRemote(aPtr);
+  }
+}
+
+void ThreadCachingAllocator::AddSizeOf(MallocSizeOf aMallocSizeOf,
+                                       ThreadCachingAllocatorSizes& aSizes) {
+  StaticMutexAutoLock lock(sThreadCachesLock);
+  for (ThreadCache* cache = sAllThreadCaches; cache;
+       cache = cache->mNextCache) {
+    cache->AddSizeOf(aMallocSizeOf, aSizes);
+  }
+}
+
+}  // namespace mozilla
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_ThreadCachingAllocator_h
+#define mozilla_ThreadCachingAllocator_h
+
+#include <stddef.h>
+
+#include "mozilla/fallible.h"
+#include "mozilla/MemoryReporting.h"
+
+namespace mozilla {
+
+struct ThreadCachingAllocatorSizes {
+  ThreadCachingAllocatorSizes() : mUsed(0), mUnused(0), mOverhead(0) {}
+
+  // Bytes in blocks that are currently allocated, including block headers.
+  size_t mUsed;
+  // Bytes in blocks that are on a free list, or arena space not yet handed out.
+  size_t mUnused;
+  // Bytes used by the per-thread caches themselves.
+  size_t mOverhead;
+};
+
+/**
+ * A size-class pool allocator for small objects with individual lifetimes
+ * that are allocated and freed at a high rate, such as runnables and promise
+ * values.
+ *
+ * Each thread gets its own cache, which carves blocks out of an
+ * ArenaAllocator and keeps a free list per size class, so allocating and
+ * freeing on the same thread takes no locks and does no atomic
+ * read-modify-writes. A block freed on another thread is pushed onto its
+ * owning cache's remote free list, which the owner drains the next time it
+ * runs out of blocks of some size. When a thread exits its cache is handed to
+ * the next thread that needs one, so memory is reused rather than returned to
+ * the system.
+ *
+ * Allocations larger than kMaxSmallSize go to malloc. Blocks are 8-byte
+ * aligned, so types needing stronger alignment must not use this.
+ *
+ * Memory usage is reported under explicit/xpcom/thread-caching-allocator/.
+ */
+class ThreadCachingAllocator {
+ public:
+  static const size_t kMaxSmallSize = 256;
+  static const size_t kAlignment = 8;
+
+  /**
+   * Allocates aSize bytes, aborting on OOM.
+   */
+  static void* Allocate(size_t aSize);
+
+  /**
+   * Allocates aSize bytes, returning null on OOM.
+   */
+  static void* Allocate(size_t aSize, const fallible_t&);
+
+  /**
+   * Frees memory returned by Allocate(). May be called on any thread. Null is
+   * ignored.
+   */
+  static void Free(void* aPtr);
+
+  /**
+   * Adds the sizes of all the per-thread caches. The used/unused split is
+   * approximate while other threads are allocating.
+   */
+  static void AddSizeOf(MallocSizeOf aMallocSizeOf,
+                        ThreadCachingAllocatorSizes& aSizes);
+};
+
+/**
+ * Inheriting from this makes |new| and |delete| of the derived type use
+ * ThreadCachingAllocator. Intended for small, hot types that are created and
+ * destroyed at a high rate.
+ *
+ * Example usage:
+ *
+ * class MyRunnable final : public Runnable, public ThreadCachingAllocated {
+ *   ...
+ * };
+ */
+class ThreadCachingAllocated {
+ public:
+  static void* operator new(size_t aSize) {
+    return ThreadCachingAllocator::Allocate(aSize);
+  }
+
+  static void* operator new(size_t aSize, const fallible_t&) noexcept {
+    return ThreadCachingAllocator::Allocate(aSize, fallible);
+  }
+
+  static void operator delete(void* aPtr) {
+    ThreadCachingAllocator::Free(aPtr);
+  }
+};
+
+}  // namespace mozilla
+
+#endif  // mozilla_ThreadCachingAllocator_h
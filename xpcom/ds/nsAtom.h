@@ -192,6 +192,20 @@ class nsDynamicAtom : public nsAtom {
   friend class nsAtomSubTable;
   friend int32_t NS_GetUnusedAtomCount();
 
+  // Like AddRef(), but fails if the atom is unused. The atom table uses this
+  // when it finds an atom without holding a lock: only the locked path may
+  // resurrect an unused atom, since it may be about to be GCed.
+  bool AddRefIfInUse() {
+    nsrefcnt count = mRefCnt;
+    while (count != 0) {
+      if (mRefCnt.compareExchange(count, count + 1)) {
+        return true;
+      }
+      count = mRefCnt;
+    }
+    return false;
+  }
+
   static mozilla::Atomic<int32_t, mozilla::ReleaseAcquire,
                          mozilla::recordreplay::Behavior::DontPreserve>
       gUnusedAtomCount;
@@ -206,7 +220,11 @@ class nsDynamicAtom : public nsAtom {
   static nsDynamicAtom* Create(const nsAString& aString, uint32_t aHash);
   static void Destroy(nsDynamicAtom* aAtom);
 
-  mozilla::ThreadSafeAutoRefCnt mRefCnt;
+  // This is a plain atomic rather than a ThreadSafeAutoRefCnt because
+  // AddRefIfInUse() needs compare-and-swap.
+  mozilla::Atomic<nsrefcnt, mozilla::ReleaseAcquire,
+                  mozilla::recordreplay::Behavior::DontPreserve>
+      mRefCnt;
 
   // The atom's chars are stored at the end of the struct.
 };
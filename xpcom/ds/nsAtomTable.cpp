@@ -7,12 +7,14 @@
 #include "mozilla/Assertions.h"
 #include "mozilla/Attributes.h"
 #include "mozilla/HashFunctions.h"
+#include "mozilla/MathAlgorithms.h"
 #include "mozilla/MemoryReporting.h"
 #include "mozilla/MruCache.h"
 #include "mozilla/Mutex.h"
 #include "mozilla/DebugOnly.h"
 #include "mozilla/Sprintf.h"
 #include "mozilla/TextUtils.h"
+#include "mozilla/ThreadLocal.h"
 #include "mozilla/Unused.h"
 
 #include "nsAtom.h"
@@ -24,9 +26,12 @@
 #include "nsPrintfCString.h"
 #include "nsString.h"
 #include "nsThreadUtils.h"
+#include "nsTArray.h"
 #include "nsUnicharUtils.h"
-#include "PLDHashTable.h"
 #include "prenv.h"
+#include "prthread.h"
+
+#include <algorithm>
 
 // There are two kinds of atoms handled by this module.
 //
@@ -41,7 +46,9 @@
 //   immutable, so it ignores all AddRef/Release calls.
 //
 // Note that gAtomTable is used on multiple threads, and has internal
-// synchronization.
+// synchronization. Looking up an atom that is already in the table doesn't
+// take any locks; only inserting a new atom and GC do. See AtomTableStore and
+// AtomTableReaders below.
 
 using namespace mozilla;
 
@@ -156,19 +163,24 @@ struct AtomTableKey {
     mHash = HashUTF8AsUTF16(mUTF8String, mLength, aErr);
   }
 
+  bool Matches(const nsAtom* aAtom) const {
+    if (mUTF8String) {
+      bool err = false;
+      return (CompareUTF8toUTF16(nsDependentCSubstring(
+                                     mUTF8String, mUTF8String + mLength),
+                                 nsDependentAtomString(aAtom), &err) == 0) &&
+             !err;
+    }
+
+    return aAtom->Equals(mUTF16String, mLength);
+  }
+
   const char16_t* mUTF16String;
   const char* mUTF8String;
   uint32_t mLength;
   uint32_t mHash;
 };
 
-struct AtomTableEntry : public PLDHashEntryHdr {
-  // These references are either to dynamic atoms, in which case they are
-  // non-owning, or they are to static atoms, which aren't really refcounted.
-  // See the comment at the top of this file for more details.
-  nsAtom* MOZ_NON_OWNING_REF mAtom;
-};
-
 struct AtomCache : public MruCache<AtomTableKey, nsAtom*, AtomCache> {
   static HashNumber Hash(const AtomTableKey& aKey) { return aKey.mHash; }
   static bool Match(const AtomTableKey& aKey, const nsAtom* aVal) {
@@ -179,6 +191,227 @@ struct AtomCache : public MruCache<AtomTableKey, nsAtom*, AtomCache> {
 
 static AtomCache sRecentlyUsedMainThreadAtoms;
 
+// Atoms and stores that have been unlinked from the table may still be in use
+// by threads doing lock-free lookups, so they can't be freed straight away.
+//
+// A thread doing a lookup first increments its reader counter for the current
+// phase. Counters live in a fixed number of cache-line-sized slots, and each
+// thread always uses the same slot, so in the common case a reader only ever
+// touches a cache line that no other thread writes to. Freeing only happens
+// on the main thread, which flips the phase and then waits for every counter
+// of the previous phase to drain: at that point any reader that could have
+// seen the unlinked objects has finished. Readers never block, and read
+// sections are short (a single probe sequence), so the wait is brief.
+//
+// This is similar to the userspace RCU "reader counter flipping" scheme.
+class AtomTableReaders {
+ public:
+  class MOZ_RAII AutoRead {
+   public:
+    AutoRead() {
+      Slot& slot = sSlots[ThreadSlot()];
+      while (true) {
+        uint32_t phase = sPhase;
+        ++slot.mCount[phase];
+        // If the phase flipped under us we may have been missed by
+        // Synchronize(), so start over in the new phase.
+        if (MOZ_LIKELY(phase == sPhase)) {
+          mCount = &slot.mCount[phase];
+          return;
+        }
+        --slot.mCount[phase];
+      }
+    }
+
+    ~AutoRead() { --*mCount; }
+
+   private:
+    Atomic<uint32_t, SequentiallyConsistent,
+           recordreplay::Behavior::DontPreserve>* mCount;
+  };
+
+  static void Init() { MOZ_ALWAYS_TRUE(sThreadSlot.init()); }
+
+  // Waits until every lookup that started before this call has finished.
+  static void Synchronize() {
+    MOZ_ASSERT(NS_IsMainThread());
+    uint32_t oldPhase = sPhase;
+    sPhase = oldPhase ^ 1;
+    for (Slot& slot : sSlots) {
+      while (slot.mCount[oldPhase]) {
+        PR_Sleep(PR_INTERVAL_NO_WAIT);
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kNumSlots = 64;
+
+  struct alignas(64) Slot {
+    Atomic<uint32_t, SequentiallyConsistent,
+           recordreplay::Behavior::DontPreserve>
+        mCount[2];
+  };
+
+  static uint32_t ThreadSlot() {
+    // sThreadSlot holds the slot index plus one, so that zero means "not yet
+    // assigned".
+    uint32_t slot = sThreadSlot.get();
+    if (MOZ_UNLIKELY(!slot)) {
+      slot = (sNextSlot++ % kNumSlots) + 1;
+      sThreadSlot.set(slot);
+    }
+    return slot - 1;
+  }
+
+  static Slot sSlots[kNumSlots];
+  static Atomic<uint32_t, SequentiallyConsistent,
+                recordreplay::Behavior::DontPreserve>
+      sPhase;
+  static Atomic<uint32_t, Relaxed, recordreplay::Behavior::DontPreserve>
+      sNextSlot;
+  static MOZ_THREAD_LOCAL(uint32_t) sThreadSlot;
+};
+
+AtomTableReaders::Slot AtomTableReaders::sSlots[kNumSlots];
+Atomic<uint32_t, SequentiallyConsistent, recordreplay::Behavior::DontPreserve>
+    AtomTableReaders::sPhase;
+Atomic<uint32_t, Relaxed, recordreplay::Behavior::DontPreserve>
+    AtomTableReaders::sNextSlot;
+MOZ_THREAD_LOCAL(uint32_t) AtomTableReaders::sThreadSlot;
+
+// The atoms of a subtable live in an open-addressed, linearly-probed array of
+// atom pointers, with a parallel array of their hashes so that probing doesn't
+// touch the atoms themselves. A store is only modified while its subtable's
+// lock is held, but it can be searched at any time.
+//
+// While a store is its subtable's current store, slots only ever go from empty
+// to full: growing the table or removing atoms builds a new store and retires
+// the old one. A lock-free lookup therefore sees every atom that was added
+// before it started, and at worst misses one that is being added concurrently,
+// in which case it falls back to the locked path.
+class AtomTableStore {
+ public:
+  static AtomTableStore* Create(uint32_t aCapacity) {
+    MOZ_ASSERT(IsPowerOfTwo(aCapacity) && aCapacity >= kMinCapacity);
+    size_t nbytes = sizeof(AtomTableStore) +
+                    aCapacity * (sizeof(AtomSlot) + sizeof(HashSlot));
+    void* mem = moz_xmalloc(nbytes);
+    AtomTableStore* store = new (mem) AtomTableStore(aCapacity);
+    for (uint32_t i = 0; i < aCapacity; i++) {
+      new (&store->Atoms()[i]) AtomSlot(nullptr);
+      new (&store->Hashes()[i]) HashSlot(0);
+    }
+    return store;
+  }
+
+  static void Destroy(AtomTableStore* aStore) { free(aStore); }
+
+  // The smallest capacity that keeps aCount atoms under the maximum load
+  // factor, with room to grow.
+  static uint32_t CapacityFor(uint32_t aCount) {
+    uint32_t capacity = RoundUpPow2(std::max(aCount * 2, kMinCapacity));
+    MOZ_ASSERT(!ShouldGrow(capacity, aCount));
+    return capacity;
+  }
+
+  // Keep the load factor under 3/4, like PLDHashTable.
+  static bool ShouldGrow(uint32_t aCapacity, uint32_t aCount) {
+    return aCount >= aCapacity - (aCapacity >> 2);
+  }
+
+  uint32_t Capacity() const { return mCapacity; }
+
+  // Safe to call either with the subtable lock held or inside an
+  // AtomTableReaders::AutoRead. Returns null if there is no matching atom.
+  nsAtom* Search(const AtomTableKey& aKey) const {
+    const uint32_t mask = mCapacity - 1;
+    const uint32_t stored = StoredHash(aKey.mHash);
+    for (uint32_t i = Start(aKey.mHash);; i = (i + 1) & mask) {
+      // This acquire pairs with the release in Insert(), and makes the atom
+      // pointer visible.
+      uint32_t hash = Hashes()[i];
+      if (!hash) {
+        return nullptr;
+      }
+      if (hash == stored) {
+        nsAtom* atom = Atoms()[i];
+        if (aKey.Matches(atom)) {
+          return atom;
+        }
+      }
+    }
+  }
+
+  // Must be called with the subtable lock held, with an atom that is not
+  // already present, and when there's room for it.
+  void Insert(nsAtom* aAtom) {
+    const uint32_t mask = mCapacity - 1;
+    uint32_t i = Start(aAtom->hash());
+    while (Hashes()[i]) {
+      i = (i + 1) & mask;
+    }
+    Atoms()[i] = aAtom;
+    Hashes()[i] = StoredHash(aAtom->hash());
+  }
+
+  // Returns the atom in slot aIndex, or null if it's empty.
+  nsAtom* AtomAt(uint32_t aIndex) const {
+    MOZ_ASSERT(aIndex < mCapacity);
+    if (!Hashes()[aIndex]) {
+      return nullptr;
+    }
+    return Atoms()[aIndex];
+  }
+
+  size_t SizeOfIncludingThis(MallocSizeOf aMallocSizeOf) const {
+    return aMallocSizeOf(this);
+  }
+
+  // Used to chain stores that have been replaced but not yet freed.
+  AtomTableStore* mNextRetired;
+
+  static constexpr uint32_t kMinCapacity = 64;
+
+ private:
+  typedef Atomic<nsAtom*, Relaxed, recordreplay::Behavior::DontPreserve>
+      AtomSlot;
+  typedef Atomic<uint32_t, ReleaseAcquire,
+                 recordreplay::Behavior::DontPreserve>
+      HashSlot;
+
+  explicit AtomTableStore(uint32_t aCapacity)
+      : mNextRetired(nullptr),
+        mCapacity(aCapacity),
+        mHashShift(kHashBits - FloorLog2(aCapacity)) {}
+
+  // Zero marks an empty slot, so atoms whose hash is zero are stored as if
+  // their hash were one. Search() compares the strings anyway.
+  static uint32_t StoredHash(uint32_t aHash) { return aHash ? aHash : 1; }
+
+  // SelectSubTable() uses the low bits of the hash, so scramble it and use the
+  // high bits here.
+  uint32_t Start(uint32_t aHash) const {
+    return ScrambleHashCode(aHash) >> mHashShift;
+  }
+
+  AtomSlot* Atoms() const {
+    return reinterpret_cast<AtomSlot*>(
+        reinterpret_cast<char*>(const_cast<AtomTableStore*>(this)) +
+        sizeof(AtomTableStore));
+  }
+
+  HashSlot* Hashes() const {
+    return reinterpret_cast<HashSlot*>(Atoms() + mCapacity);
+  }
+
+  static constexpr uint32_t kHashBits = 32;
+
+  const uint32_t mCapacity;
+  const uint32_t mHashShift;
+  // Followed by mCapacity AtomSlots and then mCapacity HashSlots.
+};
+
 // In order to reduce locking contention for concurrent atomization, we segment
 // the atom table into N subtables, each with a separate lock. If the hash
 // values we use to select the subtable are evenly distributed, this reduces the
@@ -186,23 +419,71 @@ static AtomCache sRecentlyUsedMainThreadAtoms;
 //
 // NB: This is somewhat similar to the technique used by Java's
 // ConcurrentHashTable.
+//
+// The lock is only needed to add atoms and to GC; looking up an atom that is
+// already present is lock-free (see SearchWithoutLock()).
 class nsAtomSubTable {
   friend class nsAtomTable;
   Mutex mLock;
-  PLDHashTable mTable;
+  // The current store. Only replaced with mLock held, but read without it.
+  Atomic<AtomTableStore*, ReleaseAcquire, recordreplay::Behavior::DontPreserve>
+      mStore;
+  // The number of atoms in mStore. Protected by mLock.
+  uint32_t mEntryCount;
+  // Stores that have been replaced by a bigger one, but which lock-free
+  // readers may still be using. These are freed by the next GC. Protected by
+  // mLock.
+  AtomTableStore* mRetiredStores;
+
   nsAtomSubTable();
-  void GCLocked(GCKind aKind);
+  ~nsAtomSubTable();
+  void GCLocked(GCKind aKind, nsTArray<nsDynamicAtom*>& aDeadAtoms,
+                AtomTableStore*& aDeadStores);
   void AddSizeOfExcludingThisLocked(MallocSizeOf aMallocSizeOf,
                                     AtomsSizes& aSizes);
 
-  AtomTableEntry* Search(AtomTableKey& aKey) const {
+  // Returns an addrefed atom matching aKey, or null if there isn't one or if
+  // the matching atom is unused, in which case it may be in the middle of
+  // being GCed and only the locked path may resurrect it.
+  already_AddRefed<nsAtom> SearchWithoutLock(const AtomTableKey& aKey) const {
+    AtomTableReaders::AutoRead read;
+    AtomTableStore* store = mStore;
+    nsAtom* atom = store->Search(aKey);
+    if (!atom) {
+      return nullptr;
+    }
+    if (atom->IsDynamic() && !atom->AsDynamic()->AddRefIfInUse()) {
+      return nullptr;
+    }
+    return already_AddRefed<nsAtom>(atom);
+  }
+
+  nsAtom* Search(const AtomTableKey& aKey) const {
     mLock.AssertCurrentThreadOwns();
-    return static_cast<AtomTableEntry*>(mTable.Search(&aKey));
+    AtomTableStore* store = mStore;
+    return store->Search(aKey);
   }
 
-  AtomTableEntry* Add(AtomTableKey& aKey) {
+  // The atom must not already be present.
+  void Add(nsAtom* aAtom) {
     mLock.AssertCurrentThreadOwns();
-    return static_cast<AtomTableEntry*>(mTable.Add(&aKey));  // Infallible
+    AtomTableStore* store = mStore;
+    if (AtomTableStore::ShouldGrow(store->Capacity(), mEntryCount + 1)) {
+      AtomTableStore* newStore =
+          AtomTableStore::Create(store->Capacity() * 2);  // Infallible
+      for (uint32_t i = 0; i < store->Capacity(); i++) {
+        if (nsAtom* atom = store->AtomAt(i)) {
+          newStore->Insert(atom);
+        }
+      }
+      newStore->Insert(aAtom);
+      mStore = newStore;
+      store->mNextRetired = mRetiredStores;
+      mRetiredStores = store;
+    } else {
+      store->Insert(aAtom);
+    }
+    mEntryCount++;
   }
 };
 
@@ -224,11 +505,6 @@ class nsAtomTable {
   // counting.
   size_t RacySlowCount();
 
-  // This hash table op is a static member of this class so that it can take
-  // advantage of |friend| declarations.
-  static void AtomTableClearEntry(PLDHashTable* aTable,
-                                  PLDHashEntryHdr* aEntry);
-
   // We achieve measurable reduction in locking contention in parallel CSS
   // parsing by increasing the number of subtables up to 128. This has been
   // measured to have neglible impact on the performance of initialization, GC,
@@ -265,59 +541,23 @@ class nsAtomTable {
 // Static singleton instance for the atom table.
 static nsAtomTable* gAtomTable;
 
-static PLDHashNumber AtomTableGetHash(const void* aKey) {
-  const AtomTableKey* k = static_cast<const AtomTableKey*>(aKey);
-  return k->mHash;
-}
-
-static bool AtomTableMatchKey(const PLDHashEntryHdr* aEntry, const void* aKey) {
-  const AtomTableEntry* he = static_cast<const AtomTableEntry*>(aEntry);
-  const AtomTableKey* k = static_cast<const AtomTableKey*>(aKey);
-
-  if (k->mUTF8String) {
-    bool err = false;
-    return (CompareUTF8toUTF16(nsDependentCSubstring(
-                                   k->mUTF8String, k->mUTF8String + k->mLength),
-                               nsDependentAtomString(he->mAtom), &err) == 0) &&
-           !err;
-  }
-
-  return he->mAtom->Equals(k->mUTF16String, k->mLength);
-}
-
-void nsAtomTable::AtomTableClearEntry(PLDHashTable* aTable,
-                                      PLDHashEntryHdr* aEntry) {
-  auto entry = static_cast<AtomTableEntry*>(aEntry);
-  entry->mAtom = nullptr;
-}
-
-static void AtomTableInitEntry(PLDHashEntryHdr* aEntry, const void* aKey) {
-  static_cast<AtomTableEntry*>(aEntry)->mAtom = nullptr;
-}
-
-static const PLDHashTableOps AtomTableOps = {
-    AtomTableGetHash, AtomTableMatchKey, PLDHashTable::MoveEntryStub,
-    nsAtomTable::AtomTableClearEntry, AtomTableInitEntry};
-
 // The atom table very quickly gets 10,000+ entries in it (or even 100,000+).
-// But choosing the best initial subtable length has some subtleties: we add
+// But choosing the best initial subtable capacity has some subtleties: we add
 // ~2700 static atoms at start-up, and then we start adding and removing
-// dynamic atoms. If we make the tables too big to start with, when the first
-// dynamic atom gets removed from a given table the load factor will be < 25%
-// and we will shrink it.
+// dynamic atoms. If we make the tables too big to start with, the first GC
+// that removes a dynamic atom from a given table will shrink it.
 //
 // So we first make the simplifying assumption that the atoms are more or less
 // evenly-distributed across the subtables (which is the case empirically).
 // Then, we take the total atom count when the first dynamic atom is removed
-// (~2700), divide that across the N subtables, and the largest capacity that
-// will allow each subtable to be > 25% full with that count.
+// (~2700), divide that across the N subtables, and pick the largest capacity
+// that AtomTableStore::CapacityFor() would pick for that count.
 //
-// So want an initial subtable capacity less than (2700 / N) * 4 = 10800 / N.
-// Rounding down to the nearest power of two gives us 8192 / N. Since the
-// capacity is double the initial length, we end up with (4096 / N) per
-// subtable.
-#define INITIAL_SUBTABLE_LENGTH (4096 / nsAtomTable::kNumSubTables)
-
+// That is (2700 / N) * 2 = 5400 / N, which rounds up to the nearest power of
+// two as 8192 / N.
+#define INITIAL_SUBTABLE_CAPACITY                    \
+  std::max(uint32_t(8192 / nsAtomTable::kNumSubTables), \
+           AtomTableStore::kMinCapacity)
 nsAtomSubTable& nsAtomTable::SelectSubTable(AtomTableKey& aKey) {
   // There are a few considerations around how we select subtables.
   //
@@ -330,9 +570,9 @@ nsAtomSubTable& nsAtomTable::SelectSubTable(AtomTableKey& aKey) {
   // entry's position within the subtable. If we used the exact same bits used
   // by the subtables, then each subtable would compute the same position for
   // every entry it observes, leading to pessimal performance. In this case,
-  // we're using PLDHashTable, whose primary hash function uses the N leftmost
-  // bits of the hash value (where N is the log2 capacity of the table). This
-  // means we should prefer the rightmost bits here.
+  // AtomTableStore uses the N leftmost bits of the scrambled hash value (where
+  // N is the log2 capacity of the store). This means we should prefer the
+  // rightmost bits here.
   //
   // Note that the below is equivalent to mHash % kNumSubTables, a replacement
   // which an optimizing compiler should make, but let's avoid any doubt.
@@ -341,6 +581,7 @@ nsAtomSubTable& nsAtomTable::SelectSubTable(AtomTableKey& aKey) {
   return mSubTables[aKey.mHash & (kNumSubTables - 1)];
 }
 
+
 void nsAtomTable::AddSizeOfIncludingThis(MallocSizeOf aMallocSizeOf,
                                          AtomsSizes& aSizes) {
   MOZ_ASSERT(NS_IsMainThread());
@@ -357,9 +598,25 @@ void nsAtomTable::GC(GCKind aKind) {
 
   // Note that this is effectively an incremental GC, since only one subtable
   // is locked at a time.
+  nsTArray<nsDynamicAtom*> deadAtoms;
+  AtomTableStore* deadStores = nullptr;
   for (auto& table : mSubTables) {
     MutexAutoLock lock(table.mLock);
-    table.GCLocked(aKind);
+    table.GCLocked(aKind, deadAtoms, deadStores);
+  }
+
+  // The dead atoms and stores are unreachable from the table now, but threads
+  // doing lock-free lookups may still be looking at them. Once those lookups
+  // are done it's safe to free everything. Lookups can't resurrect the dead
+  // atoms, since they only add references to atoms that are in use.
+  AtomTableReaders::Synchronize();
+  for (nsDynamicAtom* atom : deadAtoms) {
+    nsDynamicAtom::Destroy(atom);
+  }
+  while (deadStores) {
+    AtomTableStore* next = deadStores->mNextRetired;
+    AtomTableStore::Destroy(deadStores);
+    deadStores = next;
   }
 
   // We would like to assert that gUnusedAtomCount matches the number of atoms
@@ -392,7 +649,7 @@ size_t nsAtomTable::RacySlowCount() {
   size_t count = 0;
   for (auto& table : mSubTables) {
     MutexAutoLock lock(table.mLock);
-    count += table.mTable.EntryCount();
+    count += table.mEntryCount;
   }
 
   return count;
@@ -400,26 +657,47 @@ size_t nsAtomTable::RacySlowCount() {
 
 nsAtomSubTable::nsAtomSubTable()
     : mLock("Atom Sub-Table Lock"),
-      mTable(&AtomTableOps, sizeof(AtomTableEntry), INITIAL_SUBTABLE_LENGTH) {}
+      mStore(AtomTableStore::Create(INITIAL_SUBTABLE_CAPACITY)),
+      mEntryCount(0),
+      mRetiredStores(nullptr) {}
+
+nsAtomSubTable::~nsAtomSubTable() {
+  // Any atoms still in the table are either static or leaked.
+  AtomTableStore::Destroy(mStore);
+  while (mRetiredStores) {
+    AtomTableStore* next = mRetiredStores->mNextRetired;
+    AtomTableStore::Destroy(mRetiredStores);
+    mRetiredStores = next;
+  }
+}
 
-void nsAtomSubTable::GCLocked(GCKind aKind) {
+void nsAtomSubTable::GCLocked(GCKind aKind,
+                              nsTArray<nsDynamicAtom*>& aDeadAtoms,
+                              AtomTableStore*& aDeadStores) {
   MOZ_ASSERT(NS_IsMainThread());
   mLock.AssertCurrentThreadOwns();
 
-  int32_t removedCount = 0;  // A non-atomic temporary for cheaper increments.
+  // Stores retired by Add() since the last GC are freed along with this GC's
+  // garbage.
+  while (mRetiredStores) {
+    AtomTableStore* next = mRetiredStores->mNextRetired;
+    mRetiredStores->mNextRetired = aDeadStores;
+    aDeadStores = mRetiredStores;
+    mRetiredStores = next;
+  }
+
+  AtomTableStore* store = mStore;
+  size_t firstDeadAtom = aDeadAtoms.Length();
   nsAutoCString nonZeroRefcountAtoms;
   uint32_t nonZeroRefcountAtomsCount = 0;
-  for (auto i = mTable.Iter(); !i.Done(); i.Next()) {
-    auto entry = static_cast<AtomTableEntry*>(i.Get());
-    if (entry->mAtom->IsStatic()) {
+  for (uint32_t i = 0; i < store->Capacity(); i++) {
+    nsAtom* atom = store->AtomAt(i);
+    if (!atom || atom->IsStatic()) {
       continue;
     }
 
-    nsAtom* atom = entry->mAtom;
     if (atom->IsDynamic() && atom->AsDynamic()->mRefCnt == 0) {
-      i.Remove();
-      nsDynamicAtom::Destroy(atom->AsDynamic());
-      ++removedCount;
+      aDeadAtoms.AppendElement(atom->AsDynamic());
     }
 #ifdef NS_FREE_PERMANENT_DATA
     else if (aKind == GCKind::Shutdown && PR_GetEnv("XPCOM_MEM_BLOAT_LOG")) {
@@ -445,6 +723,37 @@ void nsAtomSubTable::GCLocked(GCKind aKind) {
     NS_ASSERTION(nonZeroRefcountAtomsCount == 0, msg.get());
   }
 
+  int32_t removedCount = int32_t(aDeadAtoms.Length() - firstDeadAtom);
+  if (removedCount == 0) {
+    return;
+  }
+
+  // Slots can't be emptied in place without confusing concurrent lookups, so
+  // rebuild the store without the dead atoms. This is also where the table
+  // shrinks.
+  mEntryCount -= removedCount;
+  AtomTableStore* newStore = AtomTableStore::Create(std::min(
+      store->Capacity(), AtomTableStore::CapacityFor(mEntryCount)));
+  // Other threads may drop more atoms to a zero refcount while we do this,
+  // so skip exactly the atoms found above, which are in slot order.
+  size_t nextDeadAtom = firstDeadAtom;
+  for (uint32_t i = 0; i < store->Capacity(); i++) {
+    nsAtom* atom = store->AtomAt(i);
+    if (!atom) {
+      continue;
+    }
+    if (nextDeadAtom < aDeadAtoms.Length() &&
+        atom == aDeadAtoms[nextDeadAtom]) {
+      nextDeadAtom++;
+      continue;
+    }
+    newStore->Insert(atom);
+  }
+  MOZ_ASSERT(nextDeadAtom == aDeadAtoms.Length());
+  mStore = newStore;
+  store->mNextRetired = aDeadStores;
+  aDeadStores = store;
+
   nsDynamicAtom::gUnusedAtomCount -= removedCount;
 }
 
@@ -466,6 +775,7 @@ void NS_InitAtomTable() {
 
   // We register static atoms immediately so they're available for use as early
   // as possible.
+  AtomTableReaders::Init();
   gAtomTable = new nsAtomTable();
   gAtomTable->RegisterStaticAtoms(nsGkAtoms::sAtoms, nsGkAtoms::sAtomsLen);
   gStaticAtomsDone = true;
@@ -494,10 +804,16 @@ void NS_AddSizeOfAtoms(MallocSizeOf aMallocSizeOf, AtomsSizes& aSizes) {
 void nsAtomSubTable::AddSizeOfExcludingThisLocked(MallocSizeOf aMallocSizeOf,
                                                   AtomsSizes& aSizes) {
   mLock.AssertCurrentThreadOwns();
-  aSizes.mTable += mTable.ShallowSizeOfExcludingThis(aMallocSizeOf);
-  for (auto iter = mTable.Iter(); !iter.Done(); iter.Next()) {
-    auto entry = static_cast<AtomTableEntry*>(iter.Get());
-    entry->mAtom->AddSizeOfIncludingThis(aMallocSizeOf, aSizes);
+  AtomTableStore* store = mStore;
+  aSizes.mTable += store->SizeOfIncludingThis(aMallocSizeOf);
+  for (AtomTableStore* retired = mRetiredStores; retired;
+       retired = retired->mNextRetired) {
+    aSizes.mTable += retired->SizeOfIncludingThis(aMallocSizeOf);
+  }
+  for (uint32_t i = 0; i < store->Capacity(); i++) {
+    if (nsAtom* atom = store->AtomAt(i)) {
+      atom->AddSizeOfIncludingThis(aMallocSizeOf, aSizes);
+    }
   }
 }
 
@@ -521,9 +837,8 @@ void nsAtomTable::RegisterStaticAtoms(const nsStaticAtom* aAtoms,
     AtomTableKey key(atom);
     nsAtomSubTable& table = SelectSubTable(key);
     MutexAutoLock lock(table.mLock);
-    AtomTableEntry* he = table.Add(key);
 
-    if (he->mAtom) {
+    if (nsAtom* existing = table.Search(key)) {
       // There are two ways we could get here.
       // - Register two static atoms with the same string.
       // - Create a dynamic atom and then register a static atom with the same
@@ -531,10 +846,10 @@ void nsAtomTable::RegisterStaticAtoms(const nsStaticAtom* aAtoms,
       // Both cases can cause subtle bugs, and are disallowed. We're
       // programming in C++ here, not Smalltalk.
       nsAutoCString name;
-      he->mAtom->ToUTF8String(name);
+      existing->ToUTF8String(name);
       MOZ_CRASH_UNSAFE_PRINTF("Atom for '%s' already exists", name.get());
     }
-    he->mAtom = const_cast<nsStaticAtom*>(atom);
+    table.Add(const_cast<nsStaticAtom*>(atom));
   }
 }
 
@@ -555,11 +870,13 @@ already_AddRefed<nsAtom> nsAtomTable::Atomize(const nsACString& aUTF8String) {
     return Atomize(str);
   }
   nsAtomSubTable& table = SelectSubTable(key);
-  MutexAutoLock lock(table.mLock);
-  AtomTableEntry* he = table.Add(key);
+  if (RefPtr<nsAtom> atom = table.SearchWithoutLock(key)) {
+    return atom.forget();
+  }
 
-  if (he->mAtom) {
-    RefPtr<nsAtom> atom = he->mAtom;
+  MutexAutoLock lock(table.mLock);
+  if (nsAtom* existing = table.Search(key)) {
+    RefPtr<nsAtom> atom = existing;
     return atom.forget();
   }
 
@@ -567,7 +884,7 @@ already_AddRefed<nsAtom> nsAtomTable::Atomize(const nsACString& aUTF8String) {
   CopyUTF8toUTF16(aUTF8String, str);
   RefPtr<nsAtom> atom = dont_AddRef(nsDynamicAtom::Create(str, key.mHash));
 
-  he->mAtom = atom;
+  table.Add(atom);
 
   return atom.forget();
 }
@@ -585,17 +902,19 @@ already_AddRefed<nsAtom> NS_Atomize(const char16_t* aUTF16String) {
 already_AddRefed<nsAtom> nsAtomTable::Atomize(const nsAString& aUTF16String) {
   AtomTableKey key(aUTF16String.Data(), aUTF16String.Length());
   nsAtomSubTable& table = SelectSubTable(key);
-  MutexAutoLock lock(table.mLock);
-  AtomTableEntry* he = table.Add(key);
+  if (RefPtr<nsAtom> atom = table.SearchWithoutLock(key)) {
+    return atom.forget();
+  }
 
-  if (he->mAtom) {
-    RefPtr<nsAtom> atom = he->mAtom;
+  MutexAutoLock lock(table.mLock);
+  if (nsAtom* existing = table.Search(key)) {
+    RefPtr<nsAtom> atom = existing;
     return atom.forget();
   }
 
   RefPtr<nsAtom> atom =
       dont_AddRef(nsDynamicAtom::Create(aUTF16String, key.mHash));
-  he->mAtom = atom;
+  table.Add(atom);
 
   return atom.forget();
 }
@@ -617,16 +936,15 @@ already_AddRefed<nsAtom> nsAtomTable::AtomizeMainThread(
   }
 
   nsAtomSubTable& table = SelectSubTable(key);
-  MutexAutoLock lock(table.mLock);
-  AtomTableEntry* he = table.Add(key);
-
-  if (he->mAtom) {
-    retVal = he->mAtom;
-  } else {
-    RefPtr<nsAtom> newAtom =
-        dont_AddRef(nsDynamicAtom::Create(aUTF16String, key.mHash));
-    he->mAtom = newAtom;
-    retVal = newAtom.forget();
+  retVal = table.SearchWithoutLock(key);
+  if (!retVal) {
+    MutexAutoLock lock(table.mLock);
+    if (nsAtom* existing = table.Search(key)) {
+      retVal = existing;
+    } else {
+      retVal = dont_AddRef(nsDynamicAtom::Create(aUTF16String, key.mHash));
+      table.Add(retVal);
+    }
   }
 
   p.Set(retVal);
@@ -654,10 +972,12 @@ nsStaticAtom* NS_GetStaticAtom(const nsAString& aUTF16String) {
 nsStaticAtom* nsAtomTable::GetStaticAtom(const nsAString& aUTF16String) {
   AtomTableKey key(aUTF16String.Data(), aUTF16String.Length());
   nsAtomSubTable& table = SelectSubTable(key);
-  MutexAutoLock lock(table.mLock);
-  AtomTableEntry* he = table.Search(key);
-  return he && he->mAtom->IsStatic() ? static_cast<nsStaticAtom*>(he->mAtom)
-                                     : nullptr;
+  // Static atoms are never removed, and they were all added before anyone
+  // could call this, so there's no need to take the lock.
+  AtomTableReaders::AutoRead read;
+  AtomTableStore* store = table.mStore;
+  nsAtom* atom = store->Search(key);
+  return atom && atom->IsStatic() ? static_cast<nsStaticAtom*>(atom) : nullptr;
 }
 
 void ToLowerCaseASCII(RefPtr<nsAtom>& aAtom) {
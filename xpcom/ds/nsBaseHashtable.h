@@ -104,6 +104,8 @@ class nsBaseHashtable
   nsBaseHashtable() {}
   explicit nsBaseHashtable(uint32_t aInitLength)
       : nsTHashtable<EntryType>(aInitLength) {}
+  nsBaseHashtable(uint32_t aInitLength, PLDHashTableLayout aLayout)
+      : nsTHashtable<EntryType>(aInitLength, aLayout) {}
 
   /**
    * Return the number of entries in the table.
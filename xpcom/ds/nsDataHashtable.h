@@ -30,6 +30,8 @@ class nsDataHashtable : public nsBaseHashtable<KeyClass, DataType, DataType> {
 
   nsDataHashtable() {}
   explicit nsDataHashtable(uint32_t aInitLength) : BaseClass(aInitLength) {}
+  nsDataHashtable(uint32_t aInitLength, PLDHashTableLayout aLayout)
+      : BaseClass(aInitLength, aLayout) {}
 
   /**
    * Retrieve a reference to the value for a key.
@@ -89,6 +89,13 @@ class MOZ_NEEDS_NO_VTABLE_TYPE nsTHashtable {
   explicit nsTHashtable(uint32_t aInitLength)
       : mTable(Ops(), sizeof(EntryType), aInitLength) {}
 
+  /**
+   * Create a table with a non-default entry storage layout. See
+   * PLDHashTableLayout for when PLDHashTableLayout::Grouped is worthwhile.
+   */
+  nsTHashtable(uint32_t aInitLength, PLDHashTableLayout aLayout)
+      : mTable(Ops(), sizeof(EntryType), aInitLength, aLayout) {}
+
   /**
    * destructor, cleans up and deallocates
    */
@@ -501,6 +508,8 @@ class nsTHashtable<nsPtrHashKey<T>>
  public:
   nsTHashtable() = default;
   explicit nsTHashtable(uint32_t aInitLength) : Base(aInitLength) {}
+  nsTHashtable(uint32_t aInitLength, PLDHashTableLayout aLayout)
+      : Base(aInitLength, aLayout) {}
 
   ~nsTHashtable() = default;
 
@@ -0,0 +1,727 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "mozilla/AsyncFileIO.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "mozilla/ClearOnShutdown.h"
+#include "mozilla/Mutex.h"
+#include "mozilla/StaticMutex.h"
+#include "mozilla/StaticPtr.h"
+#include "mozilla/Unused.h"
+#include "nsIEventTarget.h"
+#include "nsIFile.h"
+#include "nsThreadPool.h"
+#include "nsThreadUtils.h"
+#include "private/pprio.h"
+#include "prthread.h"
+
+#ifdef XP_UNIX
+#  include <errno.h>
+#  include <sys/uio.h>
+#  include <unistd.h>
+
+#  include "nsLocalFile.h"  // For nsresultForErrno()
+#endif
+
+#ifdef XP_WIN
+#  include <windows.h>
+#endif
+
+// io_uring is only used where the kernel headers know about it. Android's
+// seccomp policy doesn't allow it.
+#if defined(XP_LINUX) && !defined(ANDROID) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#      define MOZ_USE_IO_URING
+#    endif
+#  endif
+#endif
+
+namespace mozilla {
+
+static StaticMutex sAsyncFileIOLock;
+static StaticRefPtr<AsyncFileIO> sAsyncFileIO;
+static bool sAsyncFileIOShutdown = false;
+
+// The number of threads that run operations io_uring can't, or all of them
+// without io_uring.
+static const uint32_t kAsyncFileIOThreadLimit = 8;
+
+struct AsyncFileIO::Request {
+  enum class Op { Open, Read, Write, Sync, Close };
+
+  explicit Request(Op aOp)
+      : mOp(aOp),
+        mFD(nullptr),
+        mOffset(0),
+        mBuffer(nullptr),
+        mCount(0),
+        mFlags(0),
+        mMode(0),
+        mStatus(NS_OK),
+        mBytes(0) {}
+
+  // Runs the operation on the current thread.
+  void RunBlocking();
+
+  void InvokeCallback() {
+    if (mOp == Op::Open) {
+      mOpenCallback(mStatus, mFD);
+    } else {
+      mCallback(mStatus, mBytes);
+    }
+  }
+
+  const Op mOp;
+  PRFileDesc* mFD;
+  int64_t mOffset;
+  char* mBuffer;
+  uint32_t mCount;
+
+  // For Open.
+  nsCOMPtr<nsIFile> mFile;
+  int32_t mFlags;
+  int32_t mMode;
+
+  nsCOMPtr<nsIEventTarget> mTarget;
+  Callback mCallback;
+  OpenCallback mOpenCallback;
+
+  nsresult mStatus;
+  // The bytes transferred so far.
+  uint32_t mBytes;
+
+#ifdef MOZ_USE_IO_URING
+  struct iovec mIov;
+#endif
+};
+
+#ifdef XP_UNIX
+
+void AsyncFileIO::Request::RunBlocking() {
+  switch (mOp) {
+    case Op::Open:
+      mStatus = mFile->OpenNSPRFileDesc(mFlags, mMode, &mFD);
+      if (NS_FAILED(mStatus)) {
+        mFD = nullptr;
+      }
+      return;
+
+    case Op::Read:
+    case Op::Write: {
+      int fd = PR_FileDesc2NativeHandle(mFD);
+      while (mBytes < mCount) {
+        ssize_t result =
+            mOp == Op::Read
+                ? pread(fd, mBuffer + mBytes, mCount - mBytes, mOffset + mBytes)
+                : pwrite(fd, mBuffer + mBytes, mCount - mBytes,
+                         mOffset + mBytes);
+        if (result < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          mStatus = nsresultForErrno(errno);
+          return;
+        }
+        mBytes += uint32_t(result);
+        // Short reads are returned as they are, like PR_Read().
+        if (mOp == Op::Read || result == 0) {
+          return;
+        }
+      }
+      return;
+    }
+
+    case Op::Sync:
+      if (PR_Sync(mFD) != PR_SUCCESS) {
+        mStatus = NS_ERROR_FAILURE;
+      }
+      return;
+
+    case Op::Close:
+      if (PR_Close(mFD) != PR_SUCCESS) {
+        mStatus = NS_ERROR_FAILURE;
+      }
+      return;
+  }
+}
+
+#else  // XP_UNIX
+
+void AsyncFileIO::Request::RunBlocking() {
+  switch (mOp) {
+    case Op::Open:
+      mStatus = mFile->OpenNSPRFileDesc(mFlags, mMode, &mFD);
+      if (NS_FAILED(mStatus)) {
+        mFD = nullptr;
+      }
+      return;
+
+    case Op::Read:
+    case Op::Write: {
+      HANDLE handle = HANDLE(PR_FileDesc2NativeHandle(mFD));
+      while (mBytes < mCount) {
+        // With a synchronous handle this reads or writes at the offset in
+        // the OVERLAPPED, but also moves the file pointer.
+        uint64_t offset = uint64_t(mOffset) + mBytes;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD transferred = 0;
+        BOOL ok = mOp == Op::Read
+                      ? ReadFile(handle, mBuffer + mBytes, mCount - mBytes,
+                                 &transferred, &overlapped)
+                      : WriteFile(handle, mBuffer + mBytes, mCount - mBytes,
+                                  &transferred, &overlapped);
+        if (!ok) {
+          if (mOp == Op::Read && GetLastError() == ERROR_HANDLE_EOF) {
+            return;
+          }
+          mStatus = NS_ERROR_FAILURE;
+          return;
+        }
+        mBytes += transferred;
+        if (mOp == Op::Read || transferred == 0) {
+          return;
+        }
+      }
+      return;
+    }
+
+    case Op::Sync:
+      if (PR_Sync(mFD) != PR_SUCCESS) {
+        mStatus = NS_ERROR_FAILURE;
+      }
+      return;
+
+    case Op::Close:
+      if (PR_Close(mFD) != PR_SUCCESS) {
+        mStatus = NS_ERROR_FAILURE;
+      }
+      return;
+  }
+}
+
+#endif  // XP_UNIX
+
+#ifdef MOZ_USE_IO_URING
+
+/**
+ * A minimal io_uring: one submission queue shared by all threads under a
+ * lock, and one thread that waits for completions.
+ */
+class AsyncFileIO::IOUring final {
+ public:
+  static UniquePtr<IOUring> Create(AsyncFileIO* aOwner) {
+    UniquePtr<IOUring> ring(new IOUring(aOwner));
+    if (!ring->Init()) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  ~IOUring() {
+    MOZ_ASSERT(!mThread);
+    if (mSQEs) {
+      munmap(mSQEs, mSQEsSize);
+    }
+    if (mCQRing && mCQRing != mSQRing) {
+      munmap(mCQRing, mCQRingSize);
+    }
+    if (mSQRing) {
+      munmap(mSQRing, mSQRingSize);
+    }
+    if (mFd != -1) {
+      close(mFd);
+    }
+  }
+
+  /**
+   * Queues aRequest, or returns it if the ring is full or shutting down.
+   */
+  UniquePtr<Request> Submit(UniquePtr<Request> aRequest) {
+    MutexAutoLock lock(mLock);
+    if (mShuttingDown || mInFlight == mEntries) {
+      return aRequest;
+    }
+
+    io_uring_sqe* sqe = NextSQE();
+    switch (aRequest->mOp) {
+      case Request::Op::Read:
+      case Request::Op::Write:
+        aRequest->mIov.iov_base = aRequest->mBuffer + aRequest->mBytes;
+        aRequest->mIov.iov_len = aRequest->mCount - aRequest->mBytes;
+        sqe->opcode = aRequest->mOp == Request::Op::Read ? IORING_OP_READV
+                                                         : IORING_OP_WRITEV;
+        sqe->fd = PR_FileDesc2NativeHandle(aRequest->mFD);
+        sqe->off = uint64_t(aRequest->mOffset) + aRequest->mBytes;
+        sqe->addr = reinterpret_cast<uint64_t>(&aRequest->mIov);
+        sqe->len = 1;
+        break;
+      case Request::Op::Sync:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = PR_FileDesc2NativeHandle(aRequest->mFD);
+        break;
+      default:
+        MOZ_ASSERT_UNREACHABLE("Only reads, writes and syncs go to the ring");
+        return aRequest;
+    }
+    sqe->user_data = reinterpret_cast<uint64_t>(aRequest.get());
+
+    if (!SubmitSQE()) {
+      return aRequest;
+    }
+    Unused << aRequest.release();
+    return nullptr;
+  }
+
+  /**
+   * Waits for the operations in flight to complete and stops the completion
+   * thread. Returns false if the thread couldn't be woken up to stop, in
+   * which case it may still be using the ring, and this must not be
+   * destroyed.
+   */
+  MOZ_MUST_USE bool Shutdown() {
+    {
+      MutexAutoLock lock(mLock);
+      mShuttingDown = true;
+      // Wake the completion thread up with an operation that does nothing, in
+      // case nothing else is in flight.
+      io_uring_sqe* sqe = NextSQE();
+      sqe->opcode = IORING_OP_NOP;
+      sqe->user_data = 0;
+      if (!SubmitSQE()) {
+        // The thread can't be woken up, so leave it blocked rather than
+        // hang shutdown; the process is going away.
+        return false;
+      }
+    }
+    PR_JoinThread(mThread);
+    mThread = nullptr;
+    return true;
+  }
+
+ private:
+  explicit IOUring(AsyncFileIO* aOwner)
+      : mOwner(aOwner),
+        mLock("AsyncFileIO::IOUring::mLock"),
+        mFd(-1),
+        mEntries(0),
+        mInFlight(0),
+        mShuttingDown(false),
+        mSQRing(nullptr),
+        mSQRingSize(0),
+        mCQRing(nullptr),
+        mCQRingSize(0),
+        mSQEs(nullptr),
+        mSQEsSize(0),
+        mThread(nullptr) {}
+
+  bool Init() {
+    io_uring_params params = {};
+    mFd = int(syscall(__NR_io_uring_setup, kEntries, &params));
+    if (mFd == -1) {
+      // ENOSYS on old kernels, EPERM where it's been disabled.
+      return false;
+    }
+    mEntries = params.sq_entries;
+
+    mSQRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCQRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+      mSQRingSize = mCQRingSize = std::max(mSQRingSize, mCQRingSize);
+    }
+
+    mSQRing = Map(mSQRingSize, IORING_OFF_SQ_RING);
+    if (!mSQRing) {
+      return false;
+    }
+    mCQRing = singleMmap ? mSQRing : Map(mCQRingSize, IORING_OFF_CQ_RING);
+    if (!mCQRing) {
+      return false;
+    }
+    mSQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+    mSQEs = static_cast<io_uring_sqe*>(Map(mSQEsSize, IORING_OFF_SQES));
+    if (!mSQEs) {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(mSQRing);
+    mSQHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    mSQTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    mSQMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    mSQArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(mCQRing);
+    mCQHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    mCQTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    mCQMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    mCQEs = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    mThread = PR_CreateThread(PR_SYSTEM_THREAD, ThreadFunc, this,
+                              PR_PRIORITY_NORMAL, PR_GLOBAL_THREAD,
+                              PR_JOINABLE_THREAD, 0);
+    return !!mThread;
+  }
+
+  void* Map(size_t aSize, off_t aOffset) {
+    void* ptr = mmap(nullptr, aSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, mFd, aOffset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  // The next free submission queue entry. Must hold mLock, and there must be
+  // room in the queue.
+  io_uring_sqe* NextSQE() {
+    mLock.AssertCurrentThreadOwns();
+    unsigned tail = *mSQTail;
+    unsigned index = tail & mSQMask;
+    io_uring_sqe* sqe = &mSQEs[index];
+    memset(sqe, 0, sizeof(*sqe));
+    mSQArray[index] = index;
+    return sqe;
+  }
+
+  // Publishes the entry NextSQE() returned and tells the kernel about it.
+  bool SubmitSQE() {
+    mLock.AssertCurrentThreadOwns();
+    __atomic_store_n(mSQTail, *mSQTail + 1, __ATOMIC_RELEASE);
+    while (true) {
+      long result = syscall(__NR_io_uring_enter, mFd, 1, 0, 0, nullptr, 0);
+      if (result == 1) {
+        ++mInFlight;
+        return true;
+      }
+      if (result == -1 && (errno == EINTR || errno == EAGAIN)) {
+        continue;
+      }
+      // The kernel didn't take the entry, so take it back.
+      __atomic_store_n(mSQTail, *mSQTail - 1, __ATOMIC_RELEASE);
+      return false;
+    }
+  }
+
+  static void ThreadFunc(void* aArg) {
+    PR_SetCurrentThreadName("AsyncFileIO Ring");
+    static_cast<IOUring*>(aArg)->Run();
+  }
+
+  void Run() {
+    while (true) {
+      long result = syscall(__NR_io_uring_enter, mFd, 0, 1,
+                            IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (result == -1 && errno != EINTR) {
+        NS_WARNING("io_uring_enter failed");
+      }
+
+      unsigned head = *mCQHead;
+      unsigned tail = __atomic_load_n(mCQTail, __ATOMIC_ACQUIRE);
+      uint32_t reaped = 0;
+      for (; head != tail; ++head, ++reaped) {
+        const io_uring_cqe& cqe = mCQEs[head & mCQMask];
+        auto* request = reinterpret_cast<Request*>(cqe.user_data);
+        int res = cqe.res;
+        // Free the slot before handling the request, which may resubmit it.
+        __atomic_store_n(mCQHead, head + 1, __ATOMIC_RELEASE);
+        if (request) {
+          Complete(UniquePtr<Request>(request), res);
+        }
+      }
+
+      MutexAutoLock lock(mLock);
+      mInFlight -= reaped;
+      if (mShuttingDown && mInFlight == 0) {
+        return;
+      }
+    }
+  }
+
+  void Complete(UniquePtr<Request> aRequest, int aResult) {
+    if (aResult < 0) {
+      aRequest->mStatus = nsresultForErrno(-aResult);
+    } else if (aRequest->mOp == Request::Op::Read ||
+               aRequest->mOp == Request::Op::Write) {
+      aRequest->mBytes += uint32_t(aResult);
+      // A short write is continued from where it stopped.
+      if (aRequest->mOp == Request::Op::Write && aResult > 0 &&
+          aRequest->mBytes < aRequest->mCount) {
+        aRequest = Submit(std::move(aRequest));
+        if (!aRequest) {
+          return;
+        }
+        mOwner->RunOnThreadPool(std::move(aRequest));
+        return;
+      }
+    }
+    mOwner->Complete(std::move(aRequest));
+  }
+
+  static const unsigned kEntries = 256;
+
+  AsyncFileIO* const mOwner;
+
+  Mutex mLock;
+  int mFd;
+  uint32_t mEntries;
+  uint32_t mInFlight;
+  bool mShuttingDown;
+
+  void* mSQRing;
+  size_t mSQRingSize;
+  void* mCQRing;
+  size_t mCQRingSize;
+  io_uring_sqe* mSQEs;
+  size_t mSQEsSize;
+
+  unsigned* mSQHead;
+  unsigned* mSQTail;
+  unsigned mSQMask;
+  unsigned* mSQArray;
+  unsigned* mCQHead;
+  unsigned* mCQTail;
+  unsigned mCQMask;
+  io_uring_cqe* mCQEs;
+
+  PRThread* mThread;
+};
+
+#else  // MOZ_USE_IO_URING
+
+class AsyncFileIO::IOUring final {
+ public:
+  UniquePtr<Request> Submit(UniquePtr<Request> aRequest) { return aRequest; }
+  bool Shutdown() { return true; }
+};
+
+#endif  // MOZ_USE_IO_URING
+
+AsyncFileIO::AsyncFileIO()
+    : mThreadPoolLock("AsyncFileIO::mThreadPoolLock"), mPendingCount(0) {}
+
+AsyncFileIO::~AsyncFileIO() { MOZ_ASSERT(!mThreadPool, "Not shut down"); }
+
+/* static */
+already_AddRefed<AsyncFileIO> AsyncFileIO::Get() {
+  StaticMutexAutoLock lock(sAsyncFileIOLock);
+  if (sAsyncFileIOShutdown) {
+    return nullptr;
+  }
+
+  if (!sAsyncFileIO) {
+    RefPtr<AsyncFileIO> io = new AsyncFileIO();
+    if (NS_FAILED(io->Init())) {
+      return nullptr;
+    }
+    sAsyncFileIO = io;
+
+    auto registerShutdown = [] {
+      RunOnShutdown(AsyncFileIO::ShutdownInstance,
+                    ShutdownPhase::ShutdownThreads);
+    };
+    if (NS_IsMainThread()) {
+      registerShutdown();
+    } else {
+      NS_DispatchToMainThread(NS_NewRunnableFunction(
+          "AsyncFileIO::RegisterShutdown", registerShutdown));
+    }
+  }
+
+  return do_AddRef(sAsyncFileIO);
+}
+
+/* static */
+void AsyncFileIO::ShutdownInstance() {
+  RefPtr<AsyncFileIO> io;
+  {
+    StaticMutexAutoLock lock(sAsyncFileIOLock);
+    sAsyncFileIOShutdown = true;
+    io = sAsyncFileIO.forget();
+  }
+  if (io) {
+    io->Shutdown();
+  }
+}
+
+nsresult AsyncFileIO::Init() {
+  RefPtr<nsThreadPool> pool = new nsThreadPool();
+  nsresult rv = pool->SetName(NS_LITERAL_CSTRING("AsyncFileIO"));
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = pool->SetThreadLimit(kAsyncFileIOThreadLimit);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = pool->SetIdleThreadLimit(1);
+  NS_ENSURE_SUCCESS(rv, rv);
+  {
+    MutexAutoLock lock(mThreadPoolLock);
+    mThreadPool = pool.forget();
+  }
+
+#ifdef MOZ_USE_IO_URING
+  mRing = IOUring::Create(this);
+#endif
+  return NS_OK;
+}
+
+void AsyncFileIO::Shutdown() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  // Ring completions may fall back to the thread pool, so stop the ring
+  // first.
+  if (mRing && !mRing->Shutdown()) {
+    // The ring's thread is still blocked on the ring and may complete
+    // operations through us, so leave both alive.
+    Unused << mRing.release();
+    RefPtr<AsyncFileIO> self = this;
+    Unused << self.forget().take();
+  }
+
+  nsCOMPtr<nsIThreadPool> pool;
+  {
+    MutexAutoLock lock(mThreadPoolLock);
+    pool = mThreadPool.forget();
+  }
+  pool->Shutdown();
+}
+
+bool AsyncFileIO::UsesIOUring() const { return !!mRing; }
+
+void AsyncFileIO::Open(nsIFile* aFile, int32_t aFlags, int32_t aMode,
+                       nsIEventTarget* aTarget, OpenCallback&& aCallback) {
+  auto request = MakeUnique<Request>(Request::Op::Open);
+  request->mFile = aFile;
+  request->mFlags = aFlags;
+  request->mMode = aMode;
+  request->mTarget = aTarget;
+  request->mOpenCallback = std::move(aCallback);
+  Submit(std::move(request));
+}
+
+void AsyncFileIO::Read(PRFileDesc* aFD, int64_t aOffset, char* aBuffer,
+                       uint32_t aCount, nsIEventTarget* aTarget,
+                       Callback&& aCallback) {
+  auto request = MakeUnique<Request>(Request::Op::Read);
+  request->mFD = aFD;
+  request->mOffset = aOffset;
+  request->mBuffer = aBuffer;
+  request->mCount = aCount;
+  request->mTarget = aTarget;
+  request->mCallback = std::move(aCallback);
+  Submit(std::move(request));
+}
+
+void AsyncFileIO::Write(PRFileDesc* aFD, int64_t aOffset, const char* aBuffer,
+                        uint32_t aCount, nsIEventTarget* aTarget,
+                        Callback&& aCallback) {
+  auto request = MakeUnique<Request>(Request::Op::Write);
+  request->mFD = aFD;
+  request->mOffset = aOffset;
+  // Only ever read from.
+  request->mBuffer = const_cast<char*>(aBuffer);
+  request->mCount = aCount;
+  request->mTarget = aTarget;
+  request->mCallback = std::move(aCallback);
+  Submit(std::move(request));
+}
+
+void AsyncFileIO::Sync(PRFileDesc* aFD, nsIEventTarget* aTarget,
+                       Callback&& aCallback) {
+  auto request = MakeUnique<Request>(Request::Op::Sync);
+  request->mFD = aFD;
+  request->mTarget = aTarget;
+  request->mCallback = std::move(aCallback);
+  Submit(std::move(request));
+}
+
+void AsyncFileIO::Close(PRFileDesc* aFD, nsIEventTarget* aTarget,
+                        Callback&& aCallback) {
+  auto request = MakeUnique<Request>(Request::Op::Close);
+  request->mFD = aFD;
+  request->mTarget = aTarget;
+  request->mCallback = std::move(aCallback);
+  Submit(std::move(request));
+}
+
+void AsyncFileIO::Submit(UniquePtr<Request> aRequest) {
+  ++mPendingCount;
+
+  if (mRing && (aRequest->mOp == Request::Op::Read ||
+                aRequest->mOp == Request::Op::Write ||
+                aRequest->mOp == Request::Op::Sync)) {
+    aRequest = mRing->Submit(std::move(aRequest));
+    if (!aRequest) {
+      return;
+    }
+  }
+  RunOnThreadPool(std::move(aRequest));
+}
+
+void AsyncFileIO::RunOnThreadPool(UniquePtr<Request> aRequest) {
+  // The runnable owns the request until it runs. If it can't be dispatched,
+  // it's handed back so that the callback still gets called.
+  Request* request = aRequest.release();
+  RefPtr<AsyncFileIO> self = this;
+  nsCOMPtr<nsIThreadPool> pool;
+  {
+    MutexAutoLock lock(mThreadPoolLock);
+    pool = mThreadPool;
+  }
+  nsresult rv = pool ? pool->Dispatch(
+                                  NS_NewRunnableFunction(
+                                      "AsyncFileIO::RunOnThreadPool",
+                                      [self, request] {
+                                        request->RunBlocking();
+                                        self->Complete(
+                                            UniquePtr<Request>(request));
+                                      }),
+                                  NS_DISPATCH_NORMAL)
+                            : NS_ERROR_NOT_AVAILABLE;
+  if (NS_FAILED(rv)) {
+    request->mStatus = NS_ERROR_NOT_AVAILABLE;
+    Complete(UniquePtr<Request>(request));
+  }
+}
+
+void AsyncFileIO::Complete(UniquePtr<Request> aRequest) {
+  --mPendingCount;
+
+  nsCOMPtr<nsIEventTarget> target = std::move(aRequest->mTarget);
+  if (!target) {
+    aRequest->InvokeCallback();
+    return;
+  }
+
+  // As in RunOnThreadPool, the runnable owns the request until it runs.
+  Request* request = aRequest.release();
+  nsresult rv = target->Dispatch(
+      NS_NewRunnableFunction("AsyncFileIO::Complete",
+                             [request] {
+                               UniquePtr<Request> owned(request);
+                               owned->InvokeCallback();
+                             }),
+      NS_DISPATCH_NORMAL);
+  if (NS_FAILED(rv)) {
+    // The target is gone, most likely shut down. Rather than drop the
+    // callback, call it here with an error, and don't hand out a file which
+    // nobody would close.
+    NS_WARNING("AsyncFileIO: Couldn't dispatch a callback to its target");
+    UniquePtr<Request> owned(request);
+    if (owned->mOp == Request::Op::Open && owned->mFD) {
+      PR_Close(owned->mFD);
+      owned->mFD = nullptr;
+    }
+    owned->mStatus = NS_ERROR_NOT_AVAILABLE;
+    owned->InvokeCallback();
+  }
+}
+
+}  // namespace mozilla
@@ -0,0 +1,134 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_AsyncFileIO_h
+#define mozilla_AsyncFileIO_h
+
+#include <functional>
+
+#include "mozilla/Atomics.h"
+#include "mozilla/Mutex.h"
+#include "mozilla/UniquePtr.h"
+#include "nsCOMPtr.h"
+#include "nsISupportsImpl.h"
+#include "prio.h"
+
+class nsIEventTarget;
+class nsIFile;
+class nsIThreadPool;
+
+namespace mozilla {
+
+/**
+ * AsyncFileIO
+ *
+ * Runs file operations in the background and reports their results through
+ * callbacks, so that a thread doing file I/O doesn't have to block on each
+ * operation in turn, and many operations can be in flight at once.
+ *
+ * On Linux, reads, writes and syncs are submitted to an io_uring, where the
+ * kernel runs them without a thread per operation. Everything else, and
+ * everything on platforms or kernels without io_uring, runs on a small pool
+ * of I/O threads.
+ *
+ * Each callback is dispatched to the event target passed along with the
+ * operation, or, if that is null, called directly on whichever I/O thread
+ * completed it. Callbacks of the latter kind must be quick and must not
+ * block, since they hold up the completion of other operations. If the
+ * event target doesn't accept the callback any more, it is called on the I/O
+ * thread with NS_ERROR_NOT_AVAILABLE instead.
+ *
+ * Reads and writes are positional: they don't use or move the file's current
+ * offset, except on Windows where the fallback moves it. Buffers passed to
+ * Read() and Write(), and the file descriptor, must stay valid until the
+ * callback has been called, and a file must only be closed once all the
+ * operations on it have completed.
+ *
+ * Example usage:
+ *
+ *   RefPtr<AsyncFileIO> io = AsyncFileIO::Get();
+ *   io->Read(fd, offset, buffer, length, target,
+ *            [self](nsresult aStatus, uint32_t aBytes) {
+ *              ...
+ *            });
+ *
+ * Get() returns null during and after shutdown.
+ */
+class AsyncFileIO final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(AsyncFileIO)
+
+  // Called with NS_OK and the number of bytes transferred, or an error.
+  // Reads at the end of the file transfer zero bytes.
+  typedef std::function<void(nsresult aStatus, uint32_t aBytes)> Callback;
+  // Called with NS_OK and the new file descriptor, or an error and null.
+  typedef std::function<void(nsresult aStatus, PRFileDesc* aFD)> OpenCallback;
+
+  static already_AddRefed<AsyncFileIO> Get();
+
+  /**
+   * Opens aFile like nsIFile::OpenNSPRFileDesc().
+   */
+  void Open(nsIFile* aFile, int32_t aFlags, int32_t aMode,
+            nsIEventTarget* aTarget, OpenCallback&& aCallback);
+
+  /**
+   * Reads up to aCount bytes at aOffset into aBuffer.
+   */
+  void Read(PRFileDesc* aFD, int64_t aOffset, char* aBuffer, uint32_t aCount,
+            nsIEventTarget* aTarget, Callback&& aCallback);
+
+  /**
+   * Writes aCount bytes from aBuffer at aOffset. Unlike Read(), this only
+   * completes early if there is an error.
+   */
+  void Write(PRFileDesc* aFD, int64_t aOffset, const char* aBuffer,
+             uint32_t aCount, nsIEventTarget* aTarget, Callback&& aCallback);
+
+  /**
+   * Flushes the file to disk, like PR_Sync().
+   */
+  void Sync(PRFileDesc* aFD, nsIEventTarget* aTarget, Callback&& aCallback);
+
+  void Close(PRFileDesc* aFD, nsIEventTarget* aTarget, Callback&& aCallback);
+
+  /**
+   * Whether reads, writes and syncs go to an io_uring.
+   */
+  bool UsesIOUring() const;
+
+  /**
+   * The number of operations submitted but not completed yet.
+   */
+  uint32_t PendingCount() const { return mPendingCount; }
+
+ private:
+  struct Request;
+  class IOUring;
+
+  AsyncFileIO();
+  ~AsyncFileIO();
+
+  nsresult Init();
+  void Shutdown();
+
+  void Submit(UniquePtr<Request> aRequest);
+  void RunOnThreadPool(UniquePtr<Request> aRequest);
+  void Complete(UniquePtr<Request> aRequest);
+
+  static void ShutdownInstance();
+
+  // Protects mThreadPool, which is used on any thread and cleared on the main
+  // thread by Shutdown().
+  Mutex mThreadPoolLock;
+  nsCOMPtr<nsIThreadPool> mThreadPool;
+  UniquePtr<IOUring> mRing;
+  Atomic<uint32_t> mPendingCount;
+};
+
+}  // namespace mozilla
+
+#endif  // mozilla_AsyncFileIO_h
@@ -7,6 +7,7 @@
 #include "Base64.h"
 
 #include "mozilla/ArrayUtils.h"
+#include "mozilla/SSE.h"
 #include "mozilla/ScopeExit.h"
 #include "mozilla/UniquePtrExtensions.h"
 #include "nsIInputStream.h"
@@ -15,8 +16,108 @@
 
 #include "plbase64.h"
 
+#ifdef MOZILLA_MAY_SUPPORT_SSSE3
+namespace mozilla {
+namespace SSSE3 {
+size_t Base64EncodeBlocks(const uint8_t* aSrc, size_t aSrcLen, char* aDest,
+                          bool aURLAlphabet);
+size_t Base64DecodeBlocks(const char* aSrc, size_t aSrcLen, uint8_t* aDest,
+                          bool aURLAlphabet);
+}  // namespace SSSE3
+}  // namespace mozilla
+#endif
+
+#ifdef MOZ_BASE64_AVX2
+namespace mozilla {
+namespace AVX2 {
+size_t Base64EncodeBlocks(const uint8_t* aSrc, size_t aSrcLen, char* aDest,
+                          bool aURLAlphabet);
+size_t Base64DecodeBlocks(const char* aSrc, size_t aSrcLen, uint8_t* aDest,
+                          bool aURLAlphabet);
+}  // namespace AVX2
+}  // namespace mozilla
+#endif
+
 namespace {
 
+/*
+ * Encodes as many leading 3-byte groups of aSrc as the vectorized kernels
+ * available on this CPU can handle, and returns the number of input bytes
+ * consumed (always a multiple of 3). The caller encodes the rest.
+ */
+static uint32_t EncodeVectorized(const uint8_t* aSrc, uint32_t aSrcLen,
+                                 char* aDest, bool aURLAlphabet) {
+  size_t consumed = 0;
+#ifdef MOZ_BASE64_AVX2
+  if (mozilla::supports_avx2()) {
+    consumed = mozilla::AVX2::Base64EncodeBlocks(aSrc, aSrcLen, aDest,
+                                                 aURLAlphabet);
+  }
+#endif
+#ifdef MOZILLA_MAY_SUPPORT_SSSE3
+  if (mozilla::supports_ssse3()) {
+    consumed += mozilla::SSSE3::Base64EncodeBlocks(
+        aSrc + consumed, aSrcLen - consumed, aDest + consumed / 3 * 4,
+        aURLAlphabet);
+  }
+#endif
+  MOZ_ASSERT(consumed % 3 == 0 && consumed <= aSrcLen);
+  return uint32_t(consumed);
+}
+
+/*
+ * Decodes as many leading 4-character groups of aSrc as the vectorized
+ * kernels can handle, and returns the number of characters consumed (always a
+ * multiple of 4). Decoding stops early at a group containing a character
+ * outside the alphabet, so that the scalar decoder can report it.
+ */
+static uint32_t DecodeVectorized(const char* aSrc, uint32_t aSrcLen,
+                                 uint8_t* aDest, bool aURLAlphabet) {
+  size_t consumed = 0;
+#ifdef MOZ_BASE64_AVX2
+  if (mozilla::supports_avx2()) {
+    consumed = mozilla::AVX2::Base64DecodeBlocks(aSrc, aSrcLen, aDest,
+                                                 aURLAlphabet);
+  }
+#endif
+#ifdef MOZILLA_MAY_SUPPORT_SSSE3
+  if (mozilla::supports_ssse3()) {
+    consumed += mozilla::SSSE3::Base64DecodeBlocks(
+        aSrc + consumed, aSrcLen - consumed, aDest + consumed / 4 * 3,
+        aURLAlphabet);
+  }
+#endif
+  MOZ_ASSERT(consumed % 4 == 0 && consumed <= aSrcLen);
+  return uint32_t(consumed);
+}
+
+// The vectorized kernels only deal with 8-bit input and output; everything
+// else goes through the scalar code below.
+template <typename SrcT, typename DestT>
+static uint32_t EncodeBlocks(const SrcT*, uint32_t, DestT*) {
+  return 0;
+}
+
+static uint32_t EncodeBlocks(const unsigned char* aSrc, uint32_t aSrcLen,
+                             char* aDest) {
+  return EncodeVectorized(aSrc, aSrcLen, aDest, false);
+}
+
+static uint32_t EncodeBlocks(const char* aSrc, uint32_t aSrcLen, char* aDest) {
+  return EncodeVectorized(reinterpret_cast<const uint8_t*>(aSrc), aSrcLen,
+                          aDest, false);
+}
+
+template <typename SrcT, typename DestT>
+static uint32_t DecodeBlocks(const SrcT*, uint32_t, DestT*) {
+  return 0;
+}
+
+static uint32_t DecodeBlocks(const char* aSrc, uint32_t aSrcLen, char* aDest) {
+  return DecodeVectorized(aSrc, aSrcLen, reinterpret_cast<uint8_t*>(aDest),
+                          false);
+}
+
 // BEGIN base64 encode code copied and modified from NSPR
 const unsigned char* base =
   (unsigned char*)"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -68,6 +169,11 @@ static void Encode1to4(const SrcT* aSrc, DestT* aDest) {
 
 template <typename SrcT, typename DestT>
 static void Encode(const SrcT* aSrc, uint32_t aSrcLen, DestT* aDest) {
+  uint32_t encoded = EncodeBlocks(aSrc, aSrcLen, aDest);
+  aSrc += encoded;
+  aDest += (encoded / 3) * 4;
+  aSrcLen -= encoded;
+
   while (aSrcLen >= 3) {
     Encode3to4(aSrc, aDest);
     aSrc += 3;
@@ -110,6 +216,13 @@ nsresult EncodeInputStream_Encoder(nsIInputStream* aStream, void* aClosure,
   // If we have any data left from last time, encode it now.
   uint32_t countRemaining = aCount;
   const unsigned char* src = (const unsigned char*)aFromSegment;
+  if (state->charsOnStack == 1 && countRemaining == 1) {
+    // Still not a full triplet; keep accumulating until the next segment.
+    state->c[1] = src[0];
+    state->charsOnStack = 2;
+    *aWriteCount = aCount;
+    return NS_OK;
+  }
   if (state->charsOnStack) {
     unsigned char firstSet[4];
     if (state->charsOnStack == 1) {
@@ -184,7 +297,10 @@ nsresult EncodeInputStream(nsIInputStream* aInputStream, T& aDest,
   state.c[2] = '\0';
   state.buffer = aOffset + aDest.BeginWriting();
 
-  while (1) {
+  // Segments are encoded straight into aDest as the stream hands them out.
+  // Never ask for more than was accounted for above, even if the stream has
+  // more data available by now.
+  while (aCount) {
     uint32_t read = 0;
 
     rv = aInputStream->ReadSegments(&EncodeInputStream_Encoder<T>,
@@ -202,6 +318,7 @@ nsresult EncodeInputStream(nsIInputStream* aInputStream, T& aDest,
     if (!read) {
       break;
     }
+    aCount -= read;
   }
 
   // Finish encoding if anything is left
@@ -429,6 +546,12 @@ static nsresult Base64DecodeHelper(const SrcT* aBase64, uint32_t aBase64Len,
     }
   }
 
+  uint32_t decoded = DecodeBlocks(input, inputLength, binary);
+  input += decoded;
+  inputLength -= decoded;
+  binary += (decoded / 4) * 3;
+  binaryLength += (decoded / 4) * 3;
+
   while (inputLength >= 4) {
     if (!Decode4to3(input, binary, Base64CharToValue<SrcT>)) {
       return NS_ERROR_INVALID_ARG;
@@ -602,6 +725,11 @@ nsresult Base64URLDecode(const nsACString& aBase64,
   aBinary.SetLengthAndRetainStorage(binaryLen);
   uint8_t* binary = aBinary.Elements();
 
+  uint32_t decoded = DecodeVectorized(base64, base64Len, binary, true);
+  base64 += decoded;
+  base64Len -= decoded;
+  binary += (decoded / 4) * 3;
+
   for (; base64Len >= 4; base64Len -= 4) {
     if (!Decode4to3(base64, binary, Base64URLCharToValue)) {
       return NS_ERROR_INVALID_ARG;
@@ -654,7 +782,8 @@ nsresult Base64URLEncode(uint32_t aBinaryLen, const uint8_t* aBinary,
 
   char* base64 = handle.Elements();
 
-  uint32_t index = 0;
+  uint32_t index = EncodeVectorized(aBinary, aBinaryLen, base64, true);
+  base64 += (index / 3) * 4;
   for (; index + 3 <= aBinaryLen; index += 3) {
     *base64++ = kBase64URLAlphabet[aBinary[index] >> 2];
     *base64++ = kBase64URLAlphabet[((aBinary[index] & 0x3) << 4) |
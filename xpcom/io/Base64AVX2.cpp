@@ -0,0 +1,136 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// This file should only be compiled if you're on x86 or x86_64 and the
+// compiler supports AVX2.  Additionally, you'll need to compile this file with
+// -mavx2 if you're using gcc or clang.
+//
+// This is the 256-bit version of Base64SSSE3.cpp; each 128-bit lane handles
+// one 12-byte / 16-character block.
+
+#include <immintrin.h>
+#include <string.h>
+#include "nscore.h"
+
+namespace mozilla::AVX2 {
+
+static inline __m256i SplitIndices(__m256i aIn) {
+  __m256i in = _mm256_shuffle_epi8(
+      aIn, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                           10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+  __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  return _mm256_or_si256(t1, t3);
+}
+
+static inline __m256i IndicesToAscii(__m256i aIndices, __m256i aOffsets) {
+  __m256i range = _mm256_subs_epu8(aIndices, _mm256_set1_epi8(51));
+  __m256i isUpper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), aIndices);
+  range =
+      _mm256_or_si256(range, _mm256_and_si256(isUpper, _mm256_set1_epi8(13)));
+  return _mm256_add_epi8(aIndices, _mm256_shuffle_epi8(aOffsets, range));
+}
+
+static inline __m256i AsciiOffsets(bool aURLAlphabet) {
+  const char c62 = aURLAlphabet ? '-' : '+';
+  const char c63 = aURLAlphabet ? '_' : '/';
+  return _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, c62 - 62, c63 - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, c62 - 62, c63 - 63, 'A', 0, 0);
+}
+
+size_t Base64EncodeBlocks(const uint8_t* aSrc, size_t aSrcLen, char* aDest,
+                          bool aURLAlphabet) {
+  const __m256i offsets = AsciiOffsets(aURLAlphabet);
+  size_t consumed = 0;
+
+  // Each iteration reads 28 bytes (two overlapping 16-byte loads) and
+  // consumes 24 of them.
+  while (aSrcLen - consumed >= 28) {
+    const uint8_t* src = aSrc + consumed;
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    __m256i out = IndicesToAscii(SplitIndices(in), offsets);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDest), out);
+    consumed += 24;
+    aDest += 32;
+  }
+
+  return consumed;
+}
+
+static inline __m256i InRange(__m256i aChars, char aLow, char aHigh) {
+  return _mm256_and_si256(
+      _mm256_cmpgt_epi8(aChars, _mm256_set1_epi8(aLow - 1)),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(aHigh + 1), aChars));
+}
+
+size_t Base64DecodeBlocks(const char* aSrc, size_t aSrcLen, uint8_t* aDest,
+                          bool aURLAlphabet) {
+  const __m256i c62 = _mm256_set1_epi8(aURLAlphabet ? '-' : '+');
+  const __m256i c63 = _mm256_set1_epi8(aURLAlphabet ? '_' : '/');
+  size_t consumed = 0;
+
+  while (aSrcLen - consumed >= 32) {
+    __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSrc + consumed));
+
+    __m256i upper = InRange(in, 'A', 'Z');
+    __m256i lower = InRange(in, 'a', 'z');
+    __m256i digit = InRange(in, '0', '9');
+    __m256i is62 = _mm256_cmpeq_epi8(in, c62);
+    __m256i is63 = _mm256_cmpeq_epi8(in, c63);
+
+    __m256i valid =
+        _mm256_or_si256(_mm256_or_si256(upper, lower),
+                        _mm256_or_si256(digit, _mm256_or_si256(is62, is63)));
+    if (_mm256_movemask_epi8(valid) != -1) {
+      break;
+    }
+
+    __m256i values =
+        _mm256_and_si256(upper, _mm256_sub_epi8(in, _mm256_set1_epi8(65)));
+    values = _mm256_or_si256(
+        values,
+        _mm256_and_si256(lower, _mm256_sub_epi8(in, _mm256_set1_epi8(71))));
+    values = _mm256_or_si256(
+        values,
+        _mm256_and_si256(digit, _mm256_add_epi8(in, _mm256_set1_epi8(4))));
+    values =
+        _mm256_or_si256(values, _mm256_and_si256(is62, _mm256_set1_epi8(62)));
+    values =
+        _mm256_or_si256(values, _mm256_and_si256(is63, _mm256_set1_epi8(63)));
+
+    __m256i merged =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(
+        merged, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1,
+                                 -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                 13, 12, -1, -1, -1, -1));
+    // Gather the two 12-byte lane results into the low 24 bytes.
+    merged = _mm256_permutevar8x32_epi32(
+        merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest),
+                     _mm256_castsi256_si128(merged));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(aDest + 16),
+                     _mm256_extracti128_si256(merged, 1));
+
+    consumed += 32;
+    aDest += 24;
+  }
+
+  return consumed;
+}
+
+}  // namespace mozilla::AVX2
@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// This file should only be compiled if you're on x86 or x86_64.  Additionally,
+// you'll need to compile this file with -mssse3 if you're using gcc.
+//
+// The encoder and decoder follow the approach described by Wojciech Muła and
+// Daniel Lemire in "Faster Base64 Encoding and Decoding using AVX2
+// Instructions" (ACM TWEB, 2018), restricted to 128-bit vectors.
+
+#include <tmmintrin.h>
+#include <string.h>
+#include "nscore.h"
+
+namespace mozilla::SSSE3 {
+
+// Splits 12 input bytes (in the low 12 bytes of aIn) into 16 6-bit indices,
+// each in its own byte.
+static inline __m128i SplitIndices(__m128i aIn) {
+  // Duplicate bytes so that each 32-bit lane holds the three input bytes
+  // needed for its four output characters, in big-endian order.
+  __m128i in = _mm_shuffle_epi8(
+      aIn, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+  // Move each 6-bit field into the bottom of its own byte.
+  __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+// Maps 6-bit indices to alphabet characters by adding a per-range offset.
+static inline __m128i IndicesToAscii(__m128i aIndices, __m128i aOffsets) {
+  // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12.
+  __m128i range = _mm_subs_epu8(aIndices, _mm_set1_epi8(51));
+  __m128i isUpper = _mm_cmpgt_epi8(_mm_set1_epi8(26), aIndices);
+  range = _mm_or_si128(range, _mm_and_si128(isUpper, _mm_set1_epi8(13)));
+  return _mm_add_epi8(aIndices, _mm_shuffle_epi8(aOffsets, range));
+}
+
+static inline __m128i AsciiOffsets(bool aURLAlphabet) {
+  const char c62 = aURLAlphabet ? '-' : '+';
+  const char c63 = aURLAlphabet ? '_' : '/';
+  return _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, c62 - 62, c63 - 63, 'A', 0, 0);
+}
+
+size_t Base64EncodeBlocks(const uint8_t* aSrc, size_t aSrcLen, char* aDest,
+                          bool aURLAlphabet) {
+  const __m128i offsets = AsciiOffsets(aURLAlphabet);
+  size_t consumed = 0;
+
+  // Each iteration loads 16 bytes but only consumes 12 of them.
+  while (aSrcLen - consumed >= 16) {
+    __m128i in =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + consumed));
+    __m128i out = IndicesToAscii(SplitIndices(in), offsets);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest), out);
+    consumed += 12;
+    aDest += 16;
+  }
+
+  return consumed;
+}
+
+static inline __m128i InRange(__m128i aChars, char aLow, char aHigh) {
+  return _mm_and_si128(_mm_cmpgt_epi8(aChars, _mm_set1_epi8(aLow - 1)),
+                       _mm_cmplt_epi8(aChars, _mm_set1_epi8(aHigh + 1)));
+}
+
+size_t Base64DecodeBlocks(const char* aSrc, size_t aSrcLen, uint8_t* aDest,
+                          bool aURLAlphabet) {
+  const __m128i c62 = _mm_set1_epi8(aURLAlphabet ? '-' : '+');
+  const __m128i c63 = _mm_set1_epi8(aURLAlphabet ? '_' : '/');
+  size_t consumed = 0;
+
+  while (aSrcLen - consumed >= 16) {
+    __m128i in =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + consumed));
+
+    // Bytes >= 0x80 compare as negative and so fall outside every range.
+    __m128i upper = InRange(in, 'A', 'Z');
+    __m128i lower = InRange(in, 'a', 'z');
+    __m128i digit = InRange(in, '0', '9');
+    __m128i is62 = _mm_cmpeq_epi8(in, c62);
+    __m128i is63 = _mm_cmpeq_epi8(in, c63);
+
+    __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                 _mm_or_si128(digit, _mm_or_si128(is62, is63)));
+    if (_mm_movemask_epi8(valid) != 0xffff) {
+      // Let the scalar decoder deal with (and report) the invalid block.
+      break;
+    }
+
+    __m128i values = _mm_and_si128(upper, _mm_sub_epi8(in, _mm_set1_epi8(65)));
+    values = _mm_or_si128(
+        values, _mm_and_si128(lower, _mm_sub_epi8(in, _mm_set1_epi8(71))));
+    values = _mm_or_si128(
+        values, _mm_and_si128(digit, _mm_add_epi8(in, _mm_set1_epi8(4))));
+    values = _mm_or_si128(values, _mm_and_si128(is62, _mm_set1_epi8(62)));
+    values = _mm_or_si128(values, _mm_and_si128(is63, _mm_set1_epi8(63)));
+
+    // Pack four 6-bit values into three bytes per 32-bit lane.
+    __m128i merged =
+        _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    __m128i out = _mm_shuffle_epi8(
+        merged,
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+    // Only the first 12 bytes are meaningful; don't write past them.
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(aDest), out);
+    uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+    memcpy(aDest + 8, &tail, sizeof(tail));
+
+    consumed += 16;
+    aDest += 12;
+  }
+
+  return consumed;
+}
+
+}  // namespace mozilla::SSSE3
@@ -0,0 +1,424 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "mozilla/DirectoryReader.h"
+
+#include <utility>
+
+#ifdef XP_UNIX
+#  include <dirent.h>
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <string.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+#  include "mozilla/FilePreferences.h"
+#  include "nsLocalFile.h"
+#  include "nsNativeCharsetUtils.h"
+#else
+#  include "nsIDirectoryEnumerator.h"
+#endif
+
+#if defined(XP_LINUX)
+#  include <sys/syscall.h>
+#  ifdef SYS_getdents64
+#    define USE_GETDENTS64
+#  endif
+// Android's seccomp policy kills processes that call statx() on versions
+// that predate it, so stick to fstatat() there.
+#  if defined(STATX_TYPE) && !defined(ANDROID)
+#    define USE_STATX
+#  endif
+#endif
+
+namespace mozilla {
+
+#ifdef XP_UNIX
+
+nsresult DirectoryEntry::GetLeafName(nsAString& aLeafName) const {
+  return NS_CopyNativeToUnicode(mNativeLeafName, aLeafName);
+}
+
+#  ifdef USE_GETDENTS64
+
+// The layout getdents64() fills its buffer with; glibc doesn't declare it.
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+
+struct DirectoryReader::Impl {
+  // Large enough for a few hundred entries per call, while still small
+  // enough to not matter for the short directories most callers read.
+  static const size_t kBufferSize = 32 * 1024;
+
+  explicit Impl(int aFd) : mFd(aFd), mLength(0), mOffset(0) {}
+  ~Impl() { close(mFd); }
+
+  int DirFd() const { return mFd; }
+
+  // Returns the next raw entry, reading another batch from the kernel if
+  // needed, or null at the end of the directory or on error, with errno set
+  // in the latter case.
+  const LinuxDirent64* NextRaw() {
+    if (mOffset >= mLength) {
+      long length = syscall(SYS_getdents64, mFd, mData, kBufferSize);
+      if (length <= 0) {
+        return nullptr;
+      }
+      mLength = size_t(length);
+      mOffset = 0;
+    }
+    auto* entry = reinterpret_cast<const LinuxDirent64*>(mData + mOffset);
+    mOffset += entry->d_reclen;
+    return entry;
+  }
+
+  int mFd;
+  size_t mLength;
+  size_t mOffset;
+  alignas(LinuxDirent64) char mData[kBufferSize];
+};
+
+#  else
+
+struct DirectoryReader::Impl {
+  explicit Impl(DIR* aDir) : mDir(aDir) {}
+  ~Impl() { closedir(mDir); }
+
+  int DirFd() const { return dirfd(mDir); }
+
+  const struct dirent* NextRaw() { return readdir(mDir); }
+
+  DIR* mDir;
+};
+
+#  endif  // USE_GETDENTS64
+
+// Fills in aEntry from the file aName in the directory aDirFd, following
+// symlinks. Sets *aExists to false if the file has been removed since the
+// directory was read.
+static nsresult StatDirectoryEntry(int aDirFd, const char* aName,
+                                   DirectoryEntry& aEntry, bool* aExists) {
+  *aExists = true;
+
+#  ifdef USE_STATX
+  const unsigned int mask = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+  struct statx buf;
+  int result = statx(aDirFd, aName, AT_STATX_SYNC_AS_STAT, mask, &buf);
+  if (result == -1 && errno == ENOENT) {
+    // Like nsIFile, describe the link itself if its target doesn't exist.
+    result = statx(aDirFd, aName, AT_STATX_SYNC_AS_STAT | AT_SYMLINK_NOFOLLOW,
+                   mask, &buf);
+  }
+#  else
+  struct stat buf;
+  int result = fstatat(aDirFd, aName, &buf, 0);
+  if (result == -1 && errno == ENOENT) {
+    result = fstatat(aDirFd, aName, &buf, AT_SYMLINK_NOFOLLOW);
+  }
+#  endif
+
+  if (result == -1) {
+    if (errno == ENOENT) {
+      *aExists = false;
+      return NS_OK;
+    }
+    return NSRESULT_FOR_ERRNO();
+  }
+
+#  ifdef USE_STATX
+  mode_t mode = buf.stx_mode;
+  int64_t size = int64_t(buf.stx_size);
+  PRTime lastModified = PRTime(buf.stx_mtime.tv_sec) * PR_MSEC_PER_SEC +
+                        buf.stx_mtime.tv_nsec / PR_NSEC_PER_MSEC;
+#  else
+  mode_t mode = buf.st_mode;
+  int64_t size = int64_t(buf.st_size);
+#    ifdef XP_DARWIN
+  const struct timespec& mtime = buf.st_mtimespec;
+#    else
+  const struct timespec& mtime = buf.st_mtim;
+#    endif
+  PRTime lastModified = PRTime(mtime.tv_sec) * PR_MSEC_PER_SEC +
+                        mtime.tv_nsec / PR_NSEC_PER_MSEC;
+#  endif
+
+  if (S_ISDIR(mode)) {
+    aEntry.mType = DirectoryEntry::Type::Directory;
+    aEntry.mFileSize = 0;
+  } else {
+    aEntry.mType = S_ISREG(mode) ? DirectoryEntry::Type::File
+                                 : DirectoryEntry::Type::Other;
+    aEntry.mFileSize = size;
+  }
+  aEntry.mLastModifiedTime = lastModified;
+  return NS_OK;
+}
+
+DirectoryReader::DirectoryReader(uint32_t aFlags) : mFlags(aFlags) {}
+
+DirectoryReader::~DirectoryReader() { Close(); }
+
+nsresult DirectoryReader::Open(nsIFile* aDirectory) {
+  MOZ_ASSERT(aDirectory);
+  MOZ_ASSERT(!mImpl, "Already open");
+
+  nsAutoCString dirPath;
+  if (NS_FAILED(aDirectory->GetNativePath(dirPath)) || dirPath.IsEmpty()) {
+    return NS_ERROR_FILE_INVALID_PATH;
+  }
+
+  // As for nsIFile::GetDirectoryEntries(), the path must be checked with a
+  // slash at the end.
+  nsAutoCString dirPathWithSlash(dirPath);
+  dirPathWithSlash.Append('/');
+  if (!FilePreferences::IsAllowedPath(dirPathWithSlash)) {
+    return NS_ERROR_FILE_ACCESS_DENIED;
+  }
+
+  int fd = open(dirPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    return NSRESULT_FOR_ERRNO();
+  }
+
+#  ifdef USE_GETDENTS64
+  mImpl = MakeUnique<Impl>(fd);
+#  else
+  DIR* dir = fdopendir(fd);
+  if (!dir) {
+    nsresult rv = NSRESULT_FOR_ERRNO();
+    close(fd);
+    return rv;
+  }
+  mImpl = MakeUnique<Impl>(dir);
+#  endif
+
+  nsresult rv = aDirectory->Clone(getter_AddRefs(mDirectory));
+  if (NS_FAILED(rv)) {
+    Close();
+    return rv;
+  }
+  return NS_OK;
+}
+
+nsresult DirectoryReader::Next(DirectoryEntry& aEntry, bool* aHasEntry) {
+  MOZ_ASSERT(aHasEntry);
+
+  *aHasEntry = false;
+  if (!mImpl) {
+    return NS_OK;
+  }
+
+  while (true) {
+    errno = 0;
+    const auto* raw = mImpl->NextRaw();
+    if (!raw) {
+      // End of the directory, or an error.
+      nsresult rv = errno ? NSRESULT_FOR_ERRNO() : NS_OK;
+      Close();
+      return rv;
+    }
+
+    const char* name = raw->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+
+    bool needStat = mFlags & eStat;
+#  ifdef DT_DIR
+    switch (raw->d_type) {
+      case DT_REG:
+        aEntry.mType = DirectoryEntry::Type::File;
+        break;
+      case DT_DIR:
+        aEntry.mType = DirectoryEntry::Type::Directory;
+        break;
+      case DT_LNK:
+      case DT_UNKNOWN:
+        // Symlinks have to be followed, and some file systems don't report
+        // types at all.
+        needStat = true;
+        break;
+      default:
+        aEntry.mType = DirectoryEntry::Type::Other;
+        break;
+    }
+#  else
+    needStat = true;
+#  endif
+
+    aEntry.mFileSize = 0;
+    aEntry.mLastModifiedTime = 0;
+    aEntry.mStatResult = NS_OK;
+    if (needStat) {
+      bool exists;
+      nsresult rv = StatDirectoryEntry(mImpl->DirFd(), name, aEntry, &exists);
+      if (NS_FAILED(rv)) {
+        aEntry.mType = DirectoryEntry::Type::Other;
+        aEntry.mStatResult = rv;
+      } else if (!exists) {
+        continue;
+      }
+    }
+
+    aEntry.mNativeLeafName.Assign(name);
+    *aHasEntry = true;
+    return NS_OK;
+  }
+}
+
+nsresult DirectoryReader::GetFile(const DirectoryEntry& aEntry,
+                                  nsIFile** aFile) const {
+  if (NS_WARN_IF(!mDirectory)) {
+    return NS_ERROR_NOT_INITIALIZED;
+  }
+
+  nsCOMPtr<nsIFile> file;
+  nsresult rv = mDirectory->Clone(getter_AddRefs(file));
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+  rv = file->AppendNative(aEntry.mNativeLeafName);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+  file.forget(aFile);
+  return NS_OK;
+}
+
+void DirectoryReader::Close() { mImpl = nullptr; }
+
+#else  // XP_UNIX
+
+nsresult DirectoryEntry::GetLeafName(nsAString& aLeafName) const {
+  return mFile->GetLeafName(aLeafName);
+}
+
+struct DirectoryReader::Impl {
+  nsCOMPtr<nsIDirectoryEnumerator> mEnumerator;
+};
+
+// Fills in the type of aEntry, and its size and modification time if
+// aFlags has DirectoryReader::eStat, from aFile.
+static nsresult StatFile(nsIFile* aFile, uint32_t aFlags,
+                         DirectoryEntry& aEntry) {
+  // The stat is cached, so the checks below share a single one.
+  bool isDirectory;
+  nsresult rv = aFile->IsDirectory(&isDirectory);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+
+  bool isFile = false;
+  if (!isDirectory) {
+    rv = aFile->IsFile(&isFile);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+  }
+  aEntry.mType = isDirectory ? DirectoryEntry::Type::Directory
+                 : isFile    ? DirectoryEntry::Type::File
+                             : DirectoryEntry::Type::Other;
+
+  if (aFlags & DirectoryReader::eStat) {
+    rv = aFile->GetFileSize(&aEntry.mFileSize);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+    rv = aFile->GetLastModifiedTime(&aEntry.mLastModifiedTime);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+  }
+  return NS_OK;
+}
+
+DirectoryReader::DirectoryReader(uint32_t aFlags) : mFlags(aFlags) {}
+
+DirectoryReader::~DirectoryReader() { Close(); }
+
+nsresult DirectoryReader::Open(nsIFile* aDirectory) {
+  MOZ_ASSERT(aDirectory);
+  MOZ_ASSERT(!mImpl, "Already open");
+
+  auto impl = MakeUnique<Impl>();
+  nsresult rv = aDirectory->GetDirectoryEntries(
+      getter_AddRefs(impl->mEnumerator));
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+  mImpl = std::move(impl);
+  mDirectory = aDirectory;
+  return NS_OK;
+}
+
+nsresult DirectoryReader::Next(DirectoryEntry& aEntry, bool* aHasEntry) {
+  MOZ_ASSERT(aHasEntry);
+
+  *aHasEntry = false;
+  if (!mImpl) {
+    return NS_OK;
+  }
+
+  while (true) {
+    nsCOMPtr<nsIFile> file;
+    nsresult rv = mImpl->mEnumerator->GetNextFile(getter_AddRefs(file));
+    if (NS_FAILED(rv) || !file) {
+      Close();
+      return rv;
+    }
+
+    rv = file->GetNativeLeafName(aEntry.mNativeLeafName);
+    if (NS_FAILED(rv)) {
+      NS_WARNING("DirectoryReader::Next() - Skipping entry without a name");
+      continue;
+    }
+
+    aEntry.mType = DirectoryEntry::Type::Other;
+    aEntry.mFileSize = 0;
+    aEntry.mLastModifiedTime = 0;
+    aEntry.mStatResult = StatFile(file, mFlags, aEntry);
+    if (aEntry.mStatResult == NS_ERROR_FILE_NOT_FOUND ||
+        aEntry.mStatResult == NS_ERROR_FILE_TARGET_DOES_NOT_EXIST) {
+      continue;
+    }
+    if (NS_FAILED(aEntry.mStatResult)) {
+      aEntry.mType = DirectoryEntry::Type::Other;
+      aEntry.mFileSize = 0;
+      aEntry.mLastModifiedTime = 0;
+    }
+    aEntry.mFile = std::move(file);
+    *aHasEntry = true;
+    return NS_OK;
+  }
+}
+
+nsresult DirectoryReader::GetFile(const DirectoryEntry& aEntry,
+                                  nsIFile** aFile) const {
+  if (NS_WARN_IF(!aEntry.mFile)) {
+    return NS_ERROR_INVALID_ARG;
+  }
+  nsCOMPtr<nsIFile> file = aEntry.mFile;
+  file.forget(aFile);
+  return NS_OK;
+}
+
+void DirectoryReader::Close() {
+  if (mImpl) {
+    mImpl->mEnumerator->Close();
+    mImpl = nullptr;
+  }
+}
+
+#endif  // XP_UNIX
+
+}  // namespace mozilla
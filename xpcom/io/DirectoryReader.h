@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_DirectoryReader_h
+#define mozilla_DirectoryReader_h
+
+#include "mozilla/Attributes.h"
+#include "mozilla/UniquePtr.h"
+#include "nsCOMPtr.h"
+#include "nsIFile.h"
+#include "nsString.h"
+#include "prtime.h"
+
+namespace mozilla {
+
+/**
+ * One entry of a directory, as returned by DirectoryReader.
+ */
+struct DirectoryEntry {
+  enum class Type : uint8_t {
+    File,
+    Directory,
+    // Anything else: sockets, devices, and symlinks that don't resolve.
+    Other,
+  };
+
+  DirectoryEntry()
+      : mType(Type::Other),
+        mFileSize(0),
+        mLastModifiedTime(0),
+        mStatResult(NS_OK) {}
+
+  bool IsDirectory() const { return mType == Type::Directory; }
+  bool IsFile() const { return mType == Type::File; }
+
+  /**
+   * The same as nsIFile::GetLeafName() would return for the entry.
+   */
+  nsresult GetLeafName(nsAString& aLeafName) const;
+
+  // The same as nsIFile::GetNativeLeafName().
+  nsCString mNativeLeafName;
+
+  // Symlinks are followed, like nsIFile::IsDirectory() and friends do.
+  Type mType;
+
+  // Only filled in by a reader opened with DirectoryReader::eStat. Like
+  // nsIFile::GetFileSize(), the size of a directory is zero.
+  int64_t mFileSize;
+
+  // In milliseconds, like nsIFile::GetLastModifiedTime(). Only filled in by a
+  // reader opened with DirectoryReader::eStat.
+  PRTime mLastModifiedTime;
+
+  // Why the entry couldn't be stat'ed, if it couldn't: a permission error, a
+  // symlink loop, an I/O error and so on. The reader still returns such
+  // entries, with their name but with mType set to Other and the size and
+  // modification time set to zero, so that one bad entry doesn't end the
+  // enumeration. Callers that need the missing information can try again
+  // with the nsIFile from DirectoryReader::GetFile().
+  nsresult mStatResult;
+
+#ifndef XP_UNIX
+  // The file the entry was read from, on platforms that enumerate with
+  // nsIDirectoryEnumerator.
+  nsCOMPtr<nsIFile> mFile;
+#endif
+};
+
+/**
+ * DirectoryReader
+ *
+ * Enumerates a directory like nsIFile::GetDirectoryEntries(), but returns
+ * the name, type, size and modification time of each entry together, without
+ * creating an nsIFile for it. Enumerating a directory with an
+ * nsIDirectoryEnumerator costs an nsIFile allocation and at least one stat()
+ * for each entry the caller wants to know anything about, which adds up for
+ * directories with tens of thousands of entries like the cache's entries
+ * directory.
+ *
+ * On Linux entries are read in batches with getdents64(), whose results
+ * already include the type of most entries, and the size and modification
+ * time are read with statx() relative to the open directory, so that the
+ * kernel doesn't have to resolve the whole path again. Other Unix platforms
+ * use readdir() and fstatat(). Elsewhere this falls back to an
+ * nsIDirectoryEnumerator.
+ *
+ * Example usage:
+ *
+ *   DirectoryReader reader(DirectoryReader::eStat);
+ *   nsresult rv = reader.Open(directory);
+ *   ...
+ *   DirectoryEntry entry;
+ *   bool hasEntry;
+ *   while (NS_SUCCEEDED(rv = reader.Next(entry, &hasEntry)) && hasEntry) {
+ *     if (entry.IsFile()) {
+ *       totalSize += entry.mFileSize;
+ *     }
+ *   }
+ *
+ * A reader must only be used on one thread at a time.
+ */
+class DirectoryReader final {
+ public:
+  enum Flags : uint32_t {
+    // Only read names and types. Types are free on most Linux file systems,
+    // and cost an fstatat() call per entry elsewhere.
+    eNone = 0,
+    // Also fill in the size and modification time of each entry.
+    eStat = 1 << 0,
+  };
+
+  explicit DirectoryReader(uint32_t aFlags = eNone);
+  ~DirectoryReader();
+
+  DirectoryReader(const DirectoryReader&) = delete;
+  DirectoryReader& operator=(const DirectoryReader&) = delete;
+
+  nsresult Open(nsIFile* aDirectory);
+
+  /**
+   * Reads the next entry into aEntry, skipping "." and "..". Sets *aHasEntry
+   * to false at the end of the directory. Entries that are removed between
+   * being listed and being stat'ed are skipped; entries that can't be stat'ed
+   * for any other reason are returned with DirectoryEntry::mStatResult set.
+   * A failure means the directory itself couldn't be read any further.
+   */
+  MOZ_MUST_USE nsresult Next(DirectoryEntry& aEntry, bool* aHasEntry);
+
+  /**
+   * Creates an nsIFile for an entry returned by this reader.
+   */
+  nsresult GetFile(const DirectoryEntry& aEntry, nsIFile** aFile) const;
+
+  /**
+   * Closes the directory. It is safe to call this more than once, and the
+   * destructor calls it.
+   */
+  void Close();
+
+ private:
+  // The platform's open directory handle and any entries read but not yet
+  // returned.
+  struct Impl;
+
+  const uint32_t mFlags;
+  nsCOMPtr<nsIFile> mDirectory;
+  UniquePtr<Impl> mImpl;
+};
+
+}  // namespace mozilla
+
+#endif  // mozilla_DirectoryReader_h
@@ -7,22 +7,111 @@
 #include "mozilla/SnappyCompressOutputStream.h"
 
 #include <algorithm>
+#include "mozilla/Atomics.h"
+#include "mozilla/Monitor.h"
 #include "nsStreamUtils.h"
+#include "nsThreadUtils.h"
 #include "snappy/snappy.h"
 
 namespace mozilla {
 
+namespace {
+
+// Compresses a buffer a block at a time, into consecutive slots of a
+// compressed buffer.  The thread flushing the stream and any background tasks
+// it starts all take blocks until there are none left, so the batch finishes
+// even if no background task gets to run before the flushing thread is done.
+class CompressBatch final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(CompressBatch)
+
+  CompressBatch(const char* aSource, size_t aSourceLength, size_t aBlockSize,
+                char* aDest, size_t aDestBlockLength,
+                size_t* aCompressedLengthsOut, size_t aBlockCount)
+      : mSource(aSource),
+        mSourceLength(aSourceLength),
+        mBlockSize(aBlockSize),
+        mDest(aDest),
+        mDestBlockLength(aDestBlockLength),
+        mCompressedLengths(aCompressedLengthsOut),
+        mBlockCount(aBlockCount),
+        mNextBlock(0),
+        mMonitor("CompressBatch::mMonitor"),
+        mRemaining(aBlockCount),
+        mStatus(NS_OK) {}
+
+  void CompressBlocks() {
+    for (;;) {
+      size_t block = mNextBlock++;
+      if (block >= mBlockCount) {
+        return;
+      }
+
+      size_t offset = block * mBlockSize;
+      MOZ_ASSERT(offset <= mSourceLength);
+      size_t compressedLength = 0;
+      nsresult rv = detail::SnappyFrameUtils::WriteCompressedData(
+          mDest + block * mDestBlockLength, mDestBlockLength, mSource + offset,
+          std::min(mBlockSize, mSourceLength - offset), &compressedLength);
+
+      MonitorAutoLock lock(mMonitor);
+      mCompressedLengths[block] = compressedLength;
+      if (NS_FAILED(rv) && NS_SUCCEEDED(mStatus)) {
+        mStatus = rv;
+      }
+      if (--mRemaining == 0) {
+        lock.Notify();
+      }
+    }
+  }
+
+  // Waits for the blocks other threads took, and returns the first error.
+  nsresult Wait() {
+    MonitorAutoLock lock(mMonitor);
+    while (mRemaining) {
+      lock.Wait();
+    }
+    return mStatus;
+  }
+
+ private:
+  ~CompressBatch() = default;
+
+  // These are owned by the stream, which waits for the batch.
+  const char* const mSource;
+  const size_t mSourceLength;
+  const size_t mBlockSize;
+  char* const mDest;
+  const size_t mDestBlockLength;
+  size_t* const mCompressedLengths;
+  const size_t mBlockCount;
+
+  Atomic<size_t> mNextBlock;
+
+  Monitor mMonitor;
+  size_t mRemaining;
+  nsresult mStatus;
+};
+
+}  // anonymous namespace
+
 NS_IMPL_ISUPPORTS(SnappyCompressOutputStream, nsIOutputStream);
 
 // static
 const size_t SnappyCompressOutputStream::kMaxBlockSize = snappy::kBlockSize;
 
 SnappyCompressOutputStream::SnappyCompressOutputStream(
-    nsIOutputStream* aBaseStream, size_t aBlockSize)
+    nsIOutputStream* aBaseStream, size_t aBlockSize, uint32_t aFlags)
     : mBaseStream(aBaseStream),
       mBlockSize(std::min(aBlockSize, kMaxBlockSize)),
+      mFlags(aFlags),
+      mBufferLength(mBlockSize * ((aFlags & eParallelCompression)
+                                      ? kParallelBlockCount
+                                      : 1)),
       mNextByte(0),
-      mCompressedBufferLength(0),
+      mCompressedBlockLength(0),
+      mCompressedOffset(0),
+      mUncompressedOffset(0),
       mStreamIdentifierWritten(false) {
   MOZ_ASSERT(mBlockSize > 0);
 
@@ -51,6 +140,13 @@ SnappyCompressOutputStream::Close() {
     return rv;
   }
 
+  if (mFlags & eWriteFrameIndex) {
+    rv = WriteFrameIndexToBaseStream();
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+  }
+
   mBaseStream->Close();
   mBaseStream = nullptr;
 
@@ -99,7 +195,7 @@ SnappyCompressOutputStream::WriteSegments(nsReadSegmentFun aReader,
   }
 
   if (!mBuffer) {
-    mBuffer.reset(new (fallible) char[mBlockSize]);
+    mBuffer.reset(new (fallible) char[mBufferLength]);
     if (NS_WARN_IF(!mBuffer)) {
       return NS_ERROR_OUT_OF_MEMORY;
     }
@@ -107,8 +203,8 @@ SnappyCompressOutputStream::WriteSegments(nsReadSegmentFun aReader,
 
   while (aCount > 0) {
     // Determine how much space is left in our flat, uncompressed buffer.
-    MOZ_ASSERT(mNextByte <= mBlockSize);
-    uint32_t remaining = mBlockSize - mNextByte;
+    MOZ_ASSERT(mNextByte <= mBufferLength);
+    uint32_t remaining = mBufferLength - mNextByte;
 
     // If it is full, then compress and flush the data to the base stream.
     if (remaining == 0) {
@@ -119,7 +215,7 @@ SnappyCompressOutputStream::WriteSegments(nsReadSegmentFun aReader,
 
       // Now the entire buffer should be available for copying.
       MOZ_ASSERT(!mNextByte);
-      remaining = mBlockSize;
+      remaining = mBufferLength;
     }
 
     uint32_t numToRead = std::min(remaining, aCount);
@@ -161,8 +257,9 @@ nsresult SnappyCompressOutputStream::FlushToBaseStream() {
   // allows us to report OOM during stream operation.  This buffer
   // will then get re-used until the stream is closed.
   if (!mCompressedBuffer) {
-    mCompressedBufferLength = MaxCompressedBufferLength(mBlockSize);
-    mCompressedBuffer.reset(new (fallible) char[mCompressedBufferLength]);
+    mCompressedBlockLength = MaxCompressedBufferLength(mBlockSize);
+    mCompressedBuffer.reset(new (fallible) char[mCompressedBlockLength *
+                                                (mBufferLength / mBlockSize)]);
     if (NS_WARN_IF(!mCompressedBuffer)) {
       return NS_ERROR_OUT_OF_MEMORY;
     }
@@ -175,24 +272,99 @@ nsresult SnappyCompressOutputStream::FlushToBaseStream() {
     return rv;
   }
 
-  // Compress the data to our internal compressed buffer.
-  size_t compressedLength;
-  rv = WriteCompressedData(mCompressedBuffer.get(), mCompressedBufferLength,
-                           mBuffer.get(), mNextByte, &compressedLength);
+  // Compress the data to our internal compressed buffer.  Flushing an empty
+  // buffer still writes a single, empty block.
+  size_t length = mNextByte;
+  size_t blockCount =
+      std::max<size_t>(1, (length + mBlockSize - 1) / mBlockSize);
+  MOZ_ASSERT(blockCount <= kParallelBlockCount);
+  size_t compressedLengths[kParallelBlockCount];
+  rv = CompressBlocks(blockCount, compressedLengths);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
-  MOZ_ASSERT(compressedLength > 0);
 
   mNextByte = 0;
 
-  // Write the compressed buffer out to the base stream.
+  // Write the compressed blocks out to the base stream, in order.
+  for (size_t i = 0; i < blockCount; ++i) {
+    MOZ_ASSERT(compressedLengths[i] > 0);
+
+    if ((mFlags & eWriteFrameIndex) && i * mBlockSize < length) {
+      mFrameIndex.AppendElement(FrameIndexEntry{
+          mCompressedOffset, mUncompressedOffset + i * mBlockSize});
+    }
+
+    uint32_t numWritten = 0;
+    rv = WriteAll(&mCompressedBuffer[i * mCompressedBlockLength],
+                  compressedLengths[i], &numWritten);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+    MOZ_ASSERT(compressedLengths[i] == numWritten);
+    mCompressedOffset += numWritten;
+  }
+
+  mUncompressedOffset += length;
+
+  return NS_OK;
+}
+
+nsresult SnappyCompressOutputStream::CompressBlocks(
+    size_t aBlockCount, size_t* aCompressedLengthsOut) {
+  auto batch = MakeRefPtr<CompressBatch>(
+      mBuffer.get(), mNextByte, mBlockSize, mCompressedBuffer.get(),
+      mCompressedBlockLength, aCompressedLengthsOut, aBlockCount);
+
+  // Let background tasks take blocks too, if there are cores to run them on.
+  // This thread compresses whatever they don't get to, including everything
+  // if they can't be dispatched, like during shutdown.
+  size_t helpers = std::min(aBlockCount, GetNumberOfProcessors()) - 1;
+  for (size_t i = 0; i < helpers; ++i) {
+    nsresult rv = NS_DispatchBackgroundTask(
+        NS_NewRunnableFunction("SnappyCompressOutputStream::CompressBlocks",
+                               [batch]() { batch->CompressBlocks(); }));
+    if (NS_FAILED(rv)) {
+      break;
+    }
+  }
+
+  batch->CompressBlocks();
+  return batch->Wait();
+}
+
+nsresult SnappyCompressOutputStream::WriteFrameIndexToBaseStream() {
+  MOZ_ASSERT(mBaseStream);
+
+  size_t length = FrameIndexLength(mFrameIndex.Length());
+  if (length - kHeaderLength > kMaxChunkDataLength) {
+    // This takes about a million frames.  Readers can still seek by scanning
+    // the stream.
+    NS_WARNING("Too many frames to write a snappy frame index");
+    return NS_OK;
+  }
+
+  UniquePtr<char[]> buffer(new (fallible) char[length]);
+  if (NS_WARN_IF(!buffer)) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  size_t indexLength;
+  nsresult rv = WriteFrameIndex(buffer.get(), length, mFrameIndex,
+                                mUncompressedOffset, &indexLength);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
   uint32_t numWritten = 0;
-  rv = WriteAll(mCompressedBuffer.get(), compressedLength, &numWritten);
+  rv = WriteAll(buffer.get(), indexLength, &numWritten);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
-  MOZ_ASSERT(compressedLength == numWritten);
+  MOZ_ASSERT(indexLength == numWritten);
+  mCompressedOffset += numWritten;
+
+  mFrameIndex.Clear();
 
   return NS_OK;
 }
@@ -207,7 +379,7 @@ nsresult SnappyCompressOutputStream::MaybeFlushStreamIdentifier() {
   // Build the StreamIdentifier in our compressed buffer.
   size_t compressedLength;
   nsresult rv = WriteStreamIdentifier(
-      mCompressedBuffer.get(), mCompressedBufferLength, &compressedLength);
+      mCompressedBuffer.get(), mCompressedBlockLength, &compressedLength);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
@@ -219,6 +391,7 @@ nsresult SnappyCompressOutputStream::MaybeFlushStreamIdentifier() {
     return rv;
   }
   MOZ_ASSERT(compressedLength == numWritten);
+  mCompressedOffset += numWritten;
 
   mStreamIdentifierWritten = true;
 
@@ -12,6 +12,7 @@
 #include "nsCOMPtr.h"
 #include "nsIOutputStream.h"
 #include "nsISupportsImpl.h"
+#include "nsTArray.h"
 #include "SnappyFrameUtils.h"
 
 namespace mozilla {
@@ -22,12 +23,30 @@ class SnappyCompressOutputStream final : public nsIOutputStream,
   // Maximum compression block size.
   static const size_t kMaxBlockSize;
 
+  // Number of blocks buffered and compressed together with
+  // eParallelCompression.
+  static const size_t kParallelBlockCount = 8;
+
+  enum Flags : uint32_t {
+    // Buffer up to kParallelBlockCount blocks and compress them on background
+    // threads at once.  Each block is still compressed on its own, so the
+    // output is the same as without the flag, but the stream holds on to more
+    // data before writing it to the base stream.
+    eParallelCompression = 1 << 0,
+
+    // Append a FrameIndex chunk when the stream is closed, which lets
+    // SnappyUncompressInputStream seek without reading the whole stream.
+    // Readers from before FrameIndex chunks existed fail on it.
+    eWriteFrameIndex = 1 << 1,
+  };
+
   // Construct a new blocking output stream to compress data to
   // the given base stream.  The base stream must also be blocking.
   // The compression block size may optionally be set to a value
   // up to kMaxBlockSize.
   explicit SnappyCompressOutputStream(nsIOutputStream* aBaseStream,
-                                      size_t aBlockSize = kMaxBlockSize);
+                                      size_t aBlockSize = kMaxBlockSize,
+                                      uint32_t aFlags = 0);
 
   // The compression block size.  To optimize stream performance
   // try to write to the stream in segments at least this size.
@@ -38,22 +57,37 @@ class SnappyCompressOutputStream final : public nsIOutputStream,
 
   nsresult FlushToBaseStream();
   nsresult MaybeFlushStreamIdentifier();
+  nsresult CompressBlocks(size_t aBlockCount, size_t* aCompressedLengthsOut);
+  nsresult WriteFrameIndexToBaseStream();
   nsresult WriteAll(const char* aBuf, uint32_t aCount,
                     uint32_t* aBytesWrittenOut);
 
   nsCOMPtr<nsIOutputStream> mBaseStream;
   const size_t mBlockSize;
+  const uint32_t mFlags;
 
   // Buffer holding copied uncompressed data.  This must be copied here
   // so that the compression can be performed on a single flat buffer.
+  // It holds kParallelBlockCount blocks with eParallelCompression, and a
+  // single block otherwise.
   mozilla::UniquePtr<char[]> mBuffer;
+  const size_t mBufferLength;
 
   // The next byte in the uncompressed data to copy incoming data to.
   size_t mNextByte;
 
-  // Buffer holding the resulting compressed data.
+  // Buffer holding the resulting compressed data, with room for the
+  // compressed form of each block in mBuffer.
   mozilla::UniquePtr<char[]> mCompressedBuffer;
-  size_t mCompressedBufferLength;
+  size_t mCompressedBlockLength;
+
+  // How much has been written to the base stream, and how much data it
+  // holds once uncompressed.
+  uint64_t mCompressedOffset;
+  uint64_t mUncompressedOffset;
+
+  // Where each block was written, with eWriteFrameIndex.
+  nsTArray<FrameIndexEntry> mFrameIndex;
 
   // The first thing written to the stream must be a stream identifier.
   bool mStreamIdentifierWritten;
@@ -25,6 +25,10 @@ SnappyFrameUtils::ChunkType ReadChunkType(uint8_t aByte) {
     return SnappyFrameUtils::UncompressedData;
   } else if (aByte == 0xfe) {
     return SnappyFrameUtils::Padding;
+  } else if (aByte == 0xfd) {
+    return SnappyFrameUtils::FrameIndex;
+  } else if (aByte >= 0x80) {
+    return SnappyFrameUtils::ReservedSkippable;
   }
 
   return SnappyFrameUtils::Reserved;
@@ -40,6 +44,8 @@ void WriteChunkType(char* aDest, SnappyFrameUtils::ChunkType aType) {
     *dest = 0x01;
   } else if (aType == SnappyFrameUtils::Padding) {
     *dest = 0xfe;
+  } else if (aType == SnappyFrameUtils::FrameIndex) {
+    *dest = 0xfd;
   } else {
     *dest = 0x02;
   }
@@ -62,6 +68,15 @@ uint32_t MaskChecksum(uint32_t aValue) {
   return ((aValue >> 15) | (aValue << 17)) + 0xa282ead8;
 }
 
+const char kFrameIndexMagic[] = {'s', 'N', 'i', 'X'};
+
+// The fixed size fields of a FrameIndex chunk's data: the CRC, the
+// uncompressed length, the entry count and the trailer.
+const size_t kFrameIndexFixedDataLength =
+    SnappyFrameUtils::kCRCLength + 8 + 4 +
+    SnappyFrameUtils::kFrameIndexTrailerLength;
+const size_t kFrameIndexEntryLength = 16;
+
 }  // namespace
 
 namespace mozilla {
@@ -69,6 +84,11 @@ namespace detail {
 
 using mozilla::LittleEndian;
 
+// static
+bool SnappyFrameUtils::IsSkippable(ChunkType aType) {
+  return aType == Padding || aType == FrameIndex || aType == ReservedSkippable;
+}
+
 // static
 nsresult SnappyFrameUtils::WriteStreamIdentifier(char* aDest,
                                                  size_t aDestLength,
@@ -134,6 +154,57 @@ nsresult SnappyFrameUtils::WriteCompressedData(char* aDest, size_t aDestLength,
   return NS_OK;
 }
 
+// static
+size_t SnappyFrameUtils::FrameIndexLength(size_t aEntryCount) {
+  return kHeaderLength + kFrameIndexFixedDataLength +
+         aEntryCount * kFrameIndexEntryLength;
+}
+
+// static
+nsresult SnappyFrameUtils::WriteFrameIndex(
+    char* aDest, size_t aDestLength, const nsTArray<FrameIndexEntry>& aEntries,
+    uint64_t aUncompressedLength, size_t* aBytesWrittenOut) {
+  *aBytesWrittenOut = 0;
+
+  size_t length = FrameIndexLength(aEntries.Length());
+  if (NS_WARN_IF(length - kHeaderLength > kMaxChunkDataLength)) {
+    return NS_ERROR_ILLEGAL_VALUE;
+  }
+  if (NS_WARN_IF(aDestLength < length)) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  WriteChunkType(aDest, FrameIndex);
+  WriteUInt24(aDest + kChunkTypeLength, length - kHeaderLength);
+
+  // Fill in everything after the CRC first, so we can checksum it.
+  char* data = aDest + kHeaderLength;
+  size_t offset = kCRCLength;
+  LittleEndian::writeUint64(data + offset, aUncompressedLength);
+  offset += 8;
+  LittleEndian::writeUint32(data + offset, aEntries.Length());
+  offset += 4;
+  for (const FrameIndexEntry& entry : aEntries) {
+    LittleEndian::writeUint64(data + offset, entry.mCompressedOffset);
+    LittleEndian::writeUint64(data + offset + 8, entry.mUncompressedOffset);
+    offset += kFrameIndexEntryLength;
+  }
+  LittleEndian::writeUint32(data + offset, length);
+  offset += 4;
+  memcpy(data + offset, kFrameIndexMagic, sizeof(kFrameIndexMagic));
+  offset += sizeof(kFrameIndexMagic);
+  MOZ_ASSERT(kHeaderLength + offset == length);
+
+  uint32_t crc = ComputeCrc32c(
+      ~0, reinterpret_cast<const unsigned char*>(data) + kCRCLength,
+      offset - kCRCLength);
+  LittleEndian::writeUint32(data, MaskChecksum(crc));
+
+  *aBytesWrittenOut = length;
+
+  return NS_OK;
+}
+
 // static
 nsresult SnappyFrameUtils::ParseHeader(const char* aSource,
                                        size_t aSourceLength,
@@ -164,6 +235,16 @@ nsresult SnappyFrameUtils::ParseData(char* aDest, size_t aDestLength,
       return ParseCompressedData(aDest, aDestLength, aData, aDataLength,
                                  aBytesWrittenOut, aBytesReadOut);
 
+    case Padding:
+    case FrameIndex:
+    case ReservedSkippable:
+      *aBytesWrittenOut = 0;
+      *aBytesReadOut = aDataLength;
+      return NS_OK;
+
+    case Reserved:
+      return NS_ERROR_CORRUPTED_CONTENT;
+
     // TODO: support other snappy chunk types
     default:
       MOZ_ASSERT_UNREACHABLE("Unsupported snappy framing chunk type.");
@@ -198,6 +279,10 @@ nsresult SnappyFrameUtils::ParseCompressedData(char* aDest, size_t aDestLength,
   *aBytesReadOut = 0;
   size_t offset = 0;
 
+  if (NS_WARN_IF(aDataLength < kCRCLength)) {
+    return NS_ERROR_CORRUPTED_CONTENT;
+  }
+
   uint32_t readCrc = LittleEndian::readUint32(aData + offset);
   offset += kCRCLength;
 
@@ -229,6 +314,99 @@ nsresult SnappyFrameUtils::ParseCompressedData(char* aDest, size_t aDestLength,
   return NS_OK;
 }
 
+// static
+nsresult SnappyFrameUtils::ParseFrameIndexTrailer(const char* aSource,
+                                                  size_t aSourceLength,
+                                                  size_t* aChunkLengthOut) {
+  *aChunkLengthOut = 0;
+  if (aSourceLength < kFrameIndexTrailerLength) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  const char* trailer = aSource + aSourceLength - kFrameIndexTrailerLength;
+  if (memcmp(trailer + 4, kFrameIndexMagic, sizeof(kFrameIndexMagic))) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  uint32_t length = LittleEndian::readUint32(trailer);
+  if (length < FrameIndexLength(0) ||
+      length - kHeaderLength > kMaxChunkDataLength) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  *aChunkLengthOut = length;
+  return NS_OK;
+}
+
+// static
+nsresult SnappyFrameUtils::ParseFrameIndex(
+    const char* aSource, size_t aSourceLength, uint64_t aCompressedLength,
+    nsTArray<FrameIndexEntry>& aEntriesOut, uint64_t* aUncompressedLengthOut) {
+  aEntriesOut.Clear();
+  *aUncompressedLengthOut = 0;
+
+  ChunkType type;
+  size_t dataLength;
+  nsresult rv = ParseHeader(aSource, aSourceLength, &type, &dataLength);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+  if (NS_WARN_IF(type != FrameIndex ||
+                 dataLength != aSourceLength - kHeaderLength ||
+                 dataLength < kFrameIndexFixedDataLength)) {
+    return NS_ERROR_CORRUPTED_CONTENT;
+  }
+
+  const char* data = aSource + kHeaderLength;
+  uint32_t readCrc = LittleEndian::readUint32(data);
+  uint32_t crc = ComputeCrc32c(
+      ~0, reinterpret_cast<const unsigned char*>(data) + kCRCLength,
+      dataLength - kCRCLength);
+  if (NS_WARN_IF(readCrc != MaskChecksum(crc))) {
+    return NS_ERROR_CORRUPTED_CONTENT;
+  }
+
+  size_t offset = kCRCLength;
+  uint64_t uncompressedLength = LittleEndian::readUint64(data + offset);
+  offset += 8;
+  uint32_t count = LittleEndian::readUint32(data + offset);
+  offset += 4;
+  if (NS_WARN_IF(count > dataLength / kFrameIndexEntryLength ||
+                 FrameIndexLength(count) != aSourceLength)) {
+    return NS_ERROR_CORRUPTED_CONTENT;
+  }
+
+  if (NS_WARN_IF(!aEntriesOut.SetCapacity(count, fallible))) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  // Entries must be in order, and must only point into the data before the
+  // index.  Every frame in the index holds at least one byte.
+  uint64_t minCompressedOffset = kHeaderLength + kStreamIdentifierDataLength;
+  uint64_t minUncompressedOffset = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    FrameIndexEntry entry;
+    entry.mCompressedOffset = LittleEndian::readUint64(data + offset);
+    entry.mUncompressedOffset = LittleEndian::readUint64(data + offset + 8);
+    offset += kFrameIndexEntryLength;
+
+    if (NS_WARN_IF(entry.mCompressedOffset < minCompressedOffset ||
+                   entry.mCompressedOffset >= aCompressedLength ||
+                   entry.mUncompressedOffset < minUncompressedOffset ||
+                   entry.mUncompressedOffset >= uncompressedLength)) {
+      aEntriesOut.Clear();
+      return NS_ERROR_CORRUPTED_CONTENT;
+    }
+    minCompressedOffset = entry.mCompressedOffset + kHeaderLength + kCRCLength;
+    minUncompressedOffset = entry.mUncompressedOffset + 1;
+
+    aEntriesOut.AppendElement(entry);
+  }
+
+  *aUncompressedLengthOut = uncompressedLength;
+  return NS_OK;
+}
+
 // static
 size_t SnappyFrameUtils::MaxCompressedBufferLength(size_t aSourceLength) {
   size_t neededLength = kHeaderLength;
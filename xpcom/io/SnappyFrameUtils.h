@@ -9,6 +9,7 @@
 
 #include "mozilla/Attributes.h"
 #include "nsError.h"
+#include "nsTArray.h"
 
 namespace mozilla {
 namespace detail {
@@ -21,7 +22,25 @@ namespace detail {
 //  other-licences/snappy/src/framing_format.txt
 //
 // NOTE: Currently only the StreamIdentifier and CompressedData chunks are
-//       supported.
+//       supported.  Padding and other skippable chunks are ignored.
+//
+// In addition to the chunks defined there, streams may end with a FrameIndex
+// chunk, one of the skippable chunk types the format reserves.  It lists
+// where each CompressedData chunk starts, in the compressed and uncompressed
+// data, so that readers can seek without decompressing everything before the
+// offset they want.  It ends with a fixed size trailer, so it can be found
+// from the end of the stream:
+//
+//   masked CRC-32C of the rest of the chunk data  (4 bytes)
+//   uncompressed length of the stream             (8 bytes)
+//   number of entries                             (4 bytes)
+//   compressed and uncompressed offsets of each   (16 bytes each)
+//   CompressedData chunk that isn't empty
+//   length of the whole chunk, including header   (4 bytes)
+//   "sNiX"                                        (4 bytes)
+//
+// Offsets are relative to the start of the stream identifier, and all
+// integers are little-endian.
 //
 class SnappyFrameUtils {
  public:
@@ -31,15 +50,27 @@ class SnappyFrameUtils {
     CompressedData,
     UncompressedData,
     Padding,
+    FrameIndex,
     Reserved,
+    ReservedSkippable,
     ChunkTypeCount
   };
 
+  struct FrameIndexEntry {
+    uint64_t mCompressedOffset;
+    uint64_t mUncompressedOffset;
+  };
+
   static const size_t kChunkTypeLength = 1;
   static const size_t kChunkLengthLength = 3;
   static const size_t kHeaderLength = kChunkTypeLength + kChunkLengthLength;
   static const size_t kStreamIdentifierDataLength = 6;
   static const size_t kCRCLength = 4;
+  static const size_t kMaxChunkDataLength = 0xffffff;
+  static const size_t kFrameIndexTrailerLength = 8;
+
+  // Whether readers must ignore chunks of this type.
+  static bool IsSkippable(ChunkType aType);
 
   static nsresult WriteStreamIdentifier(char* aDest, size_t aDestLength,
                                         size_t* aBytesWrittenOut);
@@ -48,6 +79,14 @@ class SnappyFrameUtils {
                                       const char* aData, size_t aDataLength,
                                       size_t* aBytesWrittenOut);
 
+  // The length of a FrameIndex chunk with the given number of entries.
+  static size_t FrameIndexLength(size_t aEntryCount);
+
+  static nsresult WriteFrameIndex(char* aDest, size_t aDestLength,
+                                  const nsTArray<FrameIndexEntry>& aEntries,
+                                  uint64_t aUncompressedLength,
+                                  size_t* aBytesWrittenOut);
+
   static nsresult ParseHeader(const char* aSource, size_t aSourceLength,
                               ChunkType* aTypeOut, size_t* aDataLengthOut);
 
@@ -65,6 +104,21 @@ class SnappyFrameUtils {
                                       size_t* aBytesWrittenOut,
                                       size_t* aBytesReadOut);
 
+  // Reads the length of a FrameIndex chunk from the last
+  // kFrameIndexTrailerLength bytes of a stream.  Returns
+  // NS_ERROR_NOT_AVAILABLE if they are not a FrameIndex trailer.
+  static nsresult ParseFrameIndexTrailer(const char* aSource,
+                                         size_t aSourceLength,
+                                         size_t* aChunkLengthOut);
+
+  // Parses a whole FrameIndex chunk, including its header.
+  // aCompressedLength is where the chunk starts; all the entries must point
+  // before it.
+  static nsresult ParseFrameIndex(const char* aSource, size_t aSourceLength,
+                                  uint64_t aCompressedLength,
+                                  nsTArray<FrameIndexEntry>& aEntriesOut,
+                                  uint64_t* aUncompressedLengthOut);
+
   static size_t MaxCompressedBufferLength(size_t aSourceLength);
 
  protected:
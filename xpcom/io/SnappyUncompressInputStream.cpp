@@ -7,13 +7,23 @@
 #include "mozilla/SnappyUncompressInputStream.h"
 
 #include <algorithm>
+#include "mozilla/Unused.h"
 #include "nsIAsyncInputStream.h"
+#include "nsISeekableStream.h"
 #include "nsStreamUtils.h"
 #include "snappy/snappy.h"
 
 namespace mozilla {
 
-NS_IMPL_ISUPPORTS(SnappyUncompressInputStream, nsIInputStream);
+NS_IMPL_ADDREF(SnappyUncompressInputStream);
+NS_IMPL_RELEASE(SnappyUncompressInputStream);
+
+NS_INTERFACE_MAP_BEGIN(SnappyUncompressInputStream)
+  NS_INTERFACE_MAP_ENTRY(nsIInputStream)
+  NS_INTERFACE_MAP_ENTRY_CONDITIONAL(nsITellableStream, mBaseSeekable)
+  NS_INTERFACE_MAP_ENTRY_CONDITIONAL(nsISeekableStream, mBaseSeekable)
+  NS_INTERFACE_MAP_ENTRY_AMBIGUOUS(nsISupports, nsIInputStream)
+NS_INTERFACE_MAP_END
 
 // Putting kCompressedBufferLength inside a function avoids a static
 // constructor.
@@ -32,7 +42,10 @@ SnappyUncompressInputStream::SnappyUncompressInputStream(
       mNextByte(0),
       mNextChunkType(Unknown),
       mNextChunkDataLength(0),
-      mNeedFirstStreamIdentifier(true) {
+      mNeedFirstStreamIdentifier(true),
+      mBaseSeekable(do_QueryInterface(aBaseStream)),
+      mBaseOffset(0),
+      mOffset(0) {
   // This implementation only supports sync base streams.  Verify this in debug
   // builds.  Note, this is a bit complicated because the streams we support
   // advertise different capabilities:
@@ -48,6 +61,10 @@ SnappyUncompressInputStream::SnappyUncompressInputStream(
     MOZ_ASSERT(!async);
   }
 #endif
+
+  if (mBaseSeekable && NS_FAILED(mBaseSeekable->Tell(&mBaseOffset))) {
+    mBaseSeekable = nullptr;
+  }
 }
 
 NS_IMETHODIMP
@@ -138,6 +155,7 @@ SnappyUncompressInputStream::ReadSegments(nsWriteSegmentFun aWriter,
 
       *aBytesReadOut += numWritten;
       mNextByte += numWritten;
+      mOffset += numWritten;
       MOZ_ASSERT(mNextByte <= mUncompressedBytes);
 
       if (mNextByte == mUncompressedBytes) {
@@ -174,6 +192,112 @@ SnappyUncompressInputStream::IsNonBlocking(bool* aNonBlockingOut) {
   return NS_OK;
 }
 
+NS_IMETHODIMP
+SnappyUncompressInputStream::Tell(int64_t* aResult) {
+  if (!mBaseStream) {
+    return NS_BASE_STREAM_CLOSED;
+  }
+
+  *aResult = mOffset;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+SnappyUncompressInputStream::Seek(int32_t aWhence, int64_t aOffset) {
+  if (!mBaseStream) {
+    return NS_BASE_STREAM_CLOSED;
+  }
+  if (NS_WARN_IF(!mBaseSeekable)) {
+    return NS_ERROR_NOT_IMPLEMENTED;
+  }
+
+  nsresult rv = LoadFrameIndex();
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+  uint64_t length = mFrameIndex.LastElement().mUncompressedOffset;
+
+  int64_t offset;
+  switch (aWhence) {
+    case NS_SEEK_SET:
+      offset = aOffset;
+      break;
+    case NS_SEEK_CUR:
+      offset = int64_t(mOffset) + aOffset;
+      break;
+    case NS_SEEK_END:
+      offset = int64_t(length) + aOffset;
+      break;
+    default:
+      return NS_ERROR_INVALID_ARG;
+  }
+  if (NS_WARN_IF(offset < 0 || uint64_t(offset) > length)) {
+    return NS_ERROR_ILLEGAL_VALUE;
+  }
+  uint64_t target = offset;
+
+  // If the offset is in the frame we have uncompressed already, don't read it
+  // again.
+  uint64_t bufferStart = mOffset - mNextByte;
+  if (mUncompressedBytes > 0 && target >= bufferStart &&
+      target < bufferStart + mUncompressedBytes) {
+    mNextByte = target - bufferStart;
+    mOffset = target;
+    return NS_OK;
+  }
+
+  // Find the last frame that starts at or before the offset.  Seeking to the
+  // end finds the entry for the end of the data.
+  size_t frame = 0;
+  size_t end = mFrameIndex.Length();
+  while (end - frame > 1) {
+    size_t middle = frame + (end - frame) / 2;
+    if (mFrameIndex[middle].mUncompressedOffset <= target) {
+      frame = middle;
+    } else {
+      end = middle;
+    }
+  }
+  const FrameIndexEntry& entry = mFrameIndex[frame];
+
+  rv = mBaseSeekable->Seek(NS_SEEK_SET, mBaseOffset + entry.mCompressedOffset);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  mNeedFirstStreamIdentifier = false;
+  mNextChunkType = Unknown;
+  mNextChunkDataLength = 0;
+  mUncompressedBytes = 0;
+  mNextByte = 0;
+  mOffset = entry.mUncompressedOffset;
+
+  if (target == entry.mUncompressedOffset) {
+    return NS_OK;
+  }
+
+  // Uncompress the frame and skip to the offset in it.
+  uint32_t bytesRead;
+  do {
+    rv = ParseNextChunk(&bytesRead);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+  } while (!mUncompressedBytes && bytesRead);
+
+  if (NS_WARN_IF(target - entry.mUncompressedOffset >= mUncompressedBytes)) {
+    mUncompressedBytes = 0;
+    return NS_ERROR_CORRUPTED_CONTENT;
+  }
+  mNextByte = target - entry.mUncompressedOffset;
+  mOffset = target;
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+SnappyUncompressInputStream::SetEOF() { return NS_ERROR_NOT_IMPLEMENTED; }
+
 SnappyUncompressInputStream::~SnappyUncompressInputStream() { Close(); }
 
 nsresult SnappyUncompressInputStream::ParseNextChunk(uint32_t* aBytesReadOut) {
@@ -269,10 +393,19 @@ nsresult SnappyUncompressInputStream::ParseNextChunk(uint32_t* aBytesReadOut) {
     return NS_OK;
   }
 
+  // Padding, frame indexes and the like can be larger than our buffer, and
+  // have nothing for us anyways.
+  if (IsSkippable(mNextChunkType)) {
+    return SkipChunk(aBytesReadOut);
+  }
+
   // We have no decompressed data, but we do know the size of the next chunk.
   // Read at least that much from the base stream.
   uint32_t readLength = mNextChunkDataLength;
-  MOZ_ASSERT(readLength <= CompressedBufferLength());
+  if (NS_WARN_IF(mNextChunkType == Reserved ||
+                 readLength > CompressedBufferLength())) {
+    return NS_ERROR_CORRUPTED_CONTENT;
+  }
 
   // However, if there is enough data in the base stream, also read the next
   // chunk header.  This helps optimize the stream by avoiding many small reads.
@@ -324,6 +457,219 @@ nsresult SnappyUncompressInputStream::ParseNextChunk(uint32_t* aBytesReadOut) {
   return NS_OK;
 }
 
+nsresult SnappyUncompressInputStream::SkipChunk(uint32_t* aBytesReadOut) {
+  MOZ_ASSERT(IsSkippable(mNextChunkType));
+
+  *aBytesReadOut = 0;
+
+  size_t remaining = mNextChunkDataLength;
+  while (remaining > 0) {
+    uint32_t readLength = std::min(remaining, CompressedBufferLength());
+    uint32_t bytesRead;
+    nsresult rv =
+        ReadAll(mCompressedBuffer.get(), readLength, readLength, &bytesRead);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+    if (NS_WARN_IF(bytesRead == 0)) {
+      return NS_ERROR_CORRUPTED_CONTENT;
+    }
+    *aBytesReadOut += bytesRead;
+    remaining -= bytesRead;
+  }
+
+  mNextChunkType = Unknown;
+  mNextChunkDataLength = 0;
+
+  // Also read the next header, so that callers see we made progress even when
+  // the skipped chunk was empty.
+  uint32_t bytesRead;
+  nsresult rv = ReadAll(mCompressedBuffer.get(), kHeaderLength, kHeaderLength,
+                        &bytesRead);
+  if (NS_WARN_IF(NS_FAILED(rv)) || bytesRead == 0) {
+    return rv;
+  }
+  *aBytesReadOut += bytesRead;
+
+  rv = ParseHeader(mCompressedBuffer.get(), kHeaderLength, &mNextChunkType,
+                   &mNextChunkDataLength);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  return NS_OK;
+}
+
+nsresult SnappyUncompressInputStream::LoadFrameIndex() {
+  if (!mFrameIndex.IsEmpty()) {
+    return NS_OK;
+  }
+
+  // Put the base stream back where it was afterwards, so that what we have
+  // uncompressed and read ahead stays valid.
+  int64_t position;
+  nsresult rv = mBaseSeekable->Tell(&position);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  bool found;
+  rv = ReadFrameIndex(&found);
+  if (NS_SUCCEEDED(rv) && !found) {
+    rv = ScanFrameIndex();
+  }
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    mFrameIndex.Clear();
+    Unused << mBaseSeekable->Seek(NS_SEEK_SET, position);
+    return rv;
+  }
+  MOZ_ASSERT(!mFrameIndex.IsEmpty());
+
+  return mBaseSeekable->Seek(NS_SEEK_SET, position);
+}
+
+nsresult SnappyUncompressInputStream::ReadFrameIndex(bool* aFoundOut) {
+  *aFoundOut = false;
+
+  nsresult rv = mBaseSeekable->Seek(NS_SEEK_END, 0);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+  int64_t end;
+  rv = mBaseSeekable->Tell(&end);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+  int64_t compressedLength = end - mBaseOffset;
+  if (compressedLength < int64_t(kFrameIndexTrailerLength)) {
+    return NS_OK;
+  }
+
+  char trailer[kFrameIndexTrailerLength];
+  rv = mBaseSeekable->Seek(NS_SEEK_END, -int64_t(kFrameIndexTrailerLength));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+  uint32_t bytesRead;
+  rv = ReadAll(trailer, sizeof(trailer), sizeof(trailer), &bytesRead);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  size_t indexLength;
+  if (NS_FAILED(ParseFrameIndexTrailer(trailer, bytesRead, &indexLength)) ||
+      int64_t(indexLength) > compressedLength) {
+    return NS_OK;
+  }
+
+  UniquePtr<char[]> index(new (fallible) char[indexLength]);
+  if (NS_WARN_IF(!index)) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+  rv = mBaseSeekable->Seek(NS_SEEK_END, -int64_t(indexLength));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+  rv = ReadAll(index.get(), indexLength, indexLength, &bytesRead);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  // A bad index isn't fatal, we can still scan the stream.
+  uint64_t indexOffset = compressedLength - indexLength;
+  uint64_t uncompressedLength;
+  if (NS_WARN_IF(NS_FAILED(ParseFrameIndex(index.get(), bytesRead,
+                                           indexOffset, mFrameIndex,
+                                           &uncompressedLength)))) {
+    return NS_OK;
+  }
+
+  mFrameIndex.AppendElement(FrameIndexEntry{indexOffset, uncompressedLength});
+  *aFoundOut = true;
+  return NS_OK;
+}
+
+nsresult SnappyUncompressInputStream::ScanFrameIndex() {
+  MOZ_ASSERT(mFrameIndex.IsEmpty());
+
+  nsresult rv = mBaseSeekable->Seek(NS_SEEK_SET, mBaseOffset);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  // Enough of each chunk to find out how large it is uncompressed: the
+  // header, the CRC and the varint length at the start of snappy data.
+  static const size_t kMaxVarintLength = 5;
+  char buffer[kHeaderLength + kCRCLength + kMaxVarintLength];
+
+  uint64_t compressedOffset = 0;
+  uint64_t uncompressedOffset = 0;
+  bool first = true;
+  for (;;) {
+    uint32_t bytesRead;
+    rv = ReadAll(buffer, kHeaderLength, kHeaderLength, &bytesRead);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+    if (bytesRead == 0) {
+      break;
+    }
+
+    ChunkType type;
+    size_t dataLength;
+    rv = ParseHeader(buffer, bytesRead, &type, &dataLength);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+    if (NS_WARN_IF(first && type != StreamIdentifier)) {
+      return NS_ERROR_CORRUPTED_CONTENT;
+    }
+    first = false;
+
+    size_t skipLength = dataLength;
+    if (type == CompressedData) {
+      uint32_t readLength =
+          std::min(dataLength, sizeof(buffer) - kHeaderLength);
+      if (NS_WARN_IF(readLength <= kCRCLength)) {
+        return NS_ERROR_CORRUPTED_CONTENT;
+      }
+      rv = ReadAll(buffer + kHeaderLength, readLength, readLength, &bytesRead);
+      if (NS_WARN_IF(NS_FAILED(rv))) {
+        return rv;
+      }
+      if (NS_WARN_IF(bytesRead == 0)) {
+        return NS_ERROR_CORRUPTED_CONTENT;
+      }
+
+      size_t length;
+      if (NS_WARN_IF(!snappy::GetUncompressedLength(
+              buffer + kHeaderLength + kCRCLength, readLength - kCRCLength,
+              &length))) {
+        return NS_ERROR_CORRUPTED_CONTENT;
+      }
+      if (length > 0) {
+        mFrameIndex.AppendElement(
+            FrameIndexEntry{compressedOffset, uncompressedOffset});
+        uncompressedOffset += length;
+      }
+      skipLength -= readLength;
+    } else if (type != StreamIdentifier && !IsSkippable(type)) {
+      // We can't uncompress these anyways.
+      return NS_ERROR_CORRUPTED_CONTENT;
+    }
+
+    rv = mBaseSeekable->Seek(NS_SEEK_CUR, skipLength);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+    compressedOffset += kHeaderLength + dataLength;
+  }
+
+  mFrameIndex.AppendElement(
+      FrameIndexEntry{compressedOffset, uncompressedOffset});
+  return NS_OK;
+}
+
 nsresult SnappyUncompressInputStream::ReadAll(char* aBuf, uint32_t aCount,
                                               uint32_t aMinValidCount,
                                               uint32_t* aBytesReadOut) {
@@ -11,17 +11,26 @@
 #include "mozilla/UniquePtr.h"
 #include "nsCOMPtr.h"
 #include "nsIInputStream.h"
+#include "nsISeekableStream.h"
 #include "nsISupportsImpl.h"
+#include "nsTArray.h"
 #include "SnappyFrameUtils.h"
 
 namespace mozilla {
 
 class SnappyUncompressInputStream final : public nsIInputStream,
+                                          public nsISeekableStream,
                                           protected detail::SnappyFrameUtils {
  public:
   // Construct a new blocking stream to uncompress the given base stream.  The
   // base stream must also be blocking.  The base stream does not have to be
   // buffered.
+  //
+  // If the base stream is seekable, so is this stream, in the uncompressed
+  // data.  Seeking uses the FrameIndex chunk at the end of the base stream if
+  // there is one, and otherwise reads every chunk header once to build the
+  // same index.  Either way, the compressed stream must start where the base
+  // stream is positioned now.
   explicit SnappyUncompressInputStream(nsIInputStream* aBaseStream);
 
  private:
@@ -32,6 +41,16 @@ class SnappyUncompressInputStream final : public nsIInputStream,
   // contains data.
   nsresult ParseNextChunk(uint32_t* aBytesReadOut);
 
+  // Read past the data of the skippable chunk whose header was parsed last,
+  // and the header of the chunk after it.
+  nsresult SkipChunk(uint32_t* aBytesReadOut);
+
+  // Fill in mFrameIndex, if it isn't already, from the stream's FrameIndex
+  // chunk or by scanning the stream.
+  nsresult LoadFrameIndex();
+  nsresult ReadFrameIndex(bool* aFoundOut);
+  nsresult ScanFrameIndex();
+
   // Convenience routine to Read() from the base stream until we get
   // the given number of bytes or reach EOF.
   //
@@ -79,9 +98,23 @@ class SnappyUncompressInputStream final : public nsIInputStream,
   // expecting it?
   bool mNeedFirstStreamIdentifier;
 
+  // The base stream, if it is seekable, and where the compressed stream
+  // starts in it.
+  nsCOMPtr<nsISeekableStream> mBaseSeekable;
+  int64_t mBaseOffset;
+
+  // The current offset in the uncompressed data.
+  uint64_t mOffset;
+
+  // Where each frame starts, ending with where the data ends, once a Seek()
+  // has loaded it.
+  nsTArray<FrameIndexEntry> mFrameIndex;
+
  public:
   NS_DECL_THREADSAFE_ISUPPORTS
   NS_DECL_NSIINPUTSTREAM
+  NS_DECL_NSITELLABLESTREAM
+  NS_DECL_NSISEEKABLESTREAM
 };
 
 }  // namespace mozilla
@@ -9,6 +9,7 @@
 #include "mozilla/ArrayUtils.h"
 #include "mozilla/BinarySearch.h"
 #include "mozilla/CheckedInt.h"
+#include "mozilla/SSE.h"
 #include "mozilla/TextUtils.h"
 #include "nsTArray.h"
 #include "nsCRT.h"
@@ -73,6 +74,71 @@ static uint32_t AppendPercentHex(char16_t* aBuffer, char16_t aChar) {
   return i;
 }
 
+#ifdef MOZILLA_MAY_SUPPORT_SSSE3
+namespace mozilla {
+namespace SSSE3 {
+size_t SpanOfByteSet(const char* aSrc, size_t aLen, const uint8_t* aRows,
+                     bool aNonASCII);
+size_t SpanOfByteSet(const char16_t* aSrc, size_t aLen, const uint8_t* aRows,
+                     bool aNonASCII);
+}  // namespace SSSE3
+}  // namespace mozilla
+#endif
+
+namespace {
+
+// A set of characters for the vectorized scans below. Bit N of mRows[L] is set
+// if the ASCII character 0xNL is in the set; all non-ASCII characters are in
+// the set if mNonASCII is true.
+struct EscapeCharSet {
+  uint8_t mRows[16];
+  bool mNonASCII;
+
+  void Add(uint32_t aChar) {
+    MOZ_ASSERT(aChar < 0x80);
+    mRows[aChar & 0xf] |= 1 << (aChar >> 4);
+  }
+};
+
+// Everything but the characters nsAppendEscapedHTML replaces: '"' (0x22),
+// '&' (0x26), '\'' (0x27), '<' (0x3C) and '>' (0x3E).
+const EscapeCharSet kHTMLSafeChars = {
+    {0xff, 0xff, 0xfb, 0xff, 0xff, 0xff, 0xfb, 0xfb, 0xff, 0xff, 0xff, 0xff,
+     0xf7, 0xff, 0xf7, 0xff},
+    true};
+
+// Strings shorter than this are scanned a character at a time, since building
+// the set for a vectorized scan costs more than it saves.
+const size_t kMinVectorizedEscapeLength = 32;
+
+bool CanVectorizeEscape() {
+#ifdef MOZILLA_MAY_SUPPORT_SSSE3
+  return mozilla::supports_ssse3();
+#else
+  return false;
+#endif
+}
+
+/*
+ * Returns the number of leading characters of aStr that are in aSet. Only
+ * whole blocks of 16 characters are examined, so the result may stop short of
+ * the first character not in the set; the caller checks the rest one at a
+ * time. Returns 0 if no vectorized scan is available.
+ */
+template <typename CharT>
+size_t SpanOfEscapeCharSet(const CharT* aStr, size_t aLength,
+                           const EscapeCharSet& aSet) {
+#ifdef MOZILLA_MAY_SUPPORT_SSSE3
+  if (mozilla::supports_ssse3()) {
+    return mozilla::SSSE3::SpanOfByteSet(aStr, aLength, aSet.mRows,
+                                         aSet.mNonASCII);
+  }
+#endif
+  return 0;
+}
+
+}  // namespace
+
 //----------------------------------------------------------------------------------------
 char* nsEscape(const char* aStr, size_t aLength, size_t* aOutputLength,
                nsEscapeMask aFlags)
@@ -203,7 +269,33 @@ int32_t nsUnescapeCount(char* aStr)
 
 } /* NET_UnEscapeCnt */
 
+static bool NeedsHTMLEscape(char aChar) {
+  return aChar == '<' || aChar == '>' || aChar == '&' || aChar == '"' ||
+         aChar == '\'';
+}
+
+// Returns the index of the first character at or after aStart that
+// nsAppendEscapedHTML replaces, or aLength if there is none.
+static size_t FindHTMLEscape(const char* aSrc, size_t aStart, size_t aLength) {
+  size_t i = aStart + SpanOfEscapeCharSet(aSrc + aStart, aLength - aStart,
+                                          kHTMLSafeChars);
+  while (i < aLength && !NeedsHTMLEscape(aSrc[i])) {
+    ++i;
+  }
+  return i;
+}
+
 void nsAppendEscapedHTML(const nsACString& aSrc, nsACString& aDst) {
+  const char* src = aSrc.BeginReading();
+  size_t length = aSrc.Length();
+
+  size_t i = FindHTMLEscape(src, 0, length);
+  if (i == length) {
+    // Nothing to replace, so aDst can share aSrc's buffer if it is empty.
+    aDst.Append(aSrc);
+    return;
+  }
+
   // Preparation: aDst's length will increase by at least aSrc's length. If the
   // addition overflows, we skip this, which is fine, and we'll likely abort
   // while (infallibly) appending due to aDst becoming too large.
@@ -213,21 +305,31 @@ void nsAppendEscapedHTML(const nsACString& aSrc, nsACString& aDst) {
     aDst.SetCapacity(newCapacity.value());
   }
 
-  for (auto cur = aSrc.BeginReading(); cur != aSrc.EndReading(); cur++) {
-    if (*cur == '<') {
-      aDst.AppendLiteral("&lt;");
-    } else if (*cur == '>') {
-      aDst.AppendLiteral("&gt;");
-    } else if (*cur == '&') {
-      aDst.AppendLiteral("&amp;");
-    } else if (*cur == '"') {
-      aDst.AppendLiteral("&quot;");
-    } else if (*cur == '\'') {
-      aDst.AppendLiteral("&#39;");
-    } else {
-      aDst.Append(*cur);
+  // Copy the runs between replaced characters in bulk.
+  size_t runStart = 0;
+  for (; i < length; i = FindHTMLEscape(src, i + 1, length)) {
+    aDst.Append(src + runStart, i - runStart);
+    switch (src[i]) {
+      case '<':
+        aDst.AppendLiteral("&lt;");
+        break;
+      case '>':
+        aDst.AppendLiteral("&gt;");
+        break;
+      case '&':
+        aDst.AppendLiteral("&amp;");
+        break;
+      case '"':
+        aDst.AppendLiteral("&quot;");
+        break;
+      default:
+        MOZ_ASSERT(src[i] == '\'');
+        aDst.AppendLiteral("&#39;");
+        break;
     }
+    runStart = i + 1;
   }
+  aDst.Append(src + runStart, length - runStart);
 }
 
 //----------------------------------------------------------------------------------------
@@ -274,6 +376,35 @@ static uint16_t dontNeedEscape(uint16_t aChar, uint32_t aFlags) {
 
 //----------------------------------------------------------------------------------------
 
+/**
+ * Builds the set of ASCII characters that T_EscapeURL copies unchanged for
+ * aFlags and aFilterMask, ignoring the rule for '|' after non-ASCII
+ * characters, which the caller handles by not scanning after one.
+ */
+static void BuildURLSafeCharSet(uint32_t aFlags,
+                                const ASCIIMaskArray* aFilterMask,
+                                EscapeCharSet& aSet) {
+  bool forced = !!(aFlags & esc_Forced);
+  bool ignoreNonAscii = !!(aFlags & esc_OnlyASCII);
+  bool ignoreAscii = !!(aFlags & esc_OnlyNonASCII);
+  bool colon = !!(aFlags & esc_Colon);
+  bool spaces = !!(aFlags & esc_Spaces);
+
+  memset(aSet.mRows, 0, sizeof(aSet.mRows));
+  for (uint32_t c = 0; c < 0x80; ++c) {
+    if (aFilterMask && (*aFilterMask)[c]) {
+      continue;
+    }
+    if ((dontNeedEscape((unsigned char)c, aFlags) ||
+         (c == HEX_ESCAPE && !forced) ||
+         (c >= 0x20 && c < 0x7f && ignoreAscii)) &&
+        !(c == ':' && colon) && !(c == ' ' && spaces)) {
+      aSet.Add(c);
+    }
+  }
+  aSet.mNonASCII = ignoreNonAscii;
+}
+
 /**
  * Templated helper for URL escaping a portion of a string.
  *
@@ -290,7 +421,8 @@ template <class T>
 static nsresult T_EscapeURL(const typename T::char_type* aPart, size_t aPartLen,
                             uint32_t aFlags, const ASCIIMaskArray* aFilterMask,
                             T& aResult, bool& aDidAppend) {
-  typedef nsCharTraits<typename T::char_type> traits;
+  typedef typename T::char_type char_type;
+  typedef nsCharTraits<char_type> traits;
   typedef typename traits::unsigned_char_type unsigned_char_type;
   static_assert(sizeof(*aPart) == 1 || sizeof(*aPart) == 2,
                 "unexpected char type");
@@ -309,23 +441,58 @@ static nsresult T_EscapeURL(const typename T::char_type* aPart, size_t aPartLen,
 
   auto src = reinterpret_cast<const unsigned_char_type*>(aPart);
 
-  typename T::char_type tempBuffer[100];
-  unsigned int tempBufferPos = 0;
+  // Long strings skip over runs of characters that are copied unchanged with
+  // a vectorized scan, and only look at the others one at a time.
+  EscapeCharSet safeChars;
+  bool vectorize =
+      aPartLen >= kMinVectorizedEscapeLength && CanVectorizeEscape();
+  if (vectorize) {
+    BuildURLSafeCharSet(aFlags, aFilterMask, safeChars);
+  }
+
+  // Escapes and short runs of unchanged characters are gathered here, so that
+  // a string needing many escapes isn't appended a few characters at a time.
+  // Long runs are appended directly.
+  char_type tempBuffer[100];
+  size_t tempBufferPos = 0;
+  auto append = [&](const char_type* aData, size_t aLength) {
+    if (tempBufferPos + aLength > mozilla::ArrayLength(tempBuffer)) {
+      if (!aResult.Append(tempBuffer, tempBufferPos, mozilla::fallible)) {
+        return false;
+      }
+      tempBufferPos = 0;
+      if (aLength > mozilla::ArrayLength(tempBuffer)) {
+        return aResult.Append(aData, aLength, mozilla::fallible);
+      }
+    }
+    memcpy(tempBuffer + tempBufferPos, aData, aLength * sizeof(char_type));
+    tempBufferPos += aLength;
+    return true;
+  };
 
+  // The start of the characters that are copied unchanged but haven't been
+  // appended yet.
+  size_t runStart = 0;
   bool previousIsNonASCII = false;
   for (size_t i = 0; i < aPartLen; ++i) {
-    unsigned_char_type c = *src++;
+    if (vectorize && !previousIsNonASCII) {
+      i += SpanOfEscapeCharSet(aPart + i, aPartLen - i, safeChars);
+      if (i == aPartLen) {
+        break;
+      }
+    }
+
+    unsigned_char_type c = src[i];
 
     // If there is a filter, we wish to skip any characters which match it.
     // This is needed so we don't perform an extra pass just to extract the
     // filtered characters.
     if (aFilterMask && mozilla::ASCIIMask::IsMasked(*aFilterMask, c)) {
-      if (!writing) {
-        if (!aResult.Append(aPart, i, mozilla::fallible)) {
-          return NS_ERROR_OUT_OF_MEMORY;
-        }
-        writing = true;
+      if (!append(aPart + runStart, i - runStart)) {
+        return NS_ERROR_OUT_OF_MEMORY;
       }
+      runStart = i + 1;
+      writing = true;
       continue;
     }
 
@@ -344,39 +511,27 @@ static nsresult T_EscapeURL(const typename T::char_type* aPart, size_t aPartLen,
     // non-ASCII character as it may be aPart of a multi-byte character.
     //
     // 0x20..0x7e are the valid ASCII characters.
-    if ((dontNeedEscape(c, aFlags) || (c == HEX_ESCAPE && !forced) ||
-         (c > 0x7f && ignoreNonAscii) ||
-         (c >= 0x20 && c < 0x7f && ignoreAscii)) &&
-        !(c == ':' && colon) && !(c == ' ' && spaces) &&
-        !(previousIsNonASCII && c == '|' && !ignoreNonAscii)) {
-      if (writing) {
-        tempBuffer[tempBufferPos++] = c;
-      }
-    } else { /* do the escape magic */
-      if (!writing) {
-        if (!aResult.Append(aPart, i, mozilla::fallible)) {
-          return NS_ERROR_OUT_OF_MEMORY;
-        }
-        writing = true;
-      }
-      uint32_t len = ::AppendPercentHex(tempBuffer + tempBufferPos, c);
-      tempBufferPos += len;
+    if (!((dontNeedEscape(c, aFlags) || (c == HEX_ESCAPE && !forced) ||
+           (c > 0x7f && ignoreNonAscii) ||
+           (c >= 0x20 && c < 0x7f && ignoreAscii)) &&
+          !(c == ':' && colon) && !(c == ' ' && spaces) &&
+          !(previousIsNonASCII && c == '|' && !ignoreNonAscii))) {
+      /* do the escape magic */
+      char_type escaped[ENCODE_MAX_LEN];
+      uint32_t len = ::AppendPercentHex(escaped, c);
       MOZ_ASSERT(len <= ENCODE_MAX_LEN, "potential buffer overflow");
-    }
-
-    // Flush the temp buffer if it doesnt't have room for another encoded char.
-    if (tempBufferPos >= mozilla::ArrayLength(tempBuffer) - ENCODE_MAX_LEN) {
-      NS_ASSERTION(writing, "should be writing");
-      if (!aResult.Append(tempBuffer, tempBufferPos, mozilla::fallible)) {
+      if (!append(aPart + runStart, i - runStart) || !append(escaped, len)) {
         return NS_ERROR_OUT_OF_MEMORY;
       }
-      tempBufferPos = 0;
+      runStart = i + 1;
+      writing = true;
     }
 
     previousIsNonASCII = (c > 0x7f);
   }
   if (writing) {
-    if (!aResult.Append(tempBuffer, tempBufferPos, mozilla::fallible)) {
+    if (!append(aPart + runStart, aPartLen - runStart) ||
+        !aResult.Append(tempBuffer, tempBufferPos, mozilla::fallible)) {
       return NS_ERROR_OUT_OF_MEMORY;
     }
   }
@@ -565,37 +720,41 @@ nsresult NS_UnescapeURL(const char* aStr, int32_t aLen, uint32_t aFlags,
   const char* last = aStr;
   const char* end = aStr + len;
 
-  for (const char* p = aStr; p < end; ++p) {
-    if (*p == HEX_ESCAPE && p + 2 < end) {
-      unsigned char c1 = *((unsigned char*)p + 1);
-      unsigned char c2 = *((unsigned char*)p + 2);
-      unsigned char u = (UNHEX(c1) << 4) + UNHEX(c2);
-      if (mozilla::IsAsciiHexDigit(c1) && mozilla::IsAsciiHexDigit(c2) &&
-          (!skipInvalidHostChar || dontNeedEscape(u, aFlags) || c1 >= '8') &&
-          ((c1 < '8' && !ignoreAscii) || (c1 >= '8' && !ignoreNonAscii)) &&
-          !(skipControl &&
-            (c1 < '2' || (c1 == '7' && (c2 == 'f' || c2 == 'F'))))) {
-        if (MOZ_UNLIKELY(!writing)) {
-          writing = true;
-          if (!aResult.SetLength(len, mozilla::fallible)) {
-            return NS_ERROR_OUT_OF_MEMORY;
-          }
-          destPos = 0;
-          destPtr = reinterpret_cast<unsigned char*>(aResult.BeginWriting());
-        }
-        if (p > last) {
-          auto toCopy = p - last;
-          memcpy(destPtr + destPos, last, toCopy);
-          destPos += toCopy;
-          MOZ_ASSERT(destPos <= len);
-          last = p;
+  // Only '%' starts anything to unescape. memchr finds the next one much faster
+  // than looking at each character, and everything in between is copied in
+  // bulk.
+  for (const char* p = aStr;
+       (p = static_cast<const char*>(memchr(p, HEX_ESCAPE, end - p))) &&
+       p + 2 < end;
+       ++p) {
+    unsigned char c1 = *((unsigned char*)p + 1);
+    unsigned char c2 = *((unsigned char*)p + 2);
+    unsigned char u = (UNHEX(c1) << 4) + UNHEX(c2);
+    if (mozilla::IsAsciiHexDigit(c1) && mozilla::IsAsciiHexDigit(c2) &&
+        (!skipInvalidHostChar || dontNeedEscape(u, aFlags) || c1 >= '8') &&
+        ((c1 < '8' && !ignoreAscii) || (c1 >= '8' && !ignoreNonAscii)) &&
+        !(skipControl &&
+          (c1 < '2' || (c1 == '7' && (c2 == 'f' || c2 == 'F'))))) {
+      if (MOZ_UNLIKELY(!writing)) {
+        writing = true;
+        if (!aResult.SetLength(len, mozilla::fallible)) {
+          return NS_ERROR_OUT_OF_MEMORY;
         }
-        destPtr[destPos] = u;
-        destPos += 1;
+        destPos = 0;
+        destPtr = reinterpret_cast<unsigned char*>(aResult.BeginWriting());
+      }
+      if (p > last) {
+        auto toCopy = p - last;
+        memcpy(destPtr + destPos, last, toCopy);
+        destPos += toCopy;
         MOZ_ASSERT(destPos <= len);
-        p += 2;
-        last += 3;
+        last = p;
       }
+      destPtr[destPos] = u;
+      destPos += 1;
+      MOZ_ASSERT(destPos <= len);
+      p += 2;
+      last += 3;
     }
   }
   if (writing && last < end) {
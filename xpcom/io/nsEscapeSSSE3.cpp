@@ -0,0 +1,83 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// This file should only be compiled if you're on x86 or x86_64.  Additionally,
+// you'll need to compile this file with -mssse3 if you're using gcc.
+//
+// Sets of bytes are tested with two table lookups: the low nibble of each byte
+// selects a row of the set, and the high nibble selects a bit within the row.
+
+#include <tmmintrin.h>
+#include "mozilla/MathAlgorithms.h"
+#include "nscore.h"
+
+namespace mozilla::SSSE3 {
+
+// Returns 0xff in each byte of aBytes that is not in the set, and 0 in the
+// others.
+static inline __m128i NotInSet(__m128i aBytes, __m128i aRows, bool aNonASCII) {
+  const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+  __m128i lowNibbles = _mm_and_si128(aBytes, nibbleMask);
+  __m128i highNibbles = _mm_and_si128(_mm_srli_epi16(aBytes, 4), nibbleMask);
+
+  __m128i rows = _mm_shuffle_epi8(aRows, lowNibbles);
+  // 1 << highNibble for ASCII, and 0 for bytes >= 0x80.
+  __m128i bits = _mm_shuffle_epi8(
+      _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0),
+      highNibbles);
+  __m128i notInSet =
+      _mm_cmpeq_epi8(_mm_and_si128(rows, bits), _mm_setzero_si128());
+
+  if (aNonASCII) {
+    __m128i nonASCII = _mm_cmplt_epi8(aBytes, _mm_setzero_si128());
+    notInSet = _mm_andnot_si128(nonASCII, notInSet);
+  }
+  return notInSet;
+}
+
+size_t SpanOfByteSet(const char* aSrc, size_t aLen, const uint8_t* aRows,
+                     bool aNonASCII) {
+  const __m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aRows));
+  size_t i = 0;
+  for (; aLen - i >= 16; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i));
+    int mask = _mm_movemask_epi8(NotInSet(in, rows, aNonASCII));
+    if (mask) {
+      return i + CountTrailingZeroes32(mask);
+    }
+  }
+  return i;
+}
+
+size_t SpanOfByteSet(const char16_t* aSrc, size_t aLen, const uint8_t* aRows,
+                     bool aNonASCII) {
+  const __m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aRows));
+  const __m128i lowByte = _mm_set1_epi16(0x00ff);
+  size_t i = 0;
+  for (; aLen - i >= 16; i += 16) {
+    __m128i in0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i));
+    __m128i in1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i + 8));
+
+    // Narrow to bytes, mapping every unit above 0xff to 0xff so that it is
+    // classified as non-ASCII. packus would saturate units >= 0x8000 to zero.
+    __m128i wide0 = _mm_andnot_si128(
+        _mm_cmpeq_epi16(_mm_srli_epi16(in0, 8), _mm_setzero_si128()), lowByte);
+    __m128i wide1 = _mm_andnot_si128(
+        _mm_cmpeq_epi16(_mm_srli_epi16(in1, 8), _mm_setzero_si128()), lowByte);
+    __m128i bytes =
+        _mm_packus_epi16(_mm_or_si128(_mm_and_si128(in0, lowByte), wide0),
+                         _mm_or_si128(_mm_and_si128(in1, lowByte), wide1));
+
+    int mask = _mm_movemask_epi8(NotInSet(bytes, rows, aNonASCII));
+    if (mask) {
+      return i + CountTrailingZeroes32(mask);
+    }
+  }
+  return i;
+}
+
+}  // namespace mozilla::SSSE3
@@ -14,6 +14,9 @@
 #include "mozilla/MathAlgorithms.h"
 #include "mozilla/Mutex.h"
 #include "mozilla/SystemGroup.h"
+#include "mozilla/Unused.h"
+
+#include <algorithm>
 
 #include "base/basictypes.h"
 
@@ -120,6 +123,47 @@ class nsMultiplexInputStream final : public nsIMultiplexInputStream,
                             const char* aFromRawSegment, uint32_t aToOffset,
                             uint32_t aCount, uint32_t* aWriteCount);
 
+  // ReadSegmentsGathered() collects segments by reading from each sub-stream
+  // from within the ReadSegments() callback of the one before, so that all
+  // the segments stay valid until the writer has been called from the
+  // innermost callback.
+  static const uint32_t kMaxGatheredSegments = 64;
+
+  struct MOZ_STACK_CLASS GatherState {
+    nsMultiplexInputStream* mSelf;
+    nsCOMPtr<nsIInputStream> mThisStream;
+    nsGatherSegmentsFun mWriter;
+    void* mClosure;
+    AutoTArray<Span<const char>, kMaxGatheredSegments> mSegments;
+    // The number of bytes gathered so far, and how many more may be.
+    uint32_t mLength;
+    uint32_t mRemaining;
+    // Set once the writer has been called.
+    bool mDone;
+    uint32_t mWriteCount;
+    // The last sub-stream the writer consumed data from.
+    uint32_t mLastStream;
+  };
+
+  // One sub-stream being read from.
+  struct MOZ_STACK_CLASS GatherFrame {
+    GatherState* mState;
+    uint32_t mStream;
+    // What the sub-stream had available before being read from, or
+    // UINT64_MAX if more may turn up later.
+    uint64_t mAvailable;
+  };
+
+  // Gathers segments from the sub-streams starting at aIndex, and calls the
+  // writer once there are no more to gather.
+  nsresult GatherSegments(GatherState& aState, uint32_t aIndex);
+
+  static nsresult GatherSegCb(nsIInputStream* aIn, void* aClosure,
+                              const char* aFromRawSegment, uint32_t aToOffset,
+                              uint32_t aCount, uint32_t* aWriteCount);
+
+  static void CallGatherWriter(GatherState& aState);
+
   bool IsSeekable() const;
   bool IsTellable() const;
   bool IsIPCSerializable() const;
@@ -515,6 +559,172 @@ nsresult nsMultiplexInputStream::ReadSegCb(nsIInputStream* aIn, void* aClosure,
   return rv;
 }
 
+NS_IMETHODIMP
+nsMultiplexInputStream::ReadSegmentsGathered(nsGatherSegmentsFun aWriter,
+                                             void* aClosure, uint32_t aCount,
+                                             uint32_t* aResult) {
+  MutexAutoLock lock(mLock);
+
+  *aResult = 0;
+
+  if (mStatus == NS_BASE_STREAM_CLOSED) {
+    return NS_OK;
+  }
+  if (NS_FAILED(mStatus)) {
+    return mStatus;
+  }
+
+  NS_ASSERTION(aWriter, "missing aWriter");
+
+  if (!aCount) {
+    return NS_OK;
+  }
+
+  GatherState state;
+  state.mSelf = this;
+  state.mThisStream = this;
+  state.mWriter = aWriter;
+  state.mClosure = aClosure;
+  state.mLength = 0;
+  state.mRemaining = aCount;
+  state.mDone = false;
+  state.mWriteCount = 0;
+  state.mLastStream = mCurrentStream;
+
+  nsresult rv = GatherSegments(state, mCurrentStream);
+
+  if (state.mWriteCount) {
+    // The sub-streams before the last one read from have been read to the
+    // end. As in Read(), the last one becomes the current stream even if it
+    // has been read to the end too; reading moves past it.
+    mCurrentStream = state.mLastStream;
+    mStartedReadingCurrent = true;
+    *aResult = state.mWriteCount;
+    return NS_OK;
+  }
+
+  // If the writer was called, errors it returned end here.
+  return state.mDone ? NS_OK : rv;
+}
+
+nsresult nsMultiplexInputStream::GatherSegments(GatherState& aState,
+                                                uint32_t aIndex) {
+  mLock.AssertCurrentThreadOwns();
+
+  nsresult rv = NS_OK;
+  uint32_t len = mStreams.Length();
+  for (; aIndex < len; ++aIndex) {
+    StreamData& stream = mStreams[aIndex];
+
+    uint64_t avail;
+    rv = AvailableMaybeSeek(stream, &avail);
+    if (rv == NS_BASE_STREAM_CLOSED) {
+      rv = NS_OK;
+      continue;
+    }
+    if (NS_FAILED(rv)) {
+      break;
+    }
+
+    if (!stream.mAsyncStream) {
+      // Blocking streams are at their end when they have nothing available.
+      if (!avail) {
+        continue;
+      }
+    } else if (!avail && !aState.mSegments.IsEmpty()) {
+      // Don't wait for more data when there is already some to hand over.
+      break;
+    }
+
+    GatherFrame frame;
+    frame.mState = &aState;
+    frame.mStream = aIndex;
+    frame.mAvailable = stream.mAsyncStream ? UINT64_MAX : avail;
+
+    uint32_t read;
+    rv = stream.mStream->ReadSegments(GatherSegCb, &frame, aState.mRemaining,
+                                      &read);
+    if (aState.mDone) {
+      return NS_OK;
+    }
+
+    // XXX some streams return NS_BASE_STREAM_CLOSED to indicate EOF.
+    // (This is a bug in those stream implementations)
+    if (rv == NS_BASE_STREAM_CLOSED) {
+      rv = NS_OK;
+    }
+    if (NS_FAILED(rv) || !aState.mSegments.IsEmpty()) {
+      break;
+    }
+  }
+
+  if (!aState.mSegments.IsEmpty()) {
+    CallGatherWriter(aState);
+    return NS_OK;
+  }
+  return rv;
+}
+
+nsresult nsMultiplexInputStream::GatherSegCb(nsIInputStream* aIn,
+                                             void* aClosure,
+                                             const char* aFromRawSegment,
+                                             uint32_t aToOffset,
+                                             uint32_t aCount,
+                                             uint32_t* aWriteCount) {
+  GatherFrame* frame = static_cast<GatherFrame*>(aClosure);
+  GatherState& state = *frame->mState;
+
+  // Anything the sub-stream offers after the writer has been called belongs
+  // to the next call.
+  if (state.mDone) {
+    *aWriteCount = 0;
+    return NS_BASE_STREAM_WOULD_BLOCK;
+  }
+
+  NS_ASSERTION(aCount <= state.mRemaining, "Read more than requested");
+  uint32_t offset = state.mLength;
+  state.mSegments.AppendElement(MakeSpan(aFromRawSegment, aCount));
+  state.mLength += aCount;
+  state.mRemaining -= aCount;
+
+  // Only move on to the next sub-stream if this segment is the whole of what
+  // is left of this one.
+  if (aCount == frame->mAvailable && state.mRemaining &&
+      state.mSegments.Length() < kMaxGatheredSegments) {
+    Unused << state.mSelf->GatherSegments(state, frame->mStream + 1);
+  }
+  if (!state.mDone) {
+    CallGatherWriter(state);
+  }
+
+  *aWriteCount = state.mWriteCount > offset
+                     ? std::min(aCount, state.mWriteCount - offset)
+                     : 0;
+  if (!*aWriteCount) {
+    return NS_BASE_STREAM_WOULD_BLOCK;
+  }
+  if (frame->mStream > state.mLastStream) {
+    state.mLastStream = frame->mStream;
+  }
+  return NS_OK;
+}
+
+void nsMultiplexInputStream::CallGatherWriter(GatherState& aState) {
+  MOZ_ASSERT(!aState.mDone);
+  aState.mDone = true;
+
+  nsresult rv =
+      aState.mWriter(aState.mThisStream, aState.mClosure,
+                     aState.mSegments.Elements(), aState.mSegments.Length(),
+                     &aState.mWriteCount);
+  if (NS_FAILED(rv)) {
+    aState.mWriteCount = 0;
+  }
+  NS_ASSERTION(aState.mWriteCount <= aState.mLength,
+               "writer should not write more than we asked it to write");
+  aState.mWriteCount = std::min(aState.mWriteCount, aState.mLength);
+}
+
 NS_IMETHODIMP
 nsMultiplexInputStream::IsNonBlocking(bool* aNonBlocking) {
   MutexAutoLock lock(mLock);
@@ -25,12 +25,23 @@
 #include "mozilla/Attributes.h"
 #include "mozilla/Likely.h"
 #include "mozilla/MathAlgorithms.h"
+#include "mozilla/AutoMemMap.h"
+#include "mozilla/ipc/FileDescriptor.h"
 #include "mozilla/ipc/InputStreamUtils.h"
+#include "base/shared_memory.h"
 
+#ifdef XP_UNIX
+#  include <sys/stat.h>
+#endif
+
+using mozilla::MakeUnique;
 using mozilla::Maybe;
 using mozilla::Some;
+using mozilla::UniquePtr;
+using mozilla::ipc::FileDescriptor;
 using mozilla::ipc::InputStreamParams;
 using mozilla::ipc::StringInputStreamParams;
+using mozilla::loader::AutoMemMap;
 
 //
 // Log module for StorageStream logging...
@@ -49,8 +60,68 @@ static LazyLogModule sStorageStreamLog("nsStorageStream");
 #endif
 #define LOG(args) MOZ_LOG(sStorageStreamLog, mozilla::LogLevel::Debug, args)
 
+// A segment of a shared storage stream.  It is mapped writable until it is
+// sealed, and then read-only, which is also how segments shared by another
+// process are mapped.
+class nsStorageStream::SharedSegment final {
+ public:
+  // Creates a new, writable segment.
+  bool Init(uint32_t aSize) {
+    return mMem.CreateFreezeable(aSize) && mMem.Map(aSize);
+  }
+
+  // Maps a sealed segment, possibly of another process.
+  bool Init(const FileDescriptor& aHandle, uint32_t aSize) {
+#ifdef XP_UNIX
+    // Mapping more than the shared memory holds succeeds, but touching the
+    // excess raises SIGBUS, so check the handle really is as large as the
+    // sender claims. Windows refuses to map a view larger than the section.
+    auto handle = aHandle.ClonePlatformHandle();
+    struct stat info;
+    if (NS_WARN_IF(!handle) || NS_WARN_IF(fstat(handle.get(), &info) != 0) ||
+        NS_WARN_IF(uint64_t(info.st_size) < aSize)) {
+      return false;
+    }
+#endif
+    return mMap.initWithHandle(aHandle, aSize).isOk();
+  }
+
+  bool Seal() {
+    if (mMap.initialized()) {
+      return true;
+    }
+    if (NS_WARN_IF(!mMem.Freeze())) {
+      return false;
+    }
+
+    // TakeHandle resets mMem, so call max_size first.
+    size_t size = mMem.max_size();
+    FileDescriptor handle(mMem.TakeHandle());
+    return mMap.initWithHandle(handle, size).isOk();
+  }
+
+  FileDescriptor CloneHandle() const {
+    MOZ_ASSERT(mMap.initialized());
+    return mMap.cloneHandle();
+  }
+
+  char* Data() {
+    if (mMap.initialized()) {
+      return mMap.get<char>().get();
+    }
+    return static_cast<char*>(mMem.memory());
+  }
+
+ private:
+  base::SharedMemory mMem;
+  AutoMemMap mMap;
+};
+
 nsStorageStream::nsStorageStream()
     : mSegmentedBuffer(0),
+      mShared(false),
+      mSealed(false),
+      mMaxSize(0),
       mSegmentSize(0),
       mSegmentSizeLog2(0),
       mWriteInProgress(false),
@@ -79,17 +150,63 @@ nsStorageStream::Init(uint32_t aSegmentSize, uint32_t aMaxSize) {
   return mSegmentedBuffer->Init(aSegmentSize, aMaxSize);
 }
 
+nsresult nsStorageStream::InitShared(uint32_t aSegmentSize, uint32_t aMaxSize) {
+  if (NS_WARN_IF(IsInitialized())) {
+    return NS_ERROR_ALREADY_INITIALIZED;
+  }
+
+  mSegmentSize = aSegmentSize;
+  mSegmentSizeLog2 = mozilla::FloorLog2(aSegmentSize);
+
+  // Segment size must be a power of two
+  if (mSegmentSize != ((uint32_t)1 << mSegmentSizeLog2)) {
+    return NS_ERROR_INVALID_ARG;
+  }
+
+  mShared = true;
+  mMaxSize = aMaxSize;
+  return NS_OK;
+}
+
+nsresult nsStorageStream::InitWithSharedSegments(
+    const nsTArray<FileDescriptor>& aSegments, uint32_t aSegmentSize,
+    uint32_t aLength) {
+  nsresult rv = InitShared(aSegmentSize, UINT32_MAX);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+
+  // Every byte must be in a segment, and every segment must hold some.
+  uint32_t segmentCount = aSegments.Length();
+  if (NS_WARN_IF(SegNum(aLength) + !!SegOffset(aLength) != segmentCount)) {
+    return NS_ERROR_INVALID_ARG;
+  }
+
+  for (const FileDescriptor& handle : aSegments) {
+    auto segment = MakeUnique<SharedSegment>();
+    if (NS_WARN_IF(!segment->Init(handle, mSegmentSize))) {
+      return NS_ERROR_FAILURE;
+    }
+    mSharedSegments.AppendElement(std::move(segment));
+  }
+
+  mLastSegmentNum = int32_t(segmentCount) - 1;
+  mLogicalLength = aLength;
+  mSealed = true;
+  return NS_OK;
+}
+
 NS_IMETHODIMP
 nsStorageStream::GetOutputStream(int32_t aStartingOffset,
                                  nsIOutputStream** aOutputStream) {
   if (NS_WARN_IF(!aOutputStream)) {
     return NS_ERROR_INVALID_ARG;
   }
-  if (NS_WARN_IF(!mSegmentedBuffer)) {
+  if (NS_WARN_IF(!IsInitialized())) {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
-  if (mWriteInProgress) {
+  if (mWriteInProgress || mSealed) {
     return NS_ERROR_NOT_AVAILABLE;
   }
 
@@ -100,8 +217,8 @@ nsStorageStream::GetOutputStream(int32_t aStartingOffset,
 
   // Enlarge the last segment in the buffer so that it is the same size as
   // all the other segments in the buffer.  (It may have been realloc'ed
-  // smaller in the Close() method.)
-  if (mLastSegmentNum >= 0)
+  // smaller in the Close() method.)  Shared segments are never shrunk.
+  if (mLastSegmentNum >= 0 && !mShared)
     if (mSegmentedBuffer->ReallocLastSegment(mSegmentSize)) {
       // Need to re-Seek, since realloc changed segment base pointer
       rv = Seek(aStartingOffset);
@@ -118,7 +235,7 @@ nsStorageStream::GetOutputStream(int32_t aStartingOffset,
 
 NS_IMETHODIMP
 nsStorageStream::Close() {
-  if (NS_WARN_IF(!mSegmentedBuffer)) {
+  if (NS_WARN_IF(!IsInitialized())) {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
@@ -128,7 +245,7 @@ nsStorageStream::Close() {
 
   // Shrink the final segment in the segmented buffer to the minimum size
   // needed to contain the data, so as to conserve memory.
-  if (segmentOffset) {
+  if (segmentOffset && !mShared) {
     mSegmentedBuffer->ReallocLastSegment(segmentOffset);
   }
 
@@ -150,7 +267,7 @@ nsStorageStream::Write(const char* aBuffer, uint32_t aCount,
   if (NS_WARN_IF(!aNumWritten) || NS_WARN_IF(!aBuffer)) {
     return NS_ERROR_INVALID_ARG;
   }
-  if (NS_WARN_IF(!mSegmentedBuffer)) {
+  if (NS_WARN_IF(!IsInitialized())) {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
@@ -169,12 +286,12 @@ nsStorageStream::Write(const char* aBuffer, uint32_t aCount,
   // this stream contains N bytes of data and newInputStream(N) is called),
   // even for N=0 (with the caveat that we require .write("", 0) be called to
   // initialize internal buffers).
-  bool firstTime = mSegmentedBuffer->GetSegmentCount() == 0;
+  bool firstTime = GetSegmentCount() == 0;
   while (remaining || MOZ_UNLIKELY(firstTime)) {
     firstTime = false;
     availableInSegment = mSegmentEnd - mWriteCursor;
     if (!availableInSegment) {
-      mWriteCursor = mSegmentedBuffer->AppendNewSegment();
+      mWriteCursor = AppendNewSegment();
       if (!mWriteCursor) {
         mSegmentEnd = 0;
         rv = NS_ERROR_OUT_OF_MEMORY;
@@ -238,11 +355,11 @@ nsStorageStream::GetLength(uint32_t* aLength) {
 // Truncate the buffer by deleting the end segments
 NS_IMETHODIMP
 nsStorageStream::SetLength(uint32_t aLength) {
-  if (NS_WARN_IF(!mSegmentedBuffer)) {
+  if (NS_WARN_IF(!IsInitialized())) {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
-  if (mWriteInProgress) {
+  if (mWriteInProgress || mSealed) {
     return NS_ERROR_NOT_AVAILABLE;
   }
 
@@ -257,7 +374,7 @@ nsStorageStream::SetLength(uint32_t aLength) {
   }
 
   while (newLastSegmentNum < mLastSegmentNum) {
-    mSegmentedBuffer->DeleteLastSegment();
+    DeleteLastSegment();
     mLastSegmentNum--;
   }
 
@@ -271,8 +388,74 @@ nsStorageStream::GetWriteInProgress(bool* aWriteInProgress) {
   return NS_OK;
 }
 
+NS_IMETHODIMP
+nsStorageStream::ShareSegments(nsTArray<FileDescriptor>& aSegments) {
+  if (NS_WARN_IF(!IsInitialized())) {
+    return NS_ERROR_NOT_INITIALIZED;
+  }
+
+  if (!mShared || mWriteInProgress) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  // Writing nothing still creates a segment, so only share the ones that hold
+  // data.
+  uint32_t segmentCount = SegNum(mLogicalLength) + !!SegOffset(mLogicalLength);
+  MOZ_ASSERT(segmentCount <= GetSegmentCount());
+
+  // Once a segment is read-only for us, the processes we share it with can
+  // rely on it not changing under them.
+  for (uint32_t i = 0; i < segmentCount; ++i) {
+    if (NS_WARN_IF(!mSharedSegments[i]->Seal())) {
+      return NS_ERROR_FAILURE;
+    }
+  }
+  mSealed = true;
+
+  for (uint32_t i = 0; i < segmentCount; ++i) {
+    aSegments.AppendElement(mSharedSegments[i]->CloneHandle());
+  }
+
+  return NS_OK;
+}
+
+uint32_t nsStorageStream::GetSegmentCount() {
+  return mShared ? mSharedSegments.Length()
+                 : mSegmentedBuffer->GetSegmentCount();
+}
+
+char* nsStorageStream::GetSegment(uint32_t aIndex) {
+  return mShared ? mSharedSegments[aIndex]->Data()
+                 : mSegmentedBuffer->GetSegment(aIndex);
+}
+
+char* nsStorageStream::AppendNewSegment() {
+  if (!mShared) {
+    return mSegmentedBuffer->AppendNewSegment();
+  }
+
+  if (uint64_t(mSharedSegments.Length() + 1) * mSegmentSize > mMaxSize) {
+    return nullptr;
+  }
+
+  auto segment = MakeUnique<SharedSegment>();
+  if (NS_WARN_IF(!segment->Init(mSegmentSize))) {
+    return nullptr;
+  }
+  return mSharedSegments.AppendElement(std::move(segment))->get()->Data();
+}
+
+void nsStorageStream::DeleteLastSegment() {
+  if (!mShared) {
+    mSegmentedBuffer->DeleteLastSegment();
+    return;
+  }
+
+  mSharedSegments.RemoveLastElement();
+}
+
 nsresult nsStorageStream::Seek(int32_t aPosition) {
-  if (NS_WARN_IF(!mSegmentedBuffer)) {
+  if (NS_WARN_IF(!IsInitialized())) {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
@@ -299,7 +482,7 @@ nsresult nsStorageStream::Seek(int32_t aPosition) {
   }
 
   // Segment may have changed, so reset pointers
-  mWriteCursor = mSegmentedBuffer->GetSegment(mLastSegmentNum);
+  mWriteCursor = GetSegment(mLastSegmentNum);
   NS_ASSERTION(mWriteCursor, "null mWriteCursor");
   mSegmentEnd = mWriteCursor + mSegmentSize;
 
@@ -378,7 +561,7 @@ NS_IMPL_ISUPPORTS(nsStorageInputStream, nsIInputStream, nsISeekableStream,
 NS_IMETHODIMP
 nsStorageStream::NewInputStream(int32_t aStartingOffset,
                                 nsIInputStream** aInputStream) {
-  if (NS_WARN_IF(!mSegmentedBuffer)) {
+  if (NS_WARN_IF(!IsInitialized())) {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
@@ -451,7 +634,7 @@ nsStorageInputStream::ReadSegments(nsWriteSegmentFun aWriter, void* aClosure,
       mSegmentEnd = XPCOM_MIN(mSegmentSize, available);
       availableInSegment = mSegmentEnd;
     }
-    const char* cur = mStorageStream->mSegmentedBuffer->GetSegment(mSegmentNum);
+    const char* cur = mStorageStream->GetSegment(mSegmentNum);
 
     count = XPCOM_MIN(availableInSegment, remainingCapacity);
     rv = aWriter(this, aClosure, cur + mReadCursor, aCount - remainingCapacity,
@@ -638,6 +821,29 @@ nsresult NS_NewStorageStream(uint32_t aSegmentSize, uint32_t aMaxSize,
   return NS_OK;
 }
 
+nsresult NS_NewSharedStorageStream(uint32_t aSegmentSize, uint32_t aMaxSize,
+                                   nsIStorageStream** aResult) {
+  RefPtr<nsStorageStream> storageStream = new nsStorageStream();
+  nsresult rv = storageStream->InitShared(aSegmentSize, aMaxSize);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+  storageStream.forget(aResult);
+  return NS_OK;
+}
+
+nsresult NS_NewSharedStorageInputStream(
+    const nsTArray<FileDescriptor>& aSegments, uint32_t aSegmentSize,
+    uint32_t aLength, nsIInputStream** aResult) {
+  RefPtr<nsStorageStream> storageStream = new nsStorageStream();
+  nsresult rv =
+      storageStream->InitWithSharedSegments(aSegments, aSegmentSize, aLength);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+  return storageStream->NewInputStream(0, aResult);
+}
+
 // Undefine LOG, so that other .cpp files (or their includes) won't complain
 // about it already being defined, when we build in unified mode.
 #undef LOG
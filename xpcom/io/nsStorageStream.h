@@ -18,7 +18,9 @@
 #include "nsIStorageStream.h"
 #include "nsIOutputStream.h"
 #include "nsMemory.h"
+#include "nsTArray.h"
 #include "mozilla/Attributes.h"
+#include "mozilla/UniquePtr.h"
 
 #define NS_STORAGESTREAM_CID                         \
   { /* 669a9795-6ff7-4ed4-9150-c34ce2971b63 */       \
@@ -35,6 +37,15 @@ class nsStorageStream final : public nsIStorageStream, public nsIOutputStream {
  public:
   nsStorageStream();
 
+  // Like Init(), but with each segment in its own shared memory region.
+  nsresult InitShared(uint32_t aSegmentSize, uint32_t aMaxSize);
+
+  // Sets up a read-only stream over segments shared by another storage
+  // stream's ShareSegments().
+  nsresult InitWithSharedSegments(
+      const nsTArray<mozilla::ipc::FileDescriptor>& aSegments,
+      uint32_t aSegmentSize, uint32_t aLength);
+
   NS_DECL_THREADSAFE_ISUPPORTS
   NS_DECL_NSISTORAGESTREAM
   NS_DECL_NSIOUTPUTSTREAM
@@ -44,7 +55,14 @@ class nsStorageStream final : public nsIStorageStream, public nsIOutputStream {
  private:
   ~nsStorageStream();
 
+  class SharedSegment;
+
   nsSegmentedBuffer* mSegmentedBuffer;
+  // Used instead of mSegmentedBuffer with InitShared().
+  nsTArray<mozilla::UniquePtr<SharedSegment>> mSharedSegments;
+  bool mShared;
+  bool mSealed;  // true, once the segments have been shared
+  uint32_t mMaxSize;
   uint32_t
       mSegmentSize;  // All segments, except possibly the last, are of this size
                      //   Must be power-of-2
@@ -57,6 +75,12 @@ class nsStorageStream final : public nsIStorageStream, public nsIOutputStream {
   uint32_t mLogicalLength;    // Number of bytes written to stream
 
   nsresult Seek(int32_t aPosition);
+
+  bool IsInitialized() const { return mSegmentedBuffer || mShared; }
+  uint32_t GetSegmentCount();
+  char* GetSegment(uint32_t aIndex);
+  char* AppendNewSegment();
+  void DeleteLastSegment();
   uint32_t SegNum(uint32_t aPosition) { return aPosition >> mSegmentSizeLog2; }
   uint32_t SegOffset(uint32_t aPosition) {
     return aPosition & (mSegmentSize - 1);
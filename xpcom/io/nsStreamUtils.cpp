@@ -13,6 +13,8 @@
 #include "nsICancelableRunnable.h"
 #include "nsISafeOutputStream.h"
 #include "nsString.h"
+#include "nsStringRope.h"
+#include "nsUTFTranscoder.h"
 #include "nsIAsyncInputStream.h"
 #include "nsIAsyncOutputStream.h"
 #include "nsIBufferedStreams.h"
@@ -682,6 +684,89 @@ nsresult NS_ConsumeStream(nsIInputStream* aStream, uint32_t aMaxCount,
   return DoConsumeStream(aStream, aMaxCount, aResult);
 }
 
+namespace {
+
+struct MOZ_STACK_CLASS TextStreamConsumer {
+  // Null for Latin-1.
+  nsUTF8ToUTF16Transcoder* mTranscoder;
+  nsAString& mResult;
+  bool mOutOfMemory;
+
+  bool Append(const char* aData, uint32_t aLength) {
+    auto data = MakeSpan(aData, aLength);
+    if (mTranscoder) {
+      return mTranscoder->Append(data, mResult, fallible);
+    }
+    return AppendASCIItoUTF16(data, mResult, fallible);
+  }
+};
+
+nsresult AppendTextSegment(nsIInputStream* aInStr, void* aClosure,
+                           const char* aBuffer, uint32_t aOffset,
+                           uint32_t aCount, uint32_t* aCountWritten) {
+  auto* consumer = static_cast<TextStreamConsumer*>(aClosure);
+  if (!consumer->Append(aBuffer, aCount)) {
+    consumer->mOutOfMemory = true;
+    *aCountWritten = 0;
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+  *aCountWritten = aCount;
+  return NS_OK;
+}
+
+nsresult DoConsumeTextStream(nsIInputStream* aStream, uint32_t aMaxCount,
+                             TextStreamConsumer& aConsumer) {
+  bool readSegments = true;
+  while (aMaxCount) {
+    uint32_t n = 0;
+    nsresult rv;
+    if (readSegments) {
+      rv = aStream->ReadSegments(AppendTextSegment, &aConsumer, aMaxCount, &n);
+      if (rv == NS_ERROR_NOT_IMPLEMENTED) {
+        readSegments = false;
+        continue;
+      }
+    } else {
+      char buf[4096];
+      rv = aStream->Read(buf, XPCOM_MIN<uint32_t>(sizeof(buf), aMaxCount), &n);
+      if (NS_SUCCEEDED(rv) && n && !aConsumer.Append(buf, n)) {
+        aConsumer.mOutOfMemory = true;
+      }
+    }
+
+    if (aConsumer.mOutOfMemory) {
+      return NS_ERROR_OUT_OF_MEMORY;
+    }
+    if (rv == NS_BASE_STREAM_CLOSED) {
+      return NS_OK;
+    }
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+    if (n == 0) {
+      break;
+    }
+    aMaxCount -= n;
+  }
+
+  return NS_OK;
+}
+
+}  // namespace
+
+nsresult NS_ConsumeUTF8Stream(nsIInputStream* aStream, uint32_t aMaxCount,
+                              nsUTF8ToUTF16Transcoder& aTranscoder,
+                              nsAString& aResult) {
+  TextStreamConsumer consumer = {&aTranscoder, aResult, false};
+  return DoConsumeTextStream(aStream, aMaxCount, consumer);
+}
+
+nsresult NS_ConsumeLatin1Stream(nsIInputStream* aStream, uint32_t aMaxCount,
+                                nsAString& aResult) {
+  TextStreamConsumer consumer = {nullptr, aResult, false};
+  return DoConsumeTextStream(aStream, aMaxCount, consumer);
+}
+
 //-----------------------------------------------------------------------------
 
 static nsresult TestInputStream(nsIInputStream* aInStr, void* aClosure,
@@ -806,6 +891,28 @@ nsresult NS_FillArray(FallibleTArray<char>& aDest, nsIInputStream* aInput,
   return rv;
 }
 
+nsresult NS_WriteStringRope(nsIOutputStream* aStream,
+                            const nsCStringRope& aRope) {
+  nsresult rv = NS_OK;
+  aRope.ForEachSegment([&](const char* aData, uint32_t aLength) {
+    while (aLength) {
+      uint32_t written = 0;
+      rv = aStream->Write(aData, aLength, &written);
+      if (NS_FAILED(rv)) {
+        return false;
+      }
+      if (written == 0) {
+        rv = NS_BASE_STREAM_CLOSED;
+        return false;
+      }
+      aData += written;
+      aLength -= written;
+    }
+    return true;
+  });
+  return rv;
+}
+
 bool NS_InputStreamIsCloneable(nsIInputStream* aSource) {
   if (!aSource) {
     return false;
@@ -17,6 +17,7 @@ class nsIOutputStream;
 class nsIInputStreamCallback;
 class nsIOutputStreamCallback;
 class nsIEventTarget;
+class nsUTF8ToUTF16Transcoder;
 
 /**
  * A "one-shot" proxy of the OnInputStreamReady callback.  The resulting
@@ -131,6 +132,28 @@ extern nsresult NS_ConsumeStream(nsIInputStream* aSource, uint32_t aMaxCount,
 extern nsresult NS_ConsumeStream(nsIInputStream* aSource, uint32_t aMaxCount,
                                  nsTArray<uint8_t>& aBuffer);
 
+/**
+ * Like NS_ConsumeStream, but decodes the stream as UTF-8 and appends the text
+ * to aResult (which is not truncated). Each segment is converted straight out
+ * of the stream's buffer when the stream supports ReadSegments, so the bytes
+ * are never buffered as a whole.
+ *
+ * aTranscoder holds any character split between segments, and carries it
+ * over if this is called again for the same stream, e.g. after the stream
+ * returned NS_BASE_STREAM_WOULD_BLOCK. Call aTranscoder.Finish(aResult) once
+ * the stream is exhausted.
+ */
+extern nsresult NS_ConsumeUTF8Stream(nsIInputStream* aSource,
+                                     uint32_t aMaxCount,
+                                     nsUTF8ToUTF16Transcoder& aTranscoder,
+                                     nsAString& aResult);
+
+/**
+ * Just like the above, but for a stream of Latin-1, which needs no state.
+ */
+extern nsresult NS_ConsumeLatin1Stream(nsIInputStream* aSource,
+                                       uint32_t aMaxCount, nsAString& aResult);
+
 /**
  * This function tests whether or not the input stream is buffered. A buffered
  * input stream is one that implements readSegments.  The test for this is to
@@ -259,6 +282,14 @@ extern nsresult NS_FillArray(FallibleTArray<char>& aDest,
                              nsIInputStream* aInput, uint32_t aKeep,
                              uint32_t* aNewBytes);
 
+/**
+ * Writes the segments of aRope to aStream in order, without flattening it.
+ * The stream should be blocking; if a write would block, this returns
+ * NS_BASE_STREAM_WOULD_BLOCK with only part of the rope written.
+ */
+extern nsresult NS_WriteStringRope(nsIOutputStream* aStream,
+                                   const nsCStringRope& aRope);
+
 /**
  * Return true if the given stream can be directly cloned.
  */
@@ -25,6 +25,10 @@ using nsCStringRepr = nsTStringRepr<char>;
 
 static const size_t AutoStringDefaultStorageSize = 64;
 
+// The inline buffer of an nsTInlineString: 48 bytes, less the nsTString
+// fields and mInlineCapacity on 64-bit platforms.
+static const size_t InlineStringDefaultStorageBytes = 28;
+
 template <typename T>
 class nsTSubstring;
 template <typename T>
@@ -33,6 +37,8 @@ template <typename T>
 class nsTString;
 template <typename T, size_t N>
 class nsTAutoStringN;
+template <typename T, size_t N>
+class nsTInlineStringN;
 template <typename T>
 class nsTDependentString;
 template <typename T>
@@ -48,12 +54,19 @@ class nsTLiteralString;
 template <typename T>
 class nsTSubstringSplitter;
 
+template <typename T>
+class nsTStringRope;
+
 // We define this version without a size param instead of providing a
 // default value for N so that so there is a default typename that doesn't
 // require angle brackets.
 template <typename T>
 using nsTAutoString = nsTAutoStringN<T, AutoStringDefaultStorageSize>;
 
+template <typename T>
+using nsTInlineString =
+    nsTInlineStringN<T, InlineStringDefaultStorageBytes / sizeof(T)>;
+
 // Double-byte (char16_t) string types.
 
 using nsAString = nsTSubstring<char16_t>;
@@ -62,6 +75,7 @@ using nsString = nsTString<char16_t>;
 using nsAutoString = nsTAutoString<char16_t>;
 template <size_t N>
 using nsAutoStringN = nsTAutoStringN<char16_t, N>;
+using nsInlineString = nsTInlineString<char16_t>;
 using nsDependentString = nsTDependentString<char16_t>;
 using nsDependentSubstring = nsTDependentSubstring<char16_t>;
 using nsPromiseFlatString = nsTPromiseFlatString<char16_t>;
@@ -69,6 +83,7 @@ using nsStringComparator = nsTStringComparator<char16_t>;
 using nsDefaultStringComparator = nsTDefaultStringComparator<char16_t>;
 using nsLiteralString = nsTLiteralString<char16_t>;
 using nsSubstringSplitter = nsTSubstringSplitter<char16_t>;
+using nsStringRope = nsTStringRope<char16_t>;
 
 // Single-byte (char) string types.
 
@@ -78,6 +93,7 @@ using nsCString = nsTString<char>;
 using nsAutoCString = nsTAutoString<char>;
 template <size_t N>
 using nsAutoCStringN = nsTAutoStringN<char, N>;
+using nsInlineCString = nsTInlineString<char>;
 using nsDependentCString = nsTDependentString<char>;
 using nsDependentCSubstring = nsTDependentSubstring<char>;
 using nsPromiseFlatCString = nsTPromiseFlatString<char>;
@@ -85,5 +101,6 @@ using nsCStringComparator = nsTStringComparator<char>;
 using nsDefaultCStringComparator = nsTDefaultStringComparator<char>;
 using nsLiteralCString = nsTLiteralString<char>;
 using nsCSubstringSplitter = nsTSubstringSplitter<char>;
+using nsCStringRope = nsTStringRope<char>;
 
 #endif /* !defined(nsStringFwd_h) */
@@ -0,0 +1,265 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "nsStringRope.h"
+
+#include <utility>
+
+#include "mozilla/CheckedInt.h"
+#include "nsCharTraits.h"
+#include "nsDebug.h"
+
+template <typename T>
+nsTStringRope<T>::nsTStringRope(nsTStringRope&& aOther)
+    : mSegments(std::move(aOther.mSegments)),
+      mLength(aOther.mLength),
+      mChunk(std::move(aOther.mChunk)),
+      mChunkUsed(aOther.mChunkUsed),
+      mChunkCapacity(aOther.mChunkCapacity) {
+  aOther.Truncate();
+}
+
+template <typename T>
+nsTStringRope<T>& nsTStringRope<T>::operator=(nsTStringRope&& aOther) {
+  if (this != &aOther) {
+    mSegments = std::move(aOther.mSegments);
+    mLength = aOther.mLength;
+    mChunk = std::move(aOther.mChunk);
+    mChunkUsed = aOther.mChunkUsed;
+    mChunkCapacity = aOther.mChunkCapacity;
+    aOther.Truncate();
+  }
+  return *this;
+}
+
+template <typename T>
+void nsTStringRope<T>::Truncate() {
+  mSegments.Clear();
+  mLength = 0;
+  mChunk = nullptr;
+  mChunkUsed = 0;
+  mChunkCapacity = 0;
+}
+
+template <typename T>
+bool nsTStringRope<T>::AddLength(size_type aLength) {
+  mozilla::CheckedInt<size_type> length = mLength;
+  length += aLength;
+  // Leave room for the null terminator when flattening.
+  if (!length.isValid() || length.value() >= size_type(-1) / 2) {
+    return false;
+  }
+  mLength = length.value();
+  return true;
+}
+
+template <typename T>
+bool nsTStringRope<T>::Append(const char_type* aData, size_type aLength,
+                              const mozilla::fallible_t&) {
+  if (aLength == 0) {
+    return true;
+  }
+
+  size_type oldLength = mLength;
+  if (!AddLength(aLength)) {
+    return false;
+  }
+
+  if (mChunkCapacity - mChunkUsed < aLength) {
+    // Start a new chunk. Anything left in the old one is wasted, but chunks
+    // grow geometrically so that's bounded by the size of the new one.
+    size_type capacity = mChunkCapacity ? mChunkCapacity * 2 : kMinChunkLength;
+    if (capacity > kMaxChunkLength) {
+      capacity = kMaxChunkLength;
+    }
+    if (capacity < aLength) {
+      capacity = aLength;
+    }
+
+    RefPtr<nsStringBuffer> chunk =
+        nsStringBuffer::Alloc(size_t(capacity) * sizeof(char_type));
+    if (!chunk) {
+      mLength = oldLength;
+      return false;
+    }
+    mChunk = std::move(chunk);
+    mChunkUsed = 0;
+    mChunkCapacity = capacity;
+  }
+
+  char_type* dest = ChunkData() + mChunkUsed;
+  nsCharTraits<char_type>::copy(dest, aData, aLength);
+
+  // Extend the last segment if it ends where this piece was copied to.
+  if (!mSegments.IsEmpty()) {
+    Segment& last = mSegments.LastElement();
+    if (last.mIsChunk && last.mBuffer == mChunk &&
+        last.mData + last.mLength == dest) {
+      last.mLength += aLength;
+      mChunkUsed += aLength;
+      return true;
+    }
+  }
+
+  Segment* segment = mSegments.AppendElement(mozilla::fallible);
+  if (!segment) {
+    mLength = oldLength;
+    return false;
+  }
+  segment->mBuffer = mChunk;
+  segment->mData = dest;
+  segment->mLength = aLength;
+  segment->mIsChunk = true;
+  mChunkUsed += aLength;
+  return true;
+}
+
+template <typename T>
+void nsTStringRope<T>::Append(const char_type* aData, size_type aLength) {
+  if (!Append(aData, aLength, mozilla::fallible)) {
+    NS_ABORT_OOM(size_t(mLength + aLength) * sizeof(char_type));
+  }
+}
+
+template <typename T>
+bool nsTStringRope<T>::AppendShared(nsStringBuffer* aBuffer,
+                                    const char_type* aData,
+                                    size_type aLength) {
+  size_type oldLength = mLength;
+  if (!AddLength(aLength)) {
+    return false;
+  }
+
+  Segment* segment = mSegments.AppendElement(mozilla::fallible);
+  if (!segment) {
+    mLength = oldLength;
+    return false;
+  }
+  segment->mBuffer = aBuffer;
+  segment->mData = aData;
+  segment->mLength = aLength;
+  segment->mIsChunk = false;
+  return true;
+}
+
+template <typename T>
+void nsTStringRope<T>::AppendLiteral(const char_type* aData,
+                                     size_type aLength) {
+  if (aLength < kMinSharedLength) {
+    Append(aData, aLength);
+    return;
+  }
+  if (!AppendShared(nullptr, aData, aLength)) {
+    NS_ABORT_OOM(size_t(mLength + aLength) * sizeof(char_type));
+  }
+}
+
+template <typename T>
+bool nsTStringRope<T>::Append(const substring_type& aStr,
+                              const mozilla::fallible_t&) {
+  size_type length = aStr.Length();
+  if (length >= kMinSharedLength) {
+    if (aStr.IsLiteral()) {
+      return AppendShared(nullptr, aStr.BeginReading(), length);
+    }
+    // Taking a reference makes the buffer read-only, so later changes to
+    // aStr will copy it rather than write to the data we point at.
+    if (nsStringBuffer* buffer = nsStringBuffer::FromString(aStr)) {
+      return AppendShared(buffer, aStr.BeginReading(), length);
+    }
+  }
+  return Append(aStr.BeginReading(), length, mozilla::fallible);
+}
+
+template <typename T>
+void nsTStringRope<T>::Append(const substring_type& aStr) {
+  if (!Append(aStr, mozilla::fallible)) {
+    NS_ABORT_OOM(size_t(mLength + aStr.Length()) * sizeof(char_type));
+  }
+}
+
+template <typename T>
+void nsTStringRope<T>::CopyTo(char_type* aDest) const {
+  for (const Segment& segment : mSegments) {
+    nsCharTraits<char_type>::copy(aDest, segment.mData, segment.mLength);
+    aDest += segment.mLength;
+  }
+}
+
+template <typename T>
+bool nsTStringRope<T>::ToString(substring_type& aResult,
+                                const mozilla::fallible_t&) const {
+  // A rope made of a single shared string can hand out the same buffer.
+  if (mSegments.Length() == 1) {
+    const Segment& segment = mSegments[0];
+    if (segment.mBuffer && !segment.mIsChunk &&
+        segment.mData == segment.mBuffer->Data() &&
+        segment.mData[segment.mLength] == char_type(0)) {
+      segment.mBuffer->ToString(segment.mLength, aResult);
+      return true;
+    }
+  }
+
+  if (!aResult.SetLength(mLength, mozilla::fallible)) {
+    return false;
+  }
+  CopyTo(aResult.BeginWriting());
+  return true;
+}
+
+template <typename T>
+void nsTStringRope<T>::ToString(substring_type& aResult) const {
+  if (!ToString(aResult, mozilla::fallible)) {
+    aResult.AllocFailed(mLength);
+  }
+}
+
+template <typename T>
+bool nsTStringRope<T>::AppendTo(substring_type& aResult,
+                                const mozilla::fallible_t&) const {
+  if (aResult.IsEmpty()) {
+    return ToString(aResult, mozilla::fallible);
+  }
+
+  size_type oldLength = aResult.Length();
+  mozilla::CheckedInt<size_type> newLength = oldLength;
+  newLength += mLength;
+  if (!newLength.isValid() ||
+      !aResult.SetLength(newLength.value(), mozilla::fallible)) {
+    return false;
+  }
+  CopyTo(aResult.BeginWriting() + oldLength);
+  return true;
+}
+
+template <typename T>
+void nsTStringRope<T>::AppendTo(substring_type& aResult) const {
+  if (!AppendTo(aResult, mozilla::fallible)) {
+    aResult.AllocFailed(size_t(aResult.Length()) + mLength);
+  }
+}
+
+template <typename T>
+size_t nsTStringRope<T>::SizeOfExcludingThis(
+    mozilla::MallocSizeOf aMallocSizeOf) const {
+  size_t n = mSegments.ShallowSizeOfExcludingThis(aMallocSizeOf);
+  // Chunks are only referenced by the rope, but shared strings are measured
+  // by their other owners. Consecutive segments may share a chunk.
+  const nsStringBuffer* lastChunk = nullptr;
+  for (const Segment& segment : mSegments) {
+    if (segment.mIsChunk && segment.mBuffer != lastChunk) {
+      n += segment.mBuffer->SizeOfIncludingThisEvenIfShared(aMallocSizeOf);
+      lastChunk = segment.mBuffer;
+    }
+  }
+  if (mChunk && mChunk != lastChunk) {
+    n += mChunk->SizeOfIncludingThisEvenIfShared(aMallocSizeOf);
+  }
+  return n;
+}
+
+template class nsTStringRope<char>;
+template class nsTStringRope<char16_t>;
@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef nsStringRope_h
+#define nsStringRope_h
+
+#include "mozilla/fallible.h"
+#include "mozilla/MemoryReporting.h"
+#include "mozilla/RefPtr.h"
+#include "nsString.h"
+#include "nsStringBuffer.h"
+#include "nsTArray.h"
+
+/**
+ * nsTStringRope
+ *
+ * A string builder for code that produces a long string out of many small
+ * pieces. Appending to an nsTSubstring reallocates and copies everything
+ * written so far each time the buffer grows; a rope instead keeps a list of
+ * segments and only copies the pieces once, when the result is flattened
+ * with ToString() or AppendTo(). ForEachSegment() (and NS_WriteStringRope()
+ * in nsStreamUtils.h) consume the segments directly without flattening at
+ * all.
+ *
+ * Appending a string that owns a shared nsStringBuffer, or a literal, just
+ * references its data. Other pieces, and pieces too short to be worth a
+ * segment of their own, are copied into chunks the rope allocates as it
+ * grows. Chunks are never reallocated, so nothing already appended is ever
+ * moved.
+ *
+ * Example usage:
+ *
+ *   nsCStringRope rope;
+ *   rope.AppendLiteral("GET ");
+ *   rope.Append(path);
+ *   rope.Append(' ');
+ *   ...
+ *   nsAutoCString result;
+ *   rope.ToString(result);
+ *
+ * Like the string classes, a rope must only be used on one thread at a time.
+ */
+template <typename T>
+class nsTStringRope {
+ public:
+  typedef T char_type;
+  typedef nsTSubstring<T> substring_type;
+  typedef uint32_t size_type;
+
+  nsTStringRope() : mLength(0), mChunkUsed(0), mChunkCapacity(0) {}
+
+  nsTStringRope(nsTStringRope&& aOther);
+  nsTStringRope& operator=(nsTStringRope&& aOther);
+
+  nsTStringRope(const nsTStringRope&) = delete;
+  nsTStringRope& operator=(const nsTStringRope&) = delete;
+
+  size_type Length() const { return mLength; }
+  bool IsEmpty() const { return mLength == 0; }
+
+  void Append(const substring_type& aStr);
+  MOZ_MUST_USE bool Append(const substring_type& aStr,
+                           const mozilla::fallible_t&);
+
+  void Append(const char_type* aData, size_type aLength);
+  MOZ_MUST_USE bool Append(const char_type* aData, size_type aLength,
+                           const mozilla::fallible_t&);
+
+  void Append(char_type aChar) { Append(&aChar, 1); }
+
+  /**
+   * Appends a string literal by reference, without copying it unless it is
+   * very short.
+   */
+  template <int N>
+  void AppendLiteral(const char_type (&aStr)[N]) {
+    AppendLiteral(aStr, N - 1);
+  }
+
+  void Truncate();
+
+  /**
+   * Replaces the contents of aResult with the contents of the rope. This does
+   * a single allocation, or none at all if the rope consists of one shared
+   * string buffer.
+   */
+  void ToString(substring_type& aResult) const;
+  MOZ_MUST_USE bool ToString(substring_type& aResult,
+                             const mozilla::fallible_t&) const;
+
+  void AppendTo(substring_type& aResult) const;
+  MOZ_MUST_USE bool AppendTo(substring_type& aResult,
+                             const mozilla::fallible_t&) const;
+
+  /**
+   * Calls aFunc(const char_type* aData, size_type aLength) for each segment
+   * of the rope in order. Stops and returns false if aFunc returns false.
+   */
+  template <typename F>
+  bool ForEachSegment(F&& aFunc) const {
+    for (const Segment& segment : mSegments) {
+      if (!aFunc(segment.mData, segment.mLength)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_type SegmentCount() const { return mSegments.Length(); }
+
+  size_t SizeOfExcludingThis(mozilla::MallocSizeOf aMallocSizeOf) const;
+
+ private:
+  struct Segment {
+    // Null for literals.
+    RefPtr<nsStringBuffer> mBuffer;
+    const char_type* mData;
+    size_type mLength;
+    // Whether mBuffer is one of the rope's own chunks rather than a string's.
+    bool mIsChunk;
+  };
+
+  // Pieces shorter than this are copied rather than referenced, since copying
+  // them costs less than a segment of their own.
+  static const size_type kMinSharedLength = 64;
+
+  static const size_type kMinChunkLength = 256;
+  static const size_type kMaxChunkLength = 16 * 1024;
+
+  void AppendLiteral(const char_type* aData, size_type aLength);
+  MOZ_MUST_USE bool AppendShared(nsStringBuffer* aBuffer,
+                                 const char_type* aData, size_type aLength);
+  MOZ_MUST_USE bool AddLength(size_type aLength);
+  void CopyTo(char_type* aDest) const;
+
+  char_type* ChunkData() const {
+    return static_cast<char_type*>(mChunk->Data());
+  }
+
+  AutoTArray<Segment, 8> mSegments;
+  size_type mLength;
+
+  // The chunk that short pieces are currently being copied into. The last
+  // segment refers to it if the last piece appended was copied.
+  RefPtr<nsStringBuffer> mChunk;
+  size_type mChunkUsed;
+  size_type mChunkCapacity;
+};
+
+extern template class nsTStringRope<char>;
+extern template class nsTStringRope<char16_t>;
+
+#endif  // nsStringRope_h
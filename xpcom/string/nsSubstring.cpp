@@ -52,7 +52,11 @@ char16_t* const nsCharTraits<char16_t>::sEmptyBuffer =
 class nsStringStats {
  public:
   nsStringStats()
-      : mAllocCount(0), mReallocCount(0), mFreeCount(0), mShareCount(0) {}
+      : mAllocCount(0),
+        mSmallAllocCount(0),
+        mReallocCount(0),
+        mFreeCount(0),
+        mShareCount(0) {}
 
   ~nsStringStats() {
     // this is a hack to suppress duplicate string stats printing
@@ -64,6 +68,7 @@ class nsStringStats {
 
     printf("nsStringStats\n");
     printf(" => mAllocCount:     % 10d\n", int(mAllocCount));
+    printf(" => mSmallAllocCount:% 10d\n", int(mSmallAllocCount));
     printf(" => mReallocCount:   % 10d\n", int(mReallocCount));
     printf(" => mFreeCount:      % 10d", int(mFreeCount));
     if (mAllocCount > mFreeCount) {
@@ -88,6 +93,8 @@ class nsStringStats {
       AtomicInt;
 
   AtomicInt mAllocCount;
+  // Allocations small enough to have fit in an nsTInlineString.
+  AtomicInt mSmallAllocCount;
   AtomicInt mReallocCount;
   AtomicInt mFreeCount;
   AtomicInt mShareCount;
@@ -203,6 +210,11 @@ already_AddRefed<nsStringBuffer> nsStringBuffer::Alloc(size_t aSize) {
   nsStringBuffer* hdr = (nsStringBuffer*)malloc(sizeof(nsStringBuffer) + aSize);
   if (hdr) {
     STRING_STAT_INCREMENT(Alloc);
+#ifdef ENABLE_STRING_STATS
+    if (aSize <= InlineStringDefaultStorageBytes) {
+      STRING_STAT_INCREMENT(SmallAlloc);
+    }
+#endif
 
     hdr->mRefCount = 1;
     hdr->mStorageSize = aSize;
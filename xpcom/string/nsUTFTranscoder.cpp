@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "nsUTFTranscoder.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "mozilla/Likely.h"
+#include "nsCharTraits.h"
+#include "nsReadableUtils.h"
+#include "nsString.h"
+
+using mozilla::MakeSpan;
+using mozilla::Span;
+
+namespace {
+
+// The length of the UTF-8 sequence that aLead starts, or zero if aLead is
+// ASCII or can't start a well-formed sequence.
+size_t UTF8SequenceLength(uint8_t aLead) {
+  if (aLead >= 0xC2 && aLead <= 0xDF) {
+    return 2;
+  }
+  if (aLead >= 0xE0 && aLead <= 0xEF) {
+    return 3;
+  }
+  if (aLead >= 0xF0 && aLead <= 0xF4) {
+    return 4;
+  }
+  return 0;
+}
+
+// Whether aByte can be byte number aIndex of a sequence that starts with
+// aLead. The second byte has a narrower range after some leads, which rules
+// out overlong forms, surrogates and code points above U+10FFFF.
+bool IsUTF8TrailByte(uint8_t aLead, size_t aIndex, uint8_t aByte) {
+  uint8_t lower = 0x80;
+  uint8_t upper = 0xBF;
+  if (aIndex == 1) {
+    switch (aLead) {
+      case 0xE0:
+        lower = 0xA0;
+        break;
+      case 0xED:
+        upper = 0x9F;
+        break;
+      case 0xF0:
+        lower = 0x90;
+        break;
+      case 0xF4:
+        upper = 0x8F;
+        break;
+    }
+  }
+  return aByte >= lower && aByte <= upper;
+}
+
+// The length of the well-formed but incomplete sequence that aSource ends
+// with, if any. A malformed sequence at the end is left for the conversion to
+// replace, since no later input can complete it.
+size_t IncompleteUTF8TailLength(Span<const char> aSource) {
+  size_t length = aSource.Length();
+  size_t limit = std::min(length, size_t(3));
+  for (size_t i = 1; i <= limit; ++i) {
+    uint8_t lead = aSource[length - i];
+    if ((lead & 0xC0) == 0x80) {
+      continue;
+    }
+    if (UTF8SequenceLength(lead) <= i) {
+      return 0;
+    }
+    for (size_t j = 1; j < i; ++j) {
+      if (!IsUTF8TrailByte(lead, j, aSource[length - i + j])) {
+        return 0;
+      }
+    }
+    return i;
+  }
+  return 0;
+}
+
+}  // namespace
+
+bool nsUTF8ToUTF16Transcoder::Append(Span<const char> aSource,
+                                     nsAString& aDest,
+                                     const mozilla::fallible_t&) {
+  if (mPendingLength) {
+    uint8_t lead = mPending[0];
+    size_t needed = UTF8SequenceLength(lead);
+    size_t consumed = 0;
+    while (mPendingLength < needed && consumed < aSource.Length() &&
+           IsUTF8TrailByte(lead, mPendingLength, aSource[consumed])) {
+      mPending[mPendingLength++] = aSource[consumed++];
+    }
+    if (mPendingLength < needed && consumed == aSource.Length()) {
+      return true;
+    }
+
+    // The sequence is either complete or cut short by a byte that can't
+    // continue it. In the latter case converting it on its own produces the
+    // single U+FFFD that converting the whole input would have, and the byte
+    // is converted afresh below.
+    if (!AppendUTF8toUTF16(MakeSpan(mPending, mPendingLength), aDest,
+                           mozilla::fallible)) {
+      return false;
+    }
+    mPendingLength = 0;
+    aSource = aSource.From(consumed);
+  }
+
+  size_t tail = IncompleteUTF8TailLength(aSource);
+  if (!AppendUTF8toUTF16(aSource.To(aSource.Length() - tail), aDest,
+                         mozilla::fallible)) {
+    return false;
+  }
+  memcpy(mPending, aSource.Elements() + aSource.Length() - tail, tail);
+  mPendingLength = tail;
+  return true;
+}
+
+void nsUTF8ToUTF16Transcoder::Append(Span<const char> aSource,
+                                     nsAString& aDest) {
+  if (MOZ_UNLIKELY(!Append(aSource, aDest, mozilla::fallible))) {
+    aDest.AllocFailed(aDest.Length() + aSource.Length() + mPendingLength);
+  }
+}
+
+bool nsUTF8ToUTF16Transcoder::Finish(nsAString& aDest,
+                                     const mozilla::fallible_t&) {
+  if (mPendingLength) {
+    if (!AppendUTF8toUTF16(MakeSpan(mPending, mPendingLength), aDest,
+                           mozilla::fallible)) {
+      return false;
+    }
+    mPendingLength = 0;
+  }
+  return true;
+}
+
+void nsUTF8ToUTF16Transcoder::Finish(nsAString& aDest) {
+  if (MOZ_UNLIKELY(!Finish(aDest, mozilla::fallible))) {
+    aDest.AllocFailed(aDest.Length() + 1);
+  }
+}
+
+bool nsUTF16ToUTF8Transcoder::Append(Span<const char16_t> aSource,
+                                     nsACString& aDest,
+                                     const mozilla::fallible_t&) {
+  if (mPendingHighSurrogate) {
+    if (aSource.IsEmpty()) {
+      return true;
+    }
+    // An unpaired high surrogate is converted on its own, which replaces it.
+    char16_t pair[2] = {mPendingHighSurrogate, aSource[0]};
+    size_t pairLength = NS_IS_LOW_SURROGATE(aSource[0]) ? 2 : 1;
+    if (!AppendUTF16toUTF8(MakeSpan(pair, pairLength), aDest,
+                           mozilla::fallible)) {
+      return false;
+    }
+    mPendingHighSurrogate = 0;
+    aSource = aSource.From(pairLength - 1);
+  }
+
+  size_t length = aSource.Length();
+  char16_t pending = 0;
+  if (length && NS_IS_HIGH_SURROGATE(aSource[length - 1])) {
+    pending = aSource[--length];
+  }
+  if (!AppendUTF16toUTF8(aSource.To(length), aDest, mozilla::fallible)) {
+    return false;
+  }
+  mPendingHighSurrogate = pending;
+  return true;
+}
+
+void nsUTF16ToUTF8Transcoder::Append(Span<const char16_t> aSource,
+                                     nsACString& aDest) {
+  if (MOZ_UNLIKELY(!Append(aSource, aDest, mozilla::fallible))) {
+    // Each code unit can take up to three bytes.
+    aDest.AllocFailed(aDest.Length() + (aSource.Length() + 1) * 3);
+  }
+}
+
+bool nsUTF16ToUTF8Transcoder::Finish(nsACString& aDest,
+                                     const mozilla::fallible_t&) {
+  if (mPendingHighSurrogate) {
+    if (!AppendUTF16toUTF8(MakeSpan(&mPendingHighSurrogate, 1), aDest,
+                           mozilla::fallible)) {
+      return false;
+    }
+    mPendingHighSurrogate = 0;
+  }
+  return true;
+}
+
+void nsUTF16ToUTF8Transcoder::Finish(nsACString& aDest) {
+  if (MOZ_UNLIKELY(!Finish(aDest, mozilla::fallible))) {
+    aDest.AllocFailed(aDest.Length() + 3);
+  }
+}
@@ -0,0 +1,89 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef nsUTFTranscoder_h
+#define nsUTFTranscoder_h
+
+#include <stdint.h>
+
+#include "mozilla/fallible.h"
+#include "mozilla/Span.h"
+#include "nsStringFwd.h"
+
+/**
+ * Incremental versions of AppendUTF8toUTF16() and AppendUTF16toUTF8() for
+ * text that arrives in pieces, such as the segments of an nsIInputStream.
+ *
+ * Each piece is converted with the same vectorized conversions as the whole
+ * string functions, and appended to the destination as it arrives, so the
+ * source never has to be buffered. A sequence split across two pieces (a
+ * multi-byte UTF-8 character, or a UTF-16 surrogate pair) is held back until
+ * the rest of it arrives; at most three bytes or one code unit are ever held.
+ *
+ * The result is the same as converting the concatenation of the pieces in one
+ * go: malformed input is replaced with U+FFFD exactly as the whole string
+ * functions do. Call Finish() after the last piece, so that a sequence left
+ * incomplete at the end of the input is replaced too. If a fallible call
+ * fails, the state is unspecified and Reset() must be called before reuse.
+ *
+ * Latin-1 has no multi-unit sequences, so AppendASCIItoUTF16() and
+ * LossyAppendUTF16toASCII() can be called piece by piece directly.
+ *
+ * Example usage:
+ *
+ *   nsUTF8ToUTF16Transcoder transcoder;
+ *   nsAutoString text;
+ *   while (...) {
+ *     transcoder.Append(MakeSpan(segment, segmentLength), text);
+ *   }
+ *   transcoder.Finish(text);
+ */
+class nsUTF8ToUTF16Transcoder {
+ public:
+  nsUTF8ToUTF16Transcoder() : mPendingLength(0) {}
+
+  void Append(mozilla::Span<const char> aSource, nsAString& aDest);
+  MOZ_MUST_USE bool Append(mozilla::Span<const char> aSource, nsAString& aDest,
+                           const mozilla::fallible_t&);
+
+  void Finish(nsAString& aDest);
+  MOZ_MUST_USE bool Finish(nsAString& aDest, const mozilla::fallible_t&);
+
+  /**
+   * Whether part of a character is being held until the next piece.
+   */
+  bool HasPending() const { return mPendingLength != 0; }
+
+  void Reset() { mPendingLength = 0; }
+
+ private:
+  // The start of a well-formed sequence that the previous piece ended in the
+  // middle of.
+  char mPending[4];
+  uint8_t mPendingLength;
+};
+
+class nsUTF16ToUTF8Transcoder {
+ public:
+  nsUTF16ToUTF8Transcoder() : mPendingHighSurrogate(0) {}
+
+  void Append(mozilla::Span<const char16_t> aSource, nsACString& aDest);
+  MOZ_MUST_USE bool Append(mozilla::Span<const char16_t> aSource,
+                           nsACString& aDest, const mozilla::fallible_t&);
+
+  void Finish(nsACString& aDest);
+  MOZ_MUST_USE bool Finish(nsACString& aDest, const mozilla::fallible_t&);
+
+  bool HasPending() const { return mPendingHighSurrogate != 0; }
+
+  void Reset() { mPendingHighSurrogate = 0; }
+
+ private:
+  // A high surrogate that ended the previous piece, or zero.
+  char16_t mPendingHighSurrogate;
+};
+
+#endif  // nsUTFTranscoder_h
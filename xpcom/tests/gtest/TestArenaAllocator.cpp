@@ -6,11 +6,18 @@
 
 #include "mozilla/ArenaAllocator.h"
 #include "mozilla/ArenaAllocatorExtensions.h"
+#include "mozilla/ThreadCachingAllocator.h"
 #include "nsIMemoryReporter.h"  // MOZ_MALLOC_SIZE_OF
+#include "nsTArray.h"
+#include "nsThreadUtils.h"
 
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
 
 using mozilla::ArenaAllocator;
+using mozilla::ThreadCachingAllocated;
+using mozilla::ThreadCachingAllocator;
+using mozilla::ThreadCachingAllocatorSizes;
 
 TEST(ArenaAllocator, Constructor)
 { ArenaAllocator<4096, 4> a; }
@@ -310,3 +317,198 @@ TEST(ArenaAllocator, Extensions)
   nsAutoCString::char_type* y_copy = mozilla::ArenaStrdup(y, a);
   EXPECT_TRUE(y.Equals(y_copy));
 }
+
+TEST(ThreadCachingAllocator, ReusesFreedBlocks)
+{
+  void* x = ThreadCachingAllocator::Allocate(40);
+  ThreadCachingAllocator::Free(x);
+
+  // 33..48 bytes share a size class, so the block should be reused.
+  void* y = ThreadCachingAllocator::Allocate(33);
+  EXPECT_EQ(x, y);
+  ThreadCachingAllocator::Free(y);
+
+  ThreadCachingAllocator::Free(nullptr);
+}
+
+TEST(ThreadCachingAllocator, SizesAndAlignment)
+{
+  nsTArray<void*> blocks;
+  for (size_t size = 1; size <= ThreadCachingAllocator::kMaxSmallSize + 64;
+       size++) {
+    void* p = ThreadCachingAllocator::Allocate(size);
+    EXPECT_EQ(uintptr_t(p) % ThreadCachingAllocator::kAlignment,
+              uintptr_t(0));
+    memset(p, 0xe5, size);
+    blocks.AppendElement(p);
+  }
+
+  for (void* p : blocks) {
+    ThreadCachingAllocator::Free(p);
+  }
+}
+
+TEST(ThreadCachingAllocator, CrossThreadFree)
+{
+  static const size_t kCount = 1000;
+  nsTArray<void*> blocks;
+  for (size_t i = 0; i < kCount; i++) {
+    blocks.AppendElement(ThreadCachingAllocator::Allocate(64));
+  }
+
+  nsCOMPtr<nsIThread> thread;
+  nsresult rv = NS_NewNamedThread(
+      "TCAFree", getter_AddRefs(thread),
+      NS_NewRunnableFunction("CrossThreadFree", [&] {
+        for (void* p : blocks) {
+          ThreadCachingAllocator::Free(p);
+        }
+      }));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  thread->Shutdown();
+
+  // The blocks went back to this thread's cache, so they get reused.
+  void* p = ThreadCachingAllocator::Allocate(64);
+  EXPECT_TRUE(blocks.Contains(p));
+  ThreadCachingAllocator::Free(p);
+}
+
+TEST(ThreadCachingAllocator, SizeOf)
+{
+  ThreadCachingAllocatorSizes before;
+  ThreadCachingAllocator::AddSizeOf(TestSizeOf, before);
+
+  nsTArray<void*> blocks;
+  for (size_t i = 0; i < 1000; i++) {
+    blocks.AppendElement(ThreadCachingAllocator::Allocate(128));
+  }
+
+  ThreadCachingAllocatorSizes during;
+  ThreadCachingAllocator::AddSizeOf(TestSizeOf, during);
+  EXPECT_GE(during.mUsed, before.mUsed + 1000 * 128);
+  EXPECT_GT(during.mOverhead, size_t(0));
+
+  for (void* p : blocks) {
+    ThreadCachingAllocator::Free(p);
+  }
+
+  ThreadCachingAllocatorSizes after;
+  ThreadCachingAllocator::AddSizeOf(TestSizeOf, after);
+  EXPECT_LT(after.mUsed, during.mUsed);
+  EXPECT_GT(after.mUnused, during.mUnused);
+}
+
+struct CachedThing : public ThreadCachingAllocated {
+  explicit CachedThing(int aValue) : mValue(aValue) {}
+  int mValue;
+  void* mPadding[3];
+};
+
+TEST(ThreadCachingAllocator, BaseClass)
+{
+  CachedThing* thing = new CachedThing(42);
+  EXPECT_EQ(thing->mValue, 42);
+  delete thing;
+
+  CachedThing* other = new (mozilla::fallible) CachedThing(7);
+  ASSERT_TRUE(other);
+  EXPECT_EQ(thing, other);
+  delete other;
+}
+
+// Allocation-rate benchmarks: a sliding window of short-lived objects of
+// mixed sizes, as with runnables and promise values.
+
+static const size_t kBenchWindow = 64;
+static const size_t kBenchIterations = 1000000;
+
+template <typename Alloc, typename Free>
+static void BenchChurn(Alloc aAlloc, Free aFree) {
+  void* window[kBenchWindow] = {};
+  for (size_t i = 0; i < kBenchIterations; i++) {
+    void*& slot = window[i % kBenchWindow];
+    aFree(slot);
+    slot = aAlloc(16 + (i % 8) * 16);
+  }
+  for (void* p : window) {
+    aFree(p);
+  }
+}
+
+MOZ_GTEST_BENCH(ThreadCachingAllocator, BenchChurnMalloc, [] {
+  BenchChurn([](size_t aSize) { return malloc(aSize); },
+             [](void* aPtr) { free(aPtr); });
+});
+
+MOZ_GTEST_BENCH(ThreadCachingAllocator, BenchChurnThreadCaching, [] {
+  BenchChurn(
+      [](size_t aSize) { return ThreadCachingAllocator::Allocate(aSize); },
+      [](void* aPtr) { ThreadCachingAllocator::Free(aPtr); });
+});
+
+// Several threads churning at once, which contends on malloc's arena locks but
+// not on the per-thread caches.
+template <typename Alloc, typename Free>
+static void BenchChurnThreads(Alloc aAlloc, Free aFree) {
+  static const size_t kThreadCount = 4;
+  nsCOMPtr<nsIThread> threads[kThreadCount];
+  for (auto& thread : threads) {
+    nsresult rv = NS_NewNamedThread(
+        "TCABench", getter_AddRefs(thread),
+        NS_NewRunnableFunction("BenchChurnThreads",
+                               [&] { BenchChurn(aAlloc, aFree); }));
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+  }
+  for (auto& thread : threads) {
+    thread->Shutdown();
+  }
+}
+
+MOZ_GTEST_BENCH(ThreadCachingAllocator, BenchChurn4ThreadsMalloc, [] {
+  BenchChurnThreads([](size_t aSize) { return malloc(aSize); },
+                    [](void* aPtr) { free(aPtr); });
+});
+
+MOZ_GTEST_BENCH(ThreadCachingAllocator, BenchChurn4ThreadsThreadCaching, [] {
+  BenchChurnThreads(
+      [](size_t aSize) { return ThreadCachingAllocator::Allocate(aSize); },
+      [](void* aPtr) { ThreadCachingAllocator::Free(aPtr); });
+});
+
+// Objects created on one thread and destroyed on another, which exercises the
+// remote free lists.
+template <typename Alloc, typename Free>
+static void BenchProducerConsumer(Alloc aAlloc, Free aFree) {
+  static const size_t kBatch = 1000;
+  nsCOMPtr<nsIThread> consumer;
+  nsresult rv = NS_NewNamedThread("TCAConsumer", getter_AddRefs(consumer));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  for (size_t round = 0; round < kBenchIterations / kBatch; round++) {
+    nsTArray<void*> batch(kBatch);
+    for (size_t i = 0; i < kBatch; i++) {
+      batch.AppendElement(aAlloc(48));
+    }
+    rv = consumer->Dispatch(
+        NS_NewRunnableFunction("BenchProducerConsumer",
+                               [aFree, batch = std::move(batch)] {
+                                 for (void* p : batch) {
+                                   aFree(p);
+                                 }
+                               }),
+        NS_DISPATCH_NORMAL);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+  }
+  consumer->Shutdown();
+}
+
+MOZ_GTEST_BENCH(ThreadCachingAllocator, BenchProducerConsumerMalloc, [] {
+  BenchProducerConsumer([](size_t aSize) { return malloc(aSize); },
+                        [](void* aPtr) { free(aPtr); });
+});
+
+MOZ_GTEST_BENCH(ThreadCachingAllocator, BenchProducerConsumerThreadCaching, [] {
+  BenchProducerConsumer(
+      [](size_t aSize) { return ThreadCachingAllocator::Allocate(aSize); },
+      [](void* aPtr) { ThreadCachingAllocator::Free(aPtr); });
+});
@@ -0,0 +1,333 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/AsyncFileIO.h"
+#include "mozilla/Atomics.h"
+#include "mozilla/Monitor.h"
+#include "nsDirectoryServiceDefs.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIFile.h"
+#include "nsIFileStreams.h"
+#include "nsISeekableStream.h"
+#include "nsNetUtil.h"
+#include "nsString.h"
+#include "nsTArray.h"
+#include "nsThreadUtils.h"
+#include "prio.h"
+
+using mozilla::AsyncFileIO;
+using mozilla::Atomic;
+
+namespace {
+
+static already_AddRefed<nsIFile> GetTestFile(const char* aName) {
+  nsCOMPtr<nsIFile> file;
+  nsresult rv = NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(file));
+  EXPECT_TRUE(NS_SUCCEEDED(rv));
+  if (NS_FAILED(rv)) {
+    return nullptr;
+  }
+  file->AppendNative(nsDependentCString(aName));
+  file->Remove(false);
+  return file.forget();
+}
+
+static void FillData(nsTArray<char>& aData, uint32_t aLength) {
+  aData.SetLength(aLength);
+  for (uint32_t i = 0; i < aLength; ++i) {
+    aData[i] = char((i * 2654435761u) >> 13);
+  }
+}
+
+// Creates aFile containing aData, with plain synchronous I/O.
+static void WriteTestFile(nsIFile* aFile, const nsTArray<char>& aData) {
+  PRFileDesc* fd;
+  ASSERT_TRUE(NS_SUCCEEDED(aFile->OpenNSPRFileDesc(
+      PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE, 0600, &fd)));
+  ASSERT_EQ(PR_Write(fd, aData.Elements(), aData.Length()),
+            int32_t(aData.Length()));
+  PR_Close(fd);
+}
+
+}  // namespace
+
+TEST(AsyncFileIO, RoundTrip)
+{
+  RefPtr<AsyncFileIO> io = AsyncFileIO::Get();
+  ASSERT_TRUE(io);
+  nsCOMPtr<nsIEventTarget> target = GetCurrentThreadEventTarget();
+
+  nsCOMPtr<nsIFile> file = GetTestFile("asyncfileio-roundtrip");
+  ASSERT_TRUE(file);
+
+  bool done = false;
+  PRFileDesc* fd = nullptr;
+  io->Open(file, PR_RDWR | PR_CREATE_FILE | PR_TRUNCATE, 0600, target,
+           [&](nsresult aStatus, PRFileDesc* aFD) {
+             EXPECT_TRUE(NS_SUCCEEDED(aStatus));
+             EXPECT_TRUE(NS_IsMainThread());
+             fd = aFD;
+             done = true;
+           });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return done; }));
+  ASSERT_TRUE(fd);
+
+  nsTArray<char> data;
+  FillData(data, 1024 * 1024);
+
+  done = false;
+  io->Write(fd, 0, data.Elements(), data.Length(), target,
+            [&](nsresult aStatus, uint32_t aBytes) {
+              EXPECT_TRUE(NS_SUCCEEDED(aStatus));
+              EXPECT_EQ(aBytes, data.Length());
+              done = true;
+            });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return done; }));
+
+  done = false;
+  io->Sync(fd, target, [&](nsresult aStatus, uint32_t aBytes) {
+    EXPECT_TRUE(NS_SUCCEEDED(aStatus));
+    done = true;
+  });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return done; }));
+
+  // Read a few pieces at once, including one that runs off the end of the
+  // file and one that starts past it.
+  const int64_t offsets[] = {0, 4093, 512 * 1024, 1024 * 1024 - 100,
+                             2 * 1024 * 1024};
+  const uint32_t kCount = 4096;
+  const uint32_t kReads = mozilla::ArrayLength(offsets);
+  nsTArray<char> buffers;
+  buffers.SetLength(kReads * kCount);
+  uint32_t completed = 0;
+  for (uint32_t i = 0; i < kReads; ++i) {
+    int64_t offset = offsets[i];
+    char* buffer = buffers.Elements() + i * kCount;
+    io->Read(fd, offset, buffer, kCount, target,
+             [&, offset, buffer](nsresult aStatus, uint32_t aBytes) {
+               EXPECT_TRUE(NS_SUCCEEDED(aStatus));
+               int64_t expected = std::max<int64_t>(
+                   0, std::min<int64_t>(kCount, data.Length() - offset));
+               EXPECT_EQ(int64_t(aBytes), expected);
+               if (expected) {
+                 EXPECT_EQ(memcmp(buffer, data.Elements() + offset, aBytes),
+                           0);
+               }
+               ++completed;
+             });
+  }
+  MOZ_ALWAYS_TRUE(
+      mozilla::SpinEventLoopUntil([&]() { return completed == kReads; }));
+
+  done = false;
+  io->Close(fd, target, [&](nsresult aStatus, uint32_t aBytes) {
+    EXPECT_TRUE(NS_SUCCEEDED(aStatus));
+    done = true;
+  });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return done; }));
+
+  EXPECT_EQ(io->PendingCount(), 0u);
+  file->Remove(false);
+}
+
+TEST(AsyncFileIO, Errors)
+{
+  RefPtr<AsyncFileIO> io = AsyncFileIO::Get();
+  ASSERT_TRUE(io);
+  nsCOMPtr<nsIEventTarget> target = GetCurrentThreadEventTarget();
+
+  nsCOMPtr<nsIFile> file = GetTestFile("asyncfileio-missing");
+  ASSERT_TRUE(file);
+
+  bool done = false;
+  io->Open(file, PR_RDONLY, 0, target,
+           [&](nsresult aStatus, PRFileDesc* aFD) {
+             EXPECT_TRUE(NS_FAILED(aStatus));
+             EXPECT_FALSE(aFD);
+             done = true;
+           });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return done; }));
+
+  // Writing to a file opened read-only fails.
+  nsTArray<char> data;
+  FillData(data, 100);
+  WriteTestFile(file, data);
+  PRFileDesc* fd;
+  ASSERT_TRUE(NS_SUCCEEDED(file->OpenNSPRFileDesc(PR_RDONLY, 0, &fd)));
+
+  done = false;
+  io->Write(fd, 0, data.Elements(), data.Length(), target,
+            [&](nsresult aStatus, uint32_t aBytes) {
+              EXPECT_TRUE(NS_FAILED(aStatus));
+              done = true;
+            });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return done; }));
+
+  // Callbacks for a target which has gone away still get called, with an
+  // error, and without a file.
+  nsCOMPtr<nsIThread> thread;
+  ASSERT_TRUE(NS_SUCCEEDED(
+      NS_NewNamedThread("AsyncFileIO Test", getter_AddRefs(thread))));
+  thread->Shutdown();
+  Atomic<bool> called(false);
+  io->Open(file, PR_RDONLY, 0, thread,
+           [&](nsresult aStatus, PRFileDesc* aFD) {
+             EXPECT_EQ(aStatus, NS_ERROR_NOT_AVAILABLE);
+             EXPECT_FALSE(aFD);
+             called = true;
+           });
+  MOZ_ALWAYS_TRUE(mozilla::SpinEventLoopUntil([&]() { return !!called; }));
+
+  PR_Close(fd);
+  file->Remove(false);
+}
+
+TEST(AsyncFileIO, FileInputStreamReadAhead)
+{
+  nsCOMPtr<nsIFile> file = GetTestFile("asyncfileio-readahead");
+  ASSERT_TRUE(file);
+
+  nsTArray<char> data;
+  FillData(data, 300 * 1024 + 17);
+  WriteTestFile(file, data);
+
+  nsCOMPtr<nsIInputStream> stream;
+  ASSERT_TRUE(NS_SUCCEEDED(NS_NewLocalFileInputStream(
+      getter_AddRefs(stream), file, -1, -1,
+      nsIFileInputStream::READ_AHEAD)));
+  nsCOMPtr<nsISeekableStream> seekable = do_QueryInterface(stream);
+  ASSERT_TRUE(seekable);
+
+  // Read in odd sizes, seeking back and forth now and then, and check that
+  // the position and the data always agree with a plain read.
+  nsTArray<char> buffer;
+  buffer.SetLength(70000);
+  int64_t position = 0;
+  uint32_t readCount = 0;
+  while (true) {
+    uint32_t count = 1 + (readCount * 7919) % buffer.Length();
+    uint32_t read;
+    ASSERT_TRUE(NS_SUCCEEDED(stream->Read(buffer.Elements(), count, &read)));
+    if (!read) {
+      break;
+    }
+    ASSERT_LE(position + read, int64_t(data.Length()));
+    ASSERT_EQ(memcmp(buffer.Elements(), data.Elements() + position, read), 0);
+    position += read;
+
+    int64_t tell;
+    ASSERT_TRUE(NS_SUCCEEDED(seekable->Tell(&tell)));
+    ASSERT_EQ(tell, position);
+
+    uint64_t available;
+    ASSERT_TRUE(NS_SUCCEEDED(stream->Available(&available)));
+    ASSERT_EQ(int64_t(available), int64_t(data.Length()) - position);
+
+    if (++readCount % 5 == 0) {
+      position = position > 1000 ? position - 1000 : position + 1000;
+      ASSERT_TRUE(NS_SUCCEEDED(
+          seekable->Seek(nsISeekableStream::NS_SEEK_SET, position)));
+    }
+  }
+  EXPECT_EQ(position, int64_t(data.Length()));
+
+  stream->Close();
+  file->Remove(false);
+}
+
+class AsyncFileIOBench : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kFileSize = 64 * 1024 * 1024;
+  static constexpr uint32_t kBlockSize = 4096;
+  static constexpr uint32_t kReadCount = 20000;
+  static constexpr uint32_t kInFlight = 64;
+
+  void SetUp() override {
+    mFile = GetTestFile("asyncfileio-bench");
+    ASSERT_TRUE(mFile);
+    nsTArray<char> data;
+    FillData(data, kFileSize);
+    WriteTestFile(mFile, data);
+    ASSERT_TRUE(
+        NS_SUCCEEDED(mFile->OpenNSPRFileDesc(PR_RDONLY, 0, &mFD)));
+
+    mOffsets.SetLength(kReadCount);
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < kReadCount; ++i) {
+      seed = seed * 1103515245 + 12345;
+      mOffsets[i] = int64_t(seed % (kFileSize / kBlockSize)) * kBlockSize;
+    }
+    mBuffers.SetLength(kInFlight * kBlockSize);
+  }
+
+  void TearDown() override {
+    if (mFD) {
+      PR_Close(mFD);
+    }
+    if (mFile) {
+      mFile->Remove(false);
+    }
+  }
+
+  nsCOMPtr<nsIFile> mFile;
+  PRFileDesc* mFD = nullptr;
+  nsTArray<int64_t> mOffsets;
+  nsTArray<char> mBuffers;
+};
+
+// Random 4K reads, one at a time.
+MOZ_GTEST_BENCH_F(AsyncFileIOBench, RandomReadSync, [this] {
+  for (uint32_t i = 0; i < kReadCount; ++i) {
+    ASSERT_NE(PR_Seek64(mFD, mOffsets[i], PR_SEEK_SET), -1);
+    ASSERT_EQ(PR_Read(mFD, mBuffers.Elements(), kBlockSize),
+              int32_t(kBlockSize));
+  }
+});
+
+// The same reads with kInFlight of them in flight at a time.
+MOZ_GTEST_BENCH_F(AsyncFileIOBench, RandomReadAsync, [this] {
+  RefPtr<AsyncFileIO> io = AsyncFileIO::Get();
+  ASSERT_TRUE(io);
+
+  Atomic<uint32_t> completed(0);
+  Atomic<uint32_t> failed(0);
+  mozilla::Monitor monitor("AsyncFileIOBench");
+  uint32_t inFlight = 0;
+  for (uint32_t i = 0; i < kReadCount; ++i) {
+    {
+      mozilla::MonitorAutoLock lock(monitor);
+      while (inFlight == kInFlight) {
+        lock.Wait();
+      }
+      ++inFlight;
+    }
+    // The data isn't looked at, so it doesn't matter if a buffer is still
+    // being read into when it's reused.
+    char* buffer = mBuffers.Elements() + (i % kInFlight) * kBlockSize;
+    io->Read(mFD, mOffsets[i], buffer, kBlockSize, nullptr,
+             [&](nsresult aStatus, uint32_t aBytes) {
+               if (NS_FAILED(aStatus) || aBytes != kBlockSize) {
+                 ++failed;
+               }
+               ++completed;
+               mozilla::MonitorAutoLock lock(monitor);
+               --inFlight;
+               lock.Notify();
+             });
+  }
+  {
+    mozilla::MonitorAutoLock lock(monitor);
+    while (inFlight) {
+      lock.Wait();
+    }
+  }
+  ASSERT_EQ(uint32_t(completed), kReadCount);
+  ASSERT_EQ(uint32_t(failed), 0u);
+});
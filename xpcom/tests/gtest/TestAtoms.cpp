@@ -8,10 +8,12 @@
 
 #include "nsAtom.h"
 #include "nsString.h"
+#include "nsTArray.h"
 #include "UTFStrings.h"
 #include "nsThreadUtils.h"
 
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
 
 using namespace mozilla;
 
@@ -175,4 +177,102 @@ TEST(Atoms, ConcurrentAccessing)
   EXPECT_EQ(NS_GetUnusedAtomCount(), int32_t(1));
 }
 
+static const size_t kSharedAtomCount = 1000;
+
+static void MakeSharedAtomNames(nsTArray<nsString>& aNames) {
+  for (size_t i = 0; i < kSharedAtomCount; i++) {
+    nsString* name = aNames.AppendElement();
+    name->AppendLiteral("shared-atom-");
+    name->AppendInt(uint32_t(i));
+  }
+}
+
+// Atomizes a shared set of strings from several threads while the main thread
+// keeps GCing the atom table, so that lookups race with atoms being inserted,
+// removed and resurrected.
+TEST(Atoms, ConcurrentAtomizeAndGC)
+{
+  static const size_t kThreadCount = 4;
+  nsTArray<nsString> names;
+  MakeSharedAtomNames(names);
+
+  // Keep every other atom alive on the main thread; the rest come and go.
+  nsTArray<RefPtr<nsAtom>> held;
+  for (size_t i = 0; i < kSharedAtomCount; i += 2) {
+    held.AppendElement(NS_Atomize(names[i]));
+  }
+
+  Atomic<bool> mismatch(false);
+  nsCOMPtr<nsIThread> threads[kThreadCount];
+  for (size_t t = 0; t < kThreadCount; t++) {
+    nsresult rv = NS_NewNamedThread(
+        "Atomizer", getter_AddRefs(threads[t]),
+        NS_NewRunnableFunction("ConcurrentAtomizeAndGC", [&, t] {
+          for (int round = 0; round < 20; round++) {
+            for (size_t i = t; i < kSharedAtomCount; i++) {
+              RefPtr<nsAtom> atom = NS_Atomize(names[i]);
+              if (!atom->Equals(names[i]) ||
+                  (i % 2 == 0 && atom != held[i / 2])) {
+                mismatch = true;
+              }
+            }
+          }
+        }));
+    EXPECT_TRUE(NS_SUCCEEDED(rv));
+  }
+
+  for (int i = 0; i < 50; i++) {
+    NS_GetNumberOfAtoms();  // Forces a GC.
+  }
+
+  for (size_t t = 0; t < kThreadCount; t++) {
+    threads[t]->Shutdown();
+  }
+  EXPECT_FALSE(mismatch);
+
+  for (size_t i = 0; i < kSharedAtomCount; i += 2) {
+    RefPtr<nsAtom> atom = NS_Atomize(names[i]);
+    EXPECT_EQ(atom, held[i / 2]);
+  }
+}
+
+// Measures atomization of strings that are already in the table from several
+// threads at once, which is what parallel CSS parsing does.
+static void BenchConcurrentAtomize(size_t aThreadCount) {
+  nsTArray<nsString> names;
+  MakeSharedAtomNames(names);
+
+  nsTArray<RefPtr<nsAtom>> held;
+  for (const nsString& name : names) {
+    held.AppendElement(NS_Atomize(name));
+  }
+
+  nsTArray<nsCOMPtr<nsIThread>> threads;
+  for (size_t t = 0; t < aThreadCount; t++) {
+    nsCOMPtr<nsIThread> thread;
+    nsresult rv = NS_NewNamedThread(
+        "AtomizeBench", getter_AddRefs(thread),
+        NS_NewRunnableFunction("BenchConcurrentAtomize", [&] {
+          for (int round = 0; round < 200; round++) {
+            for (const nsString& name : names) {
+              RefPtr<nsAtom> atom = NS_Atomize(name);
+            }
+          }
+        }));
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    threads.AppendElement(thread);
+  }
+
+  for (auto& thread : threads) {
+    thread->Shutdown();
+  }
+}
+
+MOZ_GTEST_BENCH(Atoms, BenchAtomizeExisting1Thread,
+                [] { BenchConcurrentAtomize(1); });
+MOZ_GTEST_BENCH(Atoms, BenchAtomizeExisting4Threads,
+                [] { BenchConcurrentAtomize(4); });
+MOZ_GTEST_BENCH(Atoms, BenchAtomizeExisting8Threads,
+                [] { BenchConcurrentAtomize(8); });
+
 }  // namespace TestAtoms
@@ -5,12 +5,15 @@
 
 #include "mozilla/Attributes.h"
 #include "mozilla/Base64.h"
+#include "mozilla/Unused.h"
 #include "nsComponentManagerUtils.h"
 #include "nsIScriptableBase64Encoder.h"
 #include "nsIInputStream.h"
 #include "nsString.h"
 
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+#include "gtest/BlackBox.h"
 
 struct Chunk {
   Chunk(uint32_t l, const char* c) : mLength(l), mData(c) {}
@@ -58,6 +61,15 @@ static Chunk kTest8Chunks[] = {Chunk(5, "ALL T"),
                                Chunk(25, "ATTEMPT NO LANDING THERE."),
                                Chunk(0, nullptr)};
 
+static Chunk kTest9Chunks[] = {Chunk(1, "B"), Chunk(1, "o"), Chunk(1, "b"),
+                               Chunk(0, nullptr)};
+
+// Long enough for the vectorized encoder to kick in after a carryover.
+static Chunk kTest10Chunks[] = {
+    Chunk(1, ">"),
+    Chunk(61, "The quick brown fox jumps over the lazy dog, again and again."),
+    Chunk(1, "!"), Chunk(0, nullptr)};
+
 static Test kTests[] = {
     // Test 1, test a simple round string in one chunk
     Test(kTest1Chunks, "SGVsbG8gc2ly"),
@@ -77,6 +89,12 @@ static Test kTests[] = {
     Test(kTest8Chunks,
          "QUxMIFRIRVNFIFdPUkxEUyBBUkUgWU9VUlMgRVhDRVBUIEVVUk9QQS4gQVRURU1QVCBOT"
          "yBMQU5ESU5HIFRIRVJFLg=="),
+    // Test 9, test single-byte chunks carrying over into each other
+    Test(kTest9Chunks, "Qm9i"),
+    // Test 10, test a long chunk between two carryovers
+    Test(kTest10Chunks,
+         "PlRoZSBxdWljayBicm93biBmb3gganVtcHMgb3ZlciB0aGUgbGF6eSBkb2csIGFnYWl"
+         "uIGFuZCBhZ2Fpbi4h"),
     // Terminator
     Test(nullptr, nullptr)};
 
@@ -407,4 +425,125 @@ TEST(Base64, TruncateOnInvalidDecodeWideString)
   ASSERT_EQ(out.Length(), 0u);
 }
 
+// Fills aBinary with aLength bytes that cover every possible byte value.
+static void FillBinary(nsACString& aBinary, uint32_t aLength) {
+  aBinary.SetLength(aLength);
+  char* data = aBinary.BeginWriting();
+  for (uint32_t i = 0; i < aLength; i++) {
+    data[i] = char((i * 167 + 13) & 0xff);
+  }
+}
+
+TEST(Base64, LongInputsMatchWideString)
+{
+  // The 16-bit code paths are never vectorized, so use them as a reference for
+  // every length around the vector block sizes.
+  for (uint32_t length = 0; length < 200; length++) {
+    nsAutoCString binary;
+    FillBinary(binary, length);
+
+    nsAutoCString encoded;
+    nsresult rv = mozilla::Base64Encode(binary, encoded);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+    nsAutoString wideEncoded;
+    rv = mozilla::Base64Encode(NS_ConvertASCIItoUTF16(binary), wideEncoded);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    ASSERT_TRUE(wideEncoded.EqualsASCII(encoded.get()));
+
+    nsAutoCString decoded;
+    rv = mozilla::Base64Decode(encoded, decoded);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    ASSERT_TRUE(decoded.Equals(binary));
+  }
+}
+
+TEST(Base64, LongURLRoundTrip)
+{
+  for (uint32_t length = 0; length < 200; length++) {
+    nsAutoCString binary;
+    FillBinary(binary, length);
+
+    nsAutoCString encoded;
+    nsresult rv = mozilla::Base64URLEncode(
+        length, reinterpret_cast<const uint8_t*>(binary.get()),
+        mozilla::Base64URLEncodePaddingPolicy::Omit, encoded);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+    nsAutoCString standard;
+    rv = mozilla::Base64Encode(binary, standard);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    standard.ReplaceChar('+', '-');
+    standard.ReplaceChar('/', '_');
+    standard.Trim("=", false, true);
+    ASSERT_TRUE(encoded.Equals(standard));
+
+    FallibleTArray<uint8_t> decoded;
+    rv = mozilla::Base64URLDecode(
+        encoded, mozilla::Base64URLDecodePaddingPolicy::Reject, decoded);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    ASSERT_EQ(decoded.Length(), length);
+    ASSERT_EQ(memcmp(decoded.Elements(), binary.get(), length), 0);
+  }
+}
+
+TEST(Base64, InvalidCharacterInLongInput)
+{
+  nsAutoCString binary;
+  FillBinary(binary, 300);
+  nsAutoCString encoded;
+  nsresult rv = mozilla::Base64Encode(binary, encoded);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  for (uint32_t i = 0; i < encoded.Length() - 2; i += 7) {
+    for (char invalid : {'@', '-', '\x80', '\0'}) {
+      nsAutoCString corrupted(encoded);
+      corrupted.SetCharAt(invalid, i);
+      nsAutoCString out;
+      rv = mozilla::Base64Decode(corrupted, out);
+      ASSERT_TRUE(NS_FAILED(rv));
+      ASSERT_EQ(out.Length(), 0u);
+    }
+  }
+}
+
+class Base64Bench : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FillBinary(mBinary, 1024 * 1024);
+    ASSERT_TRUE(NS_SUCCEEDED(mozilla::Base64Encode(mBinary, mEncoded)));
+  }
+
+  nsCString mBinary;
+  nsCString mEncoded;
+};
+
+// Each iteration processes 1 MiB of binary data, so throughput in MiB/s is
+// 1000 * iterations / time in ms.
+#define BASE64_BENCH_ITERATIONS 50
+
+MOZ_GTEST_BENCH_F(Base64Bench, Encode1MiB, [this] {
+  for (int i = 0; i < BASE64_BENCH_ITERATIONS; i++) {
+    nsAutoCString out;
+    mozilla::Unused << mozilla::Base64Encode(*mozilla::BlackBox(&mBinary), out);
+  }
+});
+
+MOZ_GTEST_BENCH_F(Base64Bench, Decode1MiB, [this] {
+  for (int i = 0; i < BASE64_BENCH_ITERATIONS; i++) {
+    nsAutoCString out;
+    mozilla::Unused << mozilla::Base64Decode(*mozilla::BlackBox(&mEncoded),
+                                             out);
+  }
+});
+
+MOZ_GTEST_BENCH_F(Base64Bench, URLEncode1MiB, [this] {
+  for (int i = 0; i < BASE64_BENCH_ITERATIONS; i++) {
+    nsAutoCString out;
+    mozilla::Unused << mozilla::Base64URLEncode(
+        mBinary.Length(), reinterpret_cast<const uint8_t*>(mBinary.get()),
+        mozilla::Base64URLEncodePaddingPolicy::Omit, out);
+  }
+});
+
 // TODO: Add tests for OOM handling.
@@ -7,6 +7,7 @@
 #include "nsEscape.h"
 #include "gtest/gtest.h"
 #include "mozilla/ArrayUtils.h"
+#include "nsASCIIMask.h"
 
 using namespace mozilla;
 
@@ -142,3 +143,106 @@ TEST(Escape, EscapeSpaces)
   EXPECT_EQ(rv, NS_OK);
   EXPECT_STREQ(escaped.BeginReading(), "data:%0D%0A%20spa%20ces%C4%9F");
 }
+
+// Long enough for the vectorized scans, with a tail they leave to the scalar
+// code.
+static const char kLongClean[] =
+    "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-_.~!";
+
+TEST(Escape, LongStrings)
+{
+  const size_t length = ArrayLength(kLongClean) - 1;
+
+  // Nothing to escape: the result shares the buffer.
+  nsCString clean(kLongClean);
+  nsCString escaped;
+  nsresult rv = NS_EscapeURL(clean, esc_OnlyNonASCII, escaped, fallible);
+  EXPECT_EQ(rv, NS_OK);
+  EXPECT_EQ(clean.BeginReading(), escaped.BeginReading());
+
+  nsCString html;
+  nsAppendEscapedHTML(clean, html);
+  EXPECT_EQ(clean.BeginReading(), html.BeginReading());
+
+  // A character needing attention at every position.
+  for (size_t i = 0; i <= length; i++) {
+    nsCString src(Substring(kLongClean, i));
+    src.Append(' ');
+    src.Append(kLongClean + i);
+
+    nsCString expected(Substring(kLongClean, i));
+    expected.AppendLiteral("%20");
+    expected.Append(kLongClean + i);
+    escaped.Truncate();
+    rv = NS_EscapeURL(src, esc_OnlyNonASCII | esc_Spaces, escaped, fallible);
+    EXPECT_EQ(rv, NS_OK);
+    EXPECT_TRUE(escaped.Equals(expected));
+
+    nsCString unescaped;
+    NS_UnescapeURL(expected, 0, unescaped);
+    EXPECT_TRUE(unescaped.Equals(src));
+
+    src.SetCharAt('\t', i);
+    expected.Assign(Substring(kLongClean, i));
+    expected.Append(kLongClean + i);
+    escaped.Truncate();
+    rv = NS_EscapeAndFilterURL(src, esc_OnlyNonASCII,
+                               &ASCIIMask::MaskCRLFTab(), escaped, fallible);
+    EXPECT_EQ(rv, NS_OK);
+    EXPECT_TRUE(escaped.Equals(expected));
+
+    src.SetCharAt('<', i);
+    expected.Assign(Substring(kLongClean, i));
+    expected.AppendLiteral("&lt;");
+    expected.Append(kLongClean + i);
+    html.Truncate();
+    nsAppendEscapedHTML(src, html);
+    EXPECT_TRUE(html.Equals(expected));
+  }
+}
+
+TEST(Escape, LongStringsUTF16)
+{
+  const size_t length = ArrayLength(kLongClean) - 1;
+  NS_ConvertASCIItoUTF16 clean(kLongClean);
+
+  for (size_t i = 0; i <= length; i++) {
+    // U+011F, and a character whose low byte is ASCII.
+    nsAutoString src(Substring(clean, 0, i));
+    src.Append(char16_t(0x011F));
+    src.Append(Substring(clean, i));
+    src.Append(char16_t(0x4E41));
+
+    nsAutoString expected(Substring(clean, 0, i));
+    expected.AppendLiteral("%u011F");
+    expected.Append(Substring(clean, i));
+    expected.AppendLiteral("%u4E41");
+
+    nsAutoString result;
+    EXPECT_TRUE(NS_EscapeURL(src, esc_OnlyNonASCII, result).Equals(expected));
+
+    // Unless they are asked to be left alone.
+    result.Truncate();
+    EXPECT_EQ(&NS_EscapeURL(src, esc_OnlyASCII | esc_Directory, result), &src);
+  }
+}
+
+TEST(Escape, PipeAfterNonASCII)
+{
+  // A '|' after non-ASCII bytes may be part of a multi-byte character and so
+  // is escaped, even in a run the vectorized scan would otherwise skip.
+  nsCString src(kLongClean);
+  src.Append("\xC4|");
+  src.Append(kLongClean);
+  src.Append('|');
+
+  nsCString expected(kLongClean);
+  expected.Append("%C4%7C");
+  expected.Append(kLongClean);
+  expected.Append('|');
+
+  nsCString escaped;
+  nsresult rv = NS_EscapeURL(src, esc_Query, escaped, fallible);
+  EXPECT_EQ(rv, NS_OK);
+  EXPECT_TRUE(escaped.Equals(expected));
+}
@@ -3,15 +3,25 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <string.h>
+
 #include "prio.h"
 #include "prsystem.h"
 
+#ifdef XP_UNIX
+#  include <unistd.h>
+#endif
+
+#include "mozilla/DirectoryReader.h"
+#include "nsIDirectoryEnumerator.h"
 #include "nsIFile.h"
 #include "nsString.h"
+#include "nsPrintfCString.h"
 #include "nsDirectoryServiceDefs.h"
 #include "nsDirectoryServiceUtils.h"
 
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
 
 static bool VerifyResult(nsresult aRV, const char* aMsg) {
   bool failed = NS_FAILED(aRV);
@@ -441,3 +451,247 @@ TEST(TestFile, Tests)
   rv = base->Remove(true);
   VerifyResult(rv, "Cleaning up temp directory");
 }
+
+// Creates an empty directory called aName in the temp directory.
+static already_AddRefed<nsIFile> CreateTestDirectory(const char* aName) {
+  nsCOMPtr<nsIFile> dir;
+  nsresult rv = NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(dir));
+  if (!VerifyResult(rv, "Getting temp directory")) {
+    return nullptr;
+  }
+  rv = dir->AppendNative(nsDependentCString(aName));
+  if (!VerifyResult(rv, "Appending test directory name")) {
+    return nullptr;
+  }
+  dir->Remove(true);
+  rv = dir->Create(nsIFile::DIRECTORY_TYPE, 0700);
+  if (!VerifyResult(rv, "Creating test directory")) {
+    return nullptr;
+  }
+  return dir.forget();
+}
+
+// Creates a file called aName in aDir containing aLength bytes.
+static bool CreateTestFile(nsIFile* aDir, const nsACString& aName,
+                           uint32_t aLength) {
+  nsCOMPtr<nsIFile> file = NewFile(aDir);
+  nsresult rv = file->AppendNative(aName);
+  if (!VerifyResult(rv, "AppendNative")) {
+    return false;
+  }
+  PRFileDesc* fd;
+  rv = file->OpenNSPRFileDesc(PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE, 0600,
+                              &fd);
+  if (!VerifyResult(rv, "OpenNSPRFileDesc")) {
+    return false;
+  }
+  nsAutoCString data;
+  data.SetLength(aLength);
+  memset(data.BeginWriting(), 'x', aLength);
+  bool ok = PR_Write(fd, data.get(), aLength) == int32_t(aLength);
+  PR_Close(fd);
+  return ok;
+}
+
+TEST(TestFile, DirectoryReader)
+{
+  using mozilla::DirectoryEntry;
+  using mozilla::DirectoryReader;
+
+  nsCOMPtr<nsIFile> base = CreateTestDirectory("mozdirreadertests");
+  ASSERT_TRUE(base);
+
+  const uint32_t kFileCount = 100;
+  for (uint32_t i = 0; i < kFileCount; ++i) {
+    nsPrintfCString name("file%u", i);
+    ASSERT_TRUE(CreateTestFile(base, name, i));
+  }
+  nsCOMPtr<nsIFile> subdir = NewFile(base);
+  ASSERT_TRUE(VerifyResult(subdir->AppendNative(NS_LITERAL_CSTRING("subdir")),
+                           "AppendNative"));
+  ASSERT_TRUE(VerifyResult(subdir->Create(nsIFile::DIRECTORY_TYPE, 0700),
+                           "Creating subdirectory"));
+
+  for (uint32_t flags : {DirectoryReader::eNone, DirectoryReader::eStat}) {
+    DirectoryReader reader(flags);
+    ASSERT_TRUE(VerifyResult(reader.Open(base), "DirectoryReader::Open"));
+
+    uint32_t files = 0;
+    uint32_t dirs = 0;
+    DirectoryEntry entry;
+    bool hasEntry;
+    nsresult rv;
+    while (NS_SUCCEEDED(rv = reader.Next(entry, &hasEntry)) && hasEntry) {
+      // The entry should describe the same file nsIFile does.
+      nsCOMPtr<nsIFile> file;
+      ASSERT_TRUE(VerifyResult(reader.GetFile(entry, getter_AddRefs(file)),
+                               "DirectoryReader::GetFile"));
+
+      nsAutoCString nativeLeafName;
+      ASSERT_TRUE(
+          VerifyResult(file->GetNativeLeafName(nativeLeafName), "Leaf name"));
+      EXPECT_TRUE(entry.mNativeLeafName.Equals(nativeLeafName));
+
+      nsAutoString leafName;
+      nsAutoString expectedLeafName;
+      ASSERT_TRUE(VerifyResult(entry.GetLeafName(leafName), "Leaf name"));
+      ASSERT_TRUE(
+          VerifyResult(file->GetLeafName(expectedLeafName), "Leaf name"));
+      EXPECT_TRUE(leafName.Equals(expectedLeafName));
+
+      bool isDirectory;
+      ASSERT_TRUE(VerifyResult(file->IsDirectory(&isDirectory), "IsDirectory"));
+      EXPECT_EQ(entry.IsDirectory(), isDirectory);
+      EXPECT_EQ(entry.IsFile(), !isDirectory);
+
+      if (isDirectory) {
+        EXPECT_TRUE(entry.mNativeLeafName.EqualsLiteral("subdir"));
+        ++dirs;
+      } else {
+        ++files;
+      }
+
+      if (flags & DirectoryReader::eStat) {
+        int64_t size;
+        ASSERT_TRUE(VerifyResult(file->GetFileSize(&size), "GetFileSize"));
+        EXPECT_EQ(entry.mFileSize, size);
+
+        PRTime lastModified;
+        ASSERT_TRUE(VerifyResult(file->GetLastModifiedTime(&lastModified),
+                                 "GetLastModifiedTime"));
+        EXPECT_EQ(entry.mLastModifiedTime, lastModified);
+      }
+    }
+    EXPECT_TRUE(VerifyResult(rv, "DirectoryReader::Next"));
+    EXPECT_EQ(files, kFileCount);
+    EXPECT_EQ(dirs, 1u);
+
+    // The reader stays at the end.
+    EXPECT_TRUE(VerifyResult(reader.Next(entry, &hasEntry), "Next at end"));
+    EXPECT_FALSE(hasEntry);
+  }
+
+  // Opening something that isn't a directory fails.
+  DirectoryReader reader;
+  nsCOMPtr<nsIFile> missing = NewFile(base);
+  missing->AppendNative(NS_LITERAL_CSTRING("missing"));
+  EXPECT_TRUE(NS_FAILED(reader.Open(missing)));
+
+  VerifyResult(base->Remove(true), "Cleaning up temp directory");
+}
+
+#ifdef XP_UNIX
+TEST(TestFile, DirectoryReaderStatError)
+{
+  using mozilla::DirectoryEntry;
+  using mozilla::DirectoryReader;
+
+  nsCOMPtr<nsIFile> base = CreateTestDirectory("mozdirreaderstaterror");
+  ASSERT_TRUE(base);
+
+  // A symlink to itself can't be stat'ed, but unlike a dangling one it
+  // doesn't fail with ENOENT, so it must neither be skipped nor end the
+  // enumeration.
+  nsAutoCString loopPath;
+  ASSERT_TRUE(VerifyResult(base->GetNativePath(loopPath), "GetNativePath"));
+  loopPath.AppendLiteral("/loop");
+  ASSERT_EQ(symlink(loopPath.get(), loopPath.get()), 0);
+  ASSERT_TRUE(CreateTestFile(base, NS_LITERAL_CSTRING("file"), 10));
+
+  for (uint32_t flags : {DirectoryReader::eNone, DirectoryReader::eStat}) {
+    DirectoryReader reader(flags);
+    ASSERT_TRUE(VerifyResult(reader.Open(base), "DirectoryReader::Open"));
+
+    bool sawLoop = false;
+    bool sawFile = false;
+    DirectoryEntry entry;
+    bool hasEntry;
+    nsresult rv;
+    while (NS_SUCCEEDED(rv = reader.Next(entry, &hasEntry)) && hasEntry) {
+      if (entry.mNativeLeafName.EqualsLiteral("loop")) {
+        EXPECT_TRUE(NS_FAILED(entry.mStatResult));
+        EXPECT_FALSE(entry.IsFile());
+        EXPECT_FALSE(entry.IsDirectory());
+        EXPECT_EQ(entry.mFileSize, 0);
+        EXPECT_EQ(entry.mLastModifiedTime, 0);
+        sawLoop = true;
+      } else {
+        EXPECT_TRUE(entry.mNativeLeafName.EqualsLiteral("file"));
+        EXPECT_TRUE(VerifyResult(entry.mStatResult, "mStatResult"));
+        EXPECT_TRUE(entry.IsFile());
+        if (flags & DirectoryReader::eStat) {
+          EXPECT_EQ(entry.mFileSize, 10);
+        }
+        sawFile = true;
+      }
+    }
+    EXPECT_TRUE(VerifyResult(rv, "DirectoryReader::Next"));
+    EXPECT_TRUE(sawLoop);
+    EXPECT_TRUE(sawFile);
+  }
+
+  VerifyResult(base->Remove(true), "Cleaning up temp directory");
+}
+#endif
+
+// Compares reading the names, types, sizes and modification times of a large
+// directory with DirectoryReader and with an nsIDirectoryEnumerator.
+class DirectoryReaderBench : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kFileCount = 10000;
+
+  void SetUp() override {
+    mDir = CreateTestDirectory("mozdirreaderbench");
+    ASSERT_TRUE(mDir);
+    for (uint32_t i = 0; i < kFileCount; ++i) {
+      ASSERT_TRUE(CreateTestFile(mDir, nsPrintfCString("%08x", i), i % 64));
+    }
+  }
+
+  void TearDown() override {
+    if (mDir) {
+      mDir->Remove(true);
+    }
+  }
+
+  nsCOMPtr<nsIFile> mDir;
+};
+
+MOZ_GTEST_BENCH_F(DirectoryReaderBench, Enumerator, [this] {
+  nsCOMPtr<nsIDirectoryEnumerator> entries;
+  ASSERT_TRUE(NS_SUCCEEDED(mDir->GetDirectoryEntries(getter_AddRefs(entries))));
+
+  uint32_t count = 0;
+  int64_t totalSize = 0;
+  nsCOMPtr<nsIFile> file;
+  while (NS_SUCCEEDED(entries->GetNextFile(getter_AddRefs(file))) && file) {
+    nsAutoCString leafName;
+    bool isDirectory;
+    int64_t size;
+    PRTime lastModified;
+    file->GetNativeLeafName(leafName);
+    file->IsDirectory(&isDirectory);
+    file->GetFileSize(&size);
+    file->GetLastModifiedTime(&lastModified);
+    totalSize += size;
+    ++count;
+  }
+  ASSERT_EQ(count, kFileCount);
+  ASSERT_GT(totalSize, 0);
+});
+
+MOZ_GTEST_BENCH_F(DirectoryReaderBench, Reader, [this] {
+  mozilla::DirectoryReader reader(mozilla::DirectoryReader::eStat);
+  ASSERT_TRUE(NS_SUCCEEDED(reader.Open(mDir)));
+
+  uint32_t count = 0;
+  int64_t totalSize = 0;
+  mozilla::DirectoryEntry entry;
+  bool hasEntry;
+  while (NS_SUCCEEDED(reader.Next(entry, &hasEntry)) && hasEntry) {
+    totalSize += entry.mFileSize;
+    ++count;
+  }
+  ASSERT_EQ(count, kFileCount);
+  ASSERT_GT(totalSize, 0);
+});
@@ -13,10 +13,12 @@
 #include "nsCOMPtr.h"
 #include "nsISupports.h"
 #include "nsCOMArray.h"
+#include "nsTArray.h"
 #include "mozilla/Attributes.h"
 #include "mozilla/Unused.h"
 
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
 
 #include <numeric>
 
@@ -657,3 +659,122 @@ TEST(Hashtables, ClassHashtable_LookupForAdd)
   }
   ASSERT_TRUE(0 == EntToUniClass.Count());
 }
+
+TEST(Hashtables, DataHashtable_GroupedLayout)
+{
+  nsDataHashtable<nsUint32HashKey, const char*> UniToEntity(
+      ENTITY_COUNT, PLDHashTableLayout::Grouped);
+
+  for (auto& entity : gEntities) {
+    UniToEntity.Put(entity.mUnicode, entity.mStr);
+  }
+
+  const char* str;
+  for (auto& entity : gEntities) {
+    ASSERT_TRUE(UniToEntity.Get(entity.mUnicode, &str));
+    ASSERT_EQ(str, entity.mStr);
+  }
+  ASSERT_FALSE(UniToEntity.Get(99446, &str));
+
+  for (auto iter = UniToEntity.Iter(); !iter.Done(); iter.Next()) {
+    if (iter.Key() % 2) {
+      iter.Remove();
+    }
+  }
+  for (auto& entity : gEntities) {
+    ASSERT_EQ(UniToEntity.Get(entity.mUnicode, &str),
+              entity.mUnicode % 2 == 0);
+  }
+
+  nsTHashtable<nsPtrHashKey<const void>> ptrs(0, PLDHashTableLayout::Grouped);
+  for (uintptr_t i = 1; i <= 1000; i++) {
+    ptrs.PutEntry(reinterpret_cast<const void*>(i * 8));
+  }
+  ASSERT_EQ(ptrs.Count(), 1000u);
+  for (uintptr_t i = 1; i <= 1000; i++) {
+    ASSERT_TRUE(ptrs.Contains(reinterpret_cast<const void*>(i * 8)));
+    ASSERT_FALSE(ptrs.Contains(reinterpret_cast<const void*>(i * 8 + 4)));
+  }
+}
+
+// Compare the PLDHashTable layouts through the typed hashtable wrappers, with
+// integer keys (cheap to match) and string keys (expensive to match).
+
+static const uint32_t kBenchCount = 50000;
+
+template <typename Table>
+static void FillUint32Table(Table& aTable) {
+  for (uint32_t i = 0; i < kBenchCount; i++) {
+    aTable.Put(i * 7919, i);
+  }
+}
+
+static void BenchUint32Insert(PLDHashTableLayout aLayout) {
+  for (int run = 0; run < 10; run++) {
+    nsDataHashtable<nsUint32HashKey, uint32_t> table(0, aLayout);
+    FillUint32Table(table);
+    ASSERT_EQ(table.Count(), kBenchCount);
+  }
+}
+
+static void BenchUint32Lookup(PLDHashTableLayout aLayout) {
+  nsDataHashtable<nsUint32HashKey, uint32_t> table(0, aLayout);
+  FillUint32Table(table);
+
+  uint32_t found = 0;
+  for (int run = 0; run < 10; run++) {
+    // Half of these are misses.
+    for (uint32_t i = 0; i < 2 * kBenchCount; i++) {
+      found += table.Contains(i * 7919 / 2);
+    }
+  }
+  ASSERT_GT(found, 0u);
+}
+
+static void BenchUint32Iterate(PLDHashTableLayout aLayout) {
+  nsDataHashtable<nsUint32HashKey, uint32_t> table(0, aLayout);
+  FillUint32Table(table);
+
+  uint64_t sum = 0;
+  for (int run = 0; run < 100; run++) {
+    for (auto iter = table.ConstIter(); !iter.Done(); iter.Next()) {
+      sum += iter.Data();
+    }
+  }
+  ASSERT_GT(sum, 0u);
+}
+
+static void BenchStringLookup(PLDHashTableLayout aLayout) {
+  nsDataHashtable<nsCStringHashKey, uint32_t> table(0, aLayout);
+  nsTArray<nsCString> keys;
+  for (uint32_t i = 0; i < kBenchCount; i++) {
+    nsCString* key = keys.AppendElement();
+    key->AppendPrintf("https://example.com/resource/%u", i);
+    table.Put(*key, i);
+  }
+
+  uint32_t found = 0;
+  for (int run = 0; run < 10; run++) {
+    for (const nsCString& key : keys) {
+      found += table.Contains(key);
+    }
+  }
+  ASSERT_EQ(found, 10 * kBenchCount);
+}
+
+MOZ_GTEST_BENCH(Hashtables, BenchUint32InsertDoubleHashing,
+                [] { BenchUint32Insert(PLDHashTableLayout::DoubleHashing); });
+MOZ_GTEST_BENCH(Hashtables, BenchUint32InsertGrouped,
+                [] { BenchUint32Insert(PLDHashTableLayout::Grouped); });
+MOZ_GTEST_BENCH(Hashtables, BenchUint32LookupDoubleHashing,
+                [] { BenchUint32Lookup(PLDHashTableLayout::DoubleHashing); });
+MOZ_GTEST_BENCH(Hashtables, BenchUint32LookupGrouped,
+                [] { BenchUint32Lookup(PLDHashTableLayout::Grouped); });
+MOZ_GTEST_BENCH(Hashtables, BenchUint32IterateDoubleHashing,
+                [] { BenchUint32Iterate(PLDHashTableLayout::DoubleHashing); });
+MOZ_GTEST_BENCH(Hashtables, BenchUint32IterateGrouped,
+                [] { BenchUint32Iterate(PLDHashTableLayout::Grouped); });
+MOZ_GTEST_BENCH(Hashtables, BenchStringLookupDoubleHashing,
+                [] { BenchStringLookup(PLDHashTableLayout::DoubleHashing); });
+MOZ_GTEST_BENCH(Hashtables, BenchStringLookupGrouped,
+                [] { BenchStringLookup(PLDHashTableLayout::Grouped); });
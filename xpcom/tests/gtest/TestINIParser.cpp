@@ -0,0 +1,317 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "nsDirectoryServiceDefs.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIFile.h"
+#include "nsINIParser.h"
+#include "nsPrintfCString.h"
+#include "nsString.h"
+#include "nsTArray.h"
+#include "prio.h"
+
+namespace {
+
+static already_AddRefed<nsIFile> GetTestFile(const char* aName) {
+  nsCOMPtr<nsIFile> file;
+  nsresult rv = NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(file));
+  EXPECT_TRUE(NS_SUCCEEDED(rv));
+  if (NS_FAILED(rv)) {
+    return nullptr;
+  }
+  file->AppendNative(nsDependentCString(aName));
+  file->Remove(false);
+  return file.forget();
+}
+
+static void WriteTestFile(nsIFile* aFile, const nsACString& aData) {
+  PRFileDesc* fd;
+  ASSERT_TRUE(NS_SUCCEEDED(aFile->OpenNSPRFileDesc(
+      PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE, 0600, &fd)));
+  ASSERT_EQ(PR_Write(fd, aData.BeginReading(), aData.Length()),
+            int32_t(aData.Length()));
+  PR_Close(fd);
+}
+
+static bool CollectSection(const char* aSection, void* aClosure) {
+  static_cast<nsTArray<nsCString>*>(aClosure)->AppendElement(aSection);
+  return true;
+}
+
+static bool CollectString(const char* aString, const char* aValue,
+                          void* aClosure) {
+  static_cast<nsTArray<nsCString>*>(aClosure)->AppendElement(
+      nsPrintfCString("%s=%s", aString, aValue));
+  return true;
+}
+
+static nsCString GetString(nsINIParser& aParser, const char* aSection,
+                           const char* aKey) {
+  nsCString value;
+  if (NS_FAILED(aParser.GetString(aSection, aKey, value))) {
+    value.AssignLiteral("<none>");
+  }
+  return value;
+}
+
+}  // namespace
+
+TEST(INIParser, Parse)
+{
+  nsCOMPtr<nsIFile> file = GetTestFile("iniparser-parse.ini");
+  ASSERT_TRUE(file);
+  WriteTestFile(file, NS_LITERAL_CSTRING(
+                          "\xEF\xBB\xBF"
+                          "ignored=before any section\n"
+                          "[First]\n"
+                          "a=1\r\n"
+                          "  b = two=2\n"
+                          "# comment=no\n"
+                          "; comment=no\n"
+                          "  # not a comment=yes\n"
+                          "\n"
+                          "no equals\n"
+                          "=no key\n"
+                          "empty=\n"
+                          "[Empty]\n"
+                          "[Bad]x\n"
+                          "bad=1\n"
+                          "[Second]  \n"
+                          "a=3\n"
+                          "[First]\n"
+                          "a=4\n"
+                          "c=5"));
+
+  nsINIParser parser;
+  ASSERT_TRUE(NS_SUCCEEDED(parser.Init(file)));
+
+  EXPECT_TRUE(GetString(parser, "First", "a").EqualsLiteral("4"));
+  EXPECT_TRUE(GetString(parser, "First", "b ").EqualsLiteral(" two=2"));
+  EXPECT_TRUE(GetString(parser, "First", "# not a comment")
+                  .EqualsLiteral("yes"));
+  EXPECT_TRUE(GetString(parser, "First", "# comment")
+                  .EqualsLiteral("<none>"));
+  EXPECT_TRUE(GetString(parser, "First", "empty").IsEmpty());
+  EXPECT_TRUE(GetString(parser, "First", "c").EqualsLiteral("5"));
+  EXPECT_TRUE(GetString(parser, "First", "ignored").EqualsLiteral("<none>"));
+  EXPECT_TRUE(GetString(parser, "Second", "a").EqualsLiteral("3"));
+  EXPECT_TRUE(GetString(parser, "Bad", "bad").EqualsLiteral("<none>"));
+
+  nsTArray<nsCString> sections;
+  EXPECT_TRUE(NS_SUCCEEDED(parser.GetSections(CollectSection, &sections)));
+  ASSERT_EQ(sections.Length(), 2u);
+  EXPECT_TRUE(sections[0].EqualsLiteral("First"));
+  EXPECT_TRUE(sections[1].EqualsLiteral("Second"));
+
+  nsTArray<nsCString> strings;
+  EXPECT_TRUE(
+      NS_SUCCEEDED(parser.GetStrings("First", CollectString, &strings)));
+  ASSERT_EQ(strings.Length(), 5u);
+  EXPECT_TRUE(strings[0].EqualsLiteral("a=4"));
+  EXPECT_TRUE(strings[1].EqualsLiteral("b = two=2"));
+  EXPECT_TRUE(strings[2].EqualsLiteral("# not a comment=yes"));
+  EXPECT_TRUE(strings[3].EqualsLiteral("empty="));
+  EXPECT_TRUE(strings[4].EqualsLiteral("c=5"));
+
+  char buffer[3];
+  EXPECT_TRUE(NS_SUCCEEDED(
+      parser.GetString("Second", "a", buffer, sizeof(buffer))));
+  EXPECT_STREQ(buffer, "3");
+  EXPECT_EQ(parser.GetString("First", "b ", buffer, sizeof(buffer)),
+            NS_ERROR_LOSS_OF_SIGNIFICANT_DATA);
+  EXPECT_STREQ(buffer, " t");
+
+  EXPECT_EQ(parser.GetString("Empty", "a", buffer, sizeof(buffer)),
+            NS_ERROR_FAILURE);
+  EXPECT_EQ(parser.GetString("Fir[st", "a", buffer, sizeof(buffer)),
+            NS_ERROR_INVALID_ARG);
+
+  file->Remove(false);
+}
+
+TEST(INIParser, ParseUTF16)
+{
+  nsCOMPtr<nsIFile> file = GetTestFile("iniparser-utf16.ini");
+  ASSERT_TRUE(file);
+
+  nsCString data("\xFF\xFE");
+  const char16_t text[] = u"[S\u00e9]\nk=v\u00e9\n";
+  data.Append(reinterpret_cast<const char*>(text),
+              sizeof(text) - sizeof(char16_t));
+  WriteTestFile(file, data);
+
+  nsINIParser parser;
+  ASSERT_TRUE(NS_SUCCEEDED(parser.Init(file)));
+  EXPECT_TRUE(GetString(parser, "S\xC3\xA9", "k").EqualsLiteral("v\xC3\xA9"));
+
+  file->Remove(false);
+}
+
+TEST(INIParser, EmptyFile)
+{
+  nsCOMPtr<nsIFile> file = GetTestFile("iniparser-empty.ini");
+  ASSERT_TRUE(file);
+  WriteTestFile(file, EmptyCString());
+
+  nsINIParser parser;
+  ASSERT_TRUE(NS_SUCCEEDED(parser.Init(file)));
+  nsTArray<nsCString> sections;
+  EXPECT_TRUE(NS_SUCCEEDED(parser.GetSections(CollectSection, &sections)));
+  EXPECT_TRUE(sections.IsEmpty());
+
+  file->Remove(false);
+
+  nsINIParser missing;
+  EXPECT_TRUE(NS_FAILED(missing.Init(file)));
+}
+
+TEST(INIParser, FileChangesAfterInit)
+{
+  nsCOMPtr<nsIFile> file = GetTestFile("iniparser-changes.ini");
+  ASSERT_TRUE(file);
+  WriteTestFile(file, NS_LITERAL_CSTRING("[General]\n"
+                                         "StartWithLastProfile=1\n"
+                                         "[Profile0]\n"
+                                         "Name=default\n"));
+
+  nsINIParser parser;
+  ASSERT_TRUE(NS_SUCCEEDED(parser.Init(file)));
+
+  // Truncating, rewriting or removing the file doesn't affect a parser which
+  // has been initialized, even for sections which haven't been parsed yet.
+  WriteTestFile(file, EmptyCString());
+  WriteTestFile(file, NS_LITERAL_CSTRING("[Profile0]\nName=changed\n"));
+  EXPECT_TRUE(NS_SUCCEEDED(file->Remove(false)));
+
+  EXPECT_TRUE(GetString(parser, "Profile0", "Name").EqualsLiteral("default"));
+  EXPECT_TRUE(GetString(parser, "General", "StartWithLastProfile")
+                  .EqualsLiteral("1"));
+}
+
+TEST(INIParser, ModifyAndWrite)
+{
+  nsCOMPtr<nsIFile> file = GetTestFile("iniparser-write.ini");
+  ASSERT_TRUE(file);
+  WriteTestFile(file, NS_LITERAL_CSTRING("[General]\n"
+                                         "StartWithLastProfile=1\n"
+                                         "[Empty]\n"
+                                         "[Profile0]\n"
+                                         "Name=default\n"
+                                         "Path=abc.default\n"
+                                         "[Profile1]\n"
+                                         "Name=other\n"));
+
+  nsINIParser parser;
+  ASSERT_TRUE(NS_SUCCEEDED(parser.Init(file)));
+
+  EXPECT_TRUE(NS_SUCCEEDED(parser.SetString("General", "Version", "2")));
+  EXPECT_TRUE(
+      NS_SUCCEEDED(parser.SetString("Profile0", "Name", "renamed")));
+  EXPECT_TRUE(NS_SUCCEEDED(parser.SetString("New", "Key", "value")));
+  EXPECT_EQ(parser.SetString("New", "Key", "bad\nvalue"),
+            NS_ERROR_INVALID_ARG);
+
+  EXPECT_TRUE(NS_SUCCEEDED(parser.DeleteString("Profile1", "Name")));
+  EXPECT_EQ(parser.DeleteString("Profile1", "Name"), NS_ERROR_FAILURE);
+  EXPECT_EQ(parser.DeleteSection("Profile1"), NS_ERROR_FAILURE);
+  EXPECT_EQ(parser.DeleteSection("Empty"), NS_ERROR_FAILURE);
+
+  EXPECT_EQ(parser.RenameSection("Profile0", "General"),
+            NS_ERROR_ILLEGAL_VALUE);
+  EXPECT_EQ(parser.RenameSection("Missing", "Other"), NS_ERROR_FAILURE);
+  EXPECT_TRUE(NS_SUCCEEDED(parser.RenameSection("New", "Empty")));
+
+  // Write over the file the parser was initialized with, and keep using the
+  // parser afterwards.
+  ASSERT_TRUE(NS_SUCCEEDED(parser.WriteToFile(file)));
+  EXPECT_TRUE(GetString(parser, "Profile0", "Path").EqualsLiteral(
+      "abc.default"));
+  EXPECT_TRUE(NS_SUCCEEDED(parser.DeleteSection("General")));
+
+  nsINIParser reread;
+  ASSERT_TRUE(NS_SUCCEEDED(reread.Init(file)));
+  nsTArray<nsCString> sections;
+  EXPECT_TRUE(NS_SUCCEEDED(reread.GetSections(CollectSection, &sections)));
+  ASSERT_EQ(sections.Length(), 3u);
+  EXPECT_TRUE(sections[0].EqualsLiteral("General"));
+  EXPECT_TRUE(sections[1].EqualsLiteral("Profile0"));
+  EXPECT_TRUE(sections[2].EqualsLiteral("Empty"));
+
+  EXPECT_TRUE(GetString(reread, "General", "StartWithLastProfile")
+                  .EqualsLiteral("1"));
+  EXPECT_TRUE(GetString(reread, "General", "Version").EqualsLiteral("2"));
+  EXPECT_TRUE(GetString(reread, "Profile0", "Name").EqualsLiteral("renamed"));
+  EXPECT_TRUE(
+      GetString(reread, "Profile0", "Path").EqualsLiteral("abc.default"));
+  EXPECT_TRUE(GetString(reread, "Empty", "Key").EqualsLiteral("value"));
+
+  file->Remove(false);
+}
+
+class INIParserBench : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kProfileCount = 50;
+  static constexpr uint32_t kIterations = 1000;
+
+  void SetUp() override {
+    mFile = GetTestFile("iniparser-bench.ini");
+    ASSERT_TRUE(mFile);
+
+    // Something like a profiles.ini with a lot of profiles.
+    nsCString data;
+    data.AppendLiteral("[General]\nStartWithLastProfile=1\nVersion=2\n\n");
+    for (uint32_t i = 0; i < kProfileCount; ++i) {
+      data.AppendPrintf(
+          "[Profile%u]\nName=profile%u\nIsRelative=1\n"
+          "Path=Profiles/%08x.profile%u\n\n",
+          i, i, i * 2654435761u, i);
+    }
+    data.AppendLiteral("[Install4F96D1932A9F858E]\nDefault=Profiles/x\n");
+    WriteTestFile(mFile, data);
+  }
+
+  void TearDown() override {
+    if (mFile) {
+      mFile->Remove(false);
+    }
+  }
+
+  nsCOMPtr<nsIFile> mFile;
+};
+
+// What startup does with profiles.ini: open it and look up a few values.
+// Only the sections that are used get their keys parsed.
+MOZ_GTEST_BENCH_F(INIParserBench, StartupLookup, [this] {
+  for (uint32_t i = 0; i < kIterations; ++i) {
+    nsINIParser parser;
+    ASSERT_TRUE(NS_SUCCEEDED(parser.Init(mFile)));
+
+    nsAutoCString value;
+    ASSERT_TRUE(NS_SUCCEEDED(
+        parser.GetString("General", "StartWithLastProfile", value)));
+    ASSERT_TRUE(NS_SUCCEEDED(
+        parser.GetString("Install4F96D1932A9F858E", "Default", value)));
+    ASSERT_TRUE(NS_SUCCEEDED(parser.GetString("Profile0", "Path", value)));
+  }
+});
+
+// Enumerating every section and key, which parses the whole file.
+MOZ_GTEST_BENCH_F(INIParserBench, EnumerateAll, [this] {
+  for (uint32_t i = 0; i < kIterations; ++i) {
+    nsINIParser parser;
+    ASSERT_TRUE(NS_SUCCEEDED(parser.Init(mFile)));
+
+    nsTArray<nsCString> sections;
+    ASSERT_TRUE(NS_SUCCEEDED(parser.GetSections(CollectSection, &sections)));
+    for (const nsCString& section : sections) {
+      nsTArray<nsCString> strings;
+      ASSERT_TRUE(NS_SUCCEEDED(
+          parser.GetStrings(section.get(), CollectString, &strings)));
+    }
+  }
+});
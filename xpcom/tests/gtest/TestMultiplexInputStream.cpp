@@ -4,16 +4,24 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
+
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+#include "mozilla/Unused.h"
 #include "nsIAsyncInputStream.h"
 #include "nsComponentManagerUtils.h"
 #include "nsIInputStream.h"
 #include "nsIMultiplexInputStream.h"
 #include "nsISeekableStream.h"
+#include "nsPrintfCString.h"
 #include "nsStreamUtils.h"
+#include "nsStringStream.h"
 #include "nsThreadUtils.h"
 #include "Helpers.h"
 
+using mozilla::Unused;
+
 TEST(MultiplexInputStream, Seek_SET)
 {
   nsCString buf1;
@@ -583,3 +591,223 @@ TEST(TestMultiplexInputStream, LengthInputStream)
   ASSERT_FALSE(callback1->Called());
   ASSERT_TRUE(callback2->Called());
 }
+
+struct GatheredData {
+  nsCString mData;
+  uint32_t mCalls = 0;
+  uint32_t mSegments = 0;
+  // Bytes to consume per call, or 0 for all of them.
+  uint32_t mLimit = 0;
+  // The address of the first segment of each call.
+  nsTArray<const char*> mFirstSegments;
+};
+
+static nsresult GatherToString(nsIInputStream* aInStream, void* aClosure,
+                               const mozilla::Span<const char>* aSegments,
+                               uint32_t aSegmentCount, uint32_t* aWriteCount) {
+  GatheredData* data = static_cast<GatheredData*>(aClosure);
+  ++data->mCalls;
+  data->mSegments += aSegmentCount;
+  data->mFirstSegments.AppendElement(aSegments[0].Elements());
+
+  uint32_t limit = data->mLimit ? data->mLimit : UINT32_MAX;
+  *aWriteCount = 0;
+  for (uint32_t i = 0; i < aSegmentCount && *aWriteCount < limit; ++i) {
+    uint32_t count = std::min<uint32_t>(aSegments[i].Length(),
+                                        limit - *aWriteCount);
+    data->mData.Append(aSegments[i].Elements(), count);
+    *aWriteCount += count;
+  }
+  return NS_OK;
+}
+
+static nsresult GatherToBuffer(nsIInputStream* aInStream, void* aClosure,
+                               const mozilla::Span<const char>* aSegments,
+                               uint32_t aSegmentCount, uint32_t* aWriteCount) {
+  char* buffer = static_cast<char*>(aClosure);
+  *aWriteCount = 0;
+  for (uint32_t i = 0; i < aSegmentCount; ++i) {
+    memcpy(buffer + *aWriteCount, aSegments[i].Elements(),
+           aSegments[i].Length());
+    *aWriteCount += aSegments[i].Length();
+  }
+  return NS_OK;
+}
+
+// Appends aParts to a new multiplex stream as string streams that share the
+// strings' buffers, like memory blobs do, and returns the concatenation.
+static already_AddRefed<nsIMultiplexInputStream> CreatePartsStream(
+    const nsTArray<nsCString>& aParts, nsACString& aExpected) {
+  nsCOMPtr<nsIMultiplexInputStream> multiplexStream =
+      do_CreateInstance("@mozilla.org/io/multiplex-input-stream;1");
+  aExpected.Truncate();
+  for (const nsCString& part : aParts) {
+    nsCOMPtr<nsIInputStream> partStream;
+    nsresult rv = NS_NewByteInputStream(getter_AddRefs(partStream), part,
+                                        NS_ASSIGNMENT_DEPEND);
+    EXPECT_TRUE(NS_SUCCEEDED(rv));
+    rv = multiplexStream->AppendStream(partStream);
+    EXPECT_TRUE(NS_SUCCEEDED(rv));
+    aExpected.Append(part);
+  }
+  return multiplexStream.forget();
+}
+
+static void MakeParts(nsTArray<nsCString>& aParts, uint32_t aCount) {
+  for (uint32_t i = 0; i < aCount; ++i) {
+    nsCString* part = aParts.AppendElement();
+    // Some empty parts, and some bigger than a whole read.
+    uint32_t length = i % 17 == 3 ? 0 : i % 101 == 50 ? 70000 : 50 + i % 200;
+    for (uint32_t j = 0; j < length; ++j) {
+      part->Append(char('a' + (i + j) % 26));
+    }
+  }
+}
+
+TEST(TestMultiplexInputStream, ReadSegmentsGathered)
+{
+  nsTArray<nsCString> parts;
+  MakeParts(parts, 300);
+  nsCString expected;
+  nsCOMPtr<nsIMultiplexInputStream> multiplexStream =
+      CreatePartsStream(parts, expected);
+
+  // Something that isn't a single segment, which stops gathering.
+  nsCString tail;
+  tail.AssignLiteral("Unbuffered tail");
+  nsresult rv =
+      multiplexStream->AppendStream(new NonBufferableStringStream(tail));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  expected.Append(tail);
+
+  GatheredData data;
+  uint32_t read;
+  do {
+    rv = multiplexStream->ReadSegmentsGathered(GatherToString, &data, 32768,
+                                               &read);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+  } while (read);
+
+  ASSERT_TRUE(data.mData.Equals(expected));
+  // Most calls gathered many parts.
+  ASSERT_LT(data.mCalls * 8, data.mSegments);
+  // The first call got the first part without a copy.
+  ASSERT_EQ(data.mFirstSegments[0], parts[0].get());
+
+  nsCOMPtr<nsIInputStream> stream(do_QueryInterface(multiplexStream));
+  uint64_t length;
+  rv = stream->Available(&length);
+  ASSERT_TRUE(NS_FAILED(rv) || length == 0);
+}
+
+TEST(TestMultiplexInputStream, ReadSegmentsGathered_Partial)
+{
+  nsTArray<nsCString> parts;
+  MakeParts(parts, 120);
+  nsCString expected;
+  nsCOMPtr<nsIMultiplexInputStream> multiplexStream =
+      CreatePartsStream(parts, expected);
+  nsCOMPtr<nsIInputStream> stream(do_QueryInterface(multiplexStream));
+  nsCOMPtr<nsISeekableStream> seekable(do_QueryInterface(multiplexStream));
+  ASSERT_TRUE(seekable);
+
+  // Consume odd amounts, mixing in plain reads, and check that the position
+  // and what's available keep up.
+  GatheredData data;
+  data.mLimit = 333;
+  nsCString result;
+  while (true) {
+    uint32_t read;
+    nsresult rv = multiplexStream->ReadSegmentsGathered(GatherToString, &data,
+                                                        4096, &read);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    result.Append(data.mData);
+    data.mData.Truncate();
+
+    char buffer[77];
+    uint32_t plainRead;
+    rv = stream->Read(buffer, sizeof(buffer), &plainRead);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    result.Append(buffer, plainRead);
+
+    if (!read && !plainRead) {
+      break;
+    }
+
+    int64_t tell;
+    rv = seekable->Tell(&tell);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    ASSERT_EQ(uint64_t(tell), result.Length());
+
+    uint64_t available;
+    rv = stream->Available(&available);
+    if (NS_SUCCEEDED(rv)) {
+      ASSERT_EQ(available, expected.Length() - result.Length());
+    }
+  }
+  ASSERT_TRUE(result.Equals(expected));
+}
+
+class MultiplexInputStreamBench : public ::testing::Test {
+ protected:
+  static constexpr uint32_t kParts = 1000;
+  static constexpr uint32_t kIterations = 200;
+
+  void SetUp() override {
+    for (uint32_t i = 0; i < kParts; ++i) {
+      // A multipart/form-data body: a header and a small value per part.
+      mParts.AppendElement(nsPrintfCString(
+          "--boundary\r\nContent-Disposition: form-data; name=\"field%u\"\r\n"
+          "\r\n",
+          i));
+      mParts.AppendElement(nsPrintfCString("value %u\r\n", i * 7919));
+    }
+    mBuffer.SetLength(64 * 1024);
+  }
+
+  template <typename Reader>
+  void Run(Reader aReader) {
+    for (uint32_t i = 0; i < kIterations; ++i) {
+      nsCString expected;
+      nsCOMPtr<nsIMultiplexInputStream> stream =
+          CreatePartsStream(mParts, expected);
+      uint64_t total = 0;
+      uint32_t read;
+      while ((read = aReader(stream))) {
+        total += read;
+      }
+      ASSERT_EQ(total, expected.Length());
+    }
+  }
+
+  nsTArray<nsCString> mParts;
+  nsTArray<char> mBuffer;
+};
+
+MOZ_GTEST_BENCH_F(MultiplexInputStreamBench, Read, [this] {
+  Run([this](nsIMultiplexInputStream* aStream) {
+    nsCOMPtr<nsIInputStream> stream(do_QueryInterface(aStream));
+    uint32_t read = 0;
+    Unused << stream->Read(mBuffer.Elements(), mBuffer.Length(), &read);
+    return read;
+  });
+});
+
+MOZ_GTEST_BENCH_F(MultiplexInputStreamBench, ReadSegments, [this] {
+  Run([this](nsIMultiplexInputStream* aStream) {
+    nsCOMPtr<nsIInputStream> stream(do_QueryInterface(aStream));
+    uint32_t read = 0;
+    Unused << stream->ReadSegments(NS_CopySegmentToBuffer, mBuffer.Elements(),
+                                   mBuffer.Length(), &read);
+    return read;
+  });
+});
+
+MOZ_GTEST_BENCH_F(MultiplexInputStreamBench, ReadSegmentsGathered, [this] {
+  Run([this](nsIMultiplexInputStream* aStream) {
+    uint32_t read = 0;
+    Unused << aStream->ReadSegmentsGathered(
+        GatherToBuffer, mBuffer.Elements(), mBuffer.Length(), &read);
+    return read;
+  });
+});
@@ -9,6 +9,7 @@
 #include "nsICrashReporter.h"
 #include "nsServiceManagerUtils.h"
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
 
 // This test mostly focuses on edge cases. But more coverage of normal
 // operations wouldn't be a bad thing.
@@ -333,6 +334,144 @@ TEST(PLDHashTableTest, Iterator)
   ASSERT_EQ(t.Capacity(), unsigned(PLDHashTable::kMinCapacity));
 }
 
+TEST(PLDHashTableTest, GroupedLayout)
+{
+  PLDHashTable t(&trivialOps, sizeof(PLDHashEntryStub),
+                 PLDHashTable::kDefaultInitialLength,
+                 PLDHashTableLayout::Grouped);
+  ASSERT_EQ(t.Layout(), PLDHashTableLayout::Grouped);
+
+  // Grouped tables never get smaller than one group.
+  t.Add((const void*)1);
+  ASSERT_EQ(t.Capacity(), PLDHashTable::kGroupWidth);
+
+  // Insert enough to resize several times, then check everything is there.
+  for (intptr_t i = 2; i < 5000; i++) {
+    t.Add((const void*)i);
+  }
+  ASSERT_EQ(t.EntryCount(), 4999u);
+  for (intptr_t i = 1; i < 5000; i++) {
+    auto entry = static_cast<PLDHashEntryStub*>(t.Search((const void*)i));
+    ASSERT_TRUE(entry);
+    ASSERT_EQ(entry->key, (const void*)i);
+  }
+  ASSERT_FALSE(t.Search((const void*)5000));
+
+  // Remove every other element, both directly and through an iterator, and
+  // make sure the survivors (and only they) can still be found.
+  for (intptr_t i = 1; i < 2500; i += 2) {
+    t.Remove((const void*)i);
+  }
+  for (auto iter = t.Iter(); !iter.Done(); iter.Next()) {
+    auto entry = static_cast<PLDHashEntryStub*>(iter.Get());
+    intptr_t key = (intptr_t)entry->key;
+    if (key >= 2500 && key % 2) {
+      iter.Remove();
+    }
+  }
+  ASSERT_EQ(t.EntryCount(), 2499u);
+  for (intptr_t i = 1; i < 5000; i++) {
+    ASSERT_EQ(!!t.Search((const void*)i), i % 2 == 0);
+  }
+
+  // Re-adding removed keys reuses their slots rather than duplicating them.
+  for (intptr_t i = 1; i < 5000; i++) {
+    t.Add((const void*)i);
+  }
+  ASSERT_EQ(t.EntryCount(), 4999u);
+
+  // Moving and clearing keep the layout.
+  PLDHashTable t2(std::move(t));
+  ASSERT_EQ(t2.Layout(), PLDHashTableLayout::Grouped);
+  ASSERT_EQ(t2.EntryCount(), 4999u);
+  ASSERT_TRUE(t2.Search((const void*)4321));
+
+  t2.Clear();
+  ASSERT_EQ(t2.Layout(), PLDHashTableLayout::Grouped);
+  for (auto iter = t2.Iter(); !iter.Done(); iter.Next()) {
+    ASSERT_TRUE(false);  // shouldn't hit this on an empty table
+  }
+}
+
+// Benchmarks comparing the two layouts. Keys are spread-out pointer-like
+// values hashed with a real hash function, to resemble typical tables.
+
+static PLDHashNumber PointerHash(const void* aKey) {
+  return mozilla::HashGeneric(aKey);
+}
+
+static const PLDHashTableOps pointerOps = {
+    PointerHash, PLDHashTable::MatchEntryStub, PLDHashTable::MoveEntryStub,
+    PLDHashTable::ClearEntryStub, TrivialInitEntry};
+
+static const uintptr_t kBenchCount = 100000;
+
+static const void* BenchKey(uintptr_t aIndex) {
+  return (const void*)((aIndex + 1) * 48);
+}
+
+static void BenchInsert(PLDHashTableLayout aLayout) {
+  for (int run = 0; run < 10; run++) {
+    PLDHashTable t(&pointerOps, sizeof(PLDHashEntryStub),
+                   PLDHashTable::kDefaultInitialLength, aLayout);
+    for (uintptr_t i = 0; i < kBenchCount; i++) {
+      t.Add(BenchKey(i));
+    }
+    ASSERT_EQ(t.EntryCount(), kBenchCount);
+  }
+}
+
+static void BenchLookup(PLDHashTableLayout aLayout, bool aHits) {
+  PLDHashTable t(&pointerOps, sizeof(PLDHashEntryStub),
+                 PLDHashTable::kDefaultInitialLength, aLayout);
+  for (uintptr_t i = 0; i < kBenchCount; i++) {
+    t.Add(BenchKey(i));
+  }
+
+  // Misses are looked up with keys interleaved with the present ones.
+  const uintptr_t offset = aHits ? 0 : kBenchCount;
+  size_t found = 0;
+  for (int run = 0; run < 10; run++) {
+    for (uintptr_t i = 0; i < kBenchCount; i++) {
+      found += !!t.Search(BenchKey(i + offset));
+    }
+  }
+  ASSERT_EQ(found, aHits ? 10 * kBenchCount : 0);
+}
+
+static void BenchIterate(PLDHashTableLayout aLayout) {
+  PLDHashTable t(&pointerOps, sizeof(PLDHashEntryStub),
+                 PLDHashTable::kDefaultInitialLength, aLayout);
+  for (uintptr_t i = 0; i < kBenchCount; i++) {
+    t.Add(BenchKey(i));
+  }
+
+  size_t count = 0;
+  for (int run = 0; run < 100; run++) {
+    for (auto iter = t.Iter(); !iter.Done(); iter.Next()) {
+      count += !!static_cast<PLDHashEntryStub*>(iter.Get())->key;
+    }
+  }
+  ASSERT_EQ(count, 100 * kBenchCount);
+}
+
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchInsertDoubleHashing,
+                [] { BenchInsert(PLDHashTableLayout::DoubleHashing); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchInsertGrouped,
+                [] { BenchInsert(PLDHashTableLayout::Grouped); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchLookupHitsDoubleHashing,
+                [] { BenchLookup(PLDHashTableLayout::DoubleHashing, true); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchLookupHitsGrouped,
+                [] { BenchLookup(PLDHashTableLayout::Grouped, true); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchLookupMissesDoubleHashing,
+                [] { BenchLookup(PLDHashTableLayout::DoubleHashing, false); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchLookupMissesGrouped,
+                [] { BenchLookup(PLDHashTableLayout::Grouped, false); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchIterateDoubleHashing,
+                [] { BenchIterate(PLDHashTableLayout::DoubleHashing); });
+MOZ_GTEST_BENCH(PLDHashTableTest, BenchIterateGrouped,
+                [] { BenchIterate(PLDHashTableLayout::Grouped); });
+
 // This test involves resizing a table repeatedly up to 512 MiB in size. On
 // 32-bit platforms (Win32, Android) it sometimes OOMs, causing the test to
 // fail. (See bug 931062 and bug 1267227.) Therefore, we only run it on 64-bit
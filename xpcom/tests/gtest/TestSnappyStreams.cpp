@@ -6,9 +6,11 @@
 
 #include <algorithm>
 #include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
 #include "Helpers.h"
 #include "mozilla/SnappyCompressOutputStream.h"
 #include "mozilla/SnappyUncompressInputStream.h"
+#include "nsISeekableStream.h"
 #include "nsStreamUtils.h"
 #include "nsString.h"
 #include "nsStringStream.h"
@@ -20,19 +22,35 @@ using mozilla::SnappyCompressOutputStream;
 using mozilla::SnappyUncompressInputStream;
 
 static already_AddRefed<nsIOutputStream> CompressPipe(
-    nsIInputStream** aReaderOut) {
+    nsIInputStream** aReaderOut, uint32_t aFlags = 0) {
   nsCOMPtr<nsIOutputStream> pipeWriter;
 
-  nsresult rv = NS_NewPipe(aReaderOut, getter_AddRefs(pipeWriter));
+  // The whole compressed stream is written before any of it is read, so the
+  // pipe must be able to hold it all.
+  nsresult rv = NS_NewPipe(aReaderOut, getter_AddRefs(pipeWriter), 0,
+                           UINT32_MAX);
   if (NS_FAILED(rv)) {
     return nullptr;
   }
 
-  nsCOMPtr<nsIOutputStream> compress =
-      new SnappyCompressOutputStream(pipeWriter);
+  nsCOMPtr<nsIOutputStream> compress = new SnappyCompressOutputStream(
+      pipeWriter, SnappyCompressOutputStream::kMaxBlockSize, aFlags);
   return compress.forget();
 }
 
+static void Compress(const nsTArray<char>& aData, uint32_t aFlags,
+                     nsACString& aCompressedOut) {
+  nsCOMPtr<nsIInputStream> pipeReader;
+  nsCOMPtr<nsIOutputStream> compress =
+      CompressPipe(getter_AddRefs(pipeReader), aFlags);
+  ASSERT_TRUE(compress);
+
+  testing::WriteAllAndClose(compress, aData);
+
+  nsresult rv = NS_ConsumeStream(pipeReader, UINT32_MAX, aCompressedOut);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+}
+
 // Verify the given number of bytes compresses to a smaller number of bytes.
 static void TestCompress(uint32_t aNumBytes) {
   // Don't permit this test on small data sizes as snappy can slightly
@@ -57,9 +75,10 @@ static void TestCompress(uint32_t aNumBytes) {
 
 // Verify that the given number of bytes can be compressed and uncompressed
 // successfully.
-static void TestCompressUncompress(uint32_t aNumBytes) {
+static void TestCompressUncompress(uint32_t aNumBytes, uint32_t aFlags = 0) {
   nsCOMPtr<nsIInputStream> pipeReader;
-  nsCOMPtr<nsIOutputStream> compress = CompressPipe(getter_AddRefs(pipeReader));
+  nsCOMPtr<nsIOutputStream> compress =
+      CompressPipe(getter_AddRefs(pipeReader), aFlags);
   ASSERT_TRUE(compress);
 
   nsCOMPtr<nsIInputStream> uncompress =
@@ -80,6 +99,73 @@ static void TestCompressUncompress(uint32_t aNumBytes) {
   }
 }
 
+// Verify that seeking around the uncompressed data of a stream with the given
+// number of bytes lands where it should.
+static void TestSeek(uint32_t aNumBytes, uint32_t aFlags) {
+  nsTArray<char> inputData;
+  testing::CreateData(aNumBytes, inputData);
+
+  nsAutoCString compressed;
+  Compress(inputData, aFlags, compressed);
+
+  nsCOMPtr<nsIInputStream> source;
+  nsresult rv = NS_NewCStringInputStream(getter_AddRefs(source), compressed);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsCOMPtr<nsIInputStream> uncompress = new SnappyUncompressInputStream(source);
+  nsCOMPtr<nsISeekableStream> seekable = do_QueryInterface(uncompress);
+  ASSERT_TRUE(seekable);
+
+  // Read a little first, so that we seek away from data already uncompressed.
+  char buffer[4096];
+  uint32_t numRead;
+  rv = uncompress->Read(buffer, sizeof(buffer), &numRead);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  ASSERT_EQ(std::min<uint32_t>(aNumBytes, sizeof(buffer)), numRead);
+
+  const uint32_t offsets[] = {0,
+                              1,
+                              65535,
+                              65536,
+                              65537,
+                              1000000 + 13,
+                              aNumBytes / 2,
+                              aNumBytes - 65536,
+                              aNumBytes - 1,
+                              aNumBytes,
+                              10,
+                              aNumBytes - 10};
+  for (uint32_t offset : offsets) {
+    rv = seekable->Seek(nsISeekableStream::NS_SEEK_SET, offset);
+    ASSERT_TRUE(NS_SUCCEEDED(rv)) << "Offset " << offset;
+
+    int64_t tell;
+    rv = seekable->Tell(&tell);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    ASSERT_EQ(int64_t(offset), tell);
+
+    nsAutoCString outputData;
+    rv = NS_ConsumeStream(uncompress, 100000, outputData);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+    uint32_t expectedLength = std::min(aNumBytes - offset, 100000u);
+    ASSERT_EQ(expectedLength, outputData.Length()) << "Offset " << offset;
+    ASSERT_TRUE(!memcmp(inputData.Elements() + offset, outputData.get(),
+                        expectedLength))
+        << "Offset " << offset;
+  }
+
+  rv = seekable->Seek(nsISeekableStream::NS_SEEK_END, -100);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  int64_t tell;
+  rv = seekable->Tell(&tell);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  ASSERT_EQ(int64_t(aNumBytes) - 100, tell);
+
+  rv = seekable->Seek(nsISeekableStream::NS_SEEK_SET, aNumBytes + 1);
+  ASSERT_TRUE(NS_FAILED(rv));
+}
+
 static void TestUncompressCorrupt(const char* aCorruptData,
                                   uint32_t aCorruptLength) {
   nsCOMPtr<nsIInputStream> source;
@@ -162,3 +248,105 @@ TEST(SnappyStream, UncompressCorruptCompressedDataContent)
   static const uint32_t dataLength = (sizeof(data) / sizeof(const char)) - 1;
   TestUncompressCorrupt(data, dataLength);
 }
+
+TEST(SnappyStream, CompressUncompress_4M)
+{ TestCompressUncompress(4 * 1024 * 1024); }
+
+TEST(SnappyStream, CompressUncompress_4M_plus_13_Parallel)
+{
+  TestCompressUncompress((4 * 1024 * 1024) + 13,
+                         SnappyCompressOutputStream::eParallelCompression);
+}
+
+TEST(SnappyStream, CompressUncompress_4M_plus_13_FrameIndex)
+{
+  TestCompressUncompress((4 * 1024 * 1024) + 13,
+                         SnappyCompressOutputStream::eParallelCompression |
+                             SnappyCompressOutputStream::eWriteFrameIndex);
+}
+
+// Compressing frames in parallel must not change the output.
+TEST(SnappyStream, CompressParallel_4M_plus_13)
+{
+  nsTArray<char> inputData;
+  testing::CreateData((4 * 1024 * 1024) + 13, inputData);
+
+  nsAutoCString sequential;
+  Compress(inputData, 0, sequential);
+
+  nsAutoCString parallel;
+  Compress(inputData, SnappyCompressOutputStream::eParallelCompression,
+           parallel);
+
+  ASSERT_TRUE(sequential.Equals(parallel));
+}
+
+TEST(SnappyStream, Seek_4M_plus_13)
+{ TestSeek((4 * 1024 * 1024) + 13, 0); }
+
+TEST(SnappyStream, Seek_4M_plus_13_FrameIndex)
+{
+  TestSeek((4 * 1024 * 1024) + 13,
+           SnappyCompressOutputStream::eParallelCompression |
+               SnappyCompressOutputStream::eWriteFrameIndex);
+}
+
+TEST(SnappyStream, UncompressPadding)
+{
+  nsTArray<char> inputData;
+  testing::CreateData(256 * 1024, inputData);
+
+  nsAutoCString compressed;
+  Compress(inputData, 0, compressed);
+
+  // Insert padding larger than the stream's buffers, and an empty skippable
+  // chunk, after the stream identifier.
+  static const uint32_t kPaddingLength = 200000;
+  nsAutoCString padded(Substring(compressed, 0, 10));
+  padded.Append("\xfe\x40\x0d\x03", 4);  // kPaddingLength, little-endian
+  for (uint32_t i = 0; i < kPaddingLength; ++i) {
+    padded.Append('\0');
+  }
+  padded.Append("\x80\x00\x00\x00", 4);
+  padded.Append(Substring(compressed, 10));
+
+  nsCOMPtr<nsIInputStream> source;
+  nsresult rv = NS_NewCStringInputStream(getter_AddRefs(source), padded);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsCOMPtr<nsIInputStream> uncompress = new SnappyUncompressInputStream(source);
+  testing::ConsumeAndValidateStream(uncompress, inputData);
+}
+
+TEST(SnappyStream, UncompressCorruptChunkLength)
+{
+  // Longer than any compressed chunk can be.
+  static const char data[] =
+      "\xff\x06\x00\x00sNaPpY"  // stream identifier
+      "\x00\xff\xff\xffThis is not a valid compressed stream";
+  static const uint32_t dataLength = (sizeof(data) / sizeof(const char)) - 1;
+  TestUncompressCorrupt(data, dataLength);
+}
+
+class SnappyStreamBench : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    testing::CreateData(16 * 1024 * 1024, mInputData);
+  }
+
+  void CompressAll(uint32_t aFlags) {
+    for (uint32_t i = 0; i < 4; ++i) {
+      nsAutoCString compressed;
+      Compress(mInputData, aFlags, compressed);
+    }
+  }
+
+  nsTArray<char> mInputData;
+};
+
+MOZ_GTEST_BENCH_F(SnappyStreamBench, Compress_16M,
+                  [this] { CompressAll(0); });
+
+MOZ_GTEST_BENCH_F(SnappyStreamBench, Compress_16M_Parallel, [this] {
+  CompressAll(SnappyCompressOutputStream::eParallelCompression);
+});
@@ -13,6 +13,7 @@
 #include "nsIOutputStream.h"
 #include "nsIStorageStream.h"
 #include "nsTArray.h"
+#include "mozilla/ipc/FileDescriptor.h"
 
 namespace {
 
@@ -24,6 +25,15 @@ void WriteData(nsIOutputStream* aOut, nsTArray<char>& aData, uint32_t aNumBytes,
   aDataWritten.Append(aData.Elements(), aNumBytes);
 }
 
+// Counts the segments a stream hands out, without copying them.
+nsresult CountSegment(nsIInputStream* aInStream, void* aClosure,
+                      const char* aFromSegment, uint32_t aToOffset,
+                      uint32_t aCount, uint32_t* aWriteCount) {
+  ++*static_cast<uint32_t*>(aClosure);
+  *aWriteCount = aCount;
+  return NS_OK;
+}
+
 }  // namespace
 
 TEST(StorageStreams, Main)
@@ -127,3 +137,159 @@ TEST(StorageStreams, EarlyInputStream)
   testing::ConsumeAndValidateStream(in, dataWritten);
   in = nullptr;
 }
+
+TEST(StorageStreams, SharedSegments)
+{
+  nsTArray<char> kData;
+  testing::CreateData(64 * 1024, kData);
+
+  nsAutoCString dataWritten;
+
+  nsresult rv;
+  nsCOMPtr<nsIStorageStream> stor;
+
+  rv = NS_NewSharedStorageStream(kData.Length(), UINT32_MAX,
+                                 getter_AddRefs(stor));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsCOMPtr<nsIOutputStream> out;
+  rv = stor->GetOutputStream(0, getter_AddRefs(out));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  for (uint32_t i = 0; i < 16; ++i) {
+    WriteData(out, kData, kData.Length(), dataWritten);
+  }
+  WriteData(out, kData, 13, dataWritten);
+
+  // Can't share while writing.
+  nsTArray<mozilla::ipc::FileDescriptor> segments;
+  rv = stor->ShareSegments(segments);
+  ASSERT_EQ(NS_ERROR_NOT_AVAILABLE, rv);
+
+  rv = out->Close();
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  out = nullptr;
+
+  rv = stor->ShareSegments(segments);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  ASSERT_EQ(17u, segments.Length());
+
+  // The data can't change anymore.
+  rv = stor->GetOutputStream(0, getter_AddRefs(out));
+  ASSERT_EQ(NS_ERROR_NOT_AVAILABLE, rv);
+  rv = stor->SetLength(0);
+  ASSERT_EQ(NS_ERROR_NOT_AVAILABLE, rv);
+
+  // The handles must be for exactly as much data as there is.
+  nsCOMPtr<nsIInputStream> in;
+  rv = NS_NewSharedStorageInputStream(segments, kData.Length(),
+                                      dataWritten.Length() + kData.Length(),
+                                      getter_AddRefs(in));
+  ASSERT_TRUE(NS_FAILED(rv));
+
+  rv = NS_NewSharedStorageInputStream(segments, kData.Length(),
+                                      dataWritten.Length(), getter_AddRefs(in));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  // Each segment is handed to the reader as is, straight out of the mapping.
+  uint32_t segmentCount = 0;
+  uint32_t numRead;
+  rv = in->ReadSegments(CountSegment, &segmentCount, UINT32_MAX, &numRead);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  ASSERT_EQ(dataWritten.Length(), numRead);
+  ASSERT_EQ(17u, segmentCount);
+
+  rv = NS_NewSharedStorageInputStream(segments, kData.Length(),
+                                      dataWritten.Length(), getter_AddRefs(in));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  testing::ConsumeAndValidateStream(in, dataWritten);
+
+  // The stream that shared its segments can still be read.
+  rv = stor->NewInputStream(0, getter_AddRefs(in));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  testing::ConsumeAndValidateStream(in, dataWritten);
+}
+
+TEST(StorageStreams, SharedSegmentsEmpty)
+{
+  nsresult rv;
+  nsCOMPtr<nsIStorageStream> stor;
+
+  rv = NS_NewSharedStorageStream(4096, UINT32_MAX, getter_AddRefs(stor));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsCOMPtr<nsIOutputStream> out;
+  rv = stor->GetOutputStream(0, getter_AddRefs(out));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  uint32_t n;
+  rv = out->Write("", 0, &n);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  rv = out->Close();
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsTArray<mozilla::ipc::FileDescriptor> segments;
+  rv = stor->ShareSegments(segments);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  ASSERT_EQ(0u, segments.Length());
+
+  nsCOMPtr<nsIInputStream> in;
+  rv = NS_NewSharedStorageInputStream(segments, 4096, 0, getter_AddRefs(in));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  testing::ConsumeAndValidateStream(in, EmptyCString());
+}
+
+TEST(StorageStreams, SharedSegmentsTooSmall)
+{
+  nsTArray<char> kData;
+  testing::CreateData(4096, kData);
+
+  nsAutoCString dataWritten;
+
+  nsresult rv;
+  nsCOMPtr<nsIStorageStream> stor;
+
+  rv = NS_NewSharedStorageStream(4096, UINT32_MAX, getter_AddRefs(stor));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsCOMPtr<nsIOutputStream> out;
+  rv = stor->GetOutputStream(0, getter_AddRefs(out));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  WriteData(out, kData, kData.Length(), dataWritten);
+  WriteData(out, kData, 13, dataWritten);
+
+  rv = out->Close();
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsTArray<mozilla::ipc::FileDescriptor> segments;
+  rv = stor->ShareSegments(segments);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  ASSERT_EQ(2u, segments.Length());
+
+  // Claiming the 4KB segments hold 8KB each must fail rather than map past
+  // the end of the shared memory.
+  nsCOMPtr<nsIInputStream> in;
+  rv = NS_NewSharedStorageInputStream(segments, 8192, 8192 + 13,
+                                      getter_AddRefs(in));
+  ASSERT_TRUE(NS_FAILED(rv));
+
+  rv = NS_NewSharedStorageInputStream(segments, 4096, dataWritten.Length(),
+                                      getter_AddRefs(in));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  testing::ConsumeAndValidateStream(in, dataWritten);
+}
+
+TEST(StorageStreams, ShareSegmentsNotShared)
+{
+  nsresult rv;
+  nsCOMPtr<nsIStorageStream> stor;
+
+  rv = NS_NewStorageStream(4096, UINT32_MAX, getter_AddRefs(stor));
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsTArray<mozilla::ipc::FileDescriptor> segments;
+  rv = stor->ShareSegments(segments);
+  ASSERT_EQ(NS_ERROR_NOT_AVAILABLE, rv);
+}
@@ -9,8 +9,10 @@
 #include "nsASCIIMask.h"
 #include "nsString.h"
 #include "nsStringBuffer.h"
+#include "nsStringRope.h"
 #include "nsReadableUtils.h"
 #include "nsCRTGlue.h"
+#include "mozilla/ArrayUtils.h"
 #include "mozilla/RefPtr.h"
 #include "mozilla/TextUtils.h"
 #include "mozilla/Unused.h"
@@ -2446,6 +2448,222 @@ CONVERSION_BENCH(PerfUTF8toUTF16VIHundred, CopyUTF8toUTF16, mViHundredUtf8,
 CONVERSION_BENCH(PerfUTF8toUTF16VIThousand, CopyUTF8toUTF16, mViThousandUtf8,
                  nsAutoString);
 
+TEST_F(Strings, rope_append) {
+  nsCStringRope rope;
+  EXPECT_TRUE(rope.IsEmpty());
+
+  nsAutoCString expected;
+  for (int i = 0; i < 1000; i++) {
+    nsAutoCString piece;
+    piece.AppendInt(i);
+    rope.Append(piece);
+    rope.Append(',');
+    rope.AppendLiteral(" and ");
+    expected.Append(piece);
+    expected.AppendLiteral(", and ");
+  }
+  EXPECT_EQ(rope.Length(), expected.Length());
+
+  nsCString result;
+  rope.ToString(result);
+  EXPECT_TRUE(result.Equals(expected));
+
+  // Short pieces are all coalesced into a handful of chunks.
+  EXPECT_LT(rope.SegmentCount(), 10u);
+
+  nsCString prefixed("prefix:");
+  rope.AppendTo(prefixed);
+  EXPECT_TRUE(StringBeginsWith(prefixed, NS_LITERAL_CSTRING("prefix:")));
+  EXPECT_TRUE(Substring(prefixed, 7).Equals(expected));
+
+  nsCString segments;
+  EXPECT_TRUE(rope.ForEachSegment([&](const char* aData, uint32_t aLength) {
+    segments.Append(aData, aLength);
+    return true;
+  }));
+  EXPECT_TRUE(segments.Equals(expected));
+
+  nsCStringRope moved(std::move(rope));
+  EXPECT_TRUE(rope.IsEmpty());
+  EXPECT_EQ(moved.Length(), expected.Length());
+
+  moved.Truncate();
+  EXPECT_TRUE(moved.IsEmpty());
+  moved.ToString(result);
+  EXPECT_TRUE(result.IsEmpty());
+}
+
+TEST_F(Strings, rope_shares_buffers) {
+  nsCString shared(mExample1Utf8);
+  nsStringBuffer* buffer = nsStringBuffer::FromString(shared);
+  ASSERT_TRUE(buffer);
+
+  nsCStringRope rope;
+  rope.Append(shared);
+  EXPECT_EQ(rope.SegmentCount(), 1u);
+
+  // A rope holding one whole string buffer hands it out without copying.
+  nsCString result;
+  rope.ToString(result);
+  EXPECT_EQ(nsStringBuffer::FromString(result), buffer);
+
+  // Changing the original string afterwards doesn't affect the rope.
+  shared.Replace(0, 3, "XYZ");
+  nsCString again;
+  rope.ToString(again);
+  EXPECT_TRUE(again.Equals(mExample1Utf8));
+
+  rope.AppendLiteral(TestExample2);
+  rope.Append(shared);
+  EXPECT_EQ(rope.SegmentCount(), 3u);
+
+  nsCString expected(mExample1Utf8);
+  expected.AppendLiteral(TestExample2);
+  expected.Append(shared);
+  rope.ToString(result);
+  EXPECT_TRUE(result.Equals(expected));
+}
+
+TEST_F(Strings, rope_utf16) {
+  nsStringRope rope;
+  rope.AppendLiteral(u"abc");
+  rope.Append(mExample3Utf16);
+  rope.Append(char16_t(0x263A));
+
+  nsString expected(NS_LITERAL_STRING("abc"));
+  expected.Append(mExample3Utf16);
+  expected.Append(char16_t(0x263A));
+
+  nsString result;
+  rope.ToString(result);
+  EXPECT_TRUE(result.Equals(expected));
+}
+
+// Builds a string out of many short pieces, the way serializers do.
+template <typename Builder>
+static void BuildFromPieces(Builder& aBuilder, const nsACString& aLongPiece) {
+  for (int i = 0; i < 200; i++) {
+    nsAutoCString number;
+    number.AppendInt(i);
+    aBuilder.AppendLiteral("<span class=\"");
+    aBuilder.Append('c');
+    aBuilder.Append(number);
+    aBuilder.AppendLiteral("\">");
+    aBuilder.Append(aLongPiece);
+    aBuilder.AppendLiteral("</span>\n");
+  }
+}
+
+MOZ_GTEST_BENCH_F(Strings, PerfAppendPiecesString, [this] {
+  for (int i = 0; i < 200; i++) {
+    nsCString result;
+    BuildFromPieces(result, mExample1Utf8);
+    BlackBox(&result);
+  }
+});
+
+MOZ_GTEST_BENCH_F(Strings, PerfAppendPiecesRope, [this] {
+  for (int i = 0; i < 200; i++) {
+    nsCStringRope rope;
+    BuildFromPieces(rope, mExample1Utf8);
+    nsCString result;
+    rope.ToString(result);
+    BlackBox(&result);
+  }
+});
+
+static bool IsInline(const nsACString& aStr) {
+  return !!(aStr.GetDataFlags() & nsACString::DataFlags::INLINE);
+}
+
+static_assert(sizeof(void*) != 8 || sizeof(nsInlineCString) == 48,
+              "nsInlineCString should be three times the size of nsCString");
+static_assert(sizeof(void*) != 8 || sizeof(nsInlineString) == 48,
+              "nsInlineString should be three times the size of nsString");
+
+TEST_F(Strings, inline_string) {
+  nsInlineCString s;
+  EXPECT_TRUE(s.IsEmpty());
+  EXPECT_TRUE(IsInline(s));
+
+  s.AssignLiteral("text/html");
+  EXPECT_TRUE(IsInline(s));
+  EXPECT_TRUE(s.EqualsLiteral("text/html"));
+
+  const size_t capacity = InlineStringDefaultStorageBytes - 1;
+  s.Truncate();
+  for (size_t i = 0; i < capacity; i++) {
+    s.Append('a' + i % 26);
+  }
+  EXPECT_TRUE(IsInline(s));
+  s.Append('!');
+  EXPECT_FALSE(IsInline(s));
+  EXPECT_EQ(s.Length(), capacity + 1);
+
+  // Assigning a string with a shared buffer shares it rather than copying.
+  nsCString shared(mExample1Utf8);
+  nsInlineCString copy(shared);
+  EXPECT_EQ(nsStringBuffer::FromString(copy),
+            nsStringBuffer::FromString(shared));
+
+  // Even if the contents are short.
+  nsCString shortShared;
+  shortShared.Assign(mExample1Utf8);
+  shortShared.Truncate(4);
+  copy = shortShared;
+  EXPECT_EQ(nsStringBuffer::FromString(copy),
+            nsStringBuffer::FromString(shortShared));
+
+  nsInlineString wide(u"abc");
+  EXPECT_TRUE(!!(wide.GetDataFlags() & nsAString::DataFlags::INLINE));
+  EXPECT_TRUE(wide.EqualsLiteral("abc"));
+}
+
+TEST_F(Strings, inline_string_array) {
+  nsTArray<nsInlineCString> array;
+  for (int i = 0; i < 1000; i++) {
+    nsInlineCString* value = array.AppendElement();
+    value->AppendLiteral("value-");
+    value->AppendInt(i);
+  }
+  array.InsertElementAt(0, nsInlineCString(mExample1Utf8));
+  array.RemoveElementAt(1);
+
+  EXPECT_TRUE(array[0].Equals(mExample1Utf8));
+  for (int i = 1; i < 1000; i++) {
+    nsAutoCString expected("value-");
+    expected.AppendInt(i);
+    EXPECT_TRUE(array[i].Equals(expected));
+    EXPECT_TRUE(IsInline(array[i]));
+  }
+
+  nsTArray<nsInlineCString> moved(std::move(array));
+  EXPECT_TRUE(moved[999].EqualsLiteral("value-999"));
+}
+
+static const char* const kShortValues[] = {
+    "text/html", "gzip, deflate", "en-US", "keep-alive", "no-cache",
+    "button",    "true",          "_blank", "utf-8",     "stylesheet"};
+
+template <typename StringType>
+static void AssignShortValues() {
+  nsTArray<StringType> values;
+  values.SetLength(1000);
+  for (int j = 0; j < 10; j++) {
+    for (size_t i = 0; i < values.Length(); i++) {
+      values[i].Assign(
+          kShortValues[(i + j) % mozilla::ArrayLength(kShortValues)]);
+    }
+  }
+  BlackBox(&values);
+}
+
+MOZ_GTEST_BENCH(Strings, PerfShortValuesString,
+                [] { AssignShortValues<nsCString>(); });
+
+MOZ_GTEST_BENCH(Strings, PerfShortValuesInlineString,
+                [] { AssignShortValues<nsInlineCString>(); });
+
 // Tests for usability of nsTLiteralString in constant expressions.
 static_assert(NS_LITERAL_STRING("").IsEmpty());
 
@@ -6,6 +6,7 @@
 
 #include "mozilla/ArrayUtils.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include "nsString.h"
@@ -15,6 +16,9 @@
 #include "nsUnicharUtils.h"
 #include "mozilla/HashFunctions.h"
 #include "nsUTF8Utils.h"
+#include "nsUTFTranscoder.h"
+#include "nsStreamUtils.h"
+#include "nsStringStream.h"
 
 #include "gtest/gtest.h"
 
@@ -261,4 +265,124 @@ TEST(UTF, UTF16CharEnumerator)
   EXPECT_EQ(p, end);
 }
 
+// Converts aSource with a transcoder, aPieceLength units at a time.
+template <typename Transcoder, typename SourceString, typename DestString>
+static void TranscodeInPieces(const SourceString& aSource, size_t aPieceLength,
+                              DestString& aDest) {
+  Transcoder transcoder;
+  auto source = MakeSpan(aSource.BeginReading(), aSource.Length());
+  while (!source.IsEmpty()) {
+    size_t length = std::min(aPieceLength, source.Length());
+    transcoder.Append(source.To(length), aDest);
+    source = source.From(length);
+  }
+  transcoder.Finish(aDest);
+  EXPECT_FALSE(transcoder.HasPending());
+}
+
+template <size_t N>
+static void CheckUTF8Transcoder(const UTFStringsStringPair (&aPairs)[N]) {
+  for (const UTFStringsStringPair& pair : aPairs) {
+    nsDependentCString str8(pair.m8);
+    nsDependentString str16(pair.m16);
+    for (size_t piece = 1; piece <= str8.Length(); ++piece) {
+      nsString result;
+      TranscodeInPieces<nsUTF8ToUTF16Transcoder>(str8, piece, result);
+      EXPECT_TRUE(result.Equals(str16));
+    }
+  }
+}
+
+template <size_t N>
+static void CheckUTF16Transcoder(const UTFStringsStringPair (&aPairs)[N]) {
+  for (const UTFStringsStringPair& pair : aPairs) {
+    nsDependentCString str8(pair.m8);
+    nsDependentString str16(pair.m16);
+    for (size_t piece = 1; piece <= str16.Length(); ++piece) {
+      nsCString result;
+      TranscodeInPieces<nsUTF16ToUTF8Transcoder>(str16, piece, result);
+      EXPECT_TRUE(result.Equals(str8));
+    }
+  }
+}
+
+TEST(UTF, UTF8ToUTF16Transcoder)
+{
+  CheckUTF8Transcoder(ValidStrings);
+  CheckUTF8Transcoder(Invalid8Strings);
+  CheckUTF8Transcoder(Malformed8Strings);
+
+  // A sequence split across pieces is held until it is complete.
+  nsUTF8ToUTF16Transcoder transcoder;
+  nsString result;
+  transcoder.Append(MakeSpan("a\xF0\x9F", 3), result);
+  EXPECT_TRUE(result.EqualsLiteral("a"));
+  EXPECT_TRUE(transcoder.HasPending());
+  transcoder.Append(MakeSpan("\x92", 1), result);
+  EXPECT_TRUE(result.EqualsLiteral("a"));
+  transcoder.Append(MakeSpan("\xA9" "b", 2), result);
+  EXPECT_TRUE(result.Equals(u"a\U0001F4A9b"));
+  EXPECT_FALSE(transcoder.HasPending());
+
+  // An incomplete sequence is replaced when a byte can't continue it, or at
+  // the end of the input.
+  result.Truncate();
+  transcoder.Append(MakeSpan("\xE2\x82", 2), result);
+  transcoder.Append(MakeSpan("c\xE2", 2), result);
+  transcoder.Finish(result);
+  EXPECT_TRUE(result.Equals(u"\uFFFDc\uFFFD"));
+}
+
+TEST(UTF, UTF16ToUTF8Transcoder)
+{
+  CheckUTF16Transcoder(ValidStrings);
+  CheckUTF16Transcoder(Invalid16Strings);
+
+  nsUTF16ToUTF8Transcoder transcoder;
+  nsCString result;
+  const char16_t units[] = {'a', 0xD83D, 0xDCA9};
+  transcoder.Append(MakeSpan(units, 2), result);
+  EXPECT_TRUE(result.EqualsLiteral("a"));
+  EXPECT_TRUE(transcoder.HasPending());
+  transcoder.Append(MakeSpan(units + 2, 1), result);
+  EXPECT_TRUE(result.EqualsLiteral("a\xF0\x9F\x92\xA9"));
+
+  result.Truncate();
+  transcoder.Append(MakeSpan(units + 1, 1), result);
+  transcoder.Finish(result);
+  EXPECT_TRUE(result.EqualsLiteral("\xEF\xBF\xBD"));
+}
+
+TEST(UTF, ConsumeUTF8Stream)
+{
+  nsAutoCString str8;
+  nsAutoString str16;
+  for (const UTFStringsStringPair& pair : ValidStrings) {
+    str8.Append(pair.m8);
+    str16.Append(pair.m16);
+  }
+
+  nsCOMPtr<nsIInputStream> stream;
+  ASSERT_TRUE(NS_SUCCEEDED(NS_NewCStringInputStream(getter_AddRefs(stream),
+                                                    nsCString(str8))));
+
+  // Read in small pieces so that characters are split between reads.
+  nsUTF8ToUTF16Transcoder transcoder;
+  nsString result;
+  uint64_t available;
+  while (NS_SUCCEEDED(stream->Available(&available)) && available) {
+    ASSERT_TRUE(NS_SUCCEEDED(
+        NS_ConsumeUTF8Stream(stream, 3, transcoder, result)));
+  }
+  transcoder.Finish(result);
+  EXPECT_TRUE(result.Equals(str16));
+
+  ASSERT_TRUE(NS_SUCCEEDED(NS_NewCStringInputStream(
+      getter_AddRefs(stream), NS_LITERAL_CSTRING("caf\xE9"))));
+  result.Truncate();
+  ASSERT_TRUE(
+      NS_SUCCEEDED(NS_ConsumeLatin1Stream(stream, UINT32_MAX, result)));
+  EXPECT_TRUE(result.Equals(u"caf\u00E9"));
+}
+
 }  // namespace TestUTF